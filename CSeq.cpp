@@ -1,8 +1,9 @@
 #include "CSeq.hpp"
-#include <boost/regex.hpp>
 #include <sstream>
+#include "SipUtility.hpp"
 
 namespace Sip {
+
 CSeq::CSeq( const SipHeaderValue& srhv ) throw( CSeqException )
 {
 	this->ParseCSeq( srhv.Value() );
@@ -32,7 +33,7 @@ string CSeq::ToString() const throw()
 	std::ostringstream cseqAsStringBuilder;
 
 	string upperRequestMethodString = this->m_requestMethodString;	//because some phones can be picky...
-	transform( upperRequestMethodString.begin(), upperRequestMethodString.end(), upperRequestMethodString.begin(), (int(*)(int))toupper ); //go uppercase
+	transform( upperRequestMethodString.begin(), upperRequestMethodString.end(), upperRequestMethodString.begin(), AsciiToUpper ); //go uppercase
 	cseqAsStringBuilder << m_sequence << ' ' << upperRequestMethodString;
 
 	return cseqAsStringBuilder.str();
@@ -40,29 +41,30 @@ string CSeq::ToString() const throw()
 
 void CSeq::ParseCSeq( const string& rawValue ) throw( CSeqException )
 {
-	//								  [seq]    [RM]
-	boost::regex expression( "(.*?)\\s+(.*)" );
+	//[seq] 1*WS [RM]
+	string::size_type sequenceEnd = 0;
+	while ( sequenceEnd < rawValue.length() && !Utility::IsSpace( rawValue[sequenceEnd] ) )
+		++sequenceEnd;
+	string::size_type method = sequenceEnd;
+	while ( method < rawValue.length() && Utility::IsSpace( rawValue[method] ) )
+		++method;
 
-	boost::cmatch matches;
+	if ( sequenceEnd == rawValue.length() )
+		throw CSeqException( string( "Invalid CSeq: " ) + rawValue );
 
-	if ( boost::regex_match( rawValue.c_str(), matches, expression ) )
+	m_sequence = atoi( rawValue.substr( 0, sequenceEnd ).c_str() );
+	if (m_sequence == 0 || m_sequence < 0 ) //Or just <1...
+		throw CSeqException( string( "Invalid CSeq: " ) + rawValue );
+
+	m_requestMethodString = rawValue.substr( method );
+	try
 	{
-		m_sequence = atoi( string( matches[1].first, matches[1].second ).c_str() );
-		if (m_sequence == 0 || m_sequence < 0 ) //Or just <1...
-			throw CSeqException( string( "Invalid CSeq: " ) + rawValue );
-
-		m_requestMethodString = string( matches[2].first, matches[2].second );
-		try
-		{
-			m_requestMethod = RequestTypes.GetCase( m_requestMethodString );
-		}
-		catch ( LookupTableException& e )
-		{
-			throw CSeqException( string( "Request method not supported: " ) + m_requestMethodString );
-		}
+		m_requestMethod = RequestTypes.GetCase( m_requestMethodString );
+	}
+	catch ( LookupTableException& e )
+	{
+		throw CSeqException( string( "Request method not supported: " ) + m_requestMethodString );
 	}
-	else
-		throw CSeqException( string( "Invalid CSeq: " ) + rawValue );
 }
 
 int 		CSeq::Sequence() const throw()
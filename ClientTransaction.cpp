@@ -0,0 +1,265 @@
+#include "ClientTransaction.hpp"
+#include <algorithm>
+#include "CSeq.hpp"
+#include "SipDefines.hpp"
+
+namespace Sip {
+
+ClientTransactions::ClientTransactions( TransactionSender& sender, ClientTransactionUser& user ) throw()
+	: m_sender( sender ), m_user( user )
+{
+}
+
+ClientTransactions::~ClientTransactions()
+{
+	for ( boost::unordered_map<TransactionKey, SlabHandle>::iterator i = m_byKey.begin(); i != m_byKey.end(); ++i )
+		delete m_transactions.Get( i->second )->original;
+}
+
+SlabHandle ClientTransactions::Start( const SipRequest& request, const sockaddr_storage& destination, bool reliable,
+	uint64_t now ) throw( TransactionException )
+{
+	TransactionKey key;
+	if ( !TransactionKey::For( request, key ) )
+		throw TransactionException( "Request has no Via branch or CSeq to key a transaction by" );
+	if ( request.RequestMethod() == SipRequest::REQUEST_METHOD_ACK )
+		throw TransactionException( "ACK has no client transaction" );
+	if ( m_byKey.find( key ) != m_byKey.end() )
+		throw TransactionException( "Transaction already running for branch " + key.branch );
+
+	SlabHandle handle = m_transactions.Acquire();
+	Transaction& transaction = *m_transactions.Get( handle );
+	try
+	{
+		if ( request.RawMessageCurrent() )
+			transaction.request = request.GetOriginalRawMessage();
+		else
+			transaction.request = request.ToString();
+	}
+	catch ( std::exception& e )
+	{
+		m_transactions.Release( handle );
+		throw TransactionException( string( "Request can't be serialized: " ) + e.what() );
+	}
+	transaction.key = key;
+	transaction.destination = destination;
+	transaction.invite = key.method == SipRequest::REQUEST_METHOD_INVITE;
+	transaction.reliable = reliable;
+	transaction.state = transaction.invite ? STATE_CALLING : STATE_TRYING;
+	transaction.ack.clear();
+	transaction.original = transaction.invite ? new SipRequest( request ) : NULL;
+	transaction.interval = reliable ? SIP_T1 : m_rtt.T1For( destination );
+	transaction.sent = now;
+	transaction.retransmitted = false;
+	std::fill( transaction.timers, transaction.timers + 3, SlabHandle() );
+
+	if ( !m_sender.Send( transaction.request, destination ) )
+	{
+		++m_stats.transportErrors;
+		Terminate( handle, transaction );
+		return SlabHandle();
+	}
+	++m_stats.started;
+	m_byKey[key] = handle;
+	if ( !reliable )
+		Schedule( handle, transaction, TIMER_RETRANSMIT, now, transaction.interval );
+	//64*T1, but never shorter than with the default T1: a fast network doesn't make the far end answer sooner
+	Schedule( handle, transaction, TIMER_TIMEOUT, now,
+		std::max<uint64_t>( transaction.invite ? SIP_TB : SIP_TF, transaction.interval * 64 ) );
+	return handle;
+}
+
+bool ClientTransactions::OnResponse( const SipResponse& response, uint64_t now ) throw()
+{
+	TransactionKey key;
+	boost::unordered_map<TransactionKey, SlabHandle>::iterator found;
+	if ( !TransactionKey::For( response, key ) || ( found = m_byKey.find( key ) ) == m_byKey.end() )
+	{
+		++m_stats.unmatched;
+		return false;
+	}
+	SlabHandle handle = found->second;
+	Transaction& transaction = *m_transactions.Get( handle );
+	int code = response.StatusCode();
+	if ( ( transaction.state == STATE_CALLING || transaction.state == STATE_TRYING ) && !transaction.reliable &&
+		!transaction.retransmitted )
+		m_rtt.Sample( transaction.destination, now - transaction.sent );
+
+	if ( transaction.state == STATE_COMPLETED )
+	{
+		//A retransmitted final: the INVITE server retransmits until it hears our ACK (17.1.1.2)
+		if ( transaction.invite && code >= 300 && !transaction.ack.empty() && m_sender.Send( transaction.ack, transaction.destination ) )
+			++m_stats.acks;
+		++m_stats.absorbed;
+		return true;
+	}
+
+	if ( code < 200 )
+	{
+		//Timer A and B stop for good; for non-INVITE, Timer E carries on at T2 and F still runs (17.1.2.2)
+		transaction.state = STATE_PROCEEDING;
+		if ( transaction.invite )
+		{
+			Stop( transaction, TIMER_RETRANSMIT );
+			Stop( transaction, TIMER_TIMEOUT );
+		}
+		else
+			transaction.interval = SIP_T2;
+	}
+	else if ( transaction.invite && code < 300 )
+		//The ACK for a 2xx is the TU's, end to end (17.1.1.2)
+		Terminate( handle, transaction );
+	else
+	{
+		if ( transaction.invite )
+		{
+			transaction.ack = Ack( *transaction.original, response );
+			if ( !transaction.ack.empty() && m_sender.Send( transaction.ack, transaction.destination ) )
+				++m_stats.acks;
+		}
+		Complete( handle, transaction, now, transaction.invite ? SIP_TD : SIP_TK );
+	}
+	++m_stats.matched;
+	m_user.OnResponse( handle, response );
+	return true;
+}
+
+void ClientTransactions::RunTimers( uint64_t now ) throw()
+{
+	//Taken out of the member first: a callback may start transactions, or even run timers itself
+	vector<TimingWheel::Expired> expired;
+	expired.swap( m_expired );
+	m_wheel.Advance( now, expired );
+	for ( vector<TimingWheel::Expired>::iterator due = expired.begin(); due != expired.end(); ++due )
+	{
+		//A timer stopped by an earlier callback in this batch is still here, but no longer the transaction's
+		Transaction* transaction = m_transactions.Get( due->target );
+		if ( transaction == NULL || transaction->timers[due->kind] != due->timer )
+			continue;
+		transaction->timers[due->kind] = SlabHandle();
+		Fire( due->target, *transaction, static_cast<Timer>( due->kind ), now );
+	}
+	expired.clear();
+	if ( m_expired.empty() )
+		expired.swap( m_expired );
+}
+
+bool ClientTransactions::NextTimer( uint64_t& when ) const throw()
+{
+	return m_wheel.Next( when );
+}
+
+ClientTransactions::State ClientTransactions::GetState( SlabHandle transaction ) throw()
+{
+	Transaction* found = m_transactions.Get( transaction );
+	return found == NULL ? STATE_TERMINATED : found->state;
+}
+
+size_t ClientTransactions::Size() const throw()
+{
+	return m_transactions.Size();
+}
+
+const ClientTransactions::Stats& ClientTransactions::GetStats() const throw()
+{
+	return m_stats;
+}
+
+RttTable& ClientTransactions::GetRttTable() throw()
+{
+	return m_rtt;
+}
+
+void ClientTransactions::Schedule( SlabHandle handle, Transaction& transaction, Timer timer, uint64_t now, uint64_t delay )
+{
+	m_wheel.Cancel( transaction.timers[timer] );
+	transaction.timers[timer] = m_wheel.Schedule( now, now + delay, handle, timer );
+}
+
+void ClientTransactions::Stop( Transaction& transaction, Timer timer ) throw()
+{
+	m_wheel.Cancel( transaction.timers[timer] );
+	transaction.timers[timer] = SlabHandle();
+}
+
+void ClientTransactions::Fire( SlabHandle handle, Transaction& transaction, Timer timer, uint64_t now ) throw()
+{
+	switch ( timer )
+	{
+		case TIMER_RETRANSMIT:
+			if ( !m_sender.Send( transaction.request, transaction.destination ) )
+			{
+				++m_stats.transportErrors;
+				Terminate( handle, transaction );
+				m_user.OnTransportError( handle );
+				return;
+			}
+			++m_stats.retransmissions;
+			if ( !transaction.retransmitted )
+				m_rtt.Backoff( transaction.destination );
+			transaction.retransmitted = true;
+			//Timer A doubles without bound; Timer E doubles up to T2, and stays at T2 once proceeding
+			transaction.interval *= 2;
+			if ( !transaction.invite && transaction.interval > static_cast<uint64_t>( SIP_T2 ) )
+				transaction.interval = SIP_T2;
+			Schedule( handle, transaction, TIMER_RETRANSMIT, now, transaction.interval );
+			break;
+		case TIMER_TIMEOUT:
+			++m_stats.timeouts;
+			Terminate( handle, transaction );
+			m_user.OnTimeout( handle );
+			break;
+		case TIMER_LINGER:
+			Terminate( handle, transaction );
+			break;
+	}
+}
+
+void ClientTransactions::Complete( SlabHandle handle, Transaction& transaction, uint64_t now, int linger )
+{
+	transaction.state = STATE_COMPLETED;
+	Stop( transaction, TIMER_RETRANSMIT );
+	Stop( transaction, TIMER_TIMEOUT );
+	//Over a reliable transport there are no retransmissions to absorb, so Timer D and K are zero (17.1.1.2, 17.1.2.2)
+	Schedule( handle, transaction, TIMER_LINGER, now, transaction.reliable ? 0 : linger );
+}
+
+void ClientTransactions::Terminate( SlabHandle handle, Transaction& transaction ) throw()
+{
+	boost::unordered_map<TransactionKey, SlabHandle>::iterator found = m_byKey.find( transaction.key );
+	if ( found != m_byKey.end() && found->second == handle )
+		m_byKey.erase( found );
+	for ( unsigned int timer = 0; timer < 3; ++timer )
+		Stop( transaction, static_cast<Timer>( timer ) );
+	delete transaction.original;
+	transaction.original = NULL;
+	transaction.state = STATE_TERMINATED;
+	m_transactions.Release( handle );
+}
+
+string ClientTransactions::Ack( const SipRequest& invite, const SipResponse& response )
+{
+	//RFC 3261 17.1.1.3: the INVITE's Request-URI, top Via, From, Call-ID and Route; the response's To, for its tag
+	try
+	{
+		SipRequest ack( SipRequest::REQUEST_METHOD_ACK );
+		ack.SetRequestURI( invite.RequestURI() );
+		ack.SetHeader( "via", invite.GetHeaderValues( "via" ).front() );
+		if ( invite.HasHeader( "max-forwards" ) )
+			ack.SetHeader( "max-forwards", invite.GetHeaderValues( "max-forwards" ) );
+		ack.SetHeader( "from", invite.GetHeaderValues( "from" ) );
+		ack.SetHeader( "to", response.GetHeaderValues( "to" ) );
+		ack.SetHeader( "call-id", invite.GetHeaderValues( "call-id" ) );
+		ack.SetHeader( "cseq", CSeq( CSeq( invite.GetHeaderValues( "cseq" ).front() ).Sequence(), SipRequest::REQUEST_METHOD_ACK ).ToString() );
+		if ( invite.HasHeader( "route" ) )
+			ack.SetHeader( "route", invite.GetHeaderValues( "route" ) );
+		ack.SetUInt( "content-length", 0 );
+		return ack.ToString();
+	}
+	catch ( std::exception& e )
+	{
+		return string();
+	}
+}
+
+}; //namespace Sip
@@ -0,0 +1,175 @@
+#ifndef CLIENTTRANSACTION_HPP
+#define CLIENTTRANSACTION_HPP
+#include <string>
+#include <vector>
+#include <stdint.h>
+#include <boost/unordered_map.hpp>
+#include "HandleSlab.hpp"
+#include "RttTable.hpp"
+#include "SipResponse.hpp"
+#include "TimingWheel.hpp"
+#include "Transaction.hpp"
+
+namespace Sip {
+
+/**
+* \class ClientTransactionUser
+* \brief What a ClientTransactions table reports to. Each callback may start new transactions.
+*/
+class ClientTransactionUser
+{
+	public:
+		virtual ~ClientTransactionUser() {}
+
+		/**
+		 *     A response for the transaction: every provisional, and the first final. Retransmitted finals are absorbed.
+		 */
+		virtual void OnResponse( SlabHandle transaction, const SipResponse& response ) = 0;
+
+		/**
+		 *     Timer B or F fired before a final response came. The transaction is gone.
+		 */
+		virtual void OnTimeout( SlabHandle transaction ) = 0;
+
+		/**
+		 *     A retransmission couldn't be sent. The transaction is gone.
+		 */
+		virtual void OnTransportError( SlabHandle transaction ) = 0;
+};
+
+/**
+* \class ClientTransactions
+* \brief The client transactions of RFC 3261 17.1, INVITE and non-INVITE, keyed by branch, sent-by and method
+*
+* A request is serialized once, when its transaction starts, and retransmissions send those same bytes. A request
+* still byte for byte as it was parsed is sent as received, without ToString(). The ACK for a failed INVITE is built
+* once too, and re-sent for each retransmission of the final response.
+*
+* Time is whatever the caller says it is, in milliseconds: every call that may start or fire a timer takes now. Call
+* RunTimers() when NextTimer() comes due; timers are in a TimingWheel of the table's own. Transactions live in a
+* HandleSlab, and are named to the user by handles, which go stale rather than dangle once the transaction terminates.
+*
+* Over an unreliable transport T1 is per destination: the table times each request to the first response, as long as
+* the request went out only once, and keeps the round trips in an RttTable. A request starts retransmitting after the
+* T1 its destination's RTT calls for, and Timer B and F stay at least 64*SIP_T1.
+*
+* Not thread safe; a table belongs to one thread, like the transport feeding it.
+*/
+class ClientTransactions
+{
+	public:
+		enum State
+		{
+			STATE_CALLING, //INVITE, before any response
+			STATE_TRYING, //non-INVITE, before any response
+			STATE_PROCEEDING,
+			STATE_COMPLETED,
+			STATE_TERMINATED
+		};
+
+		/**
+		* \class Stats
+		* \brief Running totals
+		*/
+		struct Stats
+		{
+			Stats() : started( 0 ), retransmissions( 0 ), acks( 0 ), timeouts( 0 ), transportErrors( 0 ), matched( 0 ),
+				absorbed( 0 ), unmatched( 0 ) {}
+			uint64_t started, retransmissions, acks, timeouts, transportErrors;
+			/// Responses passed to the user, retransmitted finals swallowed, and responses with no transaction
+			uint64_t matched, absorbed, unmatched;
+		};
+
+		ClientTransactions( TransactionSender& sender, ClientTransactionUser& user ) throw();
+		~ClientTransactions();
+
+		/**
+		 *     Sends request and starts its transaction
+		 * @param reliable Whether the transport is reliable, which turns off retransmission and shortens the wait for
+		 *        stray responses once the transaction completes
+		 * @param now Milliseconds, on the same clock as every other call
+		 * @return The transaction, or an invalid handle if the first send failed
+		 * @throw TransactionException if the request has no branch or CSeq, is an ACK, can't be serialized, or its
+		 *        transaction is already running
+		 */
+		SlabHandle Start( const SipRequest& request, const sockaddr_storage& destination, bool reliable, uint64_t now )
+			throw( TransactionException );
+
+		/**
+		 *     Passes a response to its transaction
+		 * @return False if no transaction matched it; a proxy forwards such a response statelessly
+		 */
+		bool OnResponse( const SipResponse& response, uint64_t now ) throw();
+
+		/**
+		 *     Fires every timer due by now
+		 */
+		void RunTimers( uint64_t now ) throw();
+
+		/**
+		 *     When RunTimers() next has something to do. It may be early, never late.
+		 * @return False if no timer is pending
+		 */
+		bool NextTimer( uint64_t& when ) const throw();
+
+		/**
+		 * @return The transaction's state; STATE_TERMINATED once it is gone
+		 */
+		State GetState( SlabHandle transaction ) throw();
+
+		/**
+		 *     Transactions not yet terminated
+		 */
+		size_t Size() const throw();
+
+		const Stats& GetStats() const throw();
+
+		/**
+		 *     The round trip times measured so far, and the bounds on the T1 they give, which may be changed
+		 */
+		RttTable& GetRttTable() throw();
+
+	private:
+		ClientTransactions( const ClientTransactions& );
+		ClientTransactions& operator=( const ClientTransactions& );
+
+		enum Timer
+		{
+			TIMER_RETRANSMIT, //A, E
+			TIMER_TIMEOUT, //B, F
+			TIMER_LINGER //D, K
+		};
+
+		struct Transaction
+		{
+			TransactionKey key;
+			sockaddr_storage destination;
+			bool invite, reliable;
+			State state;
+			string request, ack;
+			SipRequest* original; //INVITE only, to build the ACK from
+			uint64_t interval; //Until the next retransmission after this one
+			uint64_t sent; //When the request first went out, to time the round trip by
+			bool retransmitted; //Then the first response is no RTT sample (Karn)
+			SlabHandle timers[3]; //By Timer, in m_wheel; invalid when not running
+		};
+
+		void Schedule( SlabHandle handle, Transaction& transaction, Timer timer, uint64_t now, uint64_t delay );
+		void Stop( Transaction& transaction, Timer timer ) throw();
+		void Fire( SlabHandle handle, Transaction& transaction, Timer timer, uint64_t now ) throw();
+		void Complete( SlabHandle handle, Transaction& transaction, uint64_t now, int linger );
+		void Terminate( SlabHandle handle, Transaction& transaction ) throw();
+		static string Ack( const SipRequest& invite, const SipResponse& response );
+
+		TransactionSender& m_sender;
+		ClientTransactionUser& m_user;
+		HandleSlab<Transaction> m_transactions;
+		boost::unordered_map<TransactionKey, SlabHandle> m_byKey;
+		TimingWheel m_wheel;
+		vector<TimingWheel::Expired> m_expired;
+		RttTable m_rtt;
+		Stats m_stats;
+};
+
+}; //namespace Sip
+#endif //CLIENTTRANSACTION_HPP
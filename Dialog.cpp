@@ -0,0 +1,291 @@
+#include "Dialog.hpp"
+#include <algorithm>
+#include <boost/functional/hash.hpp>
+#include <boost/thread/mutex.hpp>
+#include <boost/unordered_map.hpp>
+#include "CSeq.hpp"
+#include "HandleSlab.hpp"
+
+namespace Sip {
+
+namespace {
+
+bool Tag( const SipMessage& message, const char* header, string& tag )
+{
+	if ( !message.HasHeader( header ) )
+		return false;
+	const vector<SipHeaderValue>& values = message.GetHeaderValues( header );
+	if ( values.empty() || !values.front().HasTag( "tag" ) )
+		return false;
+	tag = values.front().GetTagValue( "tag" );
+	return !tag.empty();
+}
+
+bool CallId( const SipMessage& message, string& callId )
+{
+	if ( !message.HasHeader( "call-id" ) || message.GetHeaderValues( "call-id" ).empty() )
+		return false;
+	callId = message.GetHeaderValues( "call-id" ).front().Value();
+	return !callId.empty();
+}
+
+/**
+ *     The URI in a message's first Contact, without display name or brackets; empty if it has none
+ */
+string ContactUri( const SipMessage& message )
+{
+	if ( !message.HasHeader( "contact" ) || message.GetHeaderValues( "contact" ).empty() )
+		return string();
+	const string& contact = message.GetHeaderValues( "contact" ).front().Value();
+	string::size_type open = contact.find( '<' ), close;
+	if ( open != string::npos && ( close = contact.find( '>', open ) ) != string::npos )
+		return contact.substr( open + 1, close - open - 1 );
+	return contact;
+}
+
+/**
+ *     Record-Route, as the route set: in order at the UAS, reversed at the UAC (12.1.1, 12.1.2)
+ */
+void RouteSet( const SipMessage& message, bool reverse, vector<string>& routes )
+{
+	routes.clear();
+	if ( !message.HasHeader( "record-route" ) )
+		return;
+	const vector<SipHeaderValue>& records = message.GetHeaderValues( "record-route" );
+	for ( vector<SipHeaderValue>::const_iterator record = records.begin(); record != records.end(); ++record )
+		routes.push_back( record->ToString() );
+	if ( reverse )
+		std::reverse( routes.begin(), routes.end() );
+}
+
+uint32_t Sequence( const SipMessage& message )
+{
+	return CSeq( message.GetHeaderValues( "cseq" ).front() ).Sequence();
+}
+
+bool IsTargetRefresh( SipRequest::REQUEST_METHOD method )
+{
+	//RFC 3261 12.2, RFC 3311, RFC 6665
+	return method == SipRequest::REQUEST_METHOD_INVITE || method == SipRequest::REQUEST_METHOD_UPDATE ||
+		method == SipRequest::REQUEST_METHOD_SUBSCRIBE || method == SipRequest::REQUEST_METHOD_NOTIFY;
+}
+
+}; //namespace
+
+bool DialogId::ForRequest( const SipRequest& request, DialogId& id ) throw()
+{
+	try
+	{
+		if ( !CallId( request, id.callId ) || !Tag( request, "to", id.localTag ) || !Tag( request, "from", id.remoteTag ) )
+			return false;
+	}
+	catch ( std::exception& e )
+	{
+		return false;
+	}
+	id.Hash();
+	return true;
+}
+
+bool DialogId::ForResponse( const SipResponse& response, bool uac, DialogId& id ) throw()
+{
+	try
+	{
+		if ( !CallId( response, id.callId ) || !Tag( response, uac ? "from" : "to", id.localTag ) ||
+			!Tag( response, uac ? "to" : "from", id.remoteTag ) )
+			return false;
+	}
+	catch ( std::exception& e )
+	{
+		return false;
+	}
+	id.Hash();
+	return true;
+}
+
+void DialogId::Hash() throw()
+{
+	hash = boost::hash_value( callId );
+	boost::hash_combine( hash, localTag );
+	boost::hash_combine( hash, remoteTag );
+}
+
+std::size_t hash_value( const DialogId& id )
+{
+	return id.hash;
+}
+
+/**
+* \class Dialogs::Shard
+* \brief The dialogs whose ids hash to one shard, and the lock for them
+*/
+struct Dialogs::Shard
+{
+	mutable boost::mutex mutex;
+	boost::unordered_map<DialogId, SlabHandle> byId;
+	HandleSlab<Dialog> dialogs;
+
+	Dialog* Find( const DialogId& id )
+	{
+		boost::unordered_map<DialogId, SlabHandle>::iterator found = byId.find( id );
+		return found == byId.end() ? NULL : dialogs.Get( found->second );
+	}
+};
+
+Dialogs::Dialogs( unsigned int shards )
+{
+	unsigned int count = 1;
+	while ( count < shards )
+		count <<= 1;
+	for ( unsigned int i = 0; i < count; ++i )
+		m_shards.push_back( new Shard );
+}
+
+Dialogs::~Dialogs()
+{
+	for ( vector<Shard*>::iterator shard = m_shards.begin(); shard != m_shards.end(); ++shard )
+		delete *shard;
+}
+
+bool Dialogs::Create( const SipRequest& request, const SipResponse& response, bool uac ) throw()
+{
+	SipRequest::REQUEST_METHOD method = request.RequestMethod();
+	int code = response.StatusCode();
+	if ( ( method != SipRequest::REQUEST_METHOD_INVITE && method != SipRequest::REQUEST_METHOD_SUBSCRIBE &&
+		method != SipRequest::REQUEST_METHOD_REFER ) || code <= 100 || code >= 300 )
+		return false;
+
+	//Everything read from the messages before the lock is taken
+	Dialog created;
+	const SipMessage& remote = uac ? static_cast<const SipMessage&>( response ) : request;
+	try
+	{
+		if ( !DialogId::ForResponse( response, uac, created.id ) )
+			return false;
+		created.state = code < 200 ? Dialog::STATE_EARLY : Dialog::STATE_CONFIRMED;
+		created.remoteTarget = ContactUri( remote );
+		RouteSet( remote, uac, created.routeSet );
+		( uac ? created.localSequence : created.remoteSequence ) = Sequence( request );
+	}
+	catch ( std::exception& e )
+	{
+		return false;
+	}
+
+	Shard& shard = ShardFor( created.id );
+	boost::mutex::scoped_lock lock( shard.mutex );
+	Dialog* dialog = shard.Find( created.id );
+	if ( dialog == NULL )
+	{
+		SlabHandle handle = shard.dialogs.Acquire();
+		shard.dialogs.Get( handle )->id = created.id;
+		shard.byId[created.id] = handle;
+		dialog = shard.dialogs.Get( handle );
+		dialog->localSequence = created.localSequence;
+		dialog->remoteSequence = created.remoteSequence;
+	}
+	else if ( dialog->state == Dialog::STATE_CONFIRMED )
+		return true;
+	else
+	{
+		//Requests inside the early dialog, a PRACK or UPDATE, have moved its CSeqs past the INVITE's: keep them
+		dialog->localSequence = std::max( dialog->localSequence, created.localSequence );
+		dialog->remoteSequence = std::max( dialog->remoteSequence, created.remoteSequence );
+	}
+	//New, or early and now answered again: the 2xx's route set and target replace the 1xx's (12.1.2, 13.2.2.4)
+	dialog->state = created.state;
+	dialog->remoteTarget.swap( created.remoteTarget );
+	dialog->routeSet.swap( created.routeSet );
+	return true;
+}
+
+Dialogs::Match Dialogs::Receive( const SipRequest& request, Dialog* copy ) throw()
+{
+	DialogId id;
+	uint32_t sequence;
+	string target;
+	SipRequest::REQUEST_METHOD method = request.RequestMethod();
+	try
+	{
+		if ( !DialogId::ForRequest( request, id ) || !request.HasHeader( "cseq" ) )
+			return MATCH_NONE;
+		sequence = Sequence( request );
+		if ( IsTargetRefresh( method ) )
+			target = ContactUri( request );
+	}
+	catch ( std::exception& e )
+	{
+		return MATCH_NONE;
+	}
+
+	Shard& shard = ShardFor( id );
+	boost::mutex::scoped_lock lock( shard.mutex );
+	Dialog* dialog = shard.Find( id );
+	if ( dialog == NULL )
+		return MATCH_NONE;
+	//An ACK or CANCEL carries the CSeq of the request it goes with, so only a lower one is out of order
+	if ( dialog->remoteSequence != 0 && sequence < dialog->remoteSequence )
+		return MATCH_OUT_OF_ORDER;
+	dialog->remoteSequence = sequence;
+	if ( !target.empty() )
+		dialog->remoteTarget.swap( target );
+	if ( copy != NULL )
+		*copy = *dialog;
+	return MATCH_FOUND;
+}
+
+bool Dialogs::Find( const DialogId& id, Dialog& copy ) const throw()
+{
+	Shard& shard = ShardFor( id );
+	boost::mutex::scoped_lock lock( shard.mutex );
+	Dialog* dialog = shard.Find( id );
+	if ( dialog == NULL )
+		return false;
+	copy = *dialog;
+	return true;
+}
+
+bool Dialogs::NextSequence( const DialogId& id, uint32_t& sequence ) throw()
+{
+	Shard& shard = ShardFor( id );
+	boost::mutex::scoped_lock lock( shard.mutex );
+	Dialog* dialog = shard.Find( id );
+	if ( dialog == NULL )
+		return false;
+	//A UAS that hasn't sent a request in the dialog yet may start anywhere (12.1.1); 1 will do
+	sequence = ++dialog->localSequence;
+	return true;
+}
+
+bool Dialogs::Remove( const DialogId& id ) throw()
+{
+	Shard& shard = ShardFor( id );
+	boost::mutex::scoped_lock lock( shard.mutex );
+	boost::unordered_map<DialogId, SlabHandle>::iterator found = shard.byId.find( id );
+	if ( found == shard.byId.end() )
+		return false;
+	Dialog& dialog = *shard.dialogs.Get( found->second );
+	//Slots are reused, not freed: let go of the strings now rather than when the slot next fills
+	dialog = Dialog();
+	shard.dialogs.Release( found->second );
+	shard.byId.erase( found );
+	return true;
+}
+
+size_t Dialogs::Size() const throw()
+{
+	size_t size = 0;
+	for ( vector<Shard*>::const_iterator shard = m_shards.begin(); shard != m_shards.end(); ++shard )
+	{
+		boost::mutex::scoped_lock lock( ( *shard )->mutex );
+		size += ( *shard )->byId.size();
+	}
+	return size;
+}
+
+Dialogs::Shard& Dialogs::ShardFor( const DialogId& id ) const throw()
+{
+	return *m_shards[ ( id.hash ^ ( id.hash >> 16 ) ) & ( m_shards.size() - 1 ) ];
+}
+
+}; //namespace Sip
@@ -0,0 +1,152 @@
+#ifndef DIALOG_HPP
+#define DIALOG_HPP
+#include <string>
+#include <vector>
+#include <stdint.h>
+#include "SipRequest.hpp"
+#include "SipResponse.hpp"
+
+namespace Sip {
+
+using std::string;
+using std::vector;
+
+/**
+* \class DialogId
+* \brief What a dialog is known by: its Call-ID, local tag and remote tag (RFC 3261 12). The hash of the three is
+*        worked out once, when the id is filled in, and is what picks both the shard and the bucket.
+*/
+struct DialogId
+{
+	DialogId() : hash( 0 ) {}
+
+	bool operator==( const DialogId& rhs ) const
+	{
+		return hash == rhs.hash && callId == rhs.callId && localTag == rhs.localTag && remoteTag == rhs.remoteTag;
+	}
+
+	/**
+	 *     The dialog a request received in one belongs to: the To tag is ours, the From tag the far end's
+	 * @return False if the request has no Call-ID, From tag or To tag
+	 */
+	static bool ForRequest( const SipRequest& request, DialogId& id ) throw();
+
+	/**
+	 *     The dialog a response creates or belongs to
+	 * @param uac Whether we sent the request, so the From tag is ours; otherwise the To tag is
+	 * @return False if the response has no Call-ID, From tag or To tag
+	 */
+	static bool ForResponse( const SipResponse& response, bool uac, DialogId& id ) throw();
+
+	/**
+	 *     Fills in hash from the rest
+	 */
+	void Hash() throw();
+
+	string callId, localTag, remoteTag;
+	std::size_t hash;
+};
+
+std::size_t hash_value( const DialogId& id );
+
+/**
+* \class Dialog
+* \brief A dialog's state (RFC 3261 12.1), as kept in Dialogs and copied out of it
+*/
+struct Dialog
+{
+	enum State
+	{
+		STATE_EARLY, //Created by a 1xx with a To tag
+		STATE_CONFIRMED
+	};
+
+	Dialog() : state( STATE_EARLY ), localSequence( 0 ), remoteSequence( 0 ) {}
+
+	DialogId id;
+	State state;
+	/// The far end's Contact URI, where requests in the dialog go
+	string remoteTarget;
+	/// Route header values for requests in the dialog, first hop first
+	vector<string> routeSet;
+	/// CSeq of the last request each side sent in the dialog; 0 before the first
+	uint32_t localSequence, remoteSequence;
+};
+
+/**
+* \class Dialogs
+* \brief Every dialog, found by DialogId, safe to use from any number of threads at once
+*
+* The table is split into shards by the id's hash, each with its own lock, hash map and HandleSlab of dialogs, so
+* threads working on different dialogs seldom wait on each other and never on one lock for the whole table. A lock
+* is held only for the hash lookup and the copy in or out; ids are built, and messages read, before taking it.
+*
+* Dialogs are created from the response that creates them, on either side, and matched by the requests received in
+* them: Receive() checks and records the far end's CSeq and takes its new Contact from a target refresh request. The
+* table doesn't end dialogs itself; call Remove() on a BYE, or a failure to the INVITE of an early dialog.
+*/
+class Dialogs
+{
+	public:
+		enum Match
+		{
+			MATCH_NONE, //Not in a dialog the table knows; answer 481
+			MATCH_FOUND,
+			MATCH_OUT_OF_ORDER //CSeq lower than the far end's last; answer 500 (12.2.2)
+		};
+
+		/**
+		 * @param shards How many to split the table into; rounded up to a power of two
+		 */
+		Dialogs( unsigned int shards = 64 );
+		~Dialogs();
+
+		/**
+		 *     Records the dialog a response creates, or moves an early one to confirmed (12.1.1, 12.1.2)
+		 * @param request An INVITE, SUBSCRIBE or REFER
+		 * @param response A 1xx with a To tag, which creates an early dialog, or a 2xx
+		 * @param uac Whether we sent request and received response, rather than the other way round
+		 * @return False if response creates no dialog
+		 */
+		bool Create( const SipRequest& request, const SipResponse& response, bool uac ) throw();
+
+		/**
+		 *     Matches a request received within a dialog
+		 * @param dialog If not NULL, receives the dialog as it is after the request, when it matched
+		 */
+		Match Receive( const SipRequest& request, Dialog* dialog = NULL ) throw();
+
+		/**
+		 * @return False if there is no such dialog
+		 */
+		bool Find( const DialogId& id, Dialog& dialog ) const throw();
+
+		/**
+		 *     Takes the CSeq for a request we are about to send in a dialog
+		 * @return False if there is no such dialog
+		 */
+		bool NextSequence( const DialogId& id, uint32_t& sequence ) throw();
+
+		/**
+		 * @return False if there was no such dialog
+		 */
+		bool Remove( const DialogId& id ) throw();
+
+		/**
+		 *     Dialogs in the table. Each shard is counted under its own lock, so with other threads at work this is
+		 *     only an estimate.
+		 */
+		size_t Size() const throw();
+
+	private:
+		Dialogs( const Dialogs& );
+		Dialogs& operator=( const Dialogs& );
+
+		struct Shard;
+		Shard& ShardFor( const DialogId& id ) const throw();
+
+		vector<Shard*> m_shards;
+};
+
+}; //namespace Sip
+#endif //DIALOG_HPP
@@ -0,0 +1,157 @@
+#ifndef HANDLESLAB_HPP
+#define HANDLESLAB_HPP
+#include <cstddef>
+#include <vector>
+#include <stdint.h>
+
+namespace Sip {
+
+using std::vector;
+
+/**
+* \class SlabHandle
+* \brief Names one object in a HandleSlab: its slot, and which of the slot's successive occupants it is
+*
+* A handle outlives what it names safely. Once the object is released the slot's generation moves on, and the
+* handle no longer resolves, even after the slot is reused. The default handle never resolves.
+*/
+struct SlabHandle
+{
+	SlabHandle() : index( 0 ), generation( 0 ) {}
+	SlabHandle( uint32_t slot, uint32_t occupant ) : index( slot ), generation( occupant ) {}
+
+	bool operator==( const SlabHandle& rhs ) const { return index == rhs.index && generation == rhs.generation; }
+	bool operator!=( const SlabHandle& rhs ) const { return !( *this == rhs ); }
+
+	/**
+	 *     Whether this came from a slab at all; it may still be stale
+	 */
+	bool Valid() const { return generation != 0; }
+
+	uint32_t index, generation;
+};
+
+/**
+* \class HandleSlab
+* \brief Fixed-size objects in blocks allocated once and reused, reached through generational handles
+*
+* Slots are allocated a block at a time and never freed or moved until the slab is destroyed, so pointers from
+* Get() stay good while the object is held. Released slots go on a free list and are reused last in, first out,
+* while they are still in cache. The object in a slot is not destroyed on release: a reused slot keeps whatever
+* its previous occupant left there, strings' capacity included, and Acquire() callers reset what they use.
+*
+* Not thread safe.
+*/
+template <class T, unsigned int BLOCK = 256>
+class HandleSlab
+{
+	public:
+		HandleSlab() throw() : m_free( NONE ), m_live( 0 ) {}
+
+		~HandleSlab()
+		{
+			for ( typename vector<Slot*>::iterator block = m_blocks.begin(); block != m_blocks.end(); ++block )
+				delete [] *block;
+		}
+
+		/**
+		 *     Takes a free slot, allocating a block if there is none
+		 */
+		SlabHandle Acquire()
+		{
+			if ( m_free == NONE )
+				Grow();
+			uint32_t index = m_free;
+			Slot& slot = At( index );
+			m_free = slot.next;
+			slot.live = true;
+			++m_live;
+			return SlabHandle( index, slot.generation );
+		}
+
+		/**
+		 *     Gives a slot back; every handle to it goes stale. A stale handle is ignored.
+		 */
+		void Release( const SlabHandle& handle ) throw()
+		{
+			if ( Get( handle ) == NULL )
+				return;
+			Slot& slot = At( handle.index );
+			slot.live = false;
+			if ( ++slot.generation == 0 )
+				slot.generation = 1;
+			slot.next = m_free;
+			m_free = handle.index;
+			--m_live;
+		}
+
+		/**
+		 * @return The object, or NULL if the handle is stale or was never valid
+		 */
+		T* Get( const SlabHandle& handle ) throw()
+		{
+			if ( handle.index >= m_blocks.size() * BLOCK )
+				return NULL;
+			Slot& slot = At( handle.index );
+			return slot.live && slot.generation == handle.generation ? &slot.value : NULL;
+		}
+
+		const T* Get( const SlabHandle& handle ) const throw()
+		{
+			return const_cast<HandleSlab*>( this )->Get( handle );
+		}
+
+		/**
+		 *     Objects acquired and not released
+		 */
+		size_t Size() const throw()
+		{
+			return m_live;
+		}
+
+		/**
+		 *     Slots allocated, live or free
+		 */
+		size_t Capacity() const throw()
+		{
+			return m_blocks.size() * BLOCK;
+		}
+
+	private:
+		HandleSlab( const HandleSlab& );
+		HandleSlab& operator=( const HandleSlab& );
+
+		static const uint32_t NONE = 0xFFFFFFFF;
+
+		struct Slot
+		{
+			Slot() : generation( 1 ), next( NONE ), live( false ) {}
+			T value;
+			uint32_t generation, next;
+			bool live;
+		};
+
+		Slot& At( uint32_t index ) throw()
+		{
+			return m_blocks[ index / BLOCK ][ index % BLOCK ];
+		}
+
+		void Grow()
+		{
+			uint32_t first = m_blocks.size() * BLOCK;
+			m_blocks.push_back( new Slot[ BLOCK ] );
+			//Thread the new slots onto the free list so the lowest comes out first
+			for ( uint32_t i = BLOCK; i > 0; --i )
+			{
+				At( first + i - 1 ).next = m_free;
+				m_free = first + i - 1;
+			}
+		}
+
+		vector<Slot*> m_blocks;
+		uint32_t m_free;
+		size_t m_live;
+};
+
+}; //namespace Sip
+#endif //HANDLESLAB_HPP
@@ -0,0 +1,129 @@
+#include "ReceiveBuffer.hpp"
+
+namespace Sip {
+
+/**
+* \class ReceiveBuffer::Shared
+* \brief The part of a pool its slabs point at. Outlives the pool while any slab is held.
+*/
+struct ReceiveBuffer::Shared
+{
+	Shared( size_t size ) : slabSize( size ), returned( NULL ), references( 1 ), closed( false ) {}
+
+	void Release()
+	{
+		if ( __atomic_sub_fetch( &references, 1, __ATOMIC_ACQ_REL ) == 0 )
+			delete this;
+	}
+
+	/**
+	 *     Frees every returned slab, once the pool is gone. Each holds a reference, so the last one may free this.
+	 */
+	void FreeReturned()
+	{
+		ReceiveBuffer* buffer = __atomic_exchange_n( &returned, static_cast<ReceiveBuffer*>( NULL ), __ATOMIC_SEQ_CST );
+		while ( buffer != NULL )
+		{
+			ReceiveBuffer* next = buffer->m_next;
+			delete buffer;
+			Release();
+			buffer = next;
+		}
+	}
+
+	size_t slabSize;
+	ReceiveBuffer* returned; //Lock-free stack: any thread pushes, Acquire() takes the whole stack at once
+	int references; //The pool, plus one per slab in existence, plus one per release in progress
+	bool closed; //The pool is gone; slabs released from now on are freed
+};
+
+ReceiveBuffer::ReceiveBuffer( Shared* pool ) : m_references( 0 ), m_pool( pool ), m_next( NULL )
+{ }
+
+string& ReceiveBuffer::Bytes() throw()
+{
+	return m_bytes;
+}
+
+void ReceiveBuffer::Reclaim( string& bytes ) throw()
+{
+	if ( bytes.capacity() >= m_pool->slabSize )
+		m_bytes.swap( bytes );
+}
+
+void intrusive_ptr_add_ref( ReceiveBuffer* buffer )
+{
+	__atomic_add_fetch( &buffer->m_references, 1, __ATOMIC_RELAXED );
+}
+
+void intrusive_ptr_release( ReceiveBuffer* buffer )
+{
+	if ( __atomic_sub_fetch( &buffer->m_references, 1, __ATOMIC_ACQ_REL ) != 0 )
+		return;
+
+	//Once pushed, the slab may be freed by someone else at any moment, and its reference on pool with it: hold one
+	//of our own until we are done with pool
+	ReceiveBuffer::Shared* pool = buffer->m_pool;
+	__atomic_add_fetch( &pool->references, 1, __ATOMIC_RELAXED );
+
+	//Pushing only, and taking the whole stack at once, means no ABA problem
+	buffer->m_next = __atomic_load_n( &pool->returned, __ATOMIC_RELAXED );
+	while ( !__atomic_compare_exchange_n( &pool->returned, &buffer->m_next, buffer, true, __ATOMIC_SEQ_CST, __ATOMIC_RELAXED ) )
+		;
+	if ( __atomic_load_n( &pool->closed, __ATOMIC_SEQ_CST ) )
+		pool->FreeReturned();
+	pool->Release();
+}
+
+ReceiveBufferPool::ReceiveBufferPool( size_t slabSize )
+	: m_shared( new ReceiveBuffer::Shared( slabSize ) ), m_free( NULL )
+{ }
+
+ReceiveBufferPool::~ReceiveBufferPool()
+{
+	while ( m_free != NULL )
+	{
+		ReceiveBuffer* next = m_free->m_next;
+		delete m_free;
+		m_shared->Release();
+		m_free = next;
+	}
+
+	//Slabs already back are freed now; ones still held are freed by whoever releases them last
+	__atomic_store_n( &m_shared->closed, true, __ATOMIC_SEQ_CST );
+	m_shared->FreeReturned();
+	m_shared->Release();
+}
+
+ReceiveBufferHandle ReceiveBufferPool::Acquire()
+{
+	++m_stats.acquired;
+	if ( m_free == NULL )
+		m_free = __atomic_exchange_n( &m_shared->returned, static_cast<ReceiveBuffer*>( NULL ), __ATOMIC_ACQUIRE );
+
+	ReceiveBuffer* buffer = m_free;
+	if ( buffer != NULL )
+		m_free = buffer->m_next;
+	else
+	{
+		++m_stats.allocated;
+		__atomic_add_fetch( &m_shared->references, 1, __ATOMIC_RELAXED );
+		buffer = new ReceiveBuffer( m_shared );
+		buffer->m_bytes.reserve( m_shared->slabSize );
+	}
+	buffer->m_next = NULL;
+	buffer->m_bytes.resize( m_shared->slabSize );
+	return ReceiveBufferHandle( buffer );
+}
+
+size_t ReceiveBufferPool::SlabSize() const throw()
+{
+	return m_shared->slabSize;
+}
+
+const ReceiveBufferPool::Stats& ReceiveBufferPool::GetStats() const throw()
+{
+	return m_stats;
+}
+
+}; //namespace Sip
@@ -0,0 +1,100 @@
+#ifndef RECEIVEBUFFER_HPP
+#define RECEIVEBUFFER_HPP
+#include <string>
+#include <stdint.h>
+#include <boost/intrusive_ptr.hpp>
+#include "SipDefines.hpp"
+
+namespace Sip {
+
+using std::string;
+
+class ReceiveBuffer;
+typedef boost::intrusive_ptr<ReceiveBuffer> ReceiveBufferHandle;
+
+/**
+* \class ReceiveBuffer
+* \brief A fixed-size, reference counted slab from a ReceiveBufferPool. The socket writes straight into Bytes(); a
+*        message parsed from it swaps the bytes in instead of copying them, and gives them back when it is destroyed.
+*        The slab goes back to its pool when the last handle is released, from whatever thread that happens on.
+*/
+class ReceiveBuffer
+{
+	public:
+		/**
+		 *     The slab. Fresh from the pool it is SlabSize() long; resize it down to what was received.
+		 */
+		string& Bytes() throw();
+
+		/**
+		 *     Takes bytes back from a message that swapped them out, if they are still a whole slab (a copied
+		 *     message holds a copy, which isn't worth keeping)
+		 */
+		void Reclaim( string& bytes ) throw();
+
+	private:
+		friend class ReceiveBufferPool;
+		friend void intrusive_ptr_add_ref( ReceiveBuffer* buffer );
+		friend void intrusive_ptr_release( ReceiveBuffer* buffer );
+
+		struct Shared;
+		ReceiveBuffer( Shared* pool );
+		ReceiveBuffer( const ReceiveBuffer& );
+		ReceiveBuffer& operator=( const ReceiveBuffer& );
+
+		string m_bytes;
+		int m_references;
+		Shared* m_pool;
+		ReceiveBuffer* m_next; //In the pool's free or returned list
+};
+
+void intrusive_ptr_add_ref( ReceiveBuffer* buffer );
+void intrusive_ptr_release( ReceiveBuffer* buffer );
+
+/**
+* \class ReceiveBufferPool
+* \brief Recycles receive slabs so the receive path allocates nothing once warm
+*
+* Acquire() must only be called from one thread at a time (the transport's); handles may be released anywhere.
+* Released slabs go onto a lock-free list that Acquire() takes whole when its own list runs dry. The pool keeps its
+* high-water mark of slabs. Slabs still held when the pool is destroyed are freed when their last handle goes.
+*/
+class ReceiveBufferPool
+{
+	public:
+		/**
+		* \class Stats
+		* \brief Running totals since the pool was created
+		*/
+		struct Stats
+		{
+			Stats() : acquired( 0 ), allocated( 0 ) {}
+			/// Acquire() calls, and how many of them had to allocate a new slab
+			uint64_t acquired, allocated;
+		};
+
+		/**
+		 * @param slabSize Bytes per slab
+		 */
+		ReceiveBufferPool( size_t slabSize = SIP_RECEIVE_SLAB_SIZE );
+		~ReceiveBufferPool();
+
+		/**
+		 *     A slab, resized to SlabSize()
+		 */
+		ReceiveBufferHandle Acquire();
+
+		size_t SlabSize() const throw();
+		const Stats& GetStats() const throw();
+
+	private:
+		ReceiveBufferPool( const ReceiveBufferPool& );
+		ReceiveBufferPool& operator=( const ReceiveBufferPool& );
+
+		ReceiveBuffer::Shared* m_shared;
+		ReceiveBuffer* m_free; //Only touched by Acquire()
+		Stats m_stats;
+};
+
+}; //namespace Sip
+#endif //RECEIVEBUFFER_HPP
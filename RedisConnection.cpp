@@ -0,0 +1,262 @@
+#include "RedisConnection.hpp"
+#include <cerrno>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <sstream>
+#include <fcntl.h>
+#include <netdb.h>
+#include <poll.h>
+#include <unistd.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/socket.h>
+
+namespace Sip {
+
+namespace {
+
+void AppendBulk( string& out, const char* data, size_t length )
+{
+	char header[ 32 ];
+	snprintf( header, sizeof( header ), "$%lu\r\n", static_cast<unsigned long>( length ) );
+	out += header;
+	out.append( data, length );
+	out += "\r\n";
+}
+
+/**
+ *     Connects socket to address, giving up after timeout milliseconds
+ */
+bool Connect( int socket, const sockaddr* address, socklen_t length, unsigned int timeout )
+{
+	int flags = fcntl( socket, F_GETFL );
+	fcntl( socket, F_SETFL, flags | O_NONBLOCK );
+	int result = connect( socket, address, length );
+	if ( result != 0 && errno == EINPROGRESS )
+	{
+		pollfd writable = { socket, POLLOUT, 0 };
+		int error = 0;
+		socklen_t errorLength = sizeof( error );
+		if ( poll( &writable, 1, timeout ) == 1 && getsockopt( socket, SOL_SOCKET, SO_ERROR, &error, &errorLength ) == 0 &&
+			error == 0 )
+			result = 0;
+	}
+	fcntl( socket, F_SETFL, flags );
+	return result == 0;
+}
+
+}; //namespace
+
+RedisCommand::RedisCommand( const string& name )
+	: m_count( 0 )
+{
+	*this << name;
+}
+
+RedisCommand& RedisCommand::operator<<( const string& argument )
+{
+	AppendBulk( m_arguments, argument.data(), argument.length() );
+	++m_count;
+	return *this;
+}
+
+RedisCommand& RedisCommand::operator<<( int64_t argument )
+{
+	char number[ 24 ];
+	int length = snprintf( number, sizeof( number ), "%lld", static_cast<long long>( argument ) );
+	AppendBulk( m_arguments, number, length );
+	++m_count;
+	return *this;
+}
+
+void RedisCommand::Serialize( string& out ) const
+{
+	char header[ 16 ];
+	snprintf( header, sizeof( header ), "*%u\r\n", m_count );
+	out += header;
+	out += m_arguments;
+}
+
+RedisConnection::RedisConnection( const string& host, unsigned short port, unsigned int timeout ) throw( RedisConnectionException )
+	: m_socket( -1 ), m_queued( 0 ), m_roundTrips( 0 ), m_bytesSent( 0 )
+{
+	std::ostringstream service;
+	service << port;
+	addrinfo hints, *found = NULL;
+	memset( &hints, 0, sizeof( hints ) );
+	hints.ai_family = AF_UNSPEC;
+	hints.ai_socktype = SOCK_STREAM;
+	if ( getaddrinfo( host.c_str(), service.str().c_str(), &hints, &found ) != 0 )
+		throw RedisConnectionException( "Could not resolve redis host " + host );
+	for ( addrinfo* address = found; address != NULL && m_socket < 0; address = address->ai_next )
+	{
+		m_socket = socket( address->ai_family, address->ai_socktype, address->ai_protocol );
+		if ( m_socket >= 0 && !Connect( m_socket, address->ai_addr, address->ai_addrlen, timeout ) )
+		{
+			close( m_socket );
+			m_socket = -1;
+		}
+	}
+	freeaddrinfo( found );
+	if ( m_socket < 0 )
+		throw RedisConnectionException( "Could not connect to redis at " + host + ":" + service.str() );
+
+	//Small commands, each waited on: don't let Nagle hold them back
+	int on = 1;
+	setsockopt( m_socket, IPPROTO_TCP, TCP_NODELAY, &on, sizeof( on ) );
+	timeval wait = { static_cast<time_t>( timeout / 1000 ), static_cast<suseconds_t>( timeout % 1000 * 1000 ) };
+	setsockopt( m_socket, SOL_SOCKET, SO_RCVTIMEO, &wait, sizeof( wait ) );
+	setsockopt( m_socket, SOL_SOCKET, SO_SNDTIMEO, &wait, sizeof( wait ) );
+}
+
+RedisConnection::~RedisConnection()
+{
+	if ( m_socket >= 0 )
+		close( m_socket );
+}
+
+void RedisConnection::Append( const RedisCommand& command )
+{
+	command.Serialize( m_out );
+	++m_queued;
+}
+
+size_t RedisConnection::Queued() const throw()
+{
+	return m_queued;
+}
+
+void RedisConnection::Flush( vector<RedisReply>& replies ) throw( RedisConnectionException )
+{
+	replies.clear();
+	if ( m_queued == 0 )
+		return;
+	if ( m_socket < 0 )
+		throw RedisConnectionException( "redis connection already failed" );
+
+	for ( size_t sent = 0; sent < m_out.length(); )
+	{
+		ssize_t written = send( m_socket, m_out.data() + sent, m_out.length() - sent, MSG_NOSIGNAL );
+		if ( written <= 0 )
+		{
+			if ( written < 0 && errno == EINTR )
+				continue;
+			Fail( string( "Could not send to redis: " ) + strerror( errno ) );
+		}
+		sent += written;
+	}
+	m_bytesSent += m_out.length();
+	m_out.clear();
+	++m_roundTrips;
+
+	replies.resize( m_queued );
+	size_t parsed = 0, position = 0;
+	char buffer[ 16384 ];
+	while ( parsed < m_queued )
+	{
+		if ( Parse( position, replies[parsed] ) )
+		{
+			++parsed;
+			continue;
+		}
+		ssize_t received = recv( m_socket, buffer, sizeof( buffer ), 0 );
+		if ( received < 0 && errno == EINTR )
+			continue;
+		if ( received == 0 )
+			Fail( "redis closed the connection" );
+		if ( received < 0 )
+			Fail( errno == EAGAIN || errno == EWOULDBLOCK ? string( "Timed out waiting for redis" ) :
+				string( "Could not receive from redis: " ) + strerror( errno ) );
+		m_in.append( buffer, received );
+	}
+	m_in.erase( 0, position );
+	m_queued = 0;
+}
+
+RedisReply RedisConnection::Run( const RedisCommand& command ) throw( RedisConnectionException )
+{
+	Append( command );
+	vector<RedisReply> replies;
+	Flush( replies );
+	return replies.back();
+}
+
+uint64_t RedisConnection::RoundTrips() const throw()
+{
+	return m_roundTrips;
+}
+
+uint64_t RedisConnection::BytesSent() const throw()
+{
+	return m_bytesSent;
+}
+
+bool RedisConnection::Parse( size_t& position, RedisReply& reply ) const throw( RedisConnectionException )
+{
+	string::size_type end = m_in.find( "\r\n", position );
+	if ( end == string::npos )
+		return false;
+	char type = m_in[position];
+	string line( m_in, position + 1, end - position - 1 );
+	size_t next = end + 2;
+	reply.elements.clear();
+	switch ( type )
+	{
+		case '+':
+		case '-':
+			reply.type = type == '+' ? RedisReply::REPLY_STATUS : RedisReply::REPLY_ERROR;
+			reply.text.swap( line );
+			break;
+		case ':':
+			reply.type = RedisReply::REPLY_INTEGER;
+			reply.integer = strtoll( line.c_str(), NULL, 10 );
+			break;
+		case '$':
+		{
+			long long length = strtoll( line.c_str(), NULL, 10 );
+			if ( length < 0 )
+			{
+				reply.type = RedisReply::REPLY_NIL;
+				break;
+			}
+			if ( next + length + 2 > m_in.length() )
+				return false;
+			reply.type = RedisReply::REPLY_BULK;
+			reply.text.assign( m_in, next, length );
+			next += length + 2;
+			break;
+		}
+		case '*':
+		{
+			long long count = strtoll( line.c_str(), NULL, 10 );
+			if ( count < 0 )
+			{
+				reply.type = RedisReply::REPLY_NIL;
+				break;
+			}
+			reply.type = RedisReply::REPLY_ARRAY;
+			reply.elements.resize( count );
+			for ( long long i = 0; i < count; ++i )
+				if ( !Parse( next, reply.elements[i] ) )
+					return false;
+			break;
+		}
+		default:
+			throw RedisConnectionException( "Unexpected reply from redis" );
+	}
+	position = next;
+	return true;
+}
+
+void RedisConnection::Fail( const string& what ) throw( RedisConnectionException )
+{
+	close( m_socket );
+	m_socket = -1;
+	m_out.clear();
+	m_in.clear();
+	m_queued = 0;
+	throw RedisConnectionException( what );
+}
+
+}; //namespace Sip
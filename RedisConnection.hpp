@@ -0,0 +1,154 @@
+#ifndef REDISCONNECTION_HPP
+#define REDISCONNECTION_HPP
+#include <stdexcept>
+#include <string>
+#include <vector>
+#include <stdint.h>
+
+namespace Sip {
+
+using std::string;
+using std::vector;
+using std::runtime_error;
+
+/**
+* \class RedisException
+* \brief An error reply from redis. The connection is still good.
+*/
+class RedisException : public runtime_error
+{
+	public:
+		RedisException ( std::string what ) throw() : runtime_error ( what ) {};
+};
+
+/**
+* \class RedisConnectionException
+* \brief The connection failed, timed out or got a reply it couldn't make sense of, and is no longer usable
+*/
+class RedisConnectionException : public RedisException
+{
+	public:
+		RedisConnectionException ( std::string what ) throw() : RedisException ( what ) {};
+};
+
+/**
+* \class RedisCommand
+* \brief One command, serialized as a RESP array of bulk strings as its arguments are added
+*/
+class RedisCommand
+{
+	public:
+		explicit RedisCommand( const string& name );
+
+		RedisCommand& operator<<( const string& argument );
+		RedisCommand& operator<<( int64_t argument );
+
+		/**
+		 *     Appends the command, in RESP, to out
+		 */
+		void Serialize( string& out ) const;
+
+	private:
+		string m_arguments; //Each as $length\r\nbytes\r\n
+		unsigned int m_count;
+};
+
+/**
+* \class RedisReply
+* \brief A parsed RESP reply
+*/
+struct RedisReply
+{
+	enum Type
+	{
+		REPLY_STATUS, //+OK, in text
+		REPLY_ERROR, //-ERR ..., in text
+		REPLY_INTEGER,
+		REPLY_BULK, //In text
+		REPLY_NIL,
+		REPLY_ARRAY //In elements
+	};
+
+	RedisReply() : type( REPLY_NIL ), integer( 0 ) {}
+
+	Type type;
+	string text;
+	int64_t integer;
+	vector<RedisReply> elements;
+};
+
+/**
+* \class RedisConnection
+* \brief A connection to redis that pipelines: commands are queued with Append(), and Flush() sends them all in one
+*        write and reads all their replies, so a batch of commands costs one round trip
+*
+* Speaks RESP over a blocking socket with a send and receive timeout. Any failure on the socket, or a reply that
+* doesn't parse, throws RedisConnectionException and leaves the connection unusable. Not thread safe; RedisPool gives
+* each thread its own.
+*/
+class RedisConnection
+{
+	public:
+		/**
+		 * @param timeout Milliseconds to wait for the connect, and for each send or receive after it
+		 * @throw RedisConnectionException if host doesn't resolve or the connect fails
+		 */
+		RedisConnection( const string& host, unsigned short port, unsigned int timeout = 1000 )
+			throw( RedisConnectionException );
+		~RedisConnection();
+
+		/**
+		 *     Queues a command for the next Flush()
+		 */
+		void Append( const RedisCommand& command );
+
+		/**
+		 *     Commands queued since the last Flush()
+		 */
+		size_t Queued() const throw();
+
+		/**
+		 *     Sends every queued command and reads their replies, in order, into replies. Error replies are replies
+		 *     like any other; it is up to the caller to look for them.
+		 */
+		void Flush( vector<RedisReply>& replies ) throw( RedisConnectionException );
+
+		/**
+		 *     Sends one command, and anything already queued, and returns its reply
+		 */
+		RedisReply Run( const RedisCommand& command ) throw( RedisConnectionException );
+
+		/**
+		 *     Flush() calls that sent something: round trips to redis
+		 */
+		uint64_t RoundTrips() const throw();
+
+		/**
+		 *     Bytes of commands sent
+		 */
+		uint64_t BytesSent() const throw();
+
+	private:
+		RedisConnection( const RedisConnection& );
+		RedisConnection& operator=( const RedisConnection& );
+
+		/**
+		 *     Parses the reply starting at position in m_in, advancing position past it
+		 * @return False if m_in doesn't yet hold all of it
+		 * @throw RedisConnectionException if it isn't RESP
+		 */
+		bool Parse( size_t& position, RedisReply& reply ) const throw( RedisConnectionException );
+
+		/**
+		 *     Closes the socket and throws
+		 */
+		void Fail( const string& what ) throw( RedisConnectionException );
+
+		int m_socket;
+		string m_out, m_in;
+		size_t m_queued;
+		uint64_t m_roundTrips, m_bytesSent;
+};
+
+}; //namespace Sip
+#endif //REDISCONNECTION_HPP
@@ -0,0 +1,150 @@
+#include "RedisPool.hpp"
+#include <sstream>
+#include <time.h>
+
+namespace Sip {
+
+namespace {
+const unsigned int FIRST_BACKOFF = 100;
+const unsigned int MAX_BACKOFF = 30000;
+}
+
+/**
+* \class RedisPool::Connection
+* \brief One thread's connection, or the lack of one and when to try again
+*/
+struct RedisPool::Connection
+{
+	Connection() : client( NULL ), lastUsed( 0 ), retryAt( 0 ), backoff( 0 ), broken( false ) {}
+	~Connection() { delete client; }
+
+	RedisConnection* client;
+	uint64_t lastUsed, retryAt;
+	unsigned int backoff;
+	bool broken;
+};
+
+RedisPool::Lease::Lease( RedisPool& pool ) throw( RedisPoolException )
+	: m_pool( pool ), m_connection( pool.Acquire() )
+{
+}
+
+RedisPool::Lease::~Lease()
+{
+	m_pool.Release( m_connection );
+}
+
+RedisConnection& RedisPool::Lease::operator*() const throw()
+{
+	return *m_connection.client;
+}
+
+RedisConnection* RedisPool::Lease::operator->() const throw()
+{
+	return m_connection.client;
+}
+
+void RedisPool::Lease::Broken() throw()
+{
+	m_connection.broken = true;
+}
+
+RedisPool::RedisPool( const string& host, unsigned short port, unsigned int healthCheck, unsigned int timeout ) throw()
+	: m_host( host ), m_port( port ), m_healthCheck( healthCheck ), m_timeout( timeout )
+{
+}
+
+RedisPool::Stats RedisPool::GetStats() const throw()
+{
+	boost::mutex::scoped_lock lock( m_statsMutex );
+	return m_stats;
+}
+
+uint64_t RedisPool::Now() throw()
+{
+	timespec now;
+	clock_gettime( CLOCK_MONOTONIC, &now );
+	return static_cast<uint64_t>( now.tv_sec ) * 1000 + now.tv_nsec / 1000000;
+}
+
+RedisPool::Connection& RedisPool::Acquire() throw( RedisPoolException )
+{
+	Connection* connection = m_connections.get();
+	if ( connection == NULL )
+	{
+		connection = new Connection;
+		m_connections.reset( connection );
+	}
+	uint64_t now = Now();
+
+	if ( connection->client != NULL && now - connection->lastUsed >= m_healthCheck )
+	{
+		bool healthy = true;
+		try
+		{
+			healthy = connection->client->Run( RedisCommand( "PING" ) ).type == RedisReply::REPLY_STATUS;
+		}
+		catch ( RedisConnectionException& )
+		{
+			healthy = false;
+		}
+		if ( !healthy )
+		{
+			delete connection->client;
+			connection->client = NULL;
+		}
+		boost::mutex::scoped_lock lock( m_statsMutex );
+		++m_stats.healthChecks;
+		if ( !healthy )
+			++m_stats.dropped;
+	}
+
+	if ( connection->client == NULL )
+	{
+		if ( now < connection->retryAt )
+		{
+			{
+				boost::mutex::scoped_lock lock( m_statsMutex );
+				++m_stats.refused;
+			}
+			throw RedisPoolException( "redis unavailable", ( connection->retryAt - now + 999 ) / 1000 );
+		}
+		try
+		{
+			connection->client = new RedisConnection( m_host, m_port, m_timeout );
+		}
+		catch ( RedisConnectionException& )
+		{
+			connection->backoff = connection->backoff == 0 ? FIRST_BACKOFF : connection->backoff * 2;
+			if ( connection->backoff > MAX_BACKOFF )
+				connection->backoff = MAX_BACKOFF;
+			connection->retryAt = now + connection->backoff;
+			{
+				boost::mutex::scoped_lock lock( m_statsMutex );
+				++m_stats.failures;
+			}
+			std::ostringstream what;
+			what << "Could not connect to redis at " << m_host << ':' << m_port;
+			throw RedisPoolException( what.str(), ( connection->backoff + 999 ) / 1000 );
+		}
+		connection->backoff = 0;
+		connection->lastUsed = now;
+		boost::mutex::scoped_lock lock( m_statsMutex );
+		++m_stats.connects;
+	}
+	return *connection;
+}
+
+void RedisPool::Release( Connection& connection ) throw()
+{
+	connection.lastUsed = Now();
+	if ( !connection.broken )
+		return;
+	connection.broken = false;
+	delete connection.client;
+	connection.client = NULL;
+	boost::mutex::scoped_lock lock( m_statsMutex );
+	++m_stats.dropped;
+}
+
+}; //namespace Sip
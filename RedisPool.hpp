@@ -0,0 +1,130 @@
+#ifndef REDISPOOL_HPP
+#define REDISPOOL_HPP
+#include <stdexcept>
+#include <string>
+#include <stdint.h>
+#include <boost/thread/mutex.hpp>
+#include <boost/thread/tss.hpp>
+#include "RedisConnection.hpp"
+
+namespace Sip {
+
+using std::string;
+using std::runtime_error;
+
+/**
+* \class RedisPoolException
+* \brief Thrown when no redis connection can be had: the server is down, and the pool is backing off
+*/
+class RedisPoolException : public runtime_error
+{
+	public:
+		RedisPoolException ( std::string what, unsigned int retryAfter ) throw()
+			: runtime_error ( what ), RetryAfter( retryAfter ) {};
+
+		/// Seconds until the pool tries to connect again
+		unsigned int RetryAfter;
+};
+
+/**
+* \class RedisPool
+* \brief Long lived redis connections, one per thread that asks for one, so no request pays for a connect
+*
+* A thread takes its connection with a Lease, and has it to itself: there is no lock on the way to redis. The
+* connection is made on the thread's first lease, and kept until the thread exits, the pool goes, or a command on it
+* fails with a RedisConnectionException; the user reports that with Lease::Broken(), and the next lease reconnects.
+*
+* A connection left idle longer than the health check interval is checked with a cheap command before it is leased,
+* since redis or a firewall in between may have closed it, and replaced if the check fails. A failed connect backs
+* off, doubling from 100 ms to 30 s; a lease wanted meanwhile throws RedisPoolException at once, without trying, so
+* a redis outage costs REGISTERs a refusal rather than a connect timeout each.
+*
+* The pool must outlive the threads that lease from it, or have them done with it before it goes.
+*/
+class RedisPool
+{
+	struct Connection;
+
+	public:
+		/**
+		* \class Stats
+		* \brief Running totals, over every thread's connection
+		*/
+		struct Stats
+		{
+			Stats() : connects( 0 ), failures( 0 ), dropped( 0 ), healthChecks( 0 ), refused( 0 ) {}
+			/// Connections made, and connects that failed
+			uint64_t connects, failures;
+			/// Connections let go after an error, from a command or a health check
+			uint64_t dropped, healthChecks;
+			/// Leases refused while backing off
+			uint64_t refused;
+		};
+
+		/**
+		* \class Lease
+		* \brief The calling thread's connection, for as long as the lease is in scope
+		*/
+		class Lease
+		{
+			public:
+				/**
+				 * @throw RedisPoolException if there is no connection, and none can be made now
+				 */
+				Lease( RedisPool& pool ) throw( RedisPoolException );
+				~Lease();
+
+				RedisConnection& operator*() const throw();
+				RedisConnection* operator->() const throw();
+
+				/**
+				 *     Lets the connection go when the lease ends: a command on it failed in a way that leaves it unusable
+				 */
+				void Broken() throw();
+
+			private:
+				Lease( const Lease& );
+				Lease& operator=( const Lease& );
+
+				RedisPool& m_pool;
+				Connection& m_connection;
+		};
+
+		/**
+		 * @param healthCheck Milliseconds a connection may sit idle before it is checked again on its next lease
+		 * @param timeout Milliseconds to wait for a connect, or for redis to answer, before giving the connection up
+		 */
+		RedisPool( const string& host = "localhost", unsigned short port = 6379, unsigned int healthCheck = 30000,
+			unsigned int timeout = 1000 ) throw();
+
+		Stats GetStats() const throw();
+
+		/**
+		 *     Milliseconds on a monotonic clock
+		 */
+		static uint64_t Now() throw();
+
+	private:
+		RedisPool( const RedisPool& );
+		RedisPool& operator=( const RedisPool& );
+
+		friend class Lease;
+
+		/**
+		 *     The calling thread's connection, connected and checked
+		 * @throw RedisPoolException if it can't be connected now
+		 */
+		Connection& Acquire() throw( RedisPoolException );
+		void Release( Connection& connection ) throw();
+
+		string m_host;
+		unsigned short m_port;
+		unsigned int m_healthCheck, m_timeout;
+		boost::thread_specific_ptr<Connection> m_connections;
+
+		mutable boost::mutex m_statsMutex;
+		Stats m_stats;
+};
+
+}; //namespace Sip
+#endif //REDISPOOL_HPP
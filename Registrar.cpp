@@ -1,24 +1,81 @@
 #include "Registrar.hpp"
 #include "SipRequest.hpp"
-#include "redis-cplusplus-client/redisclient.h"
+#include <boost/thread/thread_time.hpp>
 
 namespace Sip {
 //
 //GLOBAL DEFS
 //
 const char* SIP_MIN_EXPIRE = "300";
+//Seconds to tell a phone to wait after its connection failed: the next lease connects again at once
+const unsigned int SIP_CONNECTION_RETRY_AFTER = 1;
+
+/**
+* \class Registrar::Outcome
+* \brief What came of one REGISTER's commands
+*/
+struct Registrar::Outcome
+{
+	enum Kind
+	{
+		OUTCOME_WRITTEN, //replies holds the commands' replies
+		OUTCOME_UNAVAILABLE, //No connection, or it failed: error, and retryAfter to pass on
+		OUTCOME_FAILED //An error reply: error
+	};
+
+	Outcome() : kind( OUTCOME_WRITTEN ), retryAfter( 0 ) {}
+
+	Kind kind;
+	string error;
+	unsigned int retryAfter;
+	vector<RedisReply> replies;
+};
+
+/**
+* \class Registrar::Pending
+* \brief One REGISTER's commands, waiting for a batch to be written. Its leader sets outcome and done under
+*        m_batchMutex, and doesn't touch it after.
+*/
+struct Registrar::Pending
+{
+	Pending( const vector<RedisCommand>& commands ) : commands( commands ), done( false ) {}
+
+	const vector<RedisCommand>& commands;
+	Outcome outcome;
+	bool done;
+};
+
+Registrar::Registrar()
+	: m_ownPool( new RedisPool ), m_pool( *m_ownPool ), m_batchWindow( 0 ), m_batchLimit( 0 ), m_collecting( false ),
+	m_coalescing( true )
+{
+}
+
+Registrar::Registrar( RedisPool& pool )
+	: m_pool( pool ), m_batchWindow( 0 ), m_batchLimit( 0 ), m_collecting( false ),
+	m_coalescing( true )
+{
+}
+
+void Registrar::SetBatching( unsigned int window, unsigned int limit ) throw()
+{
+	m_batchWindow = window;
+	m_batchLimit = limit;
+}
+
+void Registrar::SetCoalescing( bool enabled ) throw()
+{
+	m_coalescing = enabled;
+}
 
 auto_ptr<SipResponse> Registrar::HandleRequest( const SipRequest& request ) {
 
 	auto_ptr<SipResponse> response( new SipResponse( 200, "OK", request ) );
 	try {
-		redis::client rc;
-
 		const string& endpoint_id = Sip::URI( request.GetHeaderValues( "to" )[0] ).User();
 		const string& uri = Sip::URI( request.GetHeaderValues( "contact" )[0] ).URIAsString();
 		ostringstream path;
 		path << "registrar:" << endpoint_id;
-		time_t expiration = time( NULL );
 		int toExpire = 3600;
 		if ( request.GetHeaderValues( "via" )[0].HasTag( "expires" ) )
 			toExpire = atoi( request.GetHeaderValues( "via" )[0].Tags().find( "expires" )->second.c_str() );
@@ -27,26 +84,52 @@ auto_ptr<SipResponse> Registrar::HandleRequest( const SipRequest& request ) {
 		if ( request.GetHeaderValues( "contact" )[0].Value() == "*" )  //Erase registration
 			toExpire = 0;
 
+		//Register (as long as expiration > SIP_MIN_EXPIRE )
+		if ( toExpire < atoi( SIP_MIN_EXPIRE ) && toExpire != 0) { //0 has informally become the way to de-register it seems
+			vector<SipHeaderValue> minExpires;
+			minExpires.push_back( SipHeaderValue( SIP_MIN_EXPIRE ) );
+			response->SetStatusCode( 423 );
+			response->SetReasonPhrase( "Interval too brief" );
+			response->SetHeader( "min-expires", minExpires );
+
+			return response;
+		}
+
+		vector<RedisCommand> commands;
+		vector<RedisReply> replies;
 		if ( toExpire == 0 ) {	//Unregister contact
-			rc.del( path.str() );  
+			m_fingerprints.Forget( path.str() );
+			commands.push_back( RedisCommand( "DEL" ) << path.str() );
+			Write( commands, replies );
+			return response;
 		}
-		else {	//Register (as long as expiration > SIP_MIN_EXPIRE )
-			if ( toExpire < atoi( SIP_MIN_EXPIRE ) && toExpire != 0) { //0 has informally become the way to de-register it seems
-				vector<SipHeaderValue> minExpires;
-				minExpires.push_back( SipHeaderValue( SIP_MIN_EXPIRE ) );
-				response->SetStatusCode( 423 );
-				response->SetReasonPhrase( "Interval too brief" );
-				response->SetHeader( "min-expires", minExpires );
 
+		const string callId( request.HasHeader( "call-id" ) ? request.GetHeaderValues( "call-id" )[0].Value() : "" );
+		uint64_t fingerprint = RegistrationFingerprints::Fingerprint( uri, callId, toExpire );
+		if ( m_coalescing && !callId.empty() && m_fingerprints.Matches( path.str(), fingerprint ) ) {
+			//A refresh of what we wrote last: keep it, for longer. 0 means redis no longer has it
+			commands.push_back( RedisCommand( "EXPIRE" ) << path.str() << toExpire );
+			Write( commands, replies );
+			if ( replies[0].integer == 1 )
 				return response;
-			}
-			//TODO: Set keys
-			rc.hset( path.str(), "uri", uri );
-			stringstream expire;
-			expire << toExpire;
-			rc.hset( path.str(), "expiration", expire.str() );
-			rc.expire( path.str(), toExpire );
+			commands.clear();
 		}
+
+		//Forgotten until written, in case the write fails
+		m_fingerprints.Forget( path.str() );
+		commands.push_back( RedisCommand( "MULTI" ) );
+		commands.push_back( RedisCommand( "HSET" ) << path.str() << "uri" << uri << "expiration" << toExpire );
+		commands.push_back( RedisCommand( "EXPIRE" ) << path.str() << toExpire );
+		commands.push_back( RedisCommand( "EXEC" ) );
+		Write( commands, replies );
+		if ( !callId.empty() )
+			m_fingerprints.Remember( path.str(), fingerprint );
+	} catch( RedisPoolException& err ) {
+		response->SetStatusCode( 503 );
+		response->SetReasonPhrase( "Service Unavailable" );
+		response->SetUInt( "retry-after", err.RetryAfter );
+
+		return response;
 	} catch( exception& err ) {
 		response->SetStatusCode( 500 );
 		response->SetReasonPhrase( err.what() );
@@ -57,5 +140,107 @@ auto_ptr<SipResponse> Registrar::HandleRequest( const SipRequest& request ) {
 	return response;
 }
 
-};
+void Registrar::Write( const vector<RedisCommand>& commands, vector<RedisReply>& replies )
+	throw( RedisException, RedisPoolException ) {
+	Pending mine( commands );
+	if ( m_batchLimit <= 1 ) {
+		vector<Outcome> outcomes;
+		Flush( vector<Pending*>( 1, &mine ), outcomes );
+		mine.outcome = outcomes.front();
+	}
+	else {
+		boost::mutex::scoped_lock lock( m_batchMutex );
+		//A full batch is about to go: wait for its leader to take it, then join or lead the next
+		while ( m_collecting && m_batch.size() >= m_batchLimit )
+			m_batchDone.wait( lock );
+		m_batch.push_back( &mine );
+		if ( m_collecting ) {	//Another REGISTER leads this batch, and writes it
+			if ( m_batch.size() >= m_batchLimit )
+				m_batchFull.notify_one();
+			while ( !mine.done )
+				m_batchDone.wait( lock );
+		}
+		else {	//Lead a new batch: wait for the others, then take it, so the next REGISTER starts another
+			m_collecting = true;
+			boost::system_time deadline = boost::get_system_time() + boost::posix_time::microseconds( m_batchWindow );
+			while ( m_batch.size() < m_batchLimit && m_batchFull.timed_wait( lock, deadline ) )
+				;
+			vector<Pending*> batch;
+			batch.swap( m_batch );
+			m_collecting = false;
+			m_batchDone.notify_all();
+			lock.unlock();
+
+			//Outcomes are built here and published under the lock: a follower's Pending is only ours until done
+			vector<Outcome> outcomes;
+			Flush( batch, outcomes );
+
+			lock.lock();
+			for ( size_t i = 0; i < batch.size(); ++i ) {
+				batch[i]->outcome.kind = outcomes[i].kind;
+				batch[i]->outcome.error.swap( outcomes[i].error );
+				batch[i]->outcome.retryAfter = outcomes[i].retryAfter;
+				batch[i]->outcome.replies.swap( outcomes[i].replies );
+				batch[i]->done = true;
+			}
+			m_batchDone.notify_all();
+		}
+	}
+
+	if ( mine.outcome.kind == Outcome::OUTCOME_UNAVAILABLE )
+		throw RedisPoolException( mine.outcome.error, mine.outcome.retryAfter );
+	if ( mine.outcome.kind == Outcome::OUTCOME_FAILED )
+		throw RedisException( mine.outcome.error );
+	replies.swap( mine.outcome.replies );
+}
 
+void Registrar::Flush( const vector<Pending*>& batch, vector<Outcome>& outcomes ) throw() {
+	Outcome all;
+	vector<RedisReply> replies;
+	try {
+		RedisPool::Lease rc( m_pool );
+		try {
+			for ( vector<Pending*>::const_iterator pending = batch.begin(); pending != batch.end(); ++pending )
+				for ( vector<RedisCommand>::const_iterator command = (*pending)->commands.begin();
+						command != (*pending)->commands.end(); ++command )
+					rc->Append( *command );
+			rc->Flush( replies );
+		} catch( RedisConnectionException& ) {	//The connection is no good; the next lease on this thread makes another
+			rc.Broken();
+			throw;
+		}
+	} catch( RedisPoolException& err ) {
+		all.kind = Outcome::OUTCOME_UNAVAILABLE;
+		all.error = err.what();
+		all.retryAfter = err.RetryAfter;
+	} catch( RedisConnectionException& err ) {
+		all.kind = Outcome::OUTCOME_UNAVAILABLE;
+		all.error = err.what();
+		all.retryAfter = SIP_CONNECTION_RETRY_AFTER;
+	} catch( exception& err ) {
+		all.kind = Outcome::OUTCOME_FAILED;
+		all.error = err.what();
+	}
+
+	//Each REGISTER's replies follow its commands'. A command refused inside MULTI fails the EXEC, but look at every
+	//reply anyway
+	outcomes.assign( batch.size(), all );
+	vector<RedisReply>::const_iterator reply = replies.begin();
+	for ( size_t i = 0; i < batch.size() && all.kind == Outcome::OUTCOME_WRITTEN; ++i ) {
+		Outcome& outcome = outcomes[i];
+		outcome.replies.assign( reply, reply + batch[i]->commands.size() );
+		for ( size_t j = 0; j < batch[i]->commands.size(); ++j, ++reply ) {
+			if ( reply->type == RedisReply::REPLY_ERROR ) {
+				outcome.kind = Outcome::OUTCOME_FAILED;
+				outcome.error = reply->text;
+			}
+			for ( vector<RedisReply>::const_iterator result = reply->elements.begin(); result != reply->elements.end(); ++result )
+				if ( result->type == RedisReply::REPLY_ERROR ) {
+					outcome.kind = Outcome::OUTCOME_FAILED;
+					outcome.error = result->text;
+				}
+		}
+	}
+}
+
+};
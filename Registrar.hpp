@@ -1,5 +1,10 @@
 #ifndef REGISTRAR_HPP
 #define REGISTRAR_HPP
+#include <memory>
+#include <vector>
+#include <boost/thread/condition_variable.hpp>
+#include "RedisPool.hpp"
+#include "RegistrationFingerprints.hpp"
 #include "UAS.hpp"
 
 namespace Sip {
@@ -8,12 +13,89 @@ namespace Sip {
 * @brief Handles REGISTER requests, adds appropriate entries to redis db
 * @details Sets registrar:ENDPOINTID (hash)
 * 					 uri (field, string)
-* 					 callid (field, string )
-* 					 expires (field, num ) 
+* 					 expiration (field, num, seconds )
+* 				with a TTL of expiration seconds, so redis drops the registration when it lapses. A de-registration
+* 				(Expires 0, or Contact *) deletes the key.
+*
+* Writes go through a RedisPool, so each thread handling REGISTERs keeps one connection rather than making one per
+* request. While redis is down and the pool backs off, or when the connection fails under a write, REGISTERs get 503
+* with Retry-After. An error reply from redis gets 500.
+*
+* Each REGISTER costs one round trip to redis: the hash and its TTL are set by MULTI, HSET, EXPIRE, EXEC sent in one
+* write, so they also land together, and no reader ever sees a registration without its TTL. HSET with several fields
+* needs redis 4.0 or later.
+*
+* With SetBatching(), REGISTERs handled at once on different threads share that round trip. The first to arrive
+* waits up to the window, or until the batch is full, and writes every REGISTER that joined in one pipeline; the rest
+* wait for it, and each gets its own answer. A registration storm then costs a round trip per batch rather than per
+* REGISTER, at the price of up to a window's wait when the registrar is quiet. Batches only form across threads, so
+* it pays when many workers (IngressWorkers, say) share one registrar.
+*
+* Most REGISTERs are refreshes, with the Contact, Call-ID and Expires of the last one. The registrar remembers a
+* fingerprint of what it last wrote for each key (RegistrationFingerprints), and for a refresh that matches only sends
+* EXPIRE, which batches like any other write. If the key has gone from redis meanwhile (it lapsed, or redis lost it),
+* EXPIRE says so and the registration is written in full. This assumes the registrar is the only writer of its keys;
+* where several registrars may write the same AOR, turn it off with SetCoalescing( false ).
 */
 class Registrar : public UAS {
 	public:
+		/**
+		 *     Uses a pool of its own, to redis on localhost
+		 */
+		Registrar();
+
+		/**
+		 *     Uses pool, which must outlive the registrar
+		 */
+		Registrar( RedisPool& pool );
+
 		auto_ptr<SipResponse> HandleRequest( const SipRequest& request );
+
+		/**
+		 *     Batches REGISTERs across threads: each waits up to window microseconds for others to join it, limit in
+		 *     all. A limit of 0 or 1 turns batching off, as it is by default. Set before requests arrive.
+		 */
+		void SetBatching( unsigned int window, unsigned int limit ) throw();
+
+		/**
+		 *     Whether refreshes that change nothing only extend the TTL; on by default. Set before requests arrive.
+		 */
+		void SetCoalescing( bool enabled ) throw();
+
+	private:
+		struct Outcome;
+		struct Pending;
+
+		/**
+		 *     Runs commands on redis, alone or in a batch, and checks their replies
+		 * @param replies Filled with the commands' replies
+		 * @throw RedisPoolException if there is no connection
+		 * @throw RedisException on an error reply or a failed connection
+		 */
+		void Write( const std::vector<RedisCommand>& commands, std::vector<RedisReply>& replies )
+			throw( RedisException, RedisPoolException );
+
+		/**
+		 *     Writes every pending REGISTER in one pipeline, and fills outcomes with each one's, in order. Reads only the
+		 *     pendings' commands.
+		 */
+		void Flush( const std::vector<Pending*>& batch, std::vector<Outcome>& outcomes ) throw();
+
+		Registrar( const Registrar& );
+		Registrar& operator=( const Registrar& );
+
+		std::auto_ptr<RedisPool> m_ownPool;
+		RedisPool& m_pool;
+
+		unsigned int m_batchWindow, m_batchLimit;
+		boost::mutex m_batchMutex;
+		/// Wakes a batch's leader when the batch fills; the rest when it is taken, and again when written
+		boost::condition_variable m_batchFull, m_batchDone;
+		std::vector<Pending*> m_batch;
+		bool m_collecting;
+
+		bool m_coalescing;
+		RegistrationFingerprints m_fingerprints;
 };
 }; //namespace Sip
 #endif //REGISTRAR_HPP
@@ -0,0 +1,106 @@
+#include "RegistrationFingerprints.hpp"
+#include <boost/thread/mutex.hpp>
+
+namespace Sip {
+
+namespace {
+
+size_t PowerOfTwo( size_t at_least )
+{
+	size_t size = 1;
+	while ( size < at_least )
+		size <<= 1;
+	return size;
+}
+
+}; //namespace
+
+/**
+* \class RegistrationFingerprints::Shard
+* \brief Some of the entries, and their lock
+*/
+struct RegistrationFingerprints::Shard
+{
+	Shard( size_t slots ) : entries( slots ) {}
+
+	boost::mutex mutex;
+	vector<Entry> entries;
+};
+
+RegistrationFingerprints::RegistrationFingerprints( size_t slots, size_t shards )
+{
+	shards = PowerOfTwo( shards );
+	slots = PowerOfTwo( slots );
+	m_slotsPerShard = slots > shards ? slots / shards : 1;
+	for ( size_t i = 0; i < shards; ++i )
+		m_shards.push_back( new Shard( m_slotsPerShard ) );
+}
+
+RegistrationFingerprints::~RegistrationFingerprints()
+{
+	for ( vector<Shard*>::iterator shard = m_shards.begin(); shard != m_shards.end(); ++shard )
+		delete *shard;
+}
+
+uint64_t RegistrationFingerprints::Fingerprint( const string& uri, const string& callId, int64_t expires ) throw()
+{
+	//Each part ends with a byte none of them can hold, so "a" + "bc" and "ab" + "c" differ
+	uint64_t hash = Hash( callId, Hash( string( 1, '\0' ), Hash( uri ) ) );
+	for ( int i = 0; i < 8; ++i )
+		hash = ( hash ^ ( static_cast<uint64_t>( expires ) >> ( i * 8 ) & 0xFF ) ) * 1099511628211ULL;
+	return hash == 0 ? 1 : hash;
+}
+
+bool RegistrationFingerprints::Matches( const string& key, uint64_t fingerprint ) const throw()
+{
+	uint64_t hash = Hash( key );
+	Shard& shard = ShardFor( hash );
+	boost::mutex::scoped_lock lock( shard.mutex );
+	const Entry& entry = shard.entries[ SlotFor( hash ) ];
+	return entry.key == hash && entry.fingerprint == fingerprint;
+}
+
+void RegistrationFingerprints::Remember( const string& key, uint64_t fingerprint ) throw()
+{
+	uint64_t hash = Hash( key );
+	Shard& shard = ShardFor( hash );
+	boost::mutex::scoped_lock lock( shard.mutex );
+	Entry& entry = shard.entries[ SlotFor( hash ) ];
+	entry.key = hash;
+	entry.fingerprint = fingerprint;
+}
+
+void RegistrationFingerprints::Forget( const string& key ) throw()
+{
+	uint64_t hash = Hash( key );
+	Shard& shard = ShardFor( hash );
+	boost::mutex::scoped_lock lock( shard.mutex );
+	Entry& entry = shard.entries[ SlotFor( hash ) ];
+	if ( entry.key == hash )
+		entry = Entry();
+}
+
+size_t RegistrationFingerprints::Slots() const throw()
+{
+	return m_shards.size() * m_slotsPerShard;
+}
+
+uint64_t RegistrationFingerprints::Hash( const string& data, uint64_t hash ) throw()
+{
+	for ( string::const_iterator c = data.begin(); c != data.end(); ++c )
+		hash = ( hash ^ static_cast<unsigned char>( *c ) ) * 1099511628211ULL;
+	return hash == 0 ? 1 : hash;
+}
+
+RegistrationFingerprints::Shard& RegistrationFingerprints::ShardFor( uint64_t key ) const throw()
+{
+	//The high bits pick the shard and the low bits the slot, so the two don't follow each other
+	return *m_shards[ ( key >> 32 ) & ( m_shards.size() - 1 ) ];
+}
+
+size_t RegistrationFingerprints::SlotFor( uint64_t key ) const throw()
+{
+	return key & ( m_slotsPerShard - 1 );
+}
+
+}; //namespace Sip
@@ -0,0 +1,79 @@
+#ifndef REGISTRATIONFINGERPRINTS_HPP
+#define REGISTRATIONFINGERPRINTS_HPP
+#include <cstddef>
+#include <string>
+#include <vector>
+#include <stdint.h>
+
+namespace Sip {
+
+using std::string;
+using std::vector;
+
+/**
+* \class RegistrationFingerprints
+* \brief What the registrar last wrote to redis for each registration key, as a 64 bit fingerprint of its Contact URI,
+*        Call-ID and expiry, so a refresh that changes none of them can be told apart from a new registration
+*
+* Entries are 16 bytes, a hash of the key and the fingerprint, in fixed arrays indexed by that hash. Two keys sharing
+* a slot push each other out, and the price of that is one extra full write on the next refresh of the key that lost.
+* The arrays are split into shards, each with its own lock.
+*
+* A fingerprint only says what this table was told; it can't know of writes made to redis by anyone else.
+*/
+class RegistrationFingerprints
+{
+	public:
+		/**
+		 * @param slots Keys kept at once, rounded up to a power of 2 and split over shards
+		 * @param shards Locks the table is split over, rounded up to a power of 2
+		 */
+		RegistrationFingerprints( size_t slots = 65536, size_t shards = 64 );
+		~RegistrationFingerprints();
+
+		/**
+		 *     The fingerprint of a registration; never 0
+		 */
+		static uint64_t Fingerprint( const string& uri, const string& callId, int64_t expires ) throw();
+
+		/**
+		 *     Whether key was last written with fingerprint
+		 */
+		bool Matches( const string& key, uint64_t fingerprint ) const throw();
+
+		/**
+		 *     Records that key was written with fingerprint
+		 */
+		void Remember( const string& key, uint64_t fingerprint ) throw();
+
+		/**
+		 *     Forgets key: it was deleted, or its write may not have happened
+		 */
+		void Forget( const string& key ) throw();
+
+		size_t Slots() const throw();
+
+	private:
+		RegistrationFingerprints( const RegistrationFingerprints& );
+		RegistrationFingerprints& operator=( const RegistrationFingerprints& );
+
+		struct Entry
+		{
+			Entry() : key( 0 ), fingerprint( 0 ) {}
+			uint64_t key, fingerprint; //0 for none
+		};
+		struct Shard;
+
+		/**
+		 *     FNV-1a over data, continuing from hash; never 0
+		 */
+		static uint64_t Hash( const string& data, uint64_t hash = 14695981039346656037ULL ) throw();
+		Shard& ShardFor( uint64_t key ) const throw();
+		size_t SlotFor( uint64_t key ) const throw();
+
+		vector<Shard*> m_shards;
+		size_t m_slotsPerShard;
+};
+
+}; //namespace Sip
+#endif //REGISTRATIONFINGERPRINTS_HPP
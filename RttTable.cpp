@@ -0,0 +1,151 @@
+#include "RttTable.hpp"
+#include <cstring>
+#include <netinet/in.h>
+#include "SipDefines.hpp"
+
+namespace Sip {
+
+RttTable::RttTable( size_t slots )
+	: m_privateMinimum( SIP_T1_PRIVATE ), m_minimum( SIP_T1 ), m_maximum( SIP_T2 )
+{
+	size_t size = 1;
+	while ( size < slots )
+		size <<= 1;
+	m_entries.resize( size );
+}
+
+void RttTable::SetBounds( uint64_t privateMinimum, uint64_t minimum, uint64_t maximum ) throw()
+{
+	m_privateMinimum = privateMinimum;
+	m_minimum = minimum;
+	m_maximum = maximum;
+}
+
+void RttTable::Sample( const sockaddr_storage& destination, uint64_t rtt ) throw()
+{
+	Entry key;
+	if ( !Key( destination, key ) )
+		return;
+	if ( rtt > static_cast<uint64_t>( SIP_TB ) )
+		rtt = SIP_TB;
+	Entry& entry = m_entries[ SlotFor( key ) ];
+	if ( !Same( entry, key ) || entry.srtt == 0 )
+	{
+		//First measurement: SRTT = R, RTTVAR = R/2 (RFC 6298 2.2); a zero RTT still has to mark the entry as measured
+		entry = key;
+		entry.srtt = rtt == 0 ? 1 : rtt << 3;
+		entry.rttvar = rtt << 1;
+		return;
+	}
+	//RTTVAR = 3/4 RTTVAR + 1/4 |SRTT - R|, then SRTT = 7/8 SRTT + 1/8 R (RFC 6298 2.3), in Jacobson's fixed point
+	int64_t error = static_cast<int64_t>( rtt ) - ( entry.srtt >> 3 );
+	int64_t srtt = static_cast<int64_t>( entry.srtt ) + error;
+	entry.srtt = srtt < 1 ? 1 : srtt;
+	if ( error < 0 )
+		error = -error;
+	entry.rttvar += error - ( entry.rttvar >> 2 );
+	entry.backoff = 0;
+}
+
+void RttTable::Backoff( const sockaddr_storage& destination ) throw()
+{
+	Entry key;
+	if ( !Key( destination, key ) )
+		return;
+	Entry& entry = m_entries[ SlotFor( key ) ];
+	if ( Same( entry, key ) && entry.srtt != 0 && entry.backoff < 16 && T1For( destination ) < m_maximum )
+		++entry.backoff;
+}
+
+uint64_t RttTable::T1For( const sockaddr_storage& destination ) const throw()
+{
+	const Entry* entry = Find( destination );
+	if ( entry == NULL )
+		return SIP_T1;
+	//RTO = SRTT + max( G, 4 * RTTVAR ), with a clock granularity G of 1 ms (RFC 6298 2.3)
+	uint64_t rto = ( entry->srtt >> 3 ) + ( entry->rttvar == 0 ? 1 : entry->rttvar );
+	uint64_t minimum = IsPrivate( destination ) ? m_privateMinimum : m_minimum;
+	if ( rto < minimum )
+		rto = minimum;
+	rto <<= entry->backoff;
+	return rto > m_maximum ? m_maximum : rto;
+}
+
+bool RttTable::Estimate( const sockaddr_storage& destination, double& srtt, double& rttvar ) const throw()
+{
+	const Entry* entry = Find( destination );
+	if ( entry == NULL )
+		return false;
+	srtt = entry->srtt / 8.0;
+	rttvar = entry->rttvar / 4.0;
+	return true;
+}
+
+bool RttTable::IsPrivate( const sockaddr_storage& address ) throw()
+{
+	uint32_t ipv4;
+	if ( address.ss_family == AF_INET6 )
+	{
+		const in6_addr& ipv6 = reinterpret_cast<const sockaddr_in6&>( address ).sin6_addr;
+		if ( IN6_IS_ADDR_LOOPBACK( &ipv6 ) || IN6_IS_ADDR_LINKLOCAL( &ipv6 ) || ( ipv6.s6_addr[0] & 0xFE ) == 0xFC )
+			return true;
+		if ( !IN6_IS_ADDR_V4MAPPED( &ipv6 ) )
+			return false;
+		memcpy( &ipv4, ipv6.s6_addr + 12, sizeof( ipv4 ) );
+	}
+	else if ( address.ss_family == AF_INET )
+		ipv4 = reinterpret_cast<const sockaddr_in&>( address ).sin_addr.s_addr;
+	else
+		return false;
+	ipv4 = ntohl( ipv4 );
+	return ( ipv4 >> 24 ) == 10 || ( ipv4 >> 24 ) == 127 || ( ipv4 >> 20 ) == 0xAC1 || ( ipv4 >> 16 ) == 0xC0A8 ||
+		( ipv4 >> 16 ) == 0xA9FE;
+}
+
+bool RttTable::Key( const sockaddr_storage& destination, Entry& key ) throw()
+{
+	memset( key.address, 0, sizeof( key.address ) );
+	key.family = destination.ss_family;
+	if ( destination.ss_family == AF_INET6 )
+	{
+		const sockaddr_in6& ipv6 = reinterpret_cast<const sockaddr_in6&>( destination );
+		memcpy( key.address, &ipv6.sin6_addr, sizeof( ipv6.sin6_addr ) );
+		key.port = ipv6.sin6_port;
+	}
+	else if ( destination.ss_family == AF_INET )
+	{
+		const sockaddr_in& ipv4 = reinterpret_cast<const sockaddr_in&>( destination );
+		memcpy( key.address, &ipv4.sin_addr, sizeof( ipv4.sin_addr ) );
+		key.port = ipv4.sin_port;
+	}
+	else
+		return false;
+	return true;
+}
+
+bool RttTable::Same( const Entry& a, const Entry& b ) throw()
+{
+	return a.family == b.family && a.port == b.port && memcmp( a.address, b.address, sizeof( a.address ) ) == 0;
+}
+
+size_t RttTable::SlotFor( const Entry& key ) const throw()
+{
+	//FNV-1a over the address and port
+	uint32_t hash = 2166136261u;
+	for ( size_t i = 0; i < sizeof( key.address ); ++i )
+		hash = ( hash ^ key.address[i] ) * 16777619u;
+	hash = ( hash ^ ( key.port & 0xFF ) ) * 16777619u;
+	hash = ( hash ^ ( key.port >> 8 ) ) * 16777619u;
+	return hash & ( m_entries.size() - 1 );
+}
+
+const RttTable::Entry* RttTable::Find( const sockaddr_storage& destination ) const throw()
+{
+	Entry key;
+	if ( !Key( destination, key ) )
+		return NULL;
+	const Entry& entry = m_entries[ SlotFor( key ) ];
+	return Same( entry, key ) && entry.srtt != 0 ? &entry : NULL;
+}
+
+}; //namespace Sip
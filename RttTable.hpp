@@ -0,0 +1,100 @@
+#ifndef RTTTABLE_HPP
+#define RTTTABLE_HPP
+#include <cstddef>
+#include <cstring>
+#include <vector>
+#include <stdint.h>
+#include <sys/socket.h>
+
+namespace Sip {
+
+using std::vector;
+
+/**
+* \class RttTable
+* \brief Measured round trip times by destination address and port, and the T1 each one calls for
+*
+* Each destination keeps a smoothed RTT and its variation as in RFC 6298, and T1 is the retransmission timeout they
+* give, SRTT + 4 * RTTVAR, held within bounds. A destination the table knows nothing about gets SIP_T1.
+*
+* The bounds are those of RFC 3261 17.1.1.1: T1 may be larger than 500 ms for a destination known to be slow, but
+* smaller only within a closed private network. So by default T1 comes down to SIP_T1_PRIVATE for loopback, link
+* local and private (RFC 1918, RFC 4193) addresses, and no lower than SIP_T1 elsewhere. It goes up to SIP_T2.
+*
+* Samples must follow Karn's algorithm: a response to a request that was retransmitted can't say which send it answers,
+* and is no sample. Backoff() doubles a destination's T1 instead when a request to it had to be retransmitted, so an
+* estimate that has become too small can't keep every request retransmitted, and go without samples, for good.
+*
+* The table is a fixed array, indexed by a hash of the destination, and a destination whose slot is taken evicts the
+* one there. Losing an estimate is harmless: that destination simply starts over from SIP_T1. Not thread safe.
+*/
+class RttTable
+{
+	public:
+		/**
+		 * @param slots Destinations kept at once, rounded up to a power of 2
+		 */
+		RttTable( size_t slots = 4096 );
+
+		/**
+		 *     Sets the bounds of T1: minimum for public destinations, privateMinimum for private ones, maximum for all
+		 */
+		void SetBounds( uint64_t privateMinimum, uint64_t minimum, uint64_t maximum ) throw();
+
+		/**
+		 *     Adds a round trip measured to destination, in milliseconds, and clears its backoff
+		 */
+		void Sample( const sockaddr_storage& destination, uint64_t rtt ) throw();
+
+		/**
+		 *     Doubles destination's T1 until its next sample, up to the maximum. A destination without an estimate
+		 *     stays at SIP_T1.
+		 */
+		void Backoff( const sockaddr_storage& destination ) throw();
+
+		/**
+		 * @return The initial retransmission interval for a request to destination, in milliseconds
+		 */
+		uint64_t T1For( const sockaddr_storage& destination ) const throw();
+
+		/**
+		 *     The smoothed RTT and variation for destination, in milliseconds
+		 * @return False if the table has no estimate for it
+		 */
+		bool Estimate( const sockaddr_storage& destination, double& srtt, double& rttvar ) const throw();
+
+		/**
+		 *     Whether address is loopback, link local or private, and so taken to be in a closed network
+		 */
+		static bool IsPrivate( const sockaddr_storage& address ) throw();
+
+	private:
+		struct Entry
+		{
+			Entry() : family( 0 ), port( 0 ), srtt( 0 ), rttvar( 0 ), backoff( 0 ) { memset( address, 0, sizeof( address ) ); }
+			uint8_t address[16];
+			uint16_t family, port;
+			uint32_t srtt; //In 1/8 ms, as RFC 6298's alpha is 1/8
+			uint32_t rttvar; //In 1/4 ms, as beta is 1/4
+			uint8_t backoff; //Doublings since the last sample
+		};
+
+		/**
+		 *     Fills key from destination
+		 * @return False if it isn't IPv4 or IPv6
+		 */
+		static bool Key( const sockaddr_storage& destination, Entry& key ) throw();
+		static bool Same( const Entry& a, const Entry& b ) throw();
+		size_t SlotFor( const Entry& key ) const throw();
+
+		/**
+		 *     The entry for destination, or NULL
+		 */
+		const Entry* Find( const sockaddr_storage& destination ) const throw();
+
+		vector<Entry> m_entries;
+		uint64_t m_privateMinimum, m_minimum, m_maximum;
+};
+
+}; //namespace Sip
+#endif //RTTTABLE_HPP
@@ -0,0 +1,240 @@
+#include "ServerTransaction.hpp"
+#include <algorithm>
+#include "SipDefines.hpp"
+
+namespace Sip {
+
+ServerTransactions::ServerTransactions( TransactionSender& sender ) throw()
+	: m_sender( sender )
+{
+}
+
+bool ServerTransactions::Receive( const SipRequest& request, const sockaddr_storage& source, bool reliable, uint64_t now ) throw()
+{
+	TransactionKey key;
+	if ( !TransactionKey::For( request, key ) )
+	{
+		++m_stats.unkeyed;
+		return false;
+	}
+	SlabHandle handle;
+	Transaction* transaction;
+
+	if ( key.method == SipRequest::REQUEST_METHOD_ACK )
+	{
+		//An ACK for a failure belongs to the INVITE's transaction (17.2.3); one for a 2xx is the UAS's
+		key.method = SipRequest::REQUEST_METHOD_INVITE;
+		transaction = Find( key, handle );
+		if ( transaction == NULL || ( transaction->state != STATE_COMPLETED && transaction->state != STATE_CONFIRMED ) )
+			return false;
+		++m_stats.acks;
+		if ( transaction->state == STATE_COMPLETED )
+		{
+			transaction->state = STATE_CONFIRMED;
+			Stop( *transaction, TIMER_RETRANSMIT );
+			Stop( *transaction, TIMER_TIMEOUT );
+			Linger( handle, *transaction, now, SIP_TI );
+		}
+		return true;
+	}
+
+	if ( ( transaction = Find( key, handle ) ) != NULL )
+	{
+		++m_stats.absorbed;
+		//An INVITE retransmitted before the UAS has said anything has waited longer than the 200 ms RFC 3261 17.2.1
+		//allows without a 100 Trying; send one now, and keep it for further retransmissions, so the UAC stops
+		if ( transaction->invite && transaction->response.empty() && transaction->state == STATE_PROCEEDING )
+		{
+			try
+			{
+				transaction->response = SipResponse( 100, "Trying", request ).ToString();
+				++m_stats.trying;
+			}
+			catch ( std::exception& e )
+			{
+				transaction->response.clear();
+			}
+		}
+		if ( !transaction->response.empty() && transaction->state != STATE_CONFIRMED &&
+			m_sender.Send( transaction->response, transaction->destination ) )
+			++m_stats.retransmissions;
+		return true;
+	}
+
+	handle = m_transactions.Acquire();
+	transaction = m_transactions.Get( handle );
+	transaction->key = key;
+	transaction->destination = source;
+	transaction->invite = key.method == SipRequest::REQUEST_METHOD_INVITE;
+	transaction->reliable = reliable;
+	transaction->state = transaction->invite ? STATE_PROCEEDING : STATE_TRYING;
+	transaction->response.clear();
+	transaction->interval = SIP_T1;
+	std::fill( transaction->timers, transaction->timers + 3, SlabHandle() );
+	m_byKey[key] = handle;
+	++m_stats.created;
+	//Not in RFC 3261, which trusts the UAS to answer; a request it drops mustn't hold its transaction forever
+	Schedule( handle, *transaction, TIMER_TIMEOUT, now, SIP_TH );
+	return false;
+}
+
+bool ServerTransactions::Respond( const SipRequest& request, const SipResponse& response, const sockaddr_storage& destination,
+	uint64_t now ) throw()
+{
+	TransactionKey key;
+	SlabHandle handle;
+	Transaction* transaction = NULL;
+	if ( TransactionKey::For( request, key ) && key.method != SipRequest::REQUEST_METHOD_ACK )
+		transaction = Find( key, handle );
+	//Only the first final response is kept; anything after it just goes out
+	if ( transaction != NULL && transaction->state != STATE_TRYING && transaction->state != STATE_PROCEEDING )
+		transaction = NULL;
+
+	string unkept;
+	string& bytes = transaction != NULL ? transaction->response : unkept;
+	try
+	{
+		if ( response.RawMessageCurrent() )
+			bytes = response.GetOriginalRawMessage();
+		else
+			bytes = response.ToString();
+	}
+	catch ( std::exception& e )
+	{
+		bytes.clear();
+		return false;
+	}
+	if ( transaction == NULL )
+		return m_sender.Send( bytes, destination );
+
+	transaction->destination = destination;
+	bool sent = m_sender.Send( bytes, destination );
+	int code = response.StatusCode();
+	if ( code < 200 )
+	{
+		transaction->state = STATE_PROCEEDING;
+		//A call may ring for longer than 64*T1; each provisional pushes the give-up out to Timer C instead
+		if ( transaction->invite )
+			Schedule( handle, *transaction, TIMER_TIMEOUT, now, SIP_TC );
+	}
+	else if ( !transaction->invite )
+	{
+		transaction->state = STATE_COMPLETED;
+		Stop( *transaction, TIMER_TIMEOUT );
+		Linger( handle, *transaction, now, SIP_TJ );
+	}
+	else if ( code < 300 )
+	{
+		//Timer L holds regardless of transport: retransmitted INVITEs may come by another route (RFC 6026 8.7)
+		transaction->state = STATE_ACCEPTED;
+		Stop( *transaction, TIMER_TIMEOUT );
+		Schedule( handle, *transaction, TIMER_LINGER, now, SIP_TL );
+	}
+	else
+	{
+		transaction->state = STATE_COMPLETED;
+		if ( !transaction->reliable )
+			Schedule( handle, *transaction, TIMER_RETRANSMIT, now, SIP_T1 );
+		Schedule( handle, *transaction, TIMER_TIMEOUT, now, SIP_TH );
+	}
+	return sent;
+}
+
+void ServerTransactions::RunTimers( uint64_t now ) throw()
+{
+	m_wheel.Advance( now, m_expired );
+	for ( vector<TimingWheel::Expired>::iterator due = m_expired.begin(); due != m_expired.end(); ++due )
+	{
+		//A timer stopped by an earlier one in this batch is still here, but no longer the transaction's
+		Transaction* transaction = m_transactions.Get( due->target );
+		if ( transaction == NULL || transaction->timers[due->kind] != due->timer )
+			continue;
+		transaction->timers[due->kind] = SlabHandle();
+		Fire( due->target, *transaction, static_cast<Timer>( due->kind ), now );
+	}
+	m_expired.clear();
+}
+
+bool ServerTransactions::NextTimer( uint64_t& when ) const throw()
+{
+	return m_wheel.Next( when );
+}
+
+ServerTransactions::State ServerTransactions::GetState( const SipRequest& request ) throw()
+{
+	TransactionKey key;
+	SlabHandle handle;
+	Transaction* transaction = TransactionKey::For( request, key ) ? Find( key, handle ) : NULL;
+	return transaction == NULL ? STATE_TERMINATED : transaction->state;
+}
+
+size_t ServerTransactions::Size() const throw()
+{
+	return m_transactions.Size();
+}
+
+const ServerTransactions::Stats& ServerTransactions::GetStats() const throw()
+{
+	return m_stats;
+}
+
+ServerTransactions::Transaction* ServerTransactions::Find( const TransactionKey& key, SlabHandle& handle ) throw()
+{
+	Table::iterator found = m_byKey.find( key );
+	if ( found == m_byKey.end() )
+		return NULL;
+	handle = found->second;
+	return m_transactions.Get( handle );
+}
+
+void ServerTransactions::Schedule( SlabHandle handle, Transaction& transaction, Timer timer, uint64_t now, uint64_t delay )
+{
+	m_wheel.Cancel( transaction.timers[timer] );
+	transaction.timers[timer] = m_wheel.Schedule( now, now + delay, handle, timer );
+}
+
+void ServerTransactions::Stop( Transaction& transaction, Timer timer ) throw()
+{
+	m_wheel.Cancel( transaction.timers[timer] );
+	transaction.timers[timer] = SlabHandle();
+}
+
+void ServerTransactions::Linger( SlabHandle handle, Transaction& transaction, uint64_t now, int linger )
+{
+	//Over a reliable transport no retransmissions are coming, so Timer I and J are zero (17.2.1, 17.2.2)
+	Schedule( handle, transaction, TIMER_LINGER, now, transaction.reliable ? 0 : linger );
+}
+
+void ServerTransactions::Fire( SlabHandle handle, Transaction& transaction, Timer timer, uint64_t now ) throw()
+{
+	switch ( timer )
+	{
+		case TIMER_RETRANSMIT:
+			if ( m_sender.Send( transaction.response, transaction.destination ) )
+				++m_stats.retransmissions;
+			transaction.interval = std::min<uint64_t>( transaction.interval * 2, SIP_T2 );
+			Schedule( handle, transaction, TIMER_RETRANSMIT, now, transaction.interval );
+			break;
+		case TIMER_TIMEOUT:
+			if ( transaction.state == STATE_COMPLETED )
+				++m_stats.timeouts;
+			else
+				++m_stats.abandoned;
+			Terminate( handle, transaction );
+			break;
+		case TIMER_LINGER:
+			Terminate( handle, transaction );
+			break;
+	}
+}
+
+void ServerTransactions::Terminate( SlabHandle handle, Transaction& transaction ) throw()
+{
+	m_byKey.erase( transaction.key );
+	for ( unsigned int timer = 0; timer < 3; ++timer )
+		Stop( transaction, static_cast<Timer>( timer ) );
+	transaction.state = STATE_TERMINATED;
+	m_transactions.Release( handle );
+}
+
+}; //namespace Sip
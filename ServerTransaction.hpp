@@ -0,0 +1,146 @@
+#ifndef SERVERTRANSACTION_HPP
+#define SERVERTRANSACTION_HPP
+#include <string>
+#include <stdint.h>
+#include <boost/unordered_map.hpp>
+#include "HandleSlab.hpp"
+#include "SipResponse.hpp"
+#include "TimingWheel.hpp"
+#include "Transaction.hpp"
+
+namespace Sip {
+
+/**
+* \class ServerTransactions
+* \brief The server transactions of RFC 3261 17.2, INVITE and non-INVITE, keyed by branch, sent-by and method, which
+*        absorb retransmitted requests so the UAS sees each request once
+*
+* Pass every request to Receive() before the UAS; one it returns true for has been dealt with. A retransmission gets
+* the last response sent for its transaction, re-sent from the bytes serialized when the UAS answered, or nothing if
+* the UAS hasn't answered yet; a retransmitted INVITE the UAS hasn't answered gets a 100 Trying made for it, which is
+* kept like any other response. The UAS answers through Respond(), which keeps what it sends.
+*
+* A non-INVITE transaction keeps its final response until Timer J. An INVITE transaction answered with a failure
+* retransmits it on Timer G until the ACK comes, which is absorbed, or Timer H; one answered with a 2xx absorbs
+* retransmitted INVITEs until Timer L (RFC 6026). A request the UAS never answers is forgotten after 64*T1, or for an
+* INVITE, Timer C after its last provisional response.
+*
+* Time is whatever the caller says it is, in milliseconds; timers are in a TimingWheel of the table's own. Not thread
+* safe.
+*/
+class ServerTransactions
+{
+	public:
+		enum State
+		{
+			STATE_TRYING, //non-INVITE, before any response
+			STATE_PROCEEDING,
+			STATE_COMPLETED,
+			STATE_CONFIRMED, //INVITE, failure ACKed
+			STATE_ACCEPTED, //INVITE, answered with a 2xx
+			STATE_TERMINATED
+		};
+
+		/**
+		* \class Stats
+		* \brief Running totals
+		*/
+		struct Stats
+		{
+			Stats() : created( 0 ), absorbed( 0 ), retransmissions( 0 ), acks( 0 ), timeouts( 0 ), abandoned( 0 ),
+				unkeyed( 0 ), trying( 0 ) {}
+			/// Transactions started, and retransmitted requests kept from the UAS
+			uint64_t created, absorbed;
+			/// Responses re-sent, for retransmitted requests or on Timer G
+			uint64_t retransmissions;
+			/// ACKs absorbed, failures never ACKed before Timer H, and requests the UAS never answered
+			uint64_t acks, timeouts, abandoned;
+			/// Requests with no branch, passed through without a transaction
+			uint64_t unkeyed;
+			/// 100 Trying made for retransmitted INVITEs the UAS hadn't answered yet
+			uint64_t trying;
+		};
+
+		ServerTransactions( TransactionSender& sender ) throw();
+
+		/**
+		 *     Matches request to its transaction, or starts one for it
+		 * @param source Where it came from; responses go there until Respond() says otherwise
+		 * @param reliable Whether it came over a reliable transport, which turns off Timer G and shortens the linger
+		 * @return True if request was a retransmission or an ACK for a failure, and is dealt with; false if it is new,
+		 *         or has no transaction, and goes to the UAS
+		 */
+		bool Receive( const SipRequest& request, const sockaddr_storage& source, bool reliable, uint64_t now ) throw();
+
+		/**
+		 *     Sends the UAS's response to request, keeping it for retransmissions of the request. A request without a
+		 *     transaction has its response sent and nothing kept.
+		 * @return False if it couldn't be serialized or sent
+		 */
+		bool Respond( const SipRequest& request, const SipResponse& response, const sockaddr_storage& destination,
+			uint64_t now ) throw();
+
+		/**
+		 *     Fires every timer due by now
+		 */
+		void RunTimers( uint64_t now ) throw();
+
+		/**
+		 *     When RunTimers() next has something to do. It may be early, never late.
+		 * @return False if no timer is pending
+		 */
+		bool NextTimer( uint64_t& when ) const throw();
+
+		/**
+		 * @return The state of request's transaction; STATE_TERMINATED if it has none
+		 */
+		State GetState( const SipRequest& request ) throw();
+
+		/**
+		 *     Transactions not yet terminated
+		 */
+		size_t Size() const throw();
+
+		const Stats& GetStats() const throw();
+
+	private:
+		ServerTransactions( const ServerTransactions& );
+		ServerTransactions& operator=( const ServerTransactions& );
+
+		enum Timer
+		{
+			TIMER_RETRANSMIT, //G
+			TIMER_TIMEOUT, //H, or the UAS never answering
+			TIMER_LINGER //I, J, L
+		};
+
+		struct Transaction
+		{
+			TransactionKey key;
+			sockaddr_storage destination;
+			bool invite, reliable;
+			State state;
+			string response; //The last sent, serialized
+			uint64_t interval; //Until the next retransmission after this one
+			SlabHandle timers[3]; //By Timer, in m_wheel; invalid when not running
+		};
+
+		typedef boost::unordered_map<TransactionKey, SlabHandle> Table;
+
+		Transaction* Find( const TransactionKey& key, SlabHandle& handle ) throw();
+		void Schedule( SlabHandle handle, Transaction& transaction, Timer timer, uint64_t now, uint64_t delay );
+		void Stop( Transaction& transaction, Timer timer ) throw();
+		void Linger( SlabHandle handle, Transaction& transaction, uint64_t now, int linger );
+		void Fire( SlabHandle handle, Transaction& transaction, Timer timer, uint64_t now ) throw();
+		void Terminate( SlabHandle handle, Transaction& transaction ) throw();
+
+		TransactionSender& m_sender;
+		HandleSlab<Transaction> m_transactions;
+		Table m_byKey;
+		TimingWheel m_wheel;
+		vector<TimingWheel::Expired> m_expired;
+		Stats m_stats;
+};
+
+}; //namespace Sip
+#endif //SERVERTRANSACTION_HPP
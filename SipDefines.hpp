@@ -7,6 +7,8 @@ namespace Sip {
 const int SIP_T1 = 500;
 const int SIP_T2 = SIP_T1 * 4;
 const int SIP_T4 = 4000;
+//The least T1 may come down to for a destination in a closed private network, from its measured RTT ( 17.1.1.1 )
+const int SIP_T1_PRIVATE = 50;
 
 const int SIP_TB = SIP_T1 * 64;
 const int SIP_TH = SIP_T1 * 64;
@@ -15,10 +17,23 @@ const int SIP_TF = SIP_T1 * 64;
 const int SIP_TK = SIP_T4;
 const int SIP_TI = SIP_T4;
 const int SIP_TJ = SIP_T1 * 64;
+const int SIP_TL = SIP_T1 * 64; //RFC 6026, 8.7
+const int SIP_TC = 3 * 60 * 1000 + SIP_T1; //"Greater than 3 minutes", for an INVITE that has had a provisional ( 16.6 )
 
 
 const int DEFAULT_UDP_LISTENPORT = 5060;
-const int BUFFERSIZE = 2048; // Shouldn't need more than 1500 bytes for a UDP datagram, but whatever...
+const int DEFAULT_TLS_LISTENPORT = 5061;
+
+//Hard limits on what the parser will accept. Parsing is linear in message size; these bound the work and
+//memory a single crafted message can cost. Exceeding any of them makes the message unparseable.
+const unsigned int SIP_MAX_MESSAGE_SIZE = 65535;	// Largest UDP payload; stream transports frame to the same limit
+const unsigned int SIP_MAX_HEADERS = 128;			// Header lines per message
+const unsigned int SIP_MAX_HEADER_VALUES = 64;		// Comma separated values per header line
+const unsigned int SIP_MAX_PARAMETERS = 32;		// ;parameters per header value or URI
+
+//Pooled receive buffer size. Nearly every datagram fits one MTU; larger ones, up to SIP_MAX_MESSAGE_SIZE, are still
+//received whole but are copied out of the overflow area.
+const unsigned int SIP_RECEIVE_SLAB_SIZE = 4096;
 
 enum TRANSPORT_PROTOCOL
 {
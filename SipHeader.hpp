@@ -16,8 +16,12 @@ namespace Sip {
 class SipHeader
 {
 	public:
+		SipHeader() : raw_offset( string::npos ), raw_length( 0 ) {}
+
 		string header_name;
 		vector<SipHeaderValue> shvs;
+		/// Position and length of the value field in the raw message it was parsed from; raw_offset is npos if unknown or stale
+		string::size_type raw_offset, raw_length;
 
 		bool operator==( const string& header_name ) const {
 			return !( strcasecmp( this->header_name.c_str(), header_name.c_str() ) );
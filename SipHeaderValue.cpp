@@ -1,5 +1,4 @@
 #include "SipHeaderValue.hpp"
-#include <boost/regex.hpp>
 #include "SipUtility.hpp"
 #include "Via.hpp"
 #include <sstream>
@@ -7,70 +6,60 @@
 namespace Sip {
 
 SipHeaderValue::SipHeaderValue( const string& value,  map<string, string> tags) throw()
-	: m_hasTags( true ), m_tags( tags )
+	: m_hasTags( true ), m_tags( tags ), m_hasUInt( false ), m_uint( 0 )
 {
 		//Trim whitespace from value
-		boost::regex trimWS( "^\\s+|\\s+$" );
-		m_value = boost::regex_replace( value, trimWS, "" );
+		m_value = Utility::Trim( value );
 }
 SipHeaderValue::SipHeaderValue( const string& rawValue ) throw()
-	: m_hasTags( false ), m_value( rawValue )
+	: m_hasTags( false ), m_value( rawValue ), m_hasUInt( false ), m_uint( 0 )
 {
-	boost::regex semiURICheck( "^((?:\".*?\")|(?:[^<\"]+))?\\s*<" );
-	//Used to match with one or more tags
-	boost::regex tagsAreaMatch( "((?:;[^;\\?]+)*)(?:\\?.*)?$" );
-	//Ok, check if there is a uri that might so we can ignore inner semicolons
-	boost::cmatch matches;
-	string rawTags;
-	try
+	//Ok, check if there is a uri that might so we can ignore inner semicolons: [ quoted-string | display name ] *WS "<"
+	bool bracketed = false;
+	if ( !rawValue.empty() && rawValue[0] == '"' )
 	{
-		if ( boost::regex_search( rawValue.c_str(), matches, semiURICheck ) )
-		{ //Ok, lets weed out the area within the <>
-			//Find position of >. If not found, throw and exception.
-			//grab from > to first semicolon or end, that will be 'value'
-			//if a semicolon is found, everything including and after that will be raw tags.
-			string::size_type rightBracketPosition = rawValue.find( '>', 0 );
-			if ( rightBracketPosition == string::npos )
-				throw 1; //Just set m_value to rawValue...
-
-			if ( boost::regex_search( (char * ) (rawValue.c_str() + rightBracketPosition), matches, tagsAreaMatch ) && string( matches[1].first, matches[1].second ) != "" )
-			{
-				rawTags = string( matches[1].first, matches[1].second );
-				m_value = string( rawValue.c_str(), matches[1].first );
-			}
-			else
-			{ //No tags found, whole rawValue is just a value
-				rawTags = "";
-				m_value = rawValue;
-			}
-		}
-		else
-		{ //Should be safe to assume semis only used for tags
-			if ( boost::regex_search( rawValue.c_str(), matches, tagsAreaMatch )  && string( matches[1].first, matches[1].second ) != "" )
-			{
-				rawTags = string( matches[1].first, matches[1].second );
-				m_value  = string( rawValue.c_str(), matches[1].first );
-			}
-			else
-			{
-				rawTags = "";
-				m_value  = rawValue;
-			}
+		for ( string::size_type quote = rawValue.find( '"', 1 ); !bracketed && quote != string::npos; quote = rawValue.find( '"', quote + 1 ) )
+		{
+			string::size_type next = quote + 1;
+			while ( next < rawValue.length() && Utility::IsSpace( rawValue[next] ) )
+				++next;
+			bracketed = next < rawValue.length() && rawValue[next] == '<';
 		}
 	}
-	catch (...)
+	else
 	{
-		m_value  = rawValue;
+		string::size_type leftBracket = rawValue.find_first_of( "<\"" );
+		bracketed = leftBracket != string::npos && rawValue[leftBracket] == '<';
 	}
+
+	string::size_type tagsBegin = string::npos, tagsEnd;
+	if ( bracketed )
+	{ //Ok, lets weed out the area within the <>
+		//grab from > to first semicolon or end, that will be 'value'
+		//if a semicolon is found, everything including and after that will be raw tags.
+		//No > at all, and the whole thing is just the value
+		string::size_type rightBracketPosition = rawValue.find( '>', 0 );
+		if ( rightBracketPosition != string::npos )
+			tagsBegin = Utility::FindTags( rawValue, rightBracketPosition, tagsEnd );
+	}
+	else //Should be safe to assume semis only used for tags
+		tagsBegin = Utility::FindTags( rawValue, 0, tagsEnd );
+
+	string rawTags;
+	if ( tagsBegin != string::npos )
+	{
+		rawTags = rawValue.substr( tagsBegin, tagsEnd - tagsBegin );
+		m_value = rawValue.substr( 0, tagsBegin );
+	}
+
 	//Trim whitespace from value
-	boost::regex trimWS( "^\\s+|\\s+$" );
-	m_value = boost::regex_replace( m_value, trimWS, "" );
+	m_value = Utility::Trim( m_value );
 
 	// At this point, we need thave the value and rawTags seperate and cleaned up
 
 	if ( rawTags != "" )
 	{
-		Utility::FillTags( rawTags, m_tags );
+		Utility::FillTags( rawTags, m_tags ); //Parameters past SIP_MAX_PARAMETERS are dropped; this constructor can't throw
 		m_hasTags = true;
 	}
 }
@@ -102,6 +91,50 @@ const string& SipHeaderValue::Value() const throw()
 void SipHeaderValue::SetValue( const string& newValue ) throw()
 {
 	m_value = newValue;
+	m_hasUInt = false;
+}
+
+bool SipHeaderValue::UIntValue( unsigned int& number ) const throw()
+{
+	if ( !m_hasUInt )
+	{
+		if ( m_value.empty() || m_value.length() > 10 )
+			return false;
+
+		unsigned long long parsed = 0;
+		for ( string::const_iterator digit = m_value.begin(); digit != m_value.end(); ++digit )
+		{
+			if ( *digit < '0' || *digit > '9' )
+				return false;
+			parsed = parsed * 10 + ( *digit - '0' );
+		}
+
+		if ( parsed > 0xFFFFFFFFULL )
+			return false;
+
+		m_uint = static_cast<unsigned int>( parsed );
+		m_hasUInt = true;
+	}
+
+	number = m_uint;
+	return true;
+}
+
+void SipHeaderValue::SetUIntValue( unsigned int number ) throw()
+{
+	char digits[ 10 ];
+	char* first = digits + sizeof( digits );
+	unsigned int remaining = number;
+
+	do
+	{
+		*--first = '0' + ( remaining % 10 );
+		remaining /= 10;
+	} while ( remaining != 0 );
+
+	m_value.assign( first, digits + sizeof( digits ) );
+	m_uint = number;
+	m_hasUInt = true;
 }
 
 string SipHeaderValue::ToString() const throw()
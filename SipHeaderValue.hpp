@@ -54,6 +54,19 @@ class SipHeaderValue
 		 */
 		void SetValue( const string& newValue ) throw();
 
+		/**
+		 *     Interprets the value as an unsigned decimal integer. The result is cached, so repeated calls don't re-parse.
+		 * @param number Receives the value
+		 * @return True if the value is all digits and fits in an unsigned int, false otherwise
+		 */
+		bool UIntValue( unsigned int& number ) const throw();
+
+		/**
+		 * \brief Sets the value to the decimal representation of number, without going through a stringstream.
+		 * \param number The new value
+		 */
+		void SetUIntValue( unsigned int number ) throw();
+
 		/**
 		 *     Represents value and any tags
 		 * @return
@@ -85,6 +98,8 @@ class SipHeaderValue
 		bool m_hasTags;
 		string m_value;
 		map<string, string> m_tags;
+		mutable bool m_hasUInt;
+		mutable unsigned int m_uint;
 };
 }; //namespace Sip;
 #endif //SIPHEADERVALUE_HPP
@@ -2,13 +2,24 @@
 #include "SipDefines.hpp"
 #include "SipUtility.hpp"
 #include <sstream>
-#include <boost/regex.hpp>
 #include <queue>
+#include <stdint.h>
 using std::string;
 using std::ostringstream;
 using std::queue;
 namespace Sip {
 
+SipMessage::SipMessage( MESSAGE_TYPE type, const ReceiveBufferHandle& buffer ) throw()
+	: Type( type ), m_hasBody( false ), m_rawMessageCurrent( false ), m_buffer( buffer )
+{
+	rawMessage.swap( m_buffer->Bytes() );
+}
+
+SipMessage::~SipMessage()
+{
+	if ( m_buffer )
+		m_buffer->Reclaim( rawMessage );
+}
 
 string SipMessage::ToString() const
 {
@@ -86,6 +97,58 @@ const string& SipMessage::GetOriginalRawMessage() const
 	return this->rawMessage;
 }
 
+bool SipMessage::RawMessageCurrent() const throw()
+{
+	return m_rawMessageCurrent;
+}
+
+unsigned int SipMessage::GetUInt( const string& headerName ) const throw( SipMessageException )
+{
+	const vector<SipHeaderValue>& values = GetHeaderValues( headerName );
+	unsigned int number;
+
+	if ( values.empty() || !values[0].UIntValue( number ) )
+		throw SipMessageException( string( "Header is not numeric: " ) + headerName );
+
+	return number;
+}
+
+void SipMessage::SetUInt( const string& headerName, unsigned int number ) throw()
+{
+	vector<SipHeader>::iterator header = std::find( m_headers.begin(), m_headers.end(), headerName );
+	if ( header == m_headers.end() || header->shvs.size() != 1 )
+	{
+		SipHeaderValue value( "" );
+		value.SetUIntValue( number );
+		SetHeader( headerName, value );
+		return;
+	}
+
+	SipHeaderValue& value = header->shvs[0];
+	bool rawMatches = m_rawMessageCurrent && header->raw_offset != string::npos && !value.HasTags() &&
+		rawMessage.compare( header->raw_offset, header->raw_length, value.Value() ) == 0;
+
+	value.SetUIntValue( number );
+
+	if ( rawMatches && value.Value().length() == header->raw_length )
+		std::copy( value.Value().begin(), value.Value().end(), rawMessage.begin() + header->raw_offset );
+	else
+		m_rawMessageCurrent = false;
+}
+
+bool SipMessage::DecrementMaxForwards() throw( SipMessageException )
+{
+	if ( !HasHeader( "max-forwards" ) )
+		return false;
+
+	unsigned int forwards = GetUInt( "max-forwards" );
+	if ( forwards == 0 )
+		throw SipMessageException( "Cannot forward, Max-Forwards < 0" );
+
+	SetUInt( "max-forwards", forwards - 1 );
+	return true;
+}
+
 const vector<SipHeaderValue>& SipMessage::GetHeaderValues( const string& headerName ) const throw( SipMessageException )
 {
 	vector<SipHeader>::const_iterator it;
@@ -114,8 +177,8 @@ const string& SipMessage::GetMessageBody() const throw( SipMessageException )
 string& SipMessage::ModifyMessageBody() throw ( SipMessageException ) {
 	if ( ! m_hasBody )
 		throw SipMessageException( string( "ModifyMessageBody: Message has no body" ) + rawMessage  );
-	else
-		return this->messageBody;
+	m_rawMessageCurrent = false;
+	return this->messageBody;
 }
 
 bool SipMessage::HasHeader( const string& headerName ) const throw()
@@ -147,6 +210,7 @@ void SipMessage::SetMessageBody ( const string& body, const string& rtpMap ) thr
 
 		messageBody = body;
 		m_hasBody = true;
+		m_rawMessageCurrent = false;
 }
 
 vector<SipHeaderValue>& SipMessage::ModifyHeader( const string& headerName) 
@@ -157,6 +221,8 @@ vector<SipHeaderValue>& SipMessage::ModifyHeader( const string& headerName)
 		header = m_headers.end() - 1;
 		header->header_name = headerName;
 	}
+	header->raw_offset = string::npos;
+	m_rawMessageCurrent = false;
 	return header->shvs;
 }
 
@@ -169,6 +235,8 @@ void SipMessage::SetHeader( const string& headerName, const vector<SipHeaderValu
 		header->header_name = headerName;
 	}
 	header->shvs = values;
+	header->raw_offset = string::npos;
+	m_rawMessageCurrent = false;
 }
 
 void SipMessage::SetHeader( const string& headerName, const string& value ) throw()
@@ -198,7 +266,9 @@ void SipMessage::PushHeader( const string& headerName, const vector<SipHeaderVal
 	}
 	else {
 		header->shvs.insert( header->shvs.end(), values.begin(), values.end() );
+		header->raw_offset = string::npos;
 	}
+	m_rawMessageCurrent = false;
 }
 
 void SipMessage::PushHeader( const string& headerName, const string& value ) throw()
@@ -221,6 +291,7 @@ void SipMessage::DeleteHeader( const string& headerName ) throw() {
 	vector<SipHeader>::iterator header = std::find( m_headers.begin(), m_headers.end(), headerName );
 	if ( header != m_headers.end() ) {
 		m_headers.erase( header );
+		m_rawMessageCurrent = false;
 	}
 }
 
@@ -235,24 +306,79 @@ string SipMessage::MassageHeaderKey( string headerName ) const throw()
 
 void SipMessage::ProcessSipMessage( string::const_iterator start, string::const_iterator end ) throw( SipMessageException )
 {
-	boost::match_results<std::string::const_iterator> regResults;
-	boost::regex headerExpression( "([\\w\\-]+)[ ]*:[ ]*(.+?)(?:(?:\\r\\n\\r\\n)|(?:\\r\\n(?=\\w)))" ); //(?s) is inline dotall modifier
-	//boost::regex headerExpression( "([^:]+)\\s*:\\s*(.+?\\r\\n(?:[ \\t]+.+?\\r\\n)*)" ); //Used to grab headers, including multiline headers.
-	boost::regex contentExpression( "\\r\\n\\r\\n(.+)" );
-	string key, rawValue, messageBody;
-	if ( boost::regex_search( start, end, regResults, contentExpression, boost::match_single_line ) == true )
+	string::size_type position = start - string::const_iterator( rawMessage.begin() );
+	string::size_type headersEnd = end - string::const_iterator( rawMessage.begin() );
+	string messageBody;
+
+	//The body is everything after the first empty line
+	string::size_type emptyLine = rawMessage.find( "\r\n\r\n", position );
+	if ( emptyLine != string::npos && emptyLine + 4 < headersEnd )
 	{
-		messageBody = string( regResults[1].first, regResults[1].second );
-		end = regResults[1].first;
+		messageBody = rawMessage.substr( emptyLine + 4, headersEnd - emptyLine - 4 );
+		headersEnd = emptyLine + 4;
 	}
 
-	while ( boost::regex_search( start, end, regResults, headerExpression, boost::match_single_line ) == true )
+	unsigned int headerLines = 0;
+	while ( position < headersEnd )
 	{
-		key = MassageHeaderKey( string( regResults[1].first, regResults[1].second ) );
-		rawValue = string( regResults[2].first, regResults[2].second );
+		string::size_type lineEnd = rawMessage.find( "\r\n", position );
+		if ( lineEnd == string::npos || lineEnd > headersEnd )
+			lineEnd = headersEnd;
+		if ( lineEnd == position ) //Empty line, end of headers
+			break;
+
+		//name *SP ":" *SP value; the name is the first run of name characters on the line that is followed by a colon
+		string::size_type nameBegin = position, nameEnd = position, valueBegin = position;
+		bool valid = false;
+		for ( string::size_type run = position; !valid && run < lineEnd; run = nameEnd == run ? run + 1 : valueBegin )
+		{
+			nameBegin = nameEnd = run;
+			while ( nameEnd < lineEnd && ( Utility::IsWordChar( rawMessage[nameEnd] ) || rawMessage[nameEnd] == '-' ) )
+				++nameEnd;
+			valueBegin = nameEnd;
+			while ( valueBegin < lineEnd && rawMessage[valueBegin] == ' ' )
+				++valueBegin;
+			valid = nameEnd != nameBegin && valueBegin < lineEnd && rawMessage[valueBegin] == ':';
+		}
+		if ( valid )
+			++valueBegin;
+		while ( valueBegin < lineEnd && rawMessage[valueBegin] == ' ' )
+			++valueBegin;
+
+		//Folded lines (anything that doesn't start like a header name) continue the value
+		string::size_type valueEnd = lineEnd;
+		while ( valueEnd + 2 < headersEnd && rawMessage[valueEnd + 2] != '\r' && !Utility::IsWordChar( rawMessage[valueEnd + 2] ) )
+		{
+			valueEnd = rawMessage.find( "\r\n", valueEnd + 2 );
+			if ( valueEnd == string::npos || valueEnd > headersEnd )
+				valueEnd = headersEnd;
+		}
+		position = valueEnd + 2;
+
+		if ( !valid || valueBegin == lineEnd ) //Not a header, or no value
+			continue;
+
+		if ( ++headerLines > SIP_MAX_HEADERS )
+			throw SipMessageException( "Message exceeds SIP_MAX_HEADERS" );
+
+		string key = MassageHeaderKey( rawMessage.substr( nameBegin, nameEnd - nameBegin ) );
+		string rawValue = rawMessage.substr( valueBegin, valueEnd - valueBegin );
+		bool repeated = HasHeader( key );
 
 		ProcessSipHeaderValues( key, rawValue );
-		start = regResults[0].second;
+
+		//Remember where a header's value lives in the raw message, so numeric updates can be written back in place
+		vector<SipHeader>::iterator header = std::find( m_headers.begin(), m_headers.end(), key );
+		if ( header != m_headers.end() )
+		{
+			if ( repeated )
+				header->raw_offset = string::npos;
+			else
+			{
+				header->raw_offset = valueBegin;
+				header->raw_length = valueEnd - valueBegin;
+			}
+		}
 	}
 	int contentLength = 0;
 
@@ -267,32 +393,51 @@ void SipMessage::ProcessSipMessage( string::const_iterator start, string::const_
 		m_hasBody = true;
 		this->messageBody = messageBody;
 	}
+	m_rawMessageCurrent = true;
 }
 
 void SipMessage::ProcessSipHeaderValues( const string& headerName, string& rawString ) throw( SipMessageException )
 {
-	boost::regex ws( "\\r\\n" );
 	//Remove all CRLF's
-	rawString = boost::regex_replace( rawString, ws, "" );
+	string::size_type kept = 0;
+	for ( string::size_type i = 0; i < rawString.length(); ++i )
+	{
+		if ( rawString[i] == '\r' && i + 1 < rawString.length() && rawString[i + 1] == '\n' )
+			++i;
+		else
+			rawString[kept++] = rawString[i];
+	}
+	rawString.resize( kept );
 
-	//Will be used later to see if we need special handling to ignore semicolons in a bracket 'fence' - <>
-	boost::regex semiURICheck( "^\\s*(?:\".*?\")?\\s*<" );
-	//Used to match with one or more tags
-	boost::regex tagsAreaMatch( "((?:;[^;\\?]+)*)(?:\\?.*)?$" );
-	boost::match_results<std::string::const_iterator> regResults;
 	queue<string> elements;
 	CSVSeperate( rawString, elements );
-	
+	if ( elements.size() > SIP_MAX_HEADER_VALUES )
+		throw SipMessageException( string( "Header exceeds SIP_MAX_HEADER_VALUES: " ) + headerName );
+
 	while ( !elements.empty() )
 	{
 		string value, rawTags;
 		string element = elements.front();
 		elements.pop();
 
-		//Ok, check if there is a uri that might so we can ignore inner semicolons
-		boost::cmatch matches;
+		//Ok, check if there is a uri that might so we can ignore inner semicolons: *WS [ quoted-string ] *WS "<"
+		string::size_type position = 0;
+		while ( position < element.length() && Utility::IsSpace( element[position] ) )
+			++position;
+		bool bracketed = position < element.length() && element[position] == '<';
+		if ( !bracketed && position < element.length() && element[position] == '"' )
+		{
+			for ( string::size_type quote = element.find( '"', position + 1 ); !bracketed && quote != string::npos; quote = element.find( '"', quote + 1 ) )
+			{
+				string::size_type next = quote + 1;
+				while ( next < element.length() && Utility::IsSpace( element[next] ) )
+					++next;
+				bracketed = next < element.length() && element[next] == '<';
+			}
+		}
 
-		if ( boost::regex_search( element.c_str(), matches, semiURICheck ) )
+		string::size_type tagsBegin, tagsEnd;
+		if ( bracketed )
 		{ //Ok, lets weed out the area within the <>
 			//Find position of >. If not found, throw and exception.
 			//grab from > to first semicolon or end, that will be 'value'
@@ -301,41 +446,29 @@ void SipMessage::ProcessSipHeaderValues( const string& headerName, string& rawSt
 			if ( rightBracketPosition == string::npos )
 				throw SipMessageException( string( "Invalid data for (URI?) header: " ) + headerName );
 
-			if ( boost::regex_search( (char * ) (element.c_str() + rightBracketPosition), matches, tagsAreaMatch ) && string( matches[1].first, matches[1].second ) != "" )
-			{
-				rawTags = string( matches[1].first, matches[1].second );
-				value = string( element.c_str(), matches[1].first );
-			}
-			else
-			{ //No tags found, whole element is just a value
-				rawTags = "";
-				value = element;
-			}
+			tagsBegin = Utility::FindTags( element, rightBracketPosition, tagsEnd );
 		}
-		else
-		{ //Should be safe to assume semis only used for tags
-			if ( boost::regex_search( element.c_str(), matches, tagsAreaMatch )  && string( matches[1].first, matches[1].second ) != "" )
-			{
-				rawTags = string( matches[1].first, matches[1].second );
-				value = string( element.c_str(), matches[1].first );
-			}
-			else
-			{
-				rawTags = "";
-				value = element;
-			}
+		else //Should be safe to assume semis only used for tags
+			tagsBegin = Utility::FindTags( element, 0, tagsEnd );
+
+		if ( tagsBegin != string::npos )
+		{
+			rawTags = element.substr( tagsBegin, tagsEnd - tagsBegin );
+			value = element.substr( 0, tagsBegin );
 		}
+		else //No tags found, whole element is just a value
+			value = element;
 
 		//Trim whitespace from value
-		boost::regex trimWS( "^\\s+|\\s+$" );
-		value = boost::regex_replace( value, trimWS, "" );
+		value = Utility::Trim( value );
 
 		// At this point, we need thave the value and rawTags seperate and cleaned up
 
 		if ( rawTags != "" )
 		{
 			map<string, string> tagMap;
-			Utility::FillTags( rawTags, tagMap );
+			if ( !Utility::FillTags( rawTags, tagMap ) )
+				throw SipMessageException( string( "Header value exceeds SIP_MAX_PARAMETERS: " ) + headerName );
 			PushHeader( headerName, SipHeaderValue( value, tagMap ) );
 		}
 		else
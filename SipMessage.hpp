@@ -4,6 +4,7 @@
 #include <queue>
 #include "SipHeader.hpp"
 #include "SipHeaderValue.hpp"
+#include "ReceiveBuffer.hpp"
 namespace Sip {
 
 /**
@@ -41,8 +42,11 @@ class SipMessage
 			MT_RESPONSE
 		};
 
-		SipMessage( MESSAGE_TYPE type ) throw() : Type( type ), m_hasBody( false ) {}
-		virtual ~SipMessage() {}
+		SipMessage( MESSAGE_TYPE type ) throw() : Type( type ), m_hasBody( false ), m_rawMessageCurrent( false ) {}
+		/**
+		 *     Gives the raw message's storage back to the receive buffer it was parsed from, if any
+		 */
+		virtual ~SipMessage();
 		/**
 		 *     Returns a vector<SipHeaderValue> corresponding to the header key
 		 * @param key The header key. For example, 'via'
@@ -115,9 +119,42 @@ class SipMessage
 		 */
 		void DeleteHeader( const string& headerName ) throw();
 
+		/**
+		 *     Returns the first value of a numeric header (Max-Forwards, Expires, Content-Length...) as an integer.
+		 *     The integer is cached on the header value, so repeated reads don't re-parse.
+		 * @param headerName The header to read
+		 * @return The header's value
+		 * @throw SipMessageException if the header is missing or isn't an unsigned decimal number
+		 */
+		unsigned int GetUInt( const string& headerName ) const throw( SipMessageException );
+
+		/**
+		 *     Sets a numeric header. If the header was parsed from the raw message and the new value has the same
+		 *     number of digits, the raw message is patched in place and stays current.
+		 * @param headerName The header to set. It is added if not present.
+		 * @param number The new value
+		 * @sa SipMessage::RawMessageCurrent()
+		 */
+		void SetUInt( const string& headerName, unsigned int number ) throw();
+
+		/**
+		 *     Decrements the Max-Forwards header, if there is one.
+		 * @return True if the header was present and decremented, false if the message has no Max-Forwards
+		 * @throw SipMessageException if Max-Forwards is already 0, or isn't a number
+		 */
+		bool DecrementMaxForwards() throw( SipMessageException );
+
 		string ToString() const;
 		const string& GetOriginalRawMessage() const;
 
+		/**
+		 *     Indicates whether GetOriginalRawMessage() still represents this message byte for byte. Parsing sets it;
+		 *     any modification other than a same-width SetUInt() clears it. While true, the raw message can be sent on
+		 *     as-is instead of calling ToString().
+		 * @return True if the raw message is current
+		 */
+		bool RawMessageCurrent() const throw();
+
 		//
 		// UTILITY
 		//
@@ -128,6 +165,14 @@ class SipMessage
 
 	protected:
 
+		/**
+		 *     Takes the bytes in a receive buffer as the raw message, without copying them. The message holds a
+		 *     reference to the buffer until it is destroyed.
+		 * @param type The message type
+		 * @param buffer Resized to the bytes received; left empty
+		 */
+		SipMessage( MESSAGE_TYPE type, const ReceiveBufferHandle& buffer ) throw();
+
 		/**
 		 *       Adds one or more values, given a header name, to  SipMessage::m_headers
 		 * @param headerName The name of the header
@@ -139,7 +184,7 @@ class SipMessage
 
 		/**
 		 *     Populates m_headers and messageBody (Content-Length header indicates last header line, RFC 3261 7.5)
-		 * @param start The character folloing the end of the start-line and it's CR/LF
+		 * @param start The character folloing the end of the start-line and it's CR/LF. Must point into rawMessage.
 		 * @param end  The end of the entire message
 		 */
 		void ProcessSipMessage( string::const_iterator start, string::const_iterator end ) throw( SipMessageException );
@@ -153,8 +198,9 @@ class SipMessage
 
 		string messageBody, rawMessage;
 		string m_recvAddress;
-		bool m_hasBody, m_hasRecvAddress;
+		bool m_hasBody, m_hasRecvAddress, m_rawMessageCurrent;
 		vector<SipHeader> m_headers;
+		ReceiveBufferHandle m_buffer;
 
 	private:
 		static void CSVSeperate( const string& rawString, queue<string>& elements );
@@ -1,31 +1,43 @@
 #include "SipRequest.hpp"
-#include <boost/regex.hpp>
 #include <sstream>
 #include "CSeq.hpp"
+#include "SipUtility.hpp"
 using std::ostringstream;
 namespace Sip {
 
 SipRequest::SipRequest( const string& rawRequestData ) throw( SipMessageException, SipRequestException ) : SipMessage( MT_REQUEST )
 {
-	boost::regex requestExpression( "^\\s*(\\w+)\\s(sips?:.+?)\\sSIP/2.0\\r\\n" ); //Matches request line 1
-	boost::match_results<std::string::const_iterator> regResults;
-	string::const_iterator start, end;
-
-	//DEBUGGING
-	//cerr << rawRequestData << endl;
+	this->rawMessage = rawRequestData;
+	Parse();
+}
 
-	start = rawRequestData.begin();
-	end = rawRequestData.end();
+SipRequest::SipRequest( const ReceiveBufferHandle& buffer ) throw( SipMessageException, SipRequestException ) : SipMessage( MT_REQUEST, buffer )
+{
+	Parse();
+}
 
+void SipRequest::Parse() throw( SipMessageException, SipRequestException )
+{
 	//Read request header; check version is 2.0
-	this->rawMessage = rawRequestData;
-	if ( boost::regex_search( start, end, regResults, requestExpression, boost::match_default ) == false )
-		throw SipRequestException( string( "Invalid request\nRequest:\n\t" ) + rawRequestData  );
+	//Request line: Method SP Request-URI SP SIP/2.0 CRLF
+	string::size_type methodBegin = 0;
+	while ( methodBegin < rawMessage.length() && Utility::IsSpace( rawMessage[methodBegin] ) )
+		++methodBegin;
+	string::size_type lineEnd = rawMessage.find( "\r\n", methodBegin );
+	string::size_type methodEnd = methodBegin;
+	while ( methodEnd < lineEnd && Utility::IsWordChar( rawMessage[methodEnd] ) )
+		++methodEnd;
+	string::size_type uriBegin = methodEnd + 1;
+
+	if ( lineEnd == string::npos || methodEnd == methodBegin || lineEnd < uriBegin + 13 || !Utility::IsSpace( rawMessage[methodEnd] ) ||
+		rawMessage.compare( lineEnd - 7, 7, "SIP/2.0" ) != 0 || !Utility::IsSpace( rawMessage[lineEnd - 8] ) ||
+		( rawMessage.compare( uriBegin, 4, "sip:" ) != 0 && rawMessage.compare( uriBegin, 5, "sips:" ) != 0 ) )
+		throw SipRequestException( string( "Invalid request\nRequest:\n\t" ) + rawMessage  );
 	//TODO: Grap request and host (sanity check host is this one)
-	string requestMethodString = string( regResults[1].first, regResults[1].second );
+	string requestMethodString = rawMessage.substr( methodBegin, methodEnd - methodBegin );
 	try
 	{
-		m_requestURI = string( regResults[2].first, regResults[2].second );
+		m_requestURI = rawMessage.substr( uriBegin, lineEnd - 8 - uriBegin );
 		this->requestMethod = RequestTypes.GetCase( requestMethodString );
 	}
 	catch ( LookupTableException& e )
@@ -36,7 +48,7 @@ SipRequest::SipRequest( const string& rawRequestData ) throw( SipMessageExceptio
 	{
 		throw SipRequestException( e.what() );
 	}
-	start = regResults[0].second; //Ok, ready for headers
+	string::const_iterator start = rawMessage.begin() + lineEnd + 2, end = rawMessage.end(); //Ok, ready for headers
 
 	ProcessSipMessage( start, end );
 
@@ -56,8 +68,15 @@ SipRequest::SipRequest( const string& rawRequestData ) throw( SipMessageExceptio
 	}
 
 	//CSeq method must match request method
-	if ( static_cast<CSeq>(GetHeaderValues( "cseq" )[0]).RequestMethod() != this->requestMethod )
-		throw SipRequestException( "CSeq request method doesn't match request method of request." );
+	try
+	{
+		if ( static_cast<CSeq>(GetHeaderValues( "cseq" )[0]).RequestMethod() != this->requestMethod )
+			throw SipRequestException( "CSeq request method doesn't match request method of request." );
+	}
+	catch ( CSeqException& e ) //Would otherwise escape the exception specification and terminate the process
+	{
+		throw SipRequestException( e.what() );
+	}
 
 
 }
@@ -80,6 +99,7 @@ SipRequest::SipRequest( const SipRequest& rhs ) : SipMessage( MT_REQUEST )
 	m_headers = rhs.m_headers;
 	m_hasBody = rhs.m_hasBody;
 	this->messageBody = rhs.messageBody;
+	m_rawMessageCurrent = rhs.m_rawMessageCurrent;
 
 }
 
@@ -97,16 +117,18 @@ const URI& SipRequest::RequestURI() const throw()
 void SipRequest::SetRequestURI( const URI& uri ) throw()
 {
 	m_requestURI = uri;
+	m_rawMessageCurrent = false;
 }
 
 void SipRequest::SetRequestMethod( const SipRequest::REQUEST_METHOD rm ) throw()
 {
 	this->requestMethod = rm;
+	m_rawMessageCurrent = false;
 	if ( this->HasHeader( "cseq" ) )
 	{
 		ostringstream cseqBuilder;
 		string requestMethod = RequestTypes.ReverseGet( rm );
-		transform( requestMethod.begin(), requestMethod.end(), requestMethod.begin(), (int(*)(int))toupper ); //Go uppercase
+		transform( requestMethod.begin(), requestMethod.end(), requestMethod.begin(), AsciiToUpper ); //Go uppercase
 		cseqBuilder << CSeq( GetHeaderValues( "cseq" )[0] ).Sequence()
 						<< ' '
 						<< requestMethod;
@@ -120,7 +142,7 @@ string SipRequest::ToString() const
 	ostringstream stream;
 	string requestMethod = RequestTypes.ReverseGet( RequestMethod() );
 
-	transform(requestMethod.begin(), requestMethod.end(), requestMethod.begin(), (int(*)(int))toupper ); //Go uppercase
+	transform(requestMethod.begin(), requestMethod.end(), requestMethod.begin(), AsciiToUpper ); //Go uppercase
 	try
 	{
 
@@ -71,6 +71,12 @@ class SipRequest : public SipMessage
 		 */
 		SipRequest ( const string& data ) throw ( SipMessageException, SipRequestException );
 
+		/**
+		 *     Create a sip request from a receive buffer, taking its bytes instead of copying them
+		 * @param buffer Resized to the bytes received
+		 */
+		SipRequest ( const ReceiveBufferHandle& buffer ) throw ( SipMessageException, SipRequestException );
+
 		/**8496
 		*     Provides request method for this SipRequest
 		* @return The request method
@@ -101,6 +107,10 @@ class SipRequest : public SipMessage
 
 
 	private:
+		/**
+		 *     Parses rawMessage; shared by the raw data constructors
+		 */
+		void Parse() throw ( SipMessageException, SipRequestException );
 
 		URI m_requestURI;
 		REQUEST_METHOD requestMethod;
@@ -1,6 +1,6 @@
 #include "SipResponse.hpp"
-#include <boost/regex.hpp>
 #include <sstream>
+#include "SipUtility.hpp"
 
 using std::ostringstream;
 namespace Sip {
@@ -27,25 +27,40 @@ SipResponse::SipResponse( const int statusCode, const string& reasonPhrase )
 	: SipMessage( MT_RESPONSE ), m_statusCode( statusCode ), m_reasonPhrase( reasonPhrase )
 { }
 
-SipResponse::SipResponse( const string& rawResponseData ) throw ( SipResponseException ) : SipMessage( MT_RESPONSE )
+SipResponse::SipResponse( const string& rawResponseData ) throw ( SipMessageException, SipResponseException ) : SipMessage( MT_RESPONSE )
 {
-	boost::regex responseRegex( "^\\s*SIP/2.0\\s(\\d{3})\\s(.*?)\\r\\n" ); //Matches request line 1
-	boost::match_results<std::string::const_iterator> regResults;
-	string::const_iterator start, end;
+	this->rawMessage = rawResponseData;
+	Parse();
+}
 
-	start = rawResponseData.begin();
-	end = rawResponseData.end();
+SipResponse::SipResponse( const ReceiveBufferHandle& buffer ) throw ( SipMessageException, SipResponseException ) : SipMessage( MT_RESPONSE, buffer )
+{
+	Parse();
+}
 
+void SipResponse::Parse() throw ( SipMessageException, SipResponseException )
+{
 	//Read response header; check version is 2.0
-	this->rawMessage = rawResponseData;
-	if ( boost::regex_search( start, end, regResults, responseRegex, boost::match_default ) == false )
-		throw SipResponseException( string( "Invalid response\nResponse:\n\t" ) + rawResponseData  );
+
+	//Status line: SIP/2.0 SP 3DIGIT SP Reason-Phrase CRLF
+	string::size_type lineStart = 0;
+	while ( lineStart < rawMessage.length() && Utility::IsSpace( rawMessage[lineStart] ) )
+		++lineStart;
+	string::size_type lineEnd = rawMessage.find( "\r\n", lineStart );
+	string::size_type code = lineStart + 8;
+
+	if ( lineEnd == string::npos || code + 3 > lineEnd || rawMessage.compare( lineStart, 7, "SIP/2.0" ) != 0 ||
+		!Utility::IsSpace( rawMessage[lineStart + 7] ) || !Utility::IsDigit( rawMessage[code] ) ||
+		!Utility::IsDigit( rawMessage[code + 1] ) || !Utility::IsDigit( rawMessage[code + 2] ) ||
+		( code + 3 < lineEnd && !Utility::IsSpace( rawMessage[code + 3] ) ) )
+		throw SipResponseException( string( "Invalid response\nResponse:\n\t" ) + rawMessage  );
 	//TODO: Grap response and host (sanity check reponse is valid from know requests that haven't timed out)
-	m_statusCode = atoi( string( regResults[1].first, regResults[1].second ).c_str() );
+	m_statusCode = ( rawMessage[code] - '0' ) * 100 + ( rawMessage[code + 1] - '0' ) * 10 + ( rawMessage[code + 2] - '0' );
 
-	m_reasonPhrase = string( regResults[2].first, regResults[2].second );
+	if ( code + 4 < lineEnd )
+		m_reasonPhrase = rawMessage.substr( code + 4, lineEnd - code - 4 );
 
-	start = regResults[0].second; //Ok, ready for headers
+	string::const_iterator start = rawMessage.begin() + lineEnd + 2, end = rawMessage.end(); //Ok, ready for headers
 
 	ProcessSipMessage( start, end );
 }
@@ -63,10 +78,12 @@ const string& SipResponse::ReasonPhrase() const throw()
 void SipResponse::SetStatusCode( int newStatusCode )
 {
 	m_statusCode = newStatusCode;
+	m_rawMessageCurrent = false;
 }
 void SipResponse::SetReasonPhrase ( const string& newReasonPhrase )
 {
 	m_reasonPhrase = newReasonPhrase;
+	m_rawMessageCurrent = false;
 }
 
 string SipResponse::ToString() const
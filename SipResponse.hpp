@@ -42,7 +42,13 @@ class SipResponse : public SipMessage
 		 */
 		SipResponse( const int statusCode = 500, const string& reasonPhrase = "Internal Server Error" );
 
-		SipResponse( const string& rawResponseData ) throw ( SipResponseException );
+		SipResponse( const string& rawResponseData ) throw ( SipMessageException, SipResponseException );
+
+		/**
+		 *     Creates a response from a receive buffer, taking its bytes instead of copying them
+		 * @param buffer Resized to the bytes received
+		 */
+		SipResponse( const ReceiveBufferHandle& buffer ) throw ( SipMessageException, SipResponseException );
 
 		int StatusCode( ) const throw();
 		const string& ReasonPhrase() const throw();
@@ -55,6 +61,12 @@ class SipResponse : public SipMessage
 	protected:
 		int m_statusCode;
 		string m_reasonPhrase;
+
+	private:
+		/**
+		 *     Parses rawMessage; shared by the raw data constructors
+		 */
+		void Parse() throw ( SipMessageException, SipResponseException );
 }; //class SipResponse
 }; //namespace SIP
 #endif //SIPRESPONSE_HPP
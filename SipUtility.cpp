@@ -1,40 +1,100 @@
 #include "SipUtility.hpp"
-#include <boost/regex.hpp>
 #include "SipRequest.hpp"
 #include "SipResponse.hpp"
 namespace Sip {
-void Utility::FillTags( const string& rawTags, map<string, string>& tagMap)
+
+//The scanners in this file and in the header, URI, Via and CSeq parsers are written by hand so that every byte of a
+//message is looked at a bounded number of times. The regular expressions they replace backtracked on crafted input.
+
+bool Utility::FillTags( const string& rawTags, map<string, string>& tagMap, unsigned int maxTags )
 {
-			boost::regex tagSearch( ";([^;=]+)(?:=([^;]+))?" );
-			boost::match_results<std::string::const_iterator> tags;
-   		string::const_iterator start, end;
-   		start = rawTags.begin();
-   		end = rawTags.end();
-
-			while ( boost::regex_search( start, end, tags, tagSearch, boost::match_default ) )
-			{
-				if ( tags[2].matched )
-					tagMap[ string( tags[1].first, tags[1].second ) ] = string( tags[2].first, tags[2].second );
-				else
-					tagMap[ string( tags[1].first, tags[1].second ) ] = "";
-				start = tags[0].second;
-			}
+	unsigned int found = 0;
+	string::size_type position = rawTags.find( ';' );
+
+	while ( position != string::npos )
+	{
+		string::size_type nameBegin = position + 1, nameEnd = nameBegin;
+		while ( nameEnd < rawTags.length() && rawTags[nameEnd] != ';' && rawTags[nameEnd] != '=' )
+			++nameEnd;
+
+		string::size_type next = rawTags.find( ';', nameEnd );
+		if ( nameEnd == nameBegin ) //No name, not a tag
+		{
+			position = next;
+			continue;
+		}
+
+		if ( ++found > maxTags )
+			return false;
+
+		string& value = tagMap[ rawTags.substr( nameBegin, nameEnd - nameBegin ) ];
+		if ( nameEnd < rawTags.length() && rawTags[nameEnd] == '=' )
+			value.assign( rawTags, nameEnd + 1, ( next == string::npos ? rawTags.length() : next ) - nameEnd - 1 );
+		else
+			value.clear();
+
+		position = next;
+	}
+	return true;
 }
 
-void Utility::ParseMessage( auto_ptr<SipMessage>& sipMessage, const string& data ) {
-	boost::regex requestRegex( "^\\s*(\\w+)\\ssip:(.+?)\\sSIP/2.0$\\r\\n.*" );
-	boost::regex responseRegex( "^\\s*SIP/2.0\\s(\\d{3})\\s(.*?)\\r\\n.*" );
-	boost::cmatch matches;
+string::size_type Utility::FindTags( const string& value, string::size_type from, string::size_type& tagsEnd )
+{
+	tagsEnd = value.find( '?', from );
+	if ( tagsEnd == string::npos )
+		tagsEnd = value.length();
+
+	//Walk back from the end of the tags area; it may not end in ';' or contain an empty segment (";;")
+	string::size_type tagsBegin = string::npos;
+	for ( string::size_type i = tagsEnd; i > from; --i )
+	{
+		if ( value[i - 1] != ';' )
+			continue;
+		if ( i == tagsEnd || value[i] == ';' )
+			break;
+		tagsBegin = i - 1;
+	}
+	return tagsBegin;
+}
+
+string Utility::Trim( const string& value )
+{
+	string::size_type first = 0, last = value.length();
+	while ( first < last && IsSpace( value[first] ) )
+		++first;
+	while ( last > first && IsSpace( value[last - 1] ) )
+		--last;
+	return value.substr( first, last - first );
+}
+
+namespace {
+
+/**
+ *     ParseMessage() for either kind of source: data is what to classify, source what the constructor takes
+ */
+template <class Source>
+void ParseFrom( auto_ptr<SipMessage>& sipMessage, const string& data, const Source& source ) {
+	if ( data.length() > SIP_MAX_MESSAGE_SIZE )
+		throw SipMessageException( "Invalid SIP message:\nMessage exceeds SIP_MAX_MESSAGE_SIZE" );
+
+	//Classify on the start line only; the constructors do the full validation
+	string::size_type start = 0;
+	while ( start < data.length() && Utility::IsSpace( data[start] ) )
+		++start;
+	string::size_type lineEnd = data.find( "\r\n", start );
 
 	try {
-		if ( boost::regex_match( data.c_str(), matches, requestRegex) ) {
-			sipMessage.reset( new SipRequest( data ) );
+		if ( lineEnd != string::npos && data.compare( start, 7, "SIP/2.0" ) == 0 && Utility::IsSpace( data[start + 7] ) ) {
+			sipMessage.reset( new SipResponse( source ) );
 		}
-		else if ( boost::regex_match( data.c_str(), matches, responseRegex) ) {
-			sipMessage.reset( new SipResponse( data ) );
+		else {
+			string::size_type method = start;
+			while ( method < lineEnd && Utility::IsWordChar( data[method] ) )
+				++method;
+			if ( lineEnd == string::npos || method == start || !Utility::IsSpace( data[method] ) || data.compare( method + 1, 4, "sip:" ) != 0 )
+				throw SipMessageException( "SIP message not parseable" );
+			sipMessage.reset( new SipRequest( source ) );
 		}
-		else
-			throw SipMessageException( "SIP message not parseable" );
 	}
 	catch ( SipRequestException& e ) {
 		throw SipMessageException( string( "Invalid request:\n" ) + e.what() );
@@ -46,4 +106,13 @@ void Utility::ParseMessage( auto_ptr<SipMessage>& sipMessage, const string& data
 		throw SipMessageException( string( "Invalid SIP message:\n" ) + e.what() );
 	}
 }
+}; //namespace
+
+void Utility::ParseMessage( auto_ptr<SipMessage>& sipMessage, const string& data ) {
+	ParseFrom( sipMessage, data, data );
+}
+
+void Utility::ParseMessage( auto_ptr<SipMessage>& sipMessage, const ReceiveBufferHandle& buffer ) {
+	ParseFrom( sipMessage, buffer->Bytes(), buffer );
+}
 };//namespace Sip
@@ -4,6 +4,7 @@
 #include <map>
 #include <memory>
 #include "SipMessage.hpp"
+#include "SipDefines.hpp"
 using std::string;
 using std::map;
 using std::auto_ptr;
@@ -14,8 +15,32 @@ class Utility {
 	 *     Utility function for transforming a string of key & value tags into a map of tags
 	 * @param rawTags A string representations of one or more tags in the format (;key=value)*
 	 * @param tagMap The map to contain the tags
+	 * @param maxTags Tags past this many are ignored
+	 * @return False if there were more than maxTags tags
 	 */
-	static void FillTags ( const string& rawTags, map<string, string>& tagMap );
+	static bool FillTags ( const string& rawTags, map<string, string>& tagMap, unsigned int maxTags = SIP_MAX_PARAMETERS );
+
+	/**
+	 *     Finds the tags area at the end of a header value: zero or more ;tag segments, optionally followed by ?headers.
+	 *     Runs in linear time.
+	 * @param value The header value
+	 * @param from Where to start looking; tags before this are part of the value
+	 * @param tagsEnd Set to the end of the ;tag segments (the '?' or the end of value)
+	 * @return Where the tags start, or string::npos if there are none
+	 */
+	static string::size_type FindTags( const string& value, string::size_type from, string::size_type& tagsEnd );
+
+	/**
+	 *     Strips leading and trailing whitespace
+	 */
+	static string Trim( const string& value );
+
+	/**
+	 *     Character classes used by the parsers; ASCII only, matching \\s and \\w
+	 */
+	static bool IsSpace( char c ) { return c == ' ' || c == '\t' || c == '\r' || c == '\n' || c == '\v' || c == '\f'; }
+	static bool IsWordChar( char c ) { return ( c >= 'a' && c <= 'z' ) || ( c >= 'A' && c <= 'Z' ) || ( c >= '0' && c <= '9' ) || c == '_'; }
+	static bool IsDigit( char c ) { return c >= '0' && c <= '9'; }
 
 	/** 
 	 * @brief Parses a raw string into a SipMessage.
@@ -25,6 +50,14 @@ class Utility {
 	 */
 	static void ParseMessage( auto_ptr<SipMessage>& sipMessage, const string& data );
 
+	/**
+	 * @brief Parses a receive buffer into a SipMessage, which takes the buffer's bytes instead of copying them.
+	 *
+	 * @param message an auto_ptr<SipMessage>
+	 * @param buffer Resized to the bytes received. Left empty if the message was created.
+	 */
+	static void ParseMessage( auto_ptr<SipMessage>& sipMessage, const ReceiveBufferHandle& buffer );
+
 }; //class Utility
 }; //namespace Sip
 #endif //SIPUTILITY_H
@@ -0,0 +1,206 @@
+#include "TimingWheel.hpp"
+#include <algorithm>
+#include <cstring>
+
+namespace Sip {
+
+namespace {
+bool EarlierDeadline( const TimingWheel::Expired& a, const TimingWheel::Expired& b )
+{
+	return a.deadline < b.deadline;
+}
+}
+
+TimingWheel::TimingWheel( uint64_t now ) throw()
+	: m_now( now )
+{
+	memset( m_occupied, 0, sizeof( m_occupied ) );
+}
+
+SlabHandle TimingWheel::Schedule( uint64_t now, uint64_t deadline, SlabHandle target, unsigned int kind )
+{
+	if ( m_nodes.Size() == 0 && now > m_now )
+		m_now = now;
+	SlabHandle handle = m_nodes.Acquire();
+	Node& node = *m_nodes.Get( handle );
+	node.deadline = deadline;
+	node.target = target;
+	node.kind = kind;
+	Insert( handle, node );
+	return handle;
+}
+
+bool TimingWheel::Cancel( SlabHandle timer ) throw()
+{
+	Node* node = m_nodes.Get( timer );
+	if ( node == NULL )
+		return false;
+	Unlink( *node );
+	m_nodes.Release( timer );
+	return true;
+}
+
+size_t TimingWheel::Advance( uint64_t now, vector<Expired>& expired )
+{
+	//Timers armed for a millisecond already expired go first: every other deadline is later
+	size_t count = Expire( OVERDUE_LIST, expired );
+	std::sort( expired.end() - count, expired.end(), EarlierDeadline );
+
+	while ( m_now <= now )
+	{
+		uint64_t next = m_nodes.Size() == 0 ? now + 1 : NextEvent();
+		if ( next > now )
+		{
+			m_now = now + 1;
+			break;
+		}
+		m_now = next;
+		Turn();
+
+		//Everything in this slot expires now: it shares every bit of m_now above level 0
+		unsigned int slot = m_now & ( SLOTS - 1 );
+		m_occupied[0][slot / 64] &= ~( 1ULL << ( slot % 64 ) );
+		count += Expire( slot, expired );
+		++m_now;
+	}
+	//Either way out can leave m_now on a turn; bring it down now, before anything is scheduled into a slot that is
+	//about to be filled from above
+	Turn();
+	return count;
+}
+
+bool TimingWheel::Next( uint64_t& when ) const throw()
+{
+	if ( m_nodes.Size() == 0 )
+		return false;
+	if ( m_lists[OVERDUE_LIST].Valid() )
+	{
+		when = m_now - 1;
+		for ( SlabHandle handle = m_lists[OVERDUE_LIST]; handle.Valid(); handle = m_nodes.Get( handle )->next )
+			when = std::min( when, m_nodes.Get( handle )->deadline );
+	}
+	else
+		when = NextEvent();
+	return true;
+}
+
+size_t TimingWheel::Size() const throw()
+{
+	return m_nodes.Size();
+}
+
+void TimingWheel::Insert( SlabHandle handle, Node& node ) throw()
+{
+	//The lowest level whose slots span every bit in which the deadline and the present differ
+	uint64_t differs = node.deadline ^ m_now;
+	unsigned int level = 0;
+	while ( level < LEVELS && ( differs >> ( ( level + 1 ) * SLOT_BITS ) ) != 0 )
+		++level;
+	if ( node.deadline < m_now )
+		node.list = OVERDUE_LIST;
+	else if ( level == LEVELS )
+		node.list = OVERFLOW_LIST;
+	else
+	{
+		unsigned int slot = ( node.deadline >> ( level * SLOT_BITS ) ) & ( SLOTS - 1 );
+		node.list = level * SLOTS + slot;
+		m_occupied[level][slot / 64] |= 1ULL << ( slot % 64 );
+	}
+
+	SlabHandle& head = m_lists[node.list];
+	node.previous = SlabHandle();
+	node.next = head;
+	if ( head.Valid() )
+		m_nodes.Get( head )->previous = handle;
+	head = handle;
+}
+
+void TimingWheel::Unlink( Node& node ) throw()
+{
+	if ( node.previous.Valid() )
+		m_nodes.Get( node.previous )->next = node.next;
+	else
+		m_lists[node.list] = node.next;
+	if ( node.next.Valid() )
+		m_nodes.Get( node.next )->previous = node.previous;
+	if ( node.list < OVERFLOW_LIST && !m_lists[node.list].Valid() )
+		m_occupied[node.list / SLOTS][node.list % SLOTS / 64] &= ~( 1ULL << ( node.list % 64 ) );
+}
+
+void TimingWheel::Cascade( unsigned int list ) throw()
+{
+	SlabHandle handle = m_lists[list];
+	m_lists[list] = SlabHandle();
+	if ( list < OVERFLOW_LIST )
+		m_occupied[list / SLOTS][list % SLOTS / 64] &= ~( 1ULL << ( list % 64 ) );
+	while ( handle.Valid() )
+	{
+		Node& node = *m_nodes.Get( handle );
+		SlabHandle next = node.next;
+		Insert( handle, node );
+		handle = next;
+	}
+}
+
+void TimingWheel::Turn() throw()
+{
+	if ( ( m_now & ( SLOTS - 1 ) ) != 0 )
+		return;
+	//The wheel has turned into new slots of the levels above: bring their timers down, highest first
+	if ( ( m_now & 0xFFFFFFFFULL ) == 0 )
+		Cascade( OVERFLOW_LIST );
+	for ( unsigned int level = LEVELS - 1; level > 0; --level )
+		if ( ( m_now & ( ( 1ULL << ( level * SLOT_BITS ) ) - 1 ) ) == 0 )
+			Cascade( level * SLOTS + ( ( m_now >> ( level * SLOT_BITS ) ) & ( SLOTS - 1 ) ) );
+}
+
+size_t TimingWheel::Expire( unsigned int list, vector<Expired>& expired )
+{
+	size_t count = 0;
+	SlabHandle handle = m_lists[list];
+	m_lists[list] = SlabHandle();
+	while ( handle.Valid() )
+	{
+		Node& node = *m_nodes.Get( handle );
+		Expired due = { node.deadline, handle, node.target, node.kind };
+		expired.push_back( due );
+		++count;
+		SlabHandle following = node.next;
+		m_nodes.Release( handle );
+		handle = following;
+	}
+	return count;
+}
+
+unsigned int TimingWheel::Occupied( unsigned int level, unsigned int slot ) const throw()
+{
+	for ( unsigned int word = slot / 64; word < SLOTS / 64; ++word )
+	{
+		uint64_t bits = m_occupied[level][word];
+		if ( word == slot / 64 )
+			bits &= ~0ULL << ( slot % 64 );
+		if ( bits != 0 )
+			return word * 64 + __builtin_ctzll( bits );
+	}
+	return SLOTS;
+}
+
+uint64_t TimingWheel::NextEvent() const throw()
+{
+	//Nothing is ever put in a slot the wheel is already in, so a timer in the current slot of a level means the wheel
+	//has just turned into it and not brought it down yet; searching from the current slot finds that too
+	for ( unsigned int level = 0; level < LEVELS; ++level )
+	{
+		unsigned int shift = level * SLOT_BITS;
+		unsigned int found = Occupied( level, ( m_now >> shift ) & ( SLOTS - 1 ) );
+		if ( found < SLOTS )
+		{
+			uint64_t at = ( m_now & ~( ( 1ULL << ( shift + SLOT_BITS ) ) - 1 ) ) + ( static_cast<uint64_t>( found ) << shift );
+			return at > m_now ? at : m_now;
+		}
+	}
+	//Only the overflow list is left; it comes down at the next turn of the top level
+	return m_now == 0 ? 0 : ( ( m_now - 1 ) | 0xFFFFFFFFULL ) + 1;
+}
+
+}; //namespace Sip
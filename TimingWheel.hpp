@@ -0,0 +1,137 @@
+#ifndef TIMINGWHEEL_HPP
+#define TIMINGWHEEL_HPP
+#include <cstddef>
+#include <vector>
+#include <stdint.h>
+#include "HandleSlab.hpp"
+
+namespace Sip {
+
+using std::vector;
+
+/**
+* \class TimingWheel
+* \brief Millisecond timers by the million: a hierarchical timing wheel with constant time Schedule() and Cancel(),
+*        expiring in batches
+*
+* Four levels of 256 slots cover 256 ms, 65 s, 4.6 hours and 49 days; a timer further out waits in an overflow list
+* that is looked at every 49 days. A timer goes in the lowest level whose span holds its deadline, and moves down a
+* level each time the wheel turns into the slot it is in, so it is touched at most once per level. A bitmap per level
+* of the slots with timers in them lets Advance() go straight to the next one, rather than step through every
+* millisecond between.
+*
+* Timers live in a HandleSlab and are named by generational handles: cancelling one that already fired, or was
+* cancelled, does nothing. A timer carries the handle of whatever it is for and a kind of the owner's choosing, and
+* comes back with them when it expires.
+*
+* Not thread safe, and not meant to be: give each thread its own wheel.
+*/
+class TimingWheel
+{
+	public:
+		/**
+		* \class Expired
+		* \brief A timer Advance() found due; the timer itself is gone by then
+		*/
+		struct Expired
+		{
+			uint64_t deadline;
+			SlabHandle timer, target;
+			unsigned int kind;
+		};
+
+		/**
+		 * @param now Where the wheel's clock starts
+		 */
+		TimingWheel( uint64_t now = 0 ) throw();
+
+		/**
+		 *     Arms a timer
+		 * @param now The caller's clock. An empty wheel jumps to it, so a wheel left idle doesn't turn through the idle
+		 *        time on the next Advance().
+		 * @param deadline When it expires; a deadline already past expires on the next Advance()
+		 * @return The timer, for Cancel()
+		 */
+		SlabHandle Schedule( uint64_t now, uint64_t deadline, SlabHandle target, unsigned int kind );
+
+		/**
+		 * @return False if the timer had already expired or been cancelled
+		 */
+		bool Cancel( SlabHandle timer ) throw();
+
+		/**
+		 *     Expires every timer due by now, appending them to expired in deadline order
+		 * @return How many expired
+		 */
+		size_t Advance( uint64_t now, vector<Expired>& expired );
+
+		/**
+		 *     When Advance() next has something to do: the next deadline, or sooner when timers have to move down a
+		 *     level first
+		 * @return False if no timer is armed
+		 */
+		bool Next( uint64_t& when ) const throw();
+
+		/**
+		 *     Armed timers
+		 */
+		size_t Size() const throw();
+
+	private:
+		TimingWheel( const TimingWheel& );
+		TimingWheel& operator=( const TimingWheel& );
+
+		static const unsigned int LEVELS = 4;
+		static const unsigned int SLOT_BITS = 8;
+		static const unsigned int SLOTS = 1 << SLOT_BITS;
+		static const unsigned int OVERFLOW_LIST = LEVELS * SLOTS;
+		static const unsigned int OVERDUE_LIST = OVERFLOW_LIST + 1;
+
+		struct Node
+		{
+			uint64_t deadline;
+			SlabHandle target, previous, next;
+			unsigned int kind;
+			unsigned int list; //Level * SLOTS + slot, OVERFLOW_LIST or OVERDUE_LIST
+		};
+
+		/**
+		 *     Puts a node in the list for its deadline, as seen from m_now
+		 */
+		void Insert( SlabHandle handle, Node& node ) throw();
+		void Unlink( Node& node ) throw();
+
+		/**
+		 *     Empties a list, putting each node back in the list its deadline now calls for
+		 */
+		void Cascade( unsigned int list ) throw();
+
+		/**
+		 *     If m_now is on a turn of level 0, brings down the timers in the slots the levels above have turned into
+		 */
+		void Turn() throw();
+
+		/**
+		 *     Empties a list into expired, releasing its nodes
+		 * @return How many there were
+		 */
+		size_t Expire( unsigned int list, vector<Expired>& expired );
+
+		/**
+		 *     The first slot at or after slot in a level with timers in it, or SLOTS
+		 */
+		unsigned int Occupied( unsigned int level, unsigned int slot ) const throw();
+
+		/**
+		 *     When the wheel next has work: a level 0 slot to expire, or a slot above to bring down
+		 */
+		uint64_t NextEvent() const throw();
+
+		HandleSlab<Node, 4096> m_nodes;
+		SlabHandle m_lists[OVERDUE_LIST + 1];
+		uint64_t m_occupied[LEVELS][SLOTS / 64]; //Bit per slot with timers
+		uint64_t m_now; //The next millisecond to expire; every one before it has been
+};
+
+}; //namespace Sip
+#endif //TIMINGWHEEL_HPP
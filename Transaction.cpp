@@ -0,0 +1,47 @@
+#include "Transaction.hpp"
+#include <sstream>
+#include <boost/functional/hash.hpp>
+#include "CSeq.hpp"
+#include "Via.hpp"
+
+namespace Sip {
+
+bool TransactionKey::For( const SipMessage& message, TransactionKey& key ) throw()
+{
+	if ( !message.HasHeader( "via" ) || !message.HasHeader( "cseq" ) )
+		return false;
+	try
+	{
+		const vector<SipHeaderValue>& vias = message.GetHeaderValues( "via" );
+		const vector<SipHeaderValue>& cseqs = message.GetHeaderValues( "cseq" );
+		if ( vias.empty() || cseqs.empty() )
+			return false;
+		Via via( vias.front() );
+		if ( !via.HasBranch() )
+			return false;
+		key.branch = via.Branch();
+		key.sentBy = via.HasHost() ? via.Host() : string();
+		if ( via.HasPort() )
+		{
+			std::ostringstream port;
+			port << ':' << via.Port();
+			key.sentBy += port.str();
+		}
+		key.method = CSeq( cseqs.front() ).RequestMethod();
+		return true;
+	}
+	catch ( std::exception& e )
+	{
+		return false;
+	}
+}
+
+std::size_t hash_value( const TransactionKey& key )
+{
+	std::size_t seed = boost::hash_value( key.branch );
+	boost::hash_combine( seed, key.sentBy );
+	boost::hash_combine( seed, static_cast<int>( key.method ) );
+	return seed;
+}
+
+}; //namespace Sip
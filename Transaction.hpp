@@ -0,0 +1,66 @@
+#ifndef TRANSACTION_HPP
+#define TRANSACTION_HPP
+#include <stdexcept>
+#include <string>
+#include <sys/socket.h>
+#include "SipRequest.hpp"
+
+namespace Sip {
+
+using std::string;
+using std::runtime_error;
+
+/**
+ * \class TransactionException
+ * \brief standard exception class for the transaction layer
+ */
+class TransactionException : public runtime_error
+{
+	public:
+		TransactionException ( std::string what ) throw() : runtime_error ( what ) {};
+};
+
+/**
+* \class TransactionSender
+* \brief Where transactions put their bytes on the wire. A transport, or a test double.
+*/
+class TransactionSender
+{
+	public:
+		virtual ~TransactionSender() {}
+
+		/**
+		 *     Sends one serialized message
+		 * @return False if the transport refused it, which the transaction treats as a transport error (RFC 3261 17.1.4)
+		 */
+		virtual bool Send( const string& data, const sockaddr_storage& destination ) = 0;
+};
+
+/**
+* \class TransactionKey
+* \brief What a message is matched to its transaction by: the top Via's branch and sent-by, and the CSeq method
+*        (RFC 3261 17.1.3, 17.2.3). The method keeps a CANCEL apart from the INVITE it shares a branch with.
+*/
+struct TransactionKey
+{
+	TransactionKey() : method( SipRequest::REQUEST_METHOD_INVITE ) {}
+
+	bool operator==( const TransactionKey& rhs ) const
+	{
+		return method == rhs.method && branch == rhs.branch && sentBy == rhs.sentBy;
+	}
+
+	/**
+	 *     Fills key from a request or response
+	 * @return False if the message has no top Via with a branch, or no CSeq that parses
+	 */
+	static bool For( const SipMessage& message, TransactionKey& key ) throw();
+
+	string branch, sentBy;
+	SipRequest::REQUEST_METHOD method;
+};
+
+std::size_t hash_value( const TransactionKey& key );
+
+}; //namespace Sip
+#endif //TRANSACTION_HPP
@@ -1,10 +1,88 @@
 #include "URI.hpp"
 #include "Via.hpp"
 #include "SipUtility.hpp"
-#include <boost/regex.hpp>
 #include <sstream>
+#include <cstring>
 
 namespace Sip {
+namespace {
+
+/**
+* \class URIParts
+* \brief Offsets of the pieces of a URI found by ScanURI; npos marks an optional piece that isn't there
+*/
+struct URIParts
+{
+	string::size_type protocol, protocolEnd, user, userEnd, host, hostEnd, port, portEnd, tags, tagsEnd, headers, headersEnd;
+};
+
+//	[Proto ]":"[Opt. User "@"][Host][Opt. ":"Port][Opt. URI tags][Opt. "?"hdrs]
+//	Matches uri[begin, end) exactly. userStop and tagStop are the characters that end a user part and a URI tag.
+bool ScanURI( const string& uri, string::size_type begin, string::size_type end, const char* userStop, const char* tagStop, bool withUser, URIParts& parts )
+{
+	string::size_type position = begin;
+	while ( position < end && Utility::IsWordChar( uri[position] ) )
+		++position;
+	if ( position == begin || position == end || uri[position] != ':' )
+		return false;
+	parts.protocol = begin;
+	parts.protocolEnd = position++;
+
+	parts.user = string::npos;
+	if ( withUser )
+	{
+		string::size_type userEnd = position;
+		while ( userEnd < end && strchr( userStop, uri[userEnd] ) == NULL )
+			++userEnd;
+		if ( userEnd == position || userEnd == end || uri[userEnd] != '@' )
+			return false;
+		parts.user = position;
+		parts.userEnd = userEnd;
+		position = userEnd + 1;
+	}
+
+	parts.host = position;
+	while ( position < end && strchr( "<>;:?", uri[position] ) == NULL )
+		++position;
+	if ( position == parts.host )
+		return false;
+	parts.hostEnd = position;
+
+	parts.port = string::npos;
+	if ( position < end && uri[position] == ':' )
+	{
+		parts.port = ++position;
+		while ( position < end && Utility::IsDigit( uri[position] ) )
+			++position;
+		if ( position == parts.port )
+			return false;
+		parts.portEnd = position;
+	}
+
+	parts.tags = position;
+	while ( position < end && uri[position] == ';' )
+	{
+		string::size_type tag = ++position;
+		while ( position < end && strchr( tagStop, uri[position] ) == NULL )
+			++position;
+		if ( position == tag )
+			return false;
+	}
+	parts.tagsEnd = position;
+
+	parts.headers = string::npos;
+	if ( position < end && uri[position] == '?' )
+	{
+		if ( position + 1 == end )
+			return false;
+		parts.headers = position + 1;
+		parts.headersEnd = position = end;
+	}
+
+	return position == end;
+}
+
+}; //namespace
 
 URI::URI( const SipHeaderValue& srhv ) throw( URIException )
 	:  has_displayName( false ), has_protocol( false ), has_user( false ), has_host( false ),has_port( false ), has_URIHeaders( false )
@@ -240,123 +318,78 @@ ostream& operator<< ( ostream &stream, const URI& uri )
 
 void URI::ParseURI( const string& uriAsString ) throw( URIException )
 {
-	//TODO: nakedURI MUST NOT MATCH SOMETHING WITH BRACKETS
 	//TODO: match either host[:port] or user@host[:port] rather than current scheme for part before URI parameters
 
-	//                                      1                         2          3           4        5                     6                   7
-	//                           [Optional Name           ]     [Prot] [Opt. User     ][Host    ][Opt. Port ][Opt.URI tags ][Opt. hdrs ]
-	boost::regex bracketedURI( "^((?:\".*?\")|(?:[^<\"]+))?\\s*<(\\w+):(?:([^<>@;\\?]+)@)?([^<>;:\\?]+)(?::(\\d+))?((?:;[^;?>]+)*)(?:\\?(.+))?>$" );
-
-	//                               1         2          3         4            5            6
-	//								 [Proto  ] [Opt. User   ][Host    ][Opt.Port  ][Opt.URI tags][Opt. hdrs ]
-	boost::regex nakedURI( "^(^\\w+):(?:([^<>@;]+)@)?([^<>;:\\?]+)(?::(\\d+))?((?:;[^;?]+)*)(?:\\?(.+))?$" );
-	boost::cmatch matches;
-
-	if ( boost::regex_match( uriAsString.c_str(), matches, bracketedURI ) ) //Looks like a bracketed URI... might have a display name
+	//Bracketed: [ quoted-string | display name ] *WS "<" uri ">"
+	string::size_type leftBracket = string::npos, nameEnd = 0;
+	if ( !uriAsString.empty() && uriAsString[0] == '"' )
 	{
-		string 	rawTags;
-
-		for ( uint sub = 1; sub < matches.size(); ++sub )
+		for ( string::size_type quote = uriAsString.find( '"', 1 ); leftBracket == string::npos && quote != string::npos; quote = uriAsString.find( '"', quote + 1 ) )
 		{
-			switch ( sub )
+			string::size_type next = quote + 1;
+			while ( next < uriAsString.length() && Utility::IsSpace( uriAsString[next] ) )
+				++next;
+			if ( next < uriAsString.length() && uriAsString[next] == '<' )
 			{
-				case 1:	//Optional Name
-					if ( matches[sub].matched )
-					{
-						boost::regex quotes( "\"" );
-						string displayName = string( matches[sub].first, matches[sub].second );
-						m_displayName = boost::regex_replace( displayName, quotes, "" );
-						this->has_displayName = true;
-					}
-					break;
-				case 2:	//Protocol
-					m_protocol = string ( matches[sub].first, matches[sub].second );
-					this->has_protocol = true;
-					break;
-				case 3:	//Optional User
-					if ( matches[sub].matched )
-					{
-						m_user = string ( matches[sub].first, matches[sub].second );
-						this->has_user = true;
-					}
-					break;
-				case 4:	//Host
-					m_host = string( matches[sub].first, matches[sub].second ) ;
-					this->has_host = true;
-					break;
-				case 5:	//Optional host port
-					if ( matches[sub].matched )
-					{
-						m_port = atoi( string( matches[sub].first, matches[sub].second ).c_str() );
-						this->has_port = true;
-					}
-					break;
-				case 6:	//Optional URI tags
-					rawTags = string( matches[sub].first, matches[sub].second );
-					if ( rawTags != "" )
-					{
-						Utility::FillTags( rawTags, m_URIParameters);
-					}
-					break;
-				case 7:	//Optional URI headers
-					if ( matches[sub].matched )
-					{
-						m_URIHeaders = string( matches[sub].first, matches[sub].second ) ;
-						this->has_URIHeaders = true;
-					}
-					break;
+				leftBracket = next;
+				nameEnd = quote + 1;
 			}
 		}
 	}
-	else if ( boost::regex_match( uriAsString.c_str(), matches, nakedURI ) ) //Ok, this must be a non-bracketed URI
+	else
 	{
-		string 	rawTags;
+		leftBracket = uriAsString.find_first_of( "<\"" );
+		if ( leftBracket != string::npos && uriAsString[leftBracket] == '"' )
+			leftBracket = string::npos;
+		nameEnd = leftBracket;
+	}
 
-		for ( uint sub = 1; sub < matches.size(); ++sub )
-		{
-			switch ( sub )
-			{
-				case 1:	//Protocol
-					m_protocol = string ( matches[sub].first, matches[sub].second );
-					this->has_protocol = true;
-					break;
-				case 2:	//Optional User
-					if ( matches[sub].matched )
-					{
-						m_user = string ( matches[sub].first, matches[sub].second );
-						this->has_user = true;
-					}
-					break;
-				case 3:	//Host
-					m_host = string( matches[sub].first, matches[sub].second ) ;
-					this->has_host = true;
-					break;
-				case 4:	//Optional host port
-					if ( matches[sub].matched )
-					{
-						m_port = atoi( string( matches[sub].first, matches[sub].second ).c_str() );
-						this->has_port = true;
-					}
-					break;
-				case 5:	//Optional URI tags
-					rawTags = string( matches[sub].first, matches[sub].second );
-					if ( rawTags != "" )
-					{
-						Utility::FillTags( rawTags, m_URIParameters);
-					}
-					break;
-				case 6:	//Optional URI headers
-					if ( matches[sub].matched )
-					{
-						m_URIHeaders = string( matches[sub].first, matches[sub].second ) ;
-						this->has_URIHeaders = true;
-					}
-					break;
-			}
-		}
+	URIParts parts;
+	bool bracketed = leftBracket != string::npos && uriAsString[uriAsString.length() - 1] == '>' && leftBracket + 1 < uriAsString.length();
+	if ( bracketed )
+	{
+		bracketed = ScanURI( uriAsString, leftBracket + 1, uriAsString.length() - 1, "<>@;?", ";?>", true, parts ) ||
+			ScanURI( uriAsString, leftBracket + 1, uriAsString.length() - 1, "<>@;?", ";?>", false, parts );
 	}
-	else
+	if ( !bracketed && !ScanURI( uriAsString, 0, uriAsString.length(), "<>@;", ";?", true, parts ) &&
+		!ScanURI( uriAsString, 0, uriAsString.length(), "<>@;", ";?", false, parts ) )
 		throw URIException( string( "Invalid URI: " ) + uriAsString );
+
+	if ( parts.tags != parts.tagsEnd && !Utility::FillTags( uriAsString.substr( parts.tags, parts.tagsEnd - parts.tags ), m_URIParameters ) )
+		throw URIException( string( "URI exceeds SIP_MAX_PARAMETERS: " ) + uriAsString );
+
+	if ( bracketed && nameEnd != 0 ) //Optional Name
+	{
+		m_displayName.clear();
+		for ( string::size_type i = 0; i < nameEnd; ++i )
+			if ( uriAsString[i] != '"' )
+				m_displayName += uriAsString[i];
+		this->has_displayName = true;
+	}
+
+	m_protocol = uriAsString.substr( parts.protocol, parts.protocolEnd - parts.protocol );
+	this->has_protocol = true;
+
+	if ( parts.user != string::npos )
+	{
+		m_user = uriAsString.substr( parts.user, parts.userEnd - parts.user );
+		this->has_user = true;
+	}
+
+	m_host = uriAsString.substr( parts.host, parts.hostEnd - parts.host );
+	this->has_host = true;
+
+	if ( parts.port != string::npos )
+	{
+		m_port = atoi( uriAsString.c_str() + parts.port );
+		this->has_port = true;
+	}
+
+	if ( parts.headers != string::npos )
+	{
+		m_URIHeaders = uriAsString.substr( parts.headers, parts.headersEnd - parts.headers );
+		this->has_URIHeaders = true;
+	}
 }
 
 bool URI::IsURI( const string& uri ) throw()
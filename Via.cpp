@@ -1,6 +1,6 @@
 #include "Via.hpp"
-#include <boost/regex.hpp>
 #include <sstream>
+#include "SipUtility.hpp"
 namespace Sip {
 Via::Via ( const SipHeaderValue& shv ) throw ( ViaException )
 	: has_port( false ), has_host( false ), has_transportProtocol( false ), m_rfc3261compliant( false ), has_branch( false )
@@ -86,7 +86,7 @@ string Sip::Via::ToString() const
 	asString << "SIP/2.0/";
 	if ( has_transportProtocol ) {
 		string transportProtocolAsString( TransportProtocolTypes.ReverseGet( m_transportProtocol ) );
-		transform( transportProtocolAsString.begin(), transportProtocolAsString.end(), transportProtocolAsString.begin(), (int(*)(int))toupper );
+		transform( transportProtocolAsString.begin(), transportProtocolAsString.end(), transportProtocolAsString.begin(), AsciiToUpper );
 		asString << transportProtocolAsString;
 	}
 	else
@@ -116,10 +116,6 @@ SipHeaderValue Via::ToSHV() {
 
 void Via::ParseFromSHV( const SipHeaderValue& shv )
 {
-	//                                                     1                          2         3
-	//                                    [Protocol                        ]   [Host       ][Opt. Port ]
-	boost::regex viaExpression( "^SIP/2.0/((?:UDP)|(?:TCP)|(?:TLS)|(?:SCTP))\\s([^:\\?<>;]+)(?::(\\d+))?.*$" );
-	boost::cmatch matches;
 
 	try
 	{
@@ -136,9 +132,22 @@ void Via::ParseFromSHV( const SipHeaderValue& shv )
 			m_branch = shv.Tags().find( "branch" )->second;
 		}
 
-		if ( boost::regex_match( shv.Value().c_str(), matches, viaExpression ) )
+		//"SIP/2.0/" transport SP host [ ":" port ] ...
+		const string& value = shv.Value();
+		string::size_type transportEnd = value.find_first_of( " \t\r\n\v\f", 8 );
+		string::size_type hostEnd = string::npos;
+		string transportProtocolAsString;
+		if ( transportEnd != string::npos )
+		{
+			transportProtocolAsString = value.substr( 8, transportEnd - 8 );
+			hostEnd = value.find_first_of( ":?<>;", transportEnd + 1 );
+			if ( hostEnd == string::npos )
+				hostEnd = value.length();
+		}
+
+		if ( value.compare( 0, 8, "SIP/2.0/" ) == 0 && transportEnd != string::npos && hostEnd > transportEnd + 1 &&
+			( transportProtocolAsString == "UDP" || transportProtocolAsString == "TCP" || transportProtocolAsString == "TLS" || transportProtocolAsString == "SCTP" ) )
 		{
-			string transportProtocolAsString( matches[1].first, matches[1].second );
 			try
 			{
 				m_transportProtocol = TransportProtocolTypes.GetCase( transportProtocolAsString );
@@ -146,15 +155,15 @@ void Via::ParseFromSHV( const SipHeaderValue& shv )
 			}
 			catch ( LookupTableException& e )
 			{
-				throw ViaException( string( "Uknown protocol specified in Via: " ) + string( matches[1].first, matches[1].second ) );
+				throw ViaException( string( "Uknown protocol specified in Via: " ) + transportProtocolAsString );
 			}
 
-			m_host = string( matches[2].first, matches[2].second );
+			m_host = value.substr( transportEnd + 1, hostEnd - transportEnd - 1 );
 			this->has_host = true;
 
-			if ( matches[3].matched ) //Port?
+			if ( hostEnd + 1 < value.length() && value[hostEnd] == ':' && Utility::IsDigit( value[hostEnd + 1] ) ) //Port?
 			{
-				m_port = atoi( string( matches[3].first, matches[3].second ).c_str() );
+				m_port = atoi( value.c_str() + hostEnd + 1 );
 				this->has_port = true;
 			}
 		}
@@ -0,0 +1,87 @@
+#ifndef BENCHCOMMON_HPP
+#define BENCHCOMMON_HPP
+#include <string>
+#include <vector>
+#include <cstdio>
+#include <stdint.h>
+#include <time.h>
+#if defined( __x86_64__ ) || defined( __i386__ )
+#include <x86intrin.h>
+#define BENCH_HAS_TSC 1
+#endif
+
+namespace Bench {
+
+using std::string;
+using std::vector;
+
+/**
+ *     Monotonic clock in nanoseconds
+ */
+inline uint64_t NowNs()
+{
+	timespec now;
+	clock_gettime( CLOCK_MONOTONIC, &now );
+	return static_cast<uint64_t>( now.tv_sec ) * 1000000000ULL + now.tv_nsec;
+}
+
+/**
+ *     Reads the CPU timestamp counter, or 0 where there isn't one
+ */
+inline uint64_t ReadCycles()
+{
+#ifdef BENCH_HAS_TSC
+	return __rdtsc();
+#else
+	return 0;
+#endif
+}
+
+/**
+ *     Escapes a string for use as a JSON string literal (without the quotes)
+ */
+inline string JsonEscape( const string& raw )
+{
+	string escaped;
+	escaped.reserve( raw.length() );
+	for ( string::const_iterator c = raw.begin(); c != raw.end(); ++c )
+	{
+		switch ( *c )
+		{
+			case '"': escaped += "\\\""; break;
+			case '\\': escaped += "\\\\"; break;
+			case '\r': escaped += "\\r"; break;
+			case '\n': escaped += "\\n"; break;
+			case '\t': escaped += "\\t"; break;
+			default:
+				if ( static_cast<unsigned char>( *c ) < 0x20 )
+				{
+					char code[ 8 ];
+					snprintf( code, sizeof( code ), "\\u%04x", static_cast<unsigned char>( *c ) );
+					escaped += code;
+				}
+				else
+					escaped += *c;
+		}
+	}
+	return escaped;
+}
+
+/**
+ *     Returns the value at the given percentile (0-100) of an already sorted sample set
+ */
+inline uint64_t Percentile( const vector<uint64_t>& sorted, double percentile )
+{
+	if ( sorted.empty() )
+		return 0;
+	size_t rank = static_cast<size_t>( percentile / 100.0 * ( sorted.size() - 1 ) + 0.5 );
+	return sorted[ rank < sorted.size() ? rank : sorted.size() - 1 ];
+}
+
+/**
+ * 	Keeps results alive so the optimizer can't discard benchmarked work
+ */
+static volatile size_t Sink = 0;
+
+}; //namespace Bench
+#endif //BENCHCOMMON_HPP
@@ -0,0 +1,199 @@
+//
+// sip_adversarial_bench: parse cost of hostile input
+//
+// Builds messages aimed at the worst cases of a SIP parser (very long headers, thousands of commas or semicolons,
+// unbalanced quotes and angle brackets, huge parameter counts, many or folded header lines) at increasing sizes and
+// times Utility::ParseMessage plus URI, Via and CSeq parsing of every value that survives. Each case reports
+// ns_per_byte per size and "growth": ns_per_byte at the largest size over ns_per_byte at the one before it, where fixed
+// per-message costs no longer dominate. Linear parsing keeps growth at or below 1.0; anything well above it is a denial
+// of service waiting to happen.
+//
+// Messages over the parser's hard limits are rejected, which is expected; "rejected" says whether that happened.
+//
+#include <iostream>
+#include <sstream>
+#include <cstdlib>
+#include <cstring>
+#include "BenchCommon.hpp"
+#include "../SipUtility.hpp"
+#include "../SipRequest.hpp"
+#include "../URI.hpp"
+#include "../Via.hpp"
+#include "../CSeq.hpp"
+
+using namespace Sip;
+using namespace std;
+
+namespace {
+
+/// Builds the hostile part of a message, roughly size bytes of it
+typedef string (*Generator)( size_t size );
+
+string Repeat( const string& unit, size_t size )
+{
+	string repeated;
+	repeated.reserve( size + unit.length() );
+	while ( repeated.length() < size )
+		repeated += unit;
+	return repeated;
+}
+
+string LongHeader( size_t size ) { return "Subject: " + Repeat( "a", size ) + "\r\n"; }
+string ManyCommas( size_t size ) { return "Accept: " + Repeat( ",", size ) + "\r\n"; }
+string ManySemicolons( size_t size ) { return "Contact: <sip:bob@192.0.2.4>" + Repeat( ";", size ) + "\r\n"; }
+string SemicolonsNoValue( size_t size ) { return "Contact: sip:bob@192.0.2.4" + Repeat( ";a", size ) + ";\r\n"; }
+string ManyParameters( size_t size ) { return "Contact: <sip:bob@192.0.2.4>" + Repeat( ";p=1", size ) + "\r\n"; }
+string UnbalancedQuotes( size_t size ) { return "Contact: " + Repeat( "\"a \" ", size ) + "<sip:bob@192.0.2.4\r\n"; }
+string UnbalancedBrackets( size_t size ) { return "Contact: " + Repeat( "<", size ) + "sip:bob@192.0.2.4;x=y\r\n"; }
+string UriParameters( size_t size ) { return "Contact: <sip:bob@192.0.2.4" + Repeat( ";x", size ) + ";>\r\n"; }
+string ManyHeaders( size_t size ) { return Repeat( "X-A: b\r\n", size ); }
+string FoldedLines( size_t size ) { return "Subject: a" + Repeat( "\r\n a", size ) + "\r\n"; }
+string NoColon( size_t size ) { return Repeat( "Subject a b c d e\r\n", size ); }
+string NameNoColon( size_t size ) { return "X" + Repeat( " a-b", size ) + "\r\n"; }
+
+/**
+ *     A valid INVITE with the hostile header lines added before Content-Length
+ */
+string Message( Generator generator, size_t size )
+{
+	return "INVITE sip:bob@192.0.2.4 SIP/2.0\r\n"
+		"Via: SIP/2.0/UDP 192.0.2.1:5060;branch=z9hG4bK776asdhds\r\n"
+		"Max-Forwards: 70\r\n"
+		"To: Bob <sip:bob@192.0.2.4>\r\n"
+		"From: Alice <sip:alice@192.0.2.1>;tag=1928301774\r\n"
+		"Call-ID: a84b4c76e66710@192.0.2.1\r\n"
+		"CSeq: 314159 INVITE\r\n"
+		+ generator( size ) +
+		"Content-Length: 0\r\n\r\n";
+}
+
+/**
+ *     Parses raw and everything structured inside it; returns false if the parser refused the message
+ */
+bool ParseAll( const string& raw )
+{
+	auto_ptr<SipMessage> message;
+	try
+	{
+		Utility::ParseMessage( message, raw );
+	}
+	catch ( SipMessageException& e )
+	{
+		return false;
+	}
+
+	const vector<SipHeader>& headers = message->GetAllHeaders();
+	for ( vector<SipHeader>::const_iterator header = headers.begin(); header != headers.end(); ++header )
+	{
+		for ( vector<SipHeaderValue>::const_iterator value = header->shvs.begin(); value != header->shvs.end(); ++value )
+		{
+			try { Bench::Sink += URI( *value ).HasHost(); } catch ( URIException& e ) {}
+			try { Bench::Sink += Via( *value ).HasPort(); } catch ( ViaException& e ) {}
+			try { Bench::Sink += CSeq( *value ).Sequence(); } catch ( CSeqException& e ) {}
+		}
+	}
+	return true;
+}
+
+struct Case
+{
+	const char* name;
+	Generator generator;
+};
+
+const Case cases[] = {
+	{ "long_header", LongHeader },
+	{ "many_commas", ManyCommas },
+	{ "many_semicolons", ManySemicolons },
+	{ "semicolons_no_value", SemicolonsNoValue },
+	{ "many_parameters", ManyParameters },
+	{ "unbalanced_quotes", UnbalancedQuotes },
+	{ "unbalanced_brackets", UnbalancedBrackets },
+	{ "uri_parameters", UriParameters },
+	{ "many_headers", ManyHeaders },
+	{ "folded_lines", FoldedLines },
+	{ "no_colon", NoColon },
+	{ "name_no_colon", NameNoColon },
+	{ NULL, NULL }
+};
+
+//Hostile bytes per message; the last stays under SIP_MAX_MESSAGE_SIZE so size alone doesn't reject it
+const size_t sizes[] = { 256, 1024, 4096, 16384, 60000, 0 };
+
+struct Options
+{
+	Options() : minTimeMs( 200 ) {}
+	unsigned int minTimeMs;
+	string onlyCase;
+};
+
+bool ParseOptions( int argc, char* argv[], Options& options )
+{
+	for ( int arg = 1; arg + 1 < argc; arg += 2 )
+	{
+		string name( argv[arg] );
+		if ( name == "--min-time-ms" )
+			options.minTimeMs = atoi( argv[arg + 1] );
+		else if ( name == "--case" )
+			options.onlyCase = argv[arg + 1];
+		else
+			return false;
+	}
+	return argc % 2 == 1;
+}
+
+}; //namespace
+
+int main( int argc, char* argv[] )
+{
+	Options options;
+	if ( !ParseOptions( argc, argv, options ) )
+	{
+		cerr << "usage: sip_adversarial_bench [--min-time-ms N] [--case NAME]" << endl;
+		return 1;
+	}
+
+	cout << "{\n  \"benchmark\": \"sip_adversarial_bench\",\n  \"schema\": 1,\n  \"cases\": [";
+	bool firstCase = true;
+	for ( const Case* adversary = cases; adversary->name != NULL; ++adversary )
+	{
+		if ( !options.onlyCase.empty() && options.onlyCase != adversary->name )
+			continue;
+
+		ostringstream json;
+		json << ( firstCase ? "" : "," ) << "\n    { \"case\": \"" << adversary->name << "\", \"sizes\": [";
+		firstCase = false;
+
+		double previousNsPerByte = 0, lastNsPerByte = 0;
+		for ( const size_t* size = sizes; *size != 0; ++size )
+		{
+			string raw = Message( adversary->generator, *size );
+			bool accepted = ParseAll( raw );
+
+			uint64_t runs = 0, startNs = Bench::NowNs(), elapsedNs = 0;
+			do
+			{
+				ParseAll( raw );
+				++runs;
+				elapsedNs = Bench::NowNs() - startNs;
+			} while ( elapsedNs < options.minTimeMs * 1000000ULL );
+
+			double nsPerMessage = static_cast<double>( elapsedNs ) / runs;
+			previousNsPerByte = lastNsPerByte;
+			lastNsPerByte = nsPerMessage / raw.length();
+
+			char line[ 256 ];
+			snprintf( line, sizeof( line ), "%s\n        { \"bytes\": %lu, \"rejected\": %s, \"ns_per_message\": %.1f, \"ns_per_byte\": %.3f }",
+				size == sizes ? "" : ",", static_cast<unsigned long>( raw.length() ), accepted ? "false" : "true", nsPerMessage, lastNsPerByte );
+			json << line;
+		}
+
+		char growth[ 64 ];
+		snprintf( growth, sizeof( growth ), "%.2f", previousNsPerByte > 0 ? lastNsPerByte / previousNsPerByte : 0.0 );
+		json << "\n      ], \"growth\": " << growth << " }";
+		cout << json.str() << flush;
+	}
+	cout << "\n  ]\n}\n";
+
+	return 0;
+}
@@ -0,0 +1,163 @@
+//
+// sip_alloc_bench: allocation and memory footprint report for the parse and registrar paths
+//
+// Linked against tests/AllocationCounter.cpp, which counts every global operator new/delete. For each message
+// type in the corpora it reports allocations and bytes per message for parsing, ToString, building a response
+// from a request and (for REGISTER) Registrar::HandleRequest, plus the resident bytes a retained parsed message
+// keeps alive. Output is JSON with fixed keys and ordering.
+//
+#include <iostream>
+#include <map>
+#include <cstring>
+#include "BenchCommon.hpp"
+#include "../tests/AllocationCounter.hpp"
+#include "../SipUtility.hpp"
+#include "../SipRequest.hpp"
+#include "../SipResponse.hpp"
+#include "../Registrar.hpp"
+
+#include "../tests/sip_messages.h"
+#include "../tests/registrar_sip_messages.h"
+
+using namespace Sip;
+using namespace std;
+
+namespace {
+
+/**
+* \class PathTotals
+* \brief Allocation totals for one path over every message of one type
+*/
+struct PathTotals
+{
+	PathTotals() : messages( 0 ), allocations( 0 ), bytes( 0 ) {}
+
+	void Add( const AllocationCounter::Counts& used )
+	{
+		++messages;
+		allocations += used.allocations;
+		bytes += used.bytes;
+	}
+
+	uint64_t messages, allocations, bytes;
+};
+
+struct TypeTotals
+{
+	TypeTotals() : rawBytes( 0 ), retainedBytes( 0 ) {}
+
+	PathTotals parse, toString, response, registrar;
+	uint64_t rawBytes;
+	int64_t retainedBytes;
+};
+
+string MessageType( const SipMessage& message )
+{
+	if ( message.Type == SipMessage::MT_REQUEST )
+	{
+		string method = RequestTypes.ReverseGet( static_cast<const SipRequest&>( message ).RequestMethod() );
+		transform( method.begin(), method.end(), method.begin(), (int(*)(int))toupper );
+		return method;
+	}
+	char name[ 32 ];
+	snprintf( name, sizeof( name ), "response_%dxx", static_cast<const SipResponse&>( message ).StatusCode() / 100 );
+	return name;
+}
+
+void Measure( const char* raw, Registrar& registrar, map<string, TypeTotals>& totals, vector<SipMessage*>& retained )
+{
+	auto_ptr<SipMessage> message;
+	AllocationCounter::Counts start = AllocationCounter::Now();
+	try
+	{
+		Utility::ParseMessage( message, raw );
+	}
+	catch ( SipMessageException& e )
+	{
+		cerr << "sip_alloc_bench: skipping unparseable message: " << e.what() << endl;
+		return;
+	}
+	AllocationCounter::Counts parse = AllocationCounter::Since( start );
+
+	TypeTotals& type = totals[ MessageType( *message ) ];
+	type.parse.Add( parse );
+	type.rawBytes += strlen( raw );
+
+	start = AllocationCounter::Now();
+	if ( message->Type == SipMessage::MT_REQUEST )
+		Bench::Sink += static_cast<SipRequest&>( *message ).ToString().length();
+	else
+		Bench::Sink += static_cast<SipResponse&>( *message ).ToString().length();
+	type.toString.Add( AllocationCounter::Since( start ) );
+
+	if ( message->Type == SipMessage::MT_REQUEST )
+	{
+		const SipRequest& request = static_cast<SipRequest&>( *message );
+		start = AllocationCounter::Now();
+		{
+			SipResponse response( 200, "OK", request );
+		}
+		type.response.Add( AllocationCounter::Since( start ) );
+
+		if ( request.RequestMethod() == SipRequest::REQUEST_METHOD_REGISTER )
+		{
+			start = AllocationCounter::Now();
+			{
+				auto_ptr<SipResponse> response( registrar.HandleRequest( request ) );
+			}
+			type.registrar.Add( AllocationCounter::Since( start ) );
+		}
+	}
+
+	//Measured separately from the first parse so the scratch work above doesn't count
+	start = AllocationCounter::Now();
+	auto_ptr<SipMessage> kept;
+	Utility::ParseMessage( kept, raw );
+	retained.push_back( kept.release() );
+	type.retainedBytes += AllocationCounter::Since( start ).liveBytes;
+}
+
+void PrintPath( ostream& json, const char* name, const PathTotals& path, bool last )
+{
+	char line[ 256 ];
+	if ( path.messages == 0 )
+		snprintf( line, sizeof( line ), "\"%s\": null", name );
+	else
+		snprintf( line, sizeof( line ), "\"%s\": { \"allocations_per_message\": %.1f, \"bytes_per_message\": %.1f }",
+			name, static_cast<double>( path.allocations ) / path.messages, static_cast<double>( path.bytes ) / path.messages );
+	json << line << ( last ? " }" : ", " );
+}
+
+}; //namespace
+
+int main( int argc, char* argv[] )
+{
+	map<string, TypeTotals> totals;
+	vector<SipMessage*> retained;
+	Registrar registrar;
+
+	for ( int i = 0; sip_messages[i] != NULL; ++i )
+		Measure( sip_messages[i], registrar, totals, retained );
+	for ( int i = 0; register_sip_messages[i] != NULL; ++i )
+		Measure( register_sip_messages[i], registrar, totals, retained );
+
+	cout << "{\n  \"benchmark\": \"sip_alloc_bench\",\n  \"schema\": 1,\n  \"types\": [";
+	for ( map<string, TypeTotals>::const_iterator type = totals.begin(); type != totals.end(); ++type )
+	{
+		char line[ 256 ];
+		snprintf( line, sizeof( line ), "%s\n    { \"type\": \"%s\", \"messages\": %llu, \"raw_bytes_per_message\": %.1f, \"retained_bytes_per_message\": %.1f, ",
+			type == totals.begin() ? "" : ",", type->first.c_str(), static_cast<unsigned long long>( type->second.parse.messages ),
+			static_cast<double>( type->second.rawBytes ) / type->second.parse.messages,
+			static_cast<double>( type->second.retainedBytes ) / type->second.parse.messages );
+		cout << line;
+		PrintPath( cout, "parse", type->second.parse, false );
+		PrintPath( cout, "to_string", type->second.toString, false );
+		PrintPath( cout, "response_from_request", type->second.response, false );
+		PrintPath( cout, "registrar", type->second.registrar, true );
+	}
+	cout << "\n  ]\n}\n";
+
+	for ( vector<SipMessage*>::iterator message = retained.begin(); message != retained.end(); ++message )
+		delete *message;
+	return 0;
+}
@@ -0,0 +1,365 @@
+//
+// sip_bench: parser and serializer microbenchmarks
+//
+// Runs each case over each corpus until --min-time-ms has elapsed and prints one JSON document.
+// Keys and ordering are fixed so results can be diffed across releases.
+//
+#include <iostream>
+#include <fstream>
+#include <sstream>
+#include <cstdlib>
+#include <cstring>
+#include "BenchCommon.hpp"
+#include "../SipUtility.hpp"
+#include "../SipRequest.hpp"
+#include "../SipResponse.hpp"
+#include "../URI.hpp"
+#include "../Via.hpp"
+#include "../CSeq.hpp"
+
+#include "../tests/sip_messages.h"
+#include "../tests/registrar_sip_messages.h"
+
+using namespace Sip;
+using namespace std;
+
+namespace {
+
+/**
+* \class Corpus
+* \brief A named set of raw messages along with their parsed forms
+*/
+class Corpus
+{
+	public:
+		Corpus( const string& name ) : Name( name ), Bytes( 0 ) {}
+		~Corpus()
+		{
+			for ( vector<SipMessage*>::iterator message = Parsed.begin(); message != Parsed.end(); ++message )
+				delete *message;
+		}
+
+		/**
+		 *     Adds a message, if it parses. Unparseable messages are reported and skipped.
+		 */
+		void Add( const string& raw )
+		{
+			auto_ptr<SipMessage> message;
+			try
+			{
+				Utility::ParseMessage( message, raw );
+			}
+			catch ( SipMessageException& e )
+			{
+				cerr << "sip_bench: skipping unparseable message in " << Name << ": " << e.what() << endl;
+				return;
+			}
+			Raw.push_back( raw );
+			Parsed.push_back( message.release() );
+			Bytes += raw.length();
+		}
+
+		string Name;
+		vector<string> Raw;
+		vector<SipMessage*> Parsed;
+		size_t Bytes;
+
+	private:
+		Corpus( const Corpus& );
+		Corpus& operator=( const Corpus& );
+};
+
+/// One pass of a case over a corpus; returns the number of messages processed and adds to bytes
+typedef size_t (*CaseFunction)( const Corpus& corpus, size_t& bytes );
+
+string Serialize( const SipMessage& message )
+{
+	if ( message.Type == SipMessage::MT_REQUEST )
+		return static_cast<const SipRequest&>( message ).ToString();
+	else
+		return static_cast<const SipResponse&>( message ).ToString();
+}
+
+size_t CaseParse( const Corpus& corpus, size_t& bytes )
+{
+	for ( vector<string>::const_iterator raw = corpus.Raw.begin(); raw != corpus.Raw.end(); ++raw )
+	{
+		auto_ptr<SipMessage> message;
+		Utility::ParseMessage( message, *raw );
+		Bench::Sink += message->GetAllHeaders().size();
+		bytes += raw->length();
+	}
+	return corpus.Raw.size();
+}
+
+size_t CaseHeaderLookup( const Corpus& corpus, size_t& bytes )
+{
+	static const char* lookups[] = { "via", "from", "to", "call-id", "cseq", "contact", "max-forwards", "content-type", NULL };
+
+	for ( size_t i = 0; i < corpus.Parsed.size(); ++i )
+	{
+		const SipMessage& message = *corpus.Parsed[i];
+		for ( const char** header = lookups; *header != NULL; ++header )
+		{
+			if ( message.HasHeader( *header ) )
+				Bench::Sink += message.GetHeaderValues( *header ).size();
+		}
+		bytes += corpus.Raw[i].length();
+	}
+	return corpus.Parsed.size();
+}
+
+size_t CaseURI( const Corpus& corpus, size_t& bytes )
+{
+	size_t processed = 0;
+	for ( size_t i = 0; i < corpus.Parsed.size(); ++i )
+	{
+		const SipMessage& message = *corpus.Parsed[i];
+		Bench::Sink += URI( message.GetHeaderValues( "from" )[0] ).HasUser();
+		Bench::Sink += URI( message.GetHeaderValues( "to" )[0] ).HasUser();
+		if ( message.HasHeader( "contact" ) )
+			Bench::Sink += URI( message.GetHeaderValues( "contact" )[0] ).HasHost();
+		bytes += corpus.Raw[i].length();
+		++processed;
+	}
+	return processed;
+}
+
+size_t CaseVia( const Corpus& corpus, size_t& bytes )
+{
+	for ( size_t i = 0; i < corpus.Parsed.size(); ++i )
+	{
+		Bench::Sink += Via( corpus.Parsed[i]->GetHeaderValues( "via" )[0] ).HasPort();
+		bytes += corpus.Raw[i].length();
+	}
+	return corpus.Parsed.size();
+}
+
+size_t CaseCSeq( const Corpus& corpus, size_t& bytes )
+{
+	for ( size_t i = 0; i < corpus.Parsed.size(); ++i )
+	{
+		Bench::Sink += CSeq( corpus.Parsed[i]->GetHeaderValues( "cseq" )[0] ).Sequence();
+		bytes += corpus.Raw[i].length();
+	}
+	return corpus.Parsed.size();
+}
+
+size_t CaseToString( const Corpus& corpus, size_t& bytes )
+{
+	for ( size_t i = 0; i < corpus.Parsed.size(); ++i )
+	{
+		Bench::Sink += Serialize( *corpus.Parsed[i] ).length();
+		bytes += corpus.Raw[i].length();
+	}
+	return corpus.Parsed.size();
+}
+
+size_t CaseResponse( const Corpus& corpus, size_t& bytes )
+{
+	size_t processed = 0;
+	for ( size_t i = 0; i < corpus.Parsed.size(); ++i )
+	{
+		if ( corpus.Parsed[i]->Type != SipMessage::MT_REQUEST )
+			continue;
+		SipResponse response( 200, "OK", static_cast<const SipRequest&>( *corpus.Parsed[i] ) );
+		Bench::Sink += response.GetAllHeaders().size();
+		bytes += corpus.Raw[i].length();
+		++processed;
+	}
+	return processed;
+}
+
+struct Case
+{
+	const char* name;
+	CaseFunction function;
+};
+
+const Case cases[] = {
+	{ "parse", CaseParse },
+	{ "header_lookup", CaseHeaderLookup },
+	{ "uri", CaseURI },
+	{ "via", CaseVia },
+	{ "cseq", CaseCSeq },
+	{ "to_string", CaseToString },
+	{ "response_from_request", CaseResponse },
+	{ NULL, NULL }
+};
+
+/**
+ *     Builds an INVITE that has gone through a long proxy chain and carries a large SDP offer. It has 2 * hops + 13
+ *     header lines, so hops over 57 make it unparseable under SIP_MAX_HEADERS.
+ */
+string LargeInvite( int hops, int mediaLines )
+{
+	ostringstream body;
+	body << "v=0\r\n"
+		<< "o=- 1251311173 1251311173 IN IP4 172.20.3.46\r\n"
+		<< "s=Synthetic\r\n"
+		<< "c=IN IP4 172.20.3.46\r\n"
+		<< "t=0 0\r\n";
+	for ( int media = 0; media < mediaLines; ++media )
+	{
+		body << "m=audio " << 2000 + media * 2 << " RTP/AVP 9 0 8 18 101\r\n"
+			<< "a=rtpmap:9 G722/8000\r\n"
+			<< "a=rtpmap:0 PCMU/8000\r\n"
+			<< "a=rtpmap:8 PCMA/8000\r\n"
+			<< "a=rtpmap:18 G729/8000\r\n"
+			<< "a=fmtp:18 annexb=no\r\n"
+			<< "a=rtpmap:101 telephone-event/8000\r\n";
+	}
+
+	ostringstream message;
+	message << "INVITE sip:2100@172.20.3.28;user=phone SIP/2.0\r\n";
+	for ( int hop = hops; hop > 0; --hop )
+		message << "Via: SIP/2.0/UDP 10.0." << hop / 250 << '.' << hop % 250 + 1 << ":5060;branch=z9hG4bK" << 100000 + hop << "\r\n";
+	message << "Via: SIP/2.0/UDP 172.20.3.46;branch=z9hG4bKce49e348C486E67\r\n";
+	for ( int hop = 1; hop <= hops; ++hop )
+		message << "Record-Route: <sip:10.0." << hop / 250 << '.' << hop % 250 + 1 << ";lr>\r\n";
+	message << "From: \"2278\" <sip:2278@172.20.3.28>;tag=F29AA123-A06C7B62\r\n"
+		<< "To: <sip:2100@172.20.3.28;user=phone>\r\n"
+		<< "CSeq: 1 INVITE\r\n"
+		<< "Call-ID: f3c99e26-20e78e85-6ecadb84@172.20.3.46\r\n"
+		<< "Contact: <sip:2278@172.20.3.46>\r\n"
+		<< "Allow: INVITE, ACK, BYE, CANCEL, OPTIONS, INFO, MESSAGE, SUBSCRIBE, NOTIFY, PRACK, UPDATE, REFER\r\n"
+		<< "User-Agent: PolycomSoundPointIP-SPIP_650-UA/3.1.3.0439\r\n"
+		<< "Supported: 100rel,replaces\r\n"
+		<< "Max-Forwards: 70\r\n"
+		<< "Content-Type: application/sdp\r\n"
+		<< "Content-Length: " << body.str().length() << "\r\n"
+		<< "\r\n"
+		<< body.str();
+
+	return message.str();
+}
+
+struct Options
+{
+	Options() : minTimeMs( 500 ) {}
+	unsigned int minTimeMs;
+	string caseFilter, corpusFilter, outputPath;
+};
+
+void Usage()
+{
+	cerr << "usage: sip_bench [--min-time-ms N] [--case NAME] [--corpus NAME] [--output FILE]\n"
+		<< "cases:";
+	for ( const Case* benchCase = cases; benchCase->name != NULL; ++benchCase )
+		cerr << ' ' << benchCase->name;
+	cerr << "\ncorpora: sip_messages registrar_sip_messages synthetic_large" << endl;
+}
+
+bool ParseOptions( int argc, char* argv[], Options& options )
+{
+	for ( int arg = 1; arg < argc; ++arg )
+	{
+		string name( argv[arg] );
+		if ( arg + 1 >= argc )
+			return false;
+		string value( argv[++arg] );
+
+		if ( name == "--min-time-ms" )
+			options.minTimeMs = atoi( value.c_str() );
+		else if ( name == "--case" )
+			options.caseFilter = value;
+		else if ( name == "--corpus" )
+			options.corpusFilter = value;
+		else if ( name == "--output" )
+			options.outputPath = value;
+		else
+			return false;
+	}
+	return true;
+}
+
+void RunCase( const Case& benchCase, const Corpus& corpus, const Options& options, ostream& json, bool& first )
+{
+	size_t bytes = 0;
+	if ( benchCase.function( corpus, bytes ) == 0 )
+		return; //Nothing in this corpus applies, e.g. response construction over responses
+
+	uint64_t messages = 0, totalBytes = 0;
+	uint64_t budget = static_cast<uint64_t>( options.minTimeMs ) * 1000000ULL;
+	uint64_t startNs = Bench::NowNs(), startCycles = Bench::ReadCycles();
+	uint64_t elapsedNs;
+	do
+	{
+		bytes = 0;
+		messages += benchCase.function( corpus, bytes );
+		totalBytes += bytes;
+		elapsedNs = Bench::NowNs() - startNs;
+	} while ( elapsedNs < budget );
+	uint64_t cycles = Bench::ReadCycles() - startCycles;
+
+	char line[ 512 ];
+	snprintf( line, sizeof( line ),
+		"    { \"case\": \"%s\", \"corpus\": \"%s\", \"messages\": %llu, \"bytes\": %llu, "
+		"\"ns_per_message\": %.1f, \"messages_per_sec\": %.1f, ",
+		benchCase.name, Bench::JsonEscape( corpus.Name ).c_str(),
+		static_cast<unsigned long long>( messages ), static_cast<unsigned long long>( totalBytes ),
+		static_cast<double>( elapsedNs ) / messages, messages * 1e9 / elapsedNs );
+
+	json << ( first ? "" : ",\n" ) << line;
+	if ( cycles != 0 )
+	{
+		snprintf( line, sizeof( line ), "\"bytes_per_cycle\": %.4f }", static_cast<double>( totalBytes ) / cycles );
+		json << line;
+	}
+	else
+		json << "\"bytes_per_cycle\": null }";
+	first = false;
+}
+
+}; //namespace
+
+int main( int argc, char* argv[] )
+{
+	Options options;
+	if ( !ParseOptions( argc, argv, options ) )
+	{
+		Usage();
+		return 1;
+	}
+
+	Corpus sipCorpus( "sip_messages" ), registrarCorpus( "registrar_sip_messages" ), largeCorpus( "synthetic_large" );
+	for ( int i = 0; sip_messages[i] != NULL; ++i )
+		sipCorpus.Add( sip_messages[i] );
+	for ( int i = 0; register_sip_messages[i] != NULL; ++i )
+		registrarCorpus.Add( register_sip_messages[i] );
+	largeCorpus.Add( LargeInvite( 8, 4 ) );
+	largeCorpus.Add( LargeInvite( 32, 16 ) );
+	largeCorpus.Add( LargeInvite( 56, 32 ) ); //As long a chain as SIP_MAX_HEADERS lets through
+
+	const Corpus* corpora[] = { &sipCorpus, &registrarCorpus, &largeCorpus, NULL };
+
+	ofstream outputFile;
+	if ( !options.outputPath.empty() )
+	{
+		outputFile.open( options.outputPath.c_str() );
+		if ( !outputFile )
+		{
+			cerr << "sip_bench: cannot open " << options.outputPath << endl;
+			return 1;
+		}
+	}
+	ostream& json = options.outputPath.empty() ? cout : outputFile;
+
+	json << "{\n  \"benchmark\": \"sip_bench\",\n  \"schema\": 1,\n  \"min_time_ms\": " << options.minTimeMs
+		<< ",\n  \"results\": [\n";
+	bool first = true;
+	for ( const Case* benchCase = cases; benchCase->name != NULL; ++benchCase )
+	{
+		if ( !options.caseFilter.empty() && options.caseFilter != benchCase->name )
+			continue;
+		for ( const Corpus** corpus = corpora; *corpus != NULL; ++corpus )
+		{
+			if ( !options.corpusFilter.empty() && options.corpusFilter != ( *corpus )->Name )
+				continue;
+			RunCase( *benchCase, **corpus, options, json, first );
+		}
+	}
+	json << "\n  ]\n}\n";
+
+	return 0;
+}
@@ -0,0 +1,701 @@
+//
+// sip_pcap_replay: drives captured SIP traffic through the parser
+//
+// Reads a pcap or pcapng capture through mmap (no libpcap), pulls out every SIP payload carried over UDP or
+// TCP on the SIP port, then feeds each one through Utility::ParseMessage and ToString back to back with no
+// pacing. Reports throughput, per-method latency percentiles and a breakdown of parse failures as JSON.
+//
+// TCP streams are reassembled per direction and split into messages on Content-Length. Fragmented IP
+// datagrams are counted but not reassembled.
+//
+#include <iostream>
+#include <fstream>
+#include <sstream>
+#include <map>
+#include <algorithm>
+#include <cstdlib>
+#include <cstring>
+#include <cerrno>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include "BenchCommon.hpp"
+#include "../SipUtility.hpp"
+#include "../SipRequest.hpp"
+#include "../SipResponse.hpp"
+
+using namespace Sip;
+using namespace std;
+
+namespace {
+
+const uint32_t PCAP_MAGIC_US = 0xa1b2c3d4;
+const uint32_t PCAP_MAGIC_NS = 0xa1b23c4d;
+const uint32_t PCAPNG_SECTION_HEADER = 0x0a0d0d0a;
+const uint32_t PCAPNG_BYTE_ORDER_MAGIC = 0x1a2b3c4d;
+
+const uint32_t LINKTYPE_NULL = 0;
+const uint32_t LINKTYPE_ETHERNET = 1;
+const uint32_t LINKTYPE_RAW_OLD = 12;
+const uint32_t LINKTYPE_RAW = 101;
+const uint32_t LINKTYPE_LINUX_SLL = 113;
+const uint32_t LINKTYPE_IPV4 = 228;
+const uint32_t LINKTYPE_IPV6 = 229;
+const uint32_t LINKTYPE_LINUX_SLL2 = 276;
+
+inline uint16_t Big16( const unsigned char* p ) { return ( p[0] << 8 ) | p[1]; }
+inline uint32_t Big32( const unsigned char* p ) { return ( uint32_t( p[0] ) << 24 ) | ( p[1] << 16 ) | ( p[2] << 8 ) | p[3]; }
+
+/**
+* \class CaptureReader
+* \brief Walks the packets of a memory mapped pcap or pcapng file
+*/
+class CaptureReader
+{
+	public:
+		CaptureReader( const unsigned char* data, size_t length )
+			: m_data( data ), m_end( data + length ), m_cursor( data ), m_swapped( false ), m_pcapng( false ), m_linkType( 0 )
+		{ }
+
+		/**
+		 *     Validates the file header
+		 * @return False if this isn't a capture we understand
+		 */
+		bool Open()
+		{
+			if ( m_end - m_data < 24 )
+				return false;
+
+			uint32_t magic = Native32( m_data );
+			if ( magic == PCAPNG_SECTION_HEADER )
+			{
+				m_pcapng = true;
+				return true; //Byte order is read from each section header as we go
+			}
+			if ( magic == PCAP_MAGIC_US || magic == PCAP_MAGIC_NS )
+				m_swapped = false;
+			else if ( Swap32( magic ) == PCAP_MAGIC_US || Swap32( magic ) == PCAP_MAGIC_NS )
+				m_swapped = true;
+			else
+				return false;
+
+			m_linkType = Read32( m_data + 20 ) & 0x0fffffff;
+			m_cursor = m_data + 24;
+			return true;
+		}
+
+		/**
+		 *     Advances to the next packet
+		 * @param packet Set to the start of the captured bytes
+		 * @param length Set to the captured length
+		 * @param linkType Set to the link type of the interface it was captured on
+		 * @return False at end of file or on a truncated record
+		 */
+		bool Next( const unsigned char*& packet, size_t& length, uint32_t& linkType )
+		{
+			return m_pcapng ? NextBlock( packet, length, linkType ) : NextRecord( packet, length, linkType );
+		}
+
+	private:
+		static uint32_t Swap32( uint32_t v ) { return ( v >> 24 ) | ( ( v >> 8 ) & 0xff00 ) | ( ( v << 8 ) & 0xff0000 ) | ( v << 24 ); }
+		static uint32_t Native32( const unsigned char* p ) { uint32_t v; memcpy( &v, p, 4 ); return v; }
+		uint32_t Read32( const unsigned char* p ) const { return m_swapped ? Swap32( Native32( p ) ) : Native32( p ); }
+		uint16_t Read16( const unsigned char* p ) const
+		{
+			uint16_t v;
+			memcpy( &v, p, 2 );
+			return m_swapped ? static_cast<uint16_t>( ( v >> 8 ) | ( v << 8 ) ) : v;
+		}
+
+		bool NextRecord( const unsigned char*& packet, size_t& length, uint32_t& linkType )
+		{
+			if ( m_end - m_cursor < 16 )
+				return false;
+			uint32_t captured = Read32( m_cursor + 8 );
+			if ( static_cast<size_t>( m_end - m_cursor - 16 ) < captured )
+				return false;
+
+			packet = m_cursor + 16;
+			length = captured;
+			linkType = m_linkType;
+			m_cursor += 16 + captured;
+			return true;
+		}
+
+		bool NextBlock( const unsigned char*& packet, size_t& length, uint32_t& linkType )
+		{
+			while ( m_end - m_cursor >= 12 )
+			{
+				uint32_t type = Native32( m_cursor );
+				if ( type == PCAPNG_SECTION_HEADER )
+				{
+					uint32_t byteOrder = Native32( m_cursor + 8 );
+					if ( byteOrder == PCAPNG_BYTE_ORDER_MAGIC )
+						m_swapped = false;
+					else if ( Swap32( byteOrder ) == PCAPNG_BYTE_ORDER_MAGIC )
+						m_swapped = true;
+					else
+						return false;
+					m_interfaces.clear();
+				}
+				else
+					type = Read32( m_cursor );
+
+				uint32_t blockLength = Read32( m_cursor + 4 );
+				if ( blockLength < 12 || static_cast<size_t>( m_end - m_cursor ) < blockLength )
+					return false;
+				const unsigned char* block = m_cursor;
+				m_cursor += ( blockLength + 3 ) & ~3u;
+
+				switch ( type )
+				{
+					case 1: //Interface Description Block
+						m_interfaces.push_back( Read16( block + 8 ) );
+						break;
+					case 6: //Enhanced Packet Block
+					{
+						if ( blockLength < 32 )
+							return false;
+						uint32_t interface = Read32( block + 8 );
+						uint32_t captured = Read32( block + 20 );
+						if ( interface >= m_interfaces.size() || captured > blockLength - 32 )
+							return false;
+						packet = block + 28;
+						length = captured;
+						linkType = m_interfaces[ interface ];
+						return true;
+					}
+					case 3: //Simple Packet Block
+					{
+						if ( m_interfaces.empty() || blockLength < 16 )
+							return false;
+						uint32_t original = Read32( block + 8 );
+						packet = block + 12;
+						length = std::min<size_t>( original, blockLength - 16 );
+						linkType = m_interfaces[0];
+						return true;
+					}
+					case 2: //Obsolete Packet Block
+					{
+						if ( blockLength < 32 )
+							return false;
+						uint16_t interface = Read16( block + 8 );
+						uint32_t captured = Read32( block + 20 );
+						if ( interface >= m_interfaces.size() || captured > blockLength - 32 )
+							return false;
+						packet = block + 28;
+						length = captured;
+						linkType = m_interfaces[ interface ];
+						return true;
+					}
+					default: //Statistics, name resolution, custom... nothing for us
+						break;
+				}
+			}
+			return false;
+		}
+
+		const unsigned char *m_data, *m_end, *m_cursor;
+		bool m_swapped, m_pcapng;
+		uint32_t m_linkType;
+		vector<uint32_t> m_interfaces;
+};
+
+/**
+* \class TcpReassembler
+* \brief Rebuilds each direction of a TCP stream and splits it into SIP messages on Content-Length
+*/
+class TcpReassembler
+{
+	public:
+		/**
+		 *     Adds a segment to its flow, appending any complete SIP messages to messages
+		 */
+		void Segment( const string& flowKey, uint32_t seq, bool syn, bool finOrRst, const unsigned char* payload, size_t length, vector<string>& messages )
+		{
+			map<string, Flow>::iterator flow = m_flows.find( flowKey );
+			if ( flow == m_flows.end() )
+			{
+				if ( length == 0 && !syn )
+					return;
+				flow = m_flows.insert( make_pair( flowKey, Flow() ) ).first;
+				flow->second.nextSeq = syn ? seq + 1 : seq;
+			}
+			else if ( syn )
+				flow->second.nextSeq = seq + 1;
+
+			Flow& state = flow->second;
+			if ( length > 0 )
+			{
+				if ( static_cast<int32_t>( seq - state.nextSeq ) > 0 )
+					state.pending[ seq ].assign( reinterpret_cast<const char*>( payload ), length );
+				else
+					Append( state, seq, string( reinterpret_cast<const char*>( payload ), length ) );
+
+				//Drain anything that was waiting on this segment
+				map<uint32_t, string>::iterator next;
+				while ( ( next = state.pending.begin() ) != state.pending.end() && static_cast<int32_t>( next->first - state.nextSeq ) <= 0 )
+				{
+					Append( state, next->first, next->second );
+					state.pending.erase( next );
+				}
+				Frame( state, messages );
+			}
+
+			if ( finOrRst )
+				m_flows.erase( flow );
+		}
+
+	private:
+		struct Flow
+		{
+			uint32_t nextSeq;
+			string stream;
+			map<uint32_t, string> pending;
+		};
+
+		static void Append( Flow& state, uint32_t seq, const string& data )
+		{
+			uint32_t overlap = state.nextSeq - seq; //Retransmitted bytes we already have
+			if ( overlap >= data.length() )
+				return;
+			state.stream.append( data, overlap, string::npos );
+			state.nextSeq += data.length() - overlap;
+		}
+
+		static void Frame( Flow& state, vector<string>& messages )
+		{
+			for ( ;; )
+			{
+				string::size_type start = state.stream.find_first_not_of( "\r\n" ); //Keepalive CRLFs
+				if ( start == string::npos )
+				{
+					state.stream.clear();
+					return;
+				}
+				string::size_type headerEnd = state.stream.find( "\r\n\r\n", start );
+				if ( headerEnd == string::npos )
+				{
+					state.stream.erase( 0, start );
+					return;
+				}
+				headerEnd += 4;
+
+				size_t contentLength = ContentLength( state.stream, start, headerEnd );
+				if ( state.stream.length() - headerEnd < contentLength )
+				{
+					state.stream.erase( 0, start );
+					return;
+				}
+				messages.push_back( state.stream.substr( start, headerEnd + contentLength - start ) );
+				state.stream.erase( 0, headerEnd + contentLength );
+			}
+		}
+
+		static size_t ContentLength( const string& stream, string::size_type start, string::size_type end )
+		{
+			string::size_type line = start;
+			while ( line < end )
+			{
+				string::size_type lineEnd = stream.find( "\r\n", line );
+				string::size_type colon = stream.find( ':', line );
+				if ( colon != string::npos && colon < lineEnd )
+				{
+					string name = stream.substr( line, colon - line );
+					name.erase( name.find_last_not_of( " \t" ) + 1 );
+					if ( strcasecmp( name.c_str(), "content-length" ) == 0 || strcasecmp( name.c_str(), "l" ) == 0 )
+						return strtoul( stream.c_str() + colon + 1, NULL, 10 );
+				}
+				line = lineEnd + 2;
+			}
+			return 0;
+		}
+
+		map<string, Flow> m_flows;
+};
+
+struct ExtractStats
+{
+	ExtractStats() : packets( 0 ), udp( 0 ), tcpMessages( 0 ), fragments( 0 ), otherLink( 0 ) {}
+	uint64_t packets, udp, tcpMessages, fragments, otherLink;
+};
+
+/**
+* \class Extractor
+* \brief Pulls SIP payloads out of link layer frames
+*/
+class Extractor
+{
+	public:
+		Extractor( uint16_t port, vector<string>& payloads ) : m_port( port ), m_payloads( payloads ) {}
+
+		void Packet( const unsigned char* packet, size_t length, uint32_t linkType )
+		{
+			++Stats.packets;
+			const unsigned char* end = packet + length;
+			uint16_t etherType;
+
+			switch ( linkType )
+			{
+				case LINKTYPE_ETHERNET:
+					if ( length < 14 )
+						return;
+					etherType = Big16( packet + 12 );
+					packet += 14;
+					while ( ( etherType == 0x8100 || etherType == 0x88a8 ) && end - packet >= 4 ) //VLAN tags
+					{
+						etherType = Big16( packet + 2 );
+						packet += 4;
+					}
+					break;
+				case LINKTYPE_LINUX_SLL:
+					if ( length < 16 )
+						return;
+					etherType = Big16( packet + 14 );
+					packet += 16;
+					break;
+				case LINKTYPE_LINUX_SLL2:
+					if ( length < 20 )
+						return;
+					etherType = Big16( packet );
+					packet += 20;
+					break;
+				case LINKTYPE_NULL:
+				{
+					if ( length < 4 )
+						return;
+					uint32_t family;
+					memcpy( &family, packet, 4 );
+					etherType = ( family == 2 || Big32( packet ) == 2 ) ? 0x0800 : 0x86dd;
+					packet += 4;
+					break;
+				}
+				case LINKTYPE_RAW:
+				case LINKTYPE_RAW_OLD:
+				case LINKTYPE_IPV4:
+				case LINKTYPE_IPV6:
+					if ( length < 1 )
+						return;
+					etherType = ( packet[0] >> 4 ) == 4 ? 0x0800 : 0x86dd;
+					break;
+				default:
+					++Stats.otherLink;
+					return;
+			}
+
+			if ( etherType == 0x0800 )
+				IPv4( packet, end );
+			else if ( etherType == 0x86dd )
+				IPv6( packet, end );
+		}
+
+		ExtractStats Stats;
+
+	private:
+		void IPv4( const unsigned char* packet, const unsigned char* end )
+		{
+			if ( end - packet < 20 || ( packet[0] >> 4 ) != 4 )
+				return;
+			size_t headerLength = ( packet[0] & 0x0f ) * 4;
+			size_t totalLength = Big16( packet + 2 );
+			if ( headerLength < 20 || totalLength < headerLength || static_cast<size_t>( end - packet ) < headerLength )
+				return;
+			if ( static_cast<size_t>( end - packet ) > totalLength )
+				end = packet + totalLength; //Ethernet padding
+
+			if ( Big16( packet + 6 ) & 0x3fff ) //More fragments, or a non-zero offset
+			{
+				++Stats.fragments;
+				return;
+			}
+			Transport( packet[9], string( reinterpret_cast<const char*>( packet + 12 ), 8 ), packet + headerLength, end );
+		}
+
+		void IPv6( const unsigned char* packet, const unsigned char* end )
+		{
+			if ( end - packet < 40 || ( packet[0] >> 4 ) != 6 )
+				return;
+			size_t payloadLength = Big16( packet + 4 );
+			uint8_t next = packet[6];
+			string addresses( reinterpret_cast<const char*>( packet + 8 ), 32 );
+			const unsigned char* payload = packet + 40;
+			if ( static_cast<size_t>( end - payload ) > payloadLength )
+				end = payload + payloadLength;
+
+			//Hop-by-hop, routing and destination options all share the same layout
+			while ( ( next == 0 || next == 43 || next == 60 ) && end - payload >= 8 )
+			{
+				next = payload[0];
+				payload += ( payload[1] + 1 ) * 8;
+			}
+			if ( next == 44 )
+			{
+				++Stats.fragments;
+				return;
+			}
+			if ( payload <= end )
+				Transport( next, addresses, payload, end );
+		}
+
+		void Transport( uint8_t protocol, const string& addresses, const unsigned char* segment, const unsigned char* end )
+		{
+			if ( protocol == 17 && end - segment >= 8 )
+			{
+				if ( Big16( segment ) != m_port && Big16( segment + 2 ) != m_port )
+					return;
+				const unsigned char* payload = segment + 8;
+				//Skip keepalives (CRLF or a lone NUL) so they don't show up as parse failures
+				const unsigned char* first = payload;
+				while ( first < end && ( *first == '\r' || *first == '\n' || *first == '\0' ) )
+					++first;
+				if ( first == end )
+					return;
+				++Stats.udp;
+				m_payloads.push_back( string( reinterpret_cast<const char*>( payload ), end - payload ) );
+			}
+			else if ( protocol == 6 && end - segment >= 20 )
+			{
+				if ( Big16( segment ) != m_port && Big16( segment + 2 ) != m_port )
+					return;
+				size_t headerLength = ( segment[12] >> 4 ) * 4;
+				if ( headerLength < 20 || static_cast<size_t>( end - segment ) < headerLength )
+					return;
+				uint8_t flags = segment[13];
+				size_t before = m_payloads.size();
+				m_tcp.Segment( addresses + string( reinterpret_cast<const char*>( segment ), 4 ), Big32( segment + 4 ),
+					flags & 0x02, flags & 0x05, segment + headerLength, end - segment - headerLength, m_payloads );
+				Stats.tcpMessages += m_payloads.size() - before;
+			}
+		}
+
+		uint16_t m_port;
+		vector<string>& m_payloads;
+		TcpReassembler m_tcp;
+};
+
+/**
+ *     Reduces an exception from ParseMessage to a short, stable failure reason
+ */
+string FailureReason( const string& what )
+{
+	static const char* wrappers[] = { "Invalid SIP message:\n", "Invalid request:\n", "Invalid response:\n", NULL };
+	string reason( what );
+	for ( bool stripped = true; stripped; )
+	{
+		stripped = false;
+		for ( const char** wrapper = wrappers; *wrapper != NULL; ++wrapper )
+		{
+			if ( reason.compare( 0, strlen( *wrapper ), *wrapper ) == 0 )
+			{
+				reason.erase( 0, strlen( *wrapper ) );
+				stripped = true;
+			}
+		}
+	}
+	reason = reason.substr( 0, reason.find( '\n' ) );
+	if ( reason.length() > 80 )
+		reason = reason.substr( 0, 80 );
+	return reason;
+}
+
+/**
+ *     Names the latency bucket for a parsed message: the request method, or the response class
+ */
+string MethodName( const SipMessage& message )
+{
+	if ( message.Type == SipMessage::MT_REQUEST )
+	{
+		string method = RequestTypes.ReverseGet( static_cast<const SipRequest&>( message ).RequestMethod() );
+		transform( method.begin(), method.end(), method.begin(), (int(*)(int))toupper );
+		return method;
+	}
+	char name[ 32 ];
+	snprintf( name, sizeof( name ), "response_%dxx", static_cast<const SipResponse&>( message ).StatusCode() / 100 );
+	return name;
+}
+
+struct Options
+{
+	Options() : port( 5060 ), repeat( 1 ) {}
+	uint16_t port;
+	unsigned int repeat;
+	string capturePath, outputPath;
+};
+
+void Usage()
+{
+	cerr << "usage: sip_pcap_replay [--port N] [--repeat N] [--output FILE] CAPTURE.pcap|CAPTURE.pcapng" << endl;
+}
+
+bool ParseOptions( int argc, char* argv[], Options& options )
+{
+	for ( int arg = 1; arg < argc; ++arg )
+	{
+		string name( argv[arg] );
+		if ( name.compare( 0, 2, "--" ) != 0 )
+		{
+			if ( !options.capturePath.empty() )
+				return false;
+			options.capturePath = name;
+			continue;
+		}
+		if ( arg + 1 >= argc )
+			return false;
+		string value( argv[++arg] );
+		if ( name == "--port" )
+			options.port = atoi( value.c_str() );
+		else if ( name == "--repeat" )
+			options.repeat = std::max( 1, atoi( value.c_str() ) );
+		else if ( name == "--output" )
+			options.outputPath = value;
+		else
+			return false;
+	}
+	return !options.capturePath.empty();
+}
+
+bool CountDescending( const pair<string, uint64_t>& lhs, const pair<string, uint64_t>& rhs )
+{
+	return lhs.second != rhs.second ? lhs.second > rhs.second : lhs.first < rhs.first;
+}
+
+}; //namespace
+
+int main( int argc, char* argv[] )
+{
+	Options options;
+	if ( !ParseOptions( argc, argv, options ) )
+	{
+		Usage();
+		return 1;
+	}
+
+	int fd = open( options.capturePath.c_str(), O_RDONLY );
+	struct stat info;
+	if ( fd == -1 || fstat( fd, &info ) == -1 )
+	{
+		cerr << "sip_pcap_replay: cannot open " << options.capturePath << ": " << strerror( errno ) << endl;
+		return 1;
+	}
+	if ( info.st_size == 0 )
+	{
+		cerr << "sip_pcap_replay: " << options.capturePath << " is empty" << endl;
+		return 1;
+	}
+	void* mapped = mmap( NULL, info.st_size, PROT_READ, MAP_PRIVATE, fd, 0 );
+	close( fd );
+	if ( mapped == MAP_FAILED )
+	{
+		cerr << "sip_pcap_replay: cannot map " << options.capturePath << ": " << strerror( errno ) << endl;
+		return 1;
+	}
+	madvise( mapped, info.st_size, MADV_SEQUENTIAL );
+
+	//Extraction isn't timed; only the parser is
+	vector<string> payloads;
+	Extractor extractor( options.port, payloads );
+	CaptureReader reader( static_cast<const unsigned char*>( mapped ), info.st_size );
+	if ( !reader.Open() )
+	{
+		cerr << "sip_pcap_replay: " << options.capturePath << " is not a pcap or pcapng file" << endl;
+		munmap( mapped, info.st_size );
+		return 1;
+	}
+	const unsigned char* packet;
+	size_t length;
+	uint32_t linkType;
+	while ( reader.Next( packet, length, linkType ) )
+		extractor.Packet( packet, length, linkType );
+	munmap( mapped, info.st_size );
+
+	map<string, vector<uint64_t> > latencies;
+	map<string, uint64_t> failures;
+	uint64_t parsed = 0, failed = 0, bytes = 0;
+	uint64_t startNs = Bench::NowNs();
+
+	for ( unsigned int pass = 0; pass < options.repeat; ++pass )
+	{
+		for ( vector<string>::const_iterator payload = payloads.begin(); payload != payloads.end(); ++payload )
+		{
+			uint64_t messageStart = Bench::NowNs();
+			try
+			{
+				auto_ptr<SipMessage> message;
+				Utility::ParseMessage( message, *payload );
+				if ( message->Type == SipMessage::MT_REQUEST )
+					Bench::Sink += static_cast<SipRequest&>( *message ).ToString().length();
+				else
+					Bench::Sink += static_cast<SipResponse&>( *message ).ToString().length();
+				latencies[ MethodName( *message ) ].push_back( Bench::NowNs() - messageStart );
+				++parsed;
+			}
+			catch ( std::exception& e )
+			{
+				++failures[ FailureReason( e.what() ) ];
+				++failed;
+			}
+			bytes += payload->length();
+		}
+	}
+	uint64_t elapsedNs = Bench::NowNs() - startNs;
+	if ( elapsedNs == 0 )
+		elapsedNs = 1;
+
+	ofstream outputFile;
+	if ( !options.outputPath.empty() )
+	{
+		outputFile.open( options.outputPath.c_str() );
+		if ( !outputFile )
+		{
+			cerr << "sip_pcap_replay: cannot open " << options.outputPath << endl;
+			return 1;
+		}
+	}
+	ostream& json = options.outputPath.empty() ? cout : outputFile;
+	char line[ 512 ];
+
+	json << "{\n  \"benchmark\": \"sip_pcap_replay\",\n  \"schema\": 1,\n"
+		<< "  \"capture\": \"" << Bench::JsonEscape( options.capturePath ) << "\",\n";
+	snprintf( line, sizeof( line ),
+		"  \"packets\": %llu,\n  \"udp_payloads\": %llu,\n  \"tcp_messages\": %llu,\n  \"ip_fragments_skipped\": %llu,\n"
+		"  \"unsupported_link_packets\": %llu,\n  \"repeat\": %u,\n  \"messages\": %llu,\n  \"parsed\": %llu,\n  \"failed\": %llu,\n"
+		"  \"bytes\": %llu,\n  \"elapsed_ns\": %llu,\n  \"messages_per_sec\": %.1f,\n  \"mbytes_per_sec\": %.2f,\n",
+		static_cast<unsigned long long>( extractor.Stats.packets ), static_cast<unsigned long long>( extractor.Stats.udp ),
+		static_cast<unsigned long long>( extractor.Stats.tcpMessages ), static_cast<unsigned long long>( extractor.Stats.fragments ),
+		static_cast<unsigned long long>( extractor.Stats.otherLink ), options.repeat,
+		static_cast<unsigned long long>( parsed + failed ), static_cast<unsigned long long>( parsed ),
+		static_cast<unsigned long long>( failed ), static_cast<unsigned long long>( bytes ),
+		static_cast<unsigned long long>( elapsedNs ), ( parsed + failed ) * 1e9 / elapsedNs, bytes * 1e3 / elapsedNs );
+	json << line;
+
+	json << "  \"methods\": [";
+	for ( map<string, vector<uint64_t> >::iterator method = latencies.begin(); method != latencies.end(); ++method )
+	{
+		vector<uint64_t>& samples = method->second;
+		sort( samples.begin(), samples.end() );
+		snprintf( line, sizeof( line ),
+			"%s\n    { \"method\": \"%s\", \"count\": %llu, \"p50_ns\": %llu, \"p90_ns\": %llu, \"p99_ns\": %llu, \"p999_ns\": %llu, \"max_ns\": %llu }",
+			method == latencies.begin() ? "" : ",", Bench::JsonEscape( method->first ).c_str(),
+			static_cast<unsigned long long>( samples.size() ),
+			static_cast<unsigned long long>( Bench::Percentile( samples, 50 ) ),
+			static_cast<unsigned long long>( Bench::Percentile( samples, 90 ) ),
+			static_cast<unsigned long long>( Bench::Percentile( samples, 99 ) ),
+			static_cast<unsigned long long>( Bench::Percentile( samples, 99.9 ) ),
+			static_cast<unsigned long long>( samples.back() ) );
+		json << line;
+	}
+	json << ( latencies.empty() ? "],\n" : "\n  ],\n" );
+
+	vector<pair<string, uint64_t> > sortedFailures( failures.begin(), failures.end() );
+	sort( sortedFailures.begin(), sortedFailures.end(), CountDescending );
+	json << "  \"failures\": [";
+	for ( size_t i = 0; i < sortedFailures.size(); ++i )
+	{
+		json << ( i == 0 ? "\n" : ",\n" ) << "    { \"reason\": \"" << Bench::JsonEscape( sortedFailures[i].first )
+			<< "\", \"count\": " << sortedFailures[i].second << " }";
+	}
+	json << ( sortedFailures.empty() ? "]\n}\n" : "\n  ]\n}\n" );
+
+	return 0;
+}
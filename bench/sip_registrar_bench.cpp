@@ -0,0 +1,287 @@
+//
+// sip_registrar_bench: what a REGISTER costs in redis round trips and writes
+//
+// Times --registers writes of one registration (10000 by default) three ways: the three commands the registrar used
+// to send one at a time (HSET uri, HSET expiration, EXPIRE), the MULTI/HSET/EXPIRE/EXEC pipeline it sends now, and
+// Registrar::HandleRequest end to end, parse of the Expires and Contact included. Then runs the same number through
+// one registrar from --threads threads (16), as a boot storm would, without batching and with
+// SetBatching( --batch-window-us, --batch-limit ) (1000 us, 256). These all write in full, with coalescing off.
+// Last, --endpoints phones (1000) already registered refresh, unchanged, --registers times in all, with and without
+// coalescing. Runs against FakeRedis on loopback, which can hold each answer --rtt-us microseconds to stand in for a
+// network, or against a real server given with --redis host:port. FakeRedis answers one read at a time, so its delay
+// also serializes the unbatched threads, as a loaded redis would; against a real one far away they overlap more.
+//
+// Reports round trips and bytes sent per REGISTER, the mean/p50/p99 latency of one and REGISTERs per second. On a
+// network, latency should follow round trips, batched throughput the batch size, and coalesced refreshes should send
+// a fraction of the bytes.
+//
+#include <iostream>
+#include <algorithm>
+#include <cstdlib>
+#include <cstring>
+#include <boost/thread.hpp>
+#include "BenchCommon.hpp"
+#include "../Registrar.hpp"
+#include "../SipRequest.hpp"
+#include "../tests/FakeRedis.hpp"
+#include "../tests/registrar_sip_messages.h"
+
+using namespace Sip;
+using namespace std;
+
+namespace {
+
+struct Options
+{
+	Options() : registers( 10000 ), rttUs( 0 ), threads( 16 ), batchWindowUs( 1000 ), batchLimit( 256 ), endpoints( 1000 ),
+		port( 0 ) {}
+	unsigned int registers, rttUs, threads, batchWindowUs, batchLimit, endpoints;
+	string host;
+	unsigned short port;
+};
+
+bool ParseOptions( int argc, char* argv[], Options& options )
+{
+	for ( int arg = 1; arg + 1 < argc; arg += 2 )
+	{
+		string name( argv[arg] ), value( argv[arg + 1] );
+		if ( name == "--registers" )
+			options.registers = atoi( value.c_str() );
+		else if ( name == "--rtt-us" )
+			options.rttUs = atoi( value.c_str() );
+		else if ( name == "--threads" )
+			options.threads = atoi( value.c_str() );
+		else if ( name == "--batch-window-us" )
+			options.batchWindowUs = atoi( value.c_str() );
+		else if ( name == "--batch-limit" )
+			options.batchLimit = atoi( value.c_str() );
+		else if ( name == "--endpoints" )
+			options.endpoints = atoi( value.c_str() );
+		else if ( name == "--redis" && value.find( ':' ) != string::npos )
+		{
+			options.host = value.substr( 0, value.find( ':' ) );
+			options.port = atoi( value.c_str() + value.find( ':' ) + 1 );
+		}
+		else
+			return false;
+	}
+	if ( argc % 2 == 0 || options.registers == 0 || options.threads == 0 || options.batchLimit < 2 || options.endpoints == 0 ||
+		( !options.host.empty() && options.port == 0 ) )
+		return false;
+	return true;
+}
+
+struct Result
+{
+	Result() : roundTrips( 0 ), bytes( 0 ), errors( 0 ), elapsedNs( 0 ) {}
+	vector<uint64_t> latencies;
+	uint64_t roundTrips, bytes, errors, elapsedNs;
+};
+
+void RunPerCommand( RedisConnection& connection, unsigned int registers, Result& result )
+{
+	uint64_t roundTrips = connection.RoundTrips(), bytes = connection.BytesSent(), begin = Bench::NowNs();
+	for ( unsigned int i = 0; i < registers; ++i )
+	{
+		uint64_t start = Bench::NowNs();
+		RedisReply uri = connection.Run( RedisCommand( "HSET" ) << "registrar:3170" << "uri" << "sip:3170@172.20.3.20:5060" );
+		RedisReply expiration = connection.Run( RedisCommand( "HSET" ) << "registrar:3170" << "expiration" << "3600" );
+		RedisReply expire = connection.Run( RedisCommand( "EXPIRE" ) << "registrar:3170" << int64_t( 3600 ) );
+		result.latencies.push_back( Bench::NowNs() - start );
+		result.errors += uri.type == RedisReply::REPLY_ERROR || expiration.type == RedisReply::REPLY_ERROR ||
+			expire.type == RedisReply::REPLY_ERROR;
+	}
+	result.elapsedNs = Bench::NowNs() - begin;
+	result.roundTrips = connection.RoundTrips() - roundTrips;
+	result.bytes = connection.BytesSent() - bytes;
+}
+
+void RunPipelined( RedisConnection& connection, unsigned int registers, Result& result )
+{
+	uint64_t roundTrips = connection.RoundTrips(), bytes = connection.BytesSent(), begin = Bench::NowNs();
+	vector<RedisReply> replies;
+	for ( unsigned int i = 0; i < registers; ++i )
+	{
+		uint64_t start = Bench::NowNs();
+		connection.Append( RedisCommand( "MULTI" ) );
+		connection.Append( RedisCommand( "HSET" ) << "registrar:3170" << "uri" << "sip:3170@172.20.3.20:5060"
+			<< "expiration" << int64_t( 3600 ) );
+		connection.Append( RedisCommand( "EXPIRE" ) << "registrar:3170" << int64_t( 3600 ) );
+		connection.Append( RedisCommand( "EXEC" ) );
+		connection.Flush( replies );
+		result.latencies.push_back( Bench::NowNs() - start );
+		result.errors += replies.back().type != RedisReply::REPLY_ARRAY;
+	}
+	result.elapsedNs = Bench::NowNs() - begin;
+	result.roundTrips = connection.RoundTrips() - roundTrips;
+	result.bytes = connection.BytesSent() - bytes;
+}
+
+/**
+ *     The test REGISTER, from endpoint instead of 3170
+ */
+SipRequest RegisterFrom( unsigned int endpoint )
+{
+	char number[ 16 ];
+	snprintf( number, sizeof( number ), "%u", endpoint );
+	string message( register_sip_messages[0] );
+	for ( string::size_type at = message.find( "3170" ); at != string::npos; at = message.find( "3170", at + strlen( number ) ) )
+		message.replace( at, 4, number );
+	return SipRequest( message );
+}
+
+/**
+ *     One thread's share of REGISTERs through a shared registrar, going round requests
+ */
+class RegisterWorker
+{
+	public:
+		RegisterWorker( Registrar& registrar, RedisPool& pool, const vector<SipRequest>& requests, unsigned int registers,
+			boost::barrier& start )
+			: roundTrips( 0 ), bytes( 0 ), errors( 0 ), m_registrar( registrar ), m_pool( pool ), m_requests( requests ),
+			m_registers( registers ), m_start( start ) {}
+
+		void operator()()
+		{
+			latencies.reserve( m_registers );
+			m_start.wait();
+			for ( unsigned int i = 0; i < m_registers; ++i )
+			{
+				uint64_t start = Bench::NowNs();
+				auto_ptr<SipResponse> response( m_registrar.HandleRequest( m_requests[ i % m_requests.size() ] ) );
+				latencies.push_back( Bench::NowNs() - start );
+				errors += response->StatusCode() != 200;
+			}
+			//The registrar wrote on this thread's connection from the pool, when this thread led a batch
+			try
+			{
+				RedisPool::Lease connection( m_pool );
+				roundTrips = connection->RoundTrips();
+				bytes = connection->BytesSent();
+			}
+			catch ( RedisPoolException& )
+			{
+			}
+		}
+
+		vector<uint64_t> latencies;
+		uint64_t roundTrips, bytes, errors;
+
+	private:
+		Registrar& m_registrar;
+		RedisPool& m_pool;
+		vector<SipRequest> m_requests;
+		unsigned int m_registers;
+		boost::barrier& m_start;
+};
+
+/**
+ *     Runs options.registers REGISTERs from requests over threads. The requests are registered once beforehand, from
+ *     another thread, when refresh is set.
+ */
+void RunRegistrar( const Options& options, unsigned int threads, unsigned int batchLimit, bool coalescing,
+	const vector<SipRequest>& requests, bool refresh, Result& result )
+{
+	RedisPool pool( options.host, options.port );
+	Registrar registrar( pool );
+	registrar.SetBatching( options.batchWindowUs, batchLimit );
+	registrar.SetCoalescing( coalescing );
+	if ( refresh )
+		for ( vector<SipRequest>::const_iterator request = requests.begin(); request != requests.end(); ++request )
+			registrar.HandleRequest( *request );
+	boost::barrier start( threads + 1 );
+	vector<RegisterWorker> workers;
+	for ( unsigned int i = 0; i < threads; ++i )
+		workers.push_back( RegisterWorker( registrar, pool, requests, options.registers / threads, start ) );
+	boost::thread_group group;
+	for ( unsigned int i = 0; i < threads; ++i )
+		group.create_thread( boost::ref( workers[i] ) );
+	start.wait();
+	uint64_t begin = Bench::NowNs();
+	group.join_all();
+	result.elapsedNs = Bench::NowNs() - begin;
+	for ( vector<RegisterWorker>::const_iterator worker = workers.begin(); worker != workers.end(); ++worker )
+	{
+		result.latencies.insert( result.latencies.end(), worker->latencies.begin(), worker->latencies.end() );
+		result.roundTrips += worker->roundTrips;
+		result.bytes += worker->bytes;
+		result.errors += worker->errors;
+	}
+}
+
+void Print( const char* name, unsigned int threads, Result& result, bool last )
+{
+	sort( result.latencies.begin(), result.latencies.end() );
+	uint64_t total = 0;
+	for ( vector<uint64_t>::const_iterator latency = result.latencies.begin(); latency != result.latencies.end(); ++latency )
+		total += *latency;
+	char line[ 512 ];
+	snprintf( line, sizeof( line ),
+		"\n    { \"path\": \"%s\", \"threads\": %u, \"round_trips_per_register\": %.2f, \"bytes_per_register\": %.1f, \"mean_us\": %.1f, \"p50_us\": %.1f, \"p99_us\": %.1f, \"registers_per_s\": %.0f, \"errors\": %llu }%s",
+		name, threads, static_cast<double>( result.roundTrips ) / result.latencies.size(),
+		static_cast<double>( result.bytes ) / result.latencies.size(),
+		total / 1000.0 / result.latencies.size(), Bench::Percentile( result.latencies, 50 ) / 1000.0,
+		Bench::Percentile( result.latencies, 99 ) / 1000.0, result.latencies.size() * 1e9 / result.elapsedNs,
+		static_cast<unsigned long long>( result.errors ),
+		last ? "" : "," );
+	cout << line << flush;
+}
+
+}; //namespace
+
+int main( int argc, char* argv[] )
+{
+	Options options;
+	if ( !ParseOptions( argc, argv, options ) )
+	{
+		cerr << "usage: sip_registrar_bench [--registers N] [--rtt-us N] [--threads N] [--batch-window-us N] "
+			"[--batch-limit N] [--endpoints N] [--redis host:port]" << endl;
+		return 1;
+	}
+
+	auto_ptr<FakeRedis> fake;
+	if ( options.host.empty() )
+	{
+		fake.reset( new FakeRedis( options.rttUs ) );
+		options.host = "127.0.0.1";
+		options.port = fake->Port();
+	}
+
+	cout << "{\n  \"benchmark\": \"sip_registrar_bench\",\n  \"schema\": 1,\n  \"registers\": " << options.registers
+		<< ",\n  \"redis\": \"" << ( fake.get() ? "fake" : Bench::JsonEscape( options.host ) ) << "\",\n  \"rtt_us\": "
+		<< ( fake.get() ? options.rttUs : 0 ) << ",\n  \"batch_window_us\": " << options.batchWindowUs
+		<< ",\n  \"batch_limit\": " << options.batchLimit << ",\n  \"results\": [";
+
+	try
+	{
+		RedisConnection connection( options.host, options.port );
+		Result perCommand, pipelined, registrar, concurrent, batched, refresh, coalesced;
+		RunPerCommand( connection, options.registers, perCommand );
+		Print( "per_command", 1, perCommand, false );
+		RunPipelined( connection, options.registers, pipelined );
+		Print( "pipelined", 1, pipelined, false );
+		vector<SipRequest> one( 1, SipRequest( register_sip_messages[0] ) );
+		RunRegistrar( options, 1, 0, false, one, false, registrar );
+		Print( "registrar", 1, registrar, false );
+		RunRegistrar( options, options.threads, 0, false, one, false, concurrent );
+		Print( "registrar", options.threads, concurrent, false );
+		RunRegistrar( options, options.threads, options.batchLimit, false, one, false, batched );
+		Print( "registrar_batched", options.threads, batched, false );
+
+		vector<SipRequest> phones;
+		for ( unsigned int i = 0; i < options.endpoints; ++i )
+			phones.push_back( RegisterFrom( 100000 + i ) );
+		RunRegistrar( options, 1, 0, false, phones, true, refresh );
+		Print( "refresh", 1, refresh, false );
+		RunRegistrar( options, 1, 0, true, phones, true, coalesced );
+		Print( "refresh_coalesced", 1, coalesced, true );
+	}
+	catch ( exception& err )
+	{
+		cerr << "\nredis: " << err.what() << endl;
+		return 1;
+	}
+	cout << "\n  ]\n}\n";
+
+	return 0;
+}
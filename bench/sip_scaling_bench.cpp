@@ -0,0 +1,151 @@
+//
+// sip_scaling_bench: multi-core parse scaling
+//
+// Parses the corpora on 1..N threads at once, each thread working on its own deep copy of the messages, and
+// reports aggregate throughput and scaling efficiency (throughput at N threads / (N * throughput at 1 thread)).
+// Efficiency well below 1.0 points at shared state in the parse path: locks, shared caches, allocator contention.
+//
+#include <iostream>
+#include <cstdlib>
+#include <boost/thread.hpp>
+#include "BenchCommon.hpp"
+#include "../SipUtility.hpp"
+#include "../SipRequest.hpp"
+#include "../SipResponse.hpp"
+
+#include "../tests/sip_messages.h"
+#include "../tests/registrar_sip_messages.h"
+
+using namespace Sip;
+using namespace std;
+
+namespace {
+
+/**
+* \class ParseWorker
+* \brief Parses and re-serializes its own private message set until told to stop
+*/
+class ParseWorker
+{
+	public:
+		ParseWorker( const vector<string>& corpus, boost::barrier& start, volatile bool& stop )
+			: Messages( 0 ), Bytes( 0 ), m_start( start ), m_stop( stop )
+		{
+			//Deep copies, so threads never share the bytes they parse
+			for ( vector<string>::const_iterator message = corpus.begin(); message != corpus.end(); ++message )
+				m_corpus.push_back( string( message->data(), message->length() ) );
+		}
+
+		void operator()()
+		{
+			m_start.wait();
+			while ( !m_stop )
+			{
+				for ( vector<string>::const_iterator raw = m_corpus.begin(); raw != m_corpus.end(); ++raw )
+				{
+					auto_ptr<SipMessage> message;
+					Utility::ParseMessage( message, *raw );
+					if ( message->Type == SipMessage::MT_REQUEST )
+						Bench::Sink += static_cast<SipRequest&>( *message ).ToString().length();
+					else
+						Bench::Sink += static_cast<SipResponse&>( *message ).ToString().length();
+					Bytes += raw->length();
+				}
+				Messages += m_corpus.size();
+			}
+		}
+
+		uint64_t Messages, Bytes;
+
+	private:
+		vector<string> m_corpus;
+		boost::barrier& m_start;
+		volatile bool& m_stop;
+};
+
+struct Options
+{
+	Options() : maxThreads( boost::thread::hardware_concurrency() ), durationMs( 1000 ) {}
+	unsigned int maxThreads, durationMs;
+};
+
+bool ParseOptions( int argc, char* argv[], Options& options )
+{
+	for ( int arg = 1; arg + 1 < argc; arg += 2 )
+	{
+		string name( argv[arg] );
+		if ( name == "--threads" )
+			options.maxThreads = atoi( argv[arg + 1] );
+		else if ( name == "--duration-ms" )
+			options.durationMs = atoi( argv[arg + 1] );
+		else
+			return false;
+	}
+	if ( argc % 2 == 0 || options.maxThreads == 0 )
+		return false;
+	return true;
+}
+
+}; //namespace
+
+int main( int argc, char* argv[] )
+{
+	Options options;
+	if ( !ParseOptions( argc, argv, options ) )
+	{
+		cerr << "usage: sip_scaling_bench [--threads N] [--duration-ms N]" << endl;
+		return 1;
+	}
+
+	vector<string> corpus;
+	for ( int i = 0; sip_messages[i] != NULL; ++i )
+		corpus.push_back( sip_messages[i] );
+	for ( int i = 0; register_sip_messages[i] != NULL; ++i )
+		corpus.push_back( register_sip_messages[i] );
+
+	cout << "{\n  \"benchmark\": \"sip_scaling_bench\",\n  \"schema\": 1,\n  \"duration_ms\": " << options.durationMs
+		<< ",\n  \"results\": [";
+
+	double singleThreadRate = 0;
+	for ( unsigned int threads = 1; threads <= options.maxThreads; ++threads )
+	{
+		volatile bool stop = false;
+		boost::barrier start( threads + 1 );
+		vector<ParseWorker*> workers;
+		boost::thread_group group;
+		for ( unsigned int i = 0; i < threads; ++i )
+		{
+			workers.push_back( new ParseWorker( corpus, start, stop ) );
+			group.create_thread( boost::ref( *workers.back() ) );
+		}
+
+		start.wait();
+		uint64_t startNs = Bench::NowNs();
+		boost::this_thread::sleep( boost::posix_time::milliseconds( options.durationMs ) );
+		stop = true;
+		group.join_all();
+		uint64_t elapsedNs = Bench::NowNs() - startNs;
+
+		uint64_t messages = 0, bytes = 0;
+		for ( vector<ParseWorker*>::iterator worker = workers.begin(); worker != workers.end(); ++worker )
+		{
+			messages += ( *worker )->Messages;
+			bytes += ( *worker )->Bytes;
+			delete *worker;
+		}
+
+		double rate = messages * 1e9 / elapsedNs;
+		if ( threads == 1 )
+			singleThreadRate = rate;
+
+		char line[ 256 ];
+		snprintf( line, sizeof( line ),
+			"%s\n    { \"threads\": %u, \"messages\": %llu, \"bytes\": %llu, \"messages_per_sec\": %.1f, \"per_thread_messages_per_sec\": %.1f, \"scaling_efficiency\": %.3f }",
+			threads == 1 ? "" : ",", threads, static_cast<unsigned long long>( messages ), static_cast<unsigned long long>( bytes ),
+			rate, rate / threads, singleThreadRate > 0 ? rate / ( threads * singleThreadRate ) : 0.0 );
+		cout << line << flush;
+	}
+	cout << "\n  ]\n}\n";
+
+	return 0;
+}
@@ -0,0 +1,189 @@
+//
+// sip_timer_bench: a million armed timers
+//
+// Arms --timers timers (1M by default) with the deadlines a busy SIP server keeps: transaction retransmissions and
+// timeouts from T1 to 64*T1, keepalives around 30 s and registrations up to an hour. It then cancels half of them, as
+// answered transactions do, and runs the clock forward in --tick-ms steps until all the rest have expired. Each phase
+// is timed for the TimingWheel and for a binary heap (std::priority_queue) with lazy cancellation, the obvious
+// alternative.
+//
+// Reports ns per arm, per cancel and per expiry, and the p50/p99/max time of a single tick. A tick's cost should
+// follow the number of timers it expires, not the number armed.
+//
+#include <iostream>
+#include <queue>
+#include <algorithm>
+#include <functional>
+#include <cstdlib>
+#include "BenchCommon.hpp"
+#include "../SipDefines.hpp"
+#include "../TimingWheel.hpp"
+
+using namespace Sip;
+using namespace std;
+
+namespace {
+
+struct Options
+{
+	Options() : timers( 1000000 ), tickMs( 10 ) {}
+	unsigned int timers, tickMs;
+};
+
+bool ParseOptions( int argc, char* argv[], Options& options )
+{
+	for ( int arg = 1; arg + 1 < argc; arg += 2 )
+	{
+		string name( argv[arg] );
+		if ( name == "--timers" )
+			options.timers = atoi( argv[arg + 1] );
+		else if ( name == "--tick-ms" )
+			options.tickMs = atoi( argv[arg + 1] );
+		else
+			return false;
+	}
+	if ( argc % 2 == 0 || options.timers == 0 || options.tickMs == 0 )
+		return false;
+	return true;
+}
+
+/**
+ *     Deadlines, in ms from 0: half transaction timers, a fifth keepalives, the rest registrations
+ */
+vector<uint64_t> Deadlines( unsigned int count )
+{
+	srand( 1 );
+	vector<uint64_t> deadlines;
+	deadlines.reserve( count );
+	for ( unsigned int i = 0; i < count; ++i )
+	{
+		unsigned int kind = i % 10;
+		if ( kind < 5 )
+			deadlines.push_back( static_cast<uint64_t>( SIP_T1 ) << ( rand() % 7 ) );
+		else if ( kind < 7 )
+			deadlines.push_back( 25000 + rand() % 10000 );
+		else
+			deadlines.push_back( 1 + ( static_cast<uint64_t>( rand() ) * rand() ) % 3600000 );
+	}
+	return deadlines;
+}
+
+struct Result
+{
+	Result() : armNs( 0 ), cancelNs( 0 ), expireNs( 0 ), expired( 0 ) {}
+	uint64_t armNs, cancelNs, expireNs, expired;
+	vector<uint64_t> ticks;
+};
+
+void RunWheel( const vector<uint64_t>& deadlines, unsigned int tickMs, Result& result )
+{
+	TimingWheel wheel;
+	vector<SlabHandle> timers( deadlines.size() );
+
+	uint64_t start = Bench::NowNs();
+	for ( size_t i = 0; i < deadlines.size(); ++i )
+		timers[i] = wheel.Schedule( 0, deadlines[i], SlabHandle( i, 1 ), 0 );
+	result.armNs = Bench::NowNs() - start;
+
+	start = Bench::NowNs();
+	for ( size_t i = 0; i < timers.size(); i += 2 )
+		wheel.Cancel( timers[i] );
+	result.cancelNs = Bench::NowNs() - start;
+
+	vector<TimingWheel::Expired> expired;
+	for ( uint64_t now = 0; wheel.Size() > 0; now += tickMs )
+	{
+		uint64_t tick = Bench::NowNs();
+		result.expired += wheel.Advance( now, expired );
+		for ( vector<TimingWheel::Expired>::iterator due = expired.begin(); due != expired.end(); ++due )
+			Bench::Sink += due->target.index;
+		expired.clear();
+		tick = Bench::NowNs() - tick;
+		result.expireNs += tick;
+		result.ticks.push_back( tick );
+	}
+}
+
+void RunHeap( const vector<uint64_t>& deadlines, unsigned int tickMs, Result& result )
+{
+	typedef pair<uint64_t, uint32_t> Entry;
+	priority_queue<Entry, vector<Entry>, greater<Entry> > heap;
+	vector<bool> cancelled( deadlines.size(), false );
+	size_t armed = 0;
+
+	uint64_t start = Bench::NowNs();
+	for ( size_t i = 0; i < deadlines.size(); ++i )
+		heap.push( Entry( deadlines[i], i ) );
+	armed = deadlines.size();
+	result.armNs = Bench::NowNs() - start;
+
+	//A heap can't remove from the middle cheaply; cancelled entries are skipped when they come to the top
+	start = Bench::NowNs();
+	for ( size_t i = 0; i < deadlines.size(); i += 2 )
+	{
+		cancelled[i] = true;
+		--armed;
+	}
+	result.cancelNs = Bench::NowNs() - start;
+
+	for ( uint64_t now = 0; armed > 0; now += tickMs )
+	{
+		uint64_t tick = Bench::NowNs();
+		while ( !heap.empty() && heap.top().first <= now )
+		{
+			uint32_t timer = heap.top().second;
+			heap.pop();
+			if ( cancelled[timer] )
+				continue;
+			Bench::Sink += timer;
+			++result.expired;
+			--armed;
+		}
+		tick = Bench::NowNs() - tick;
+		result.expireNs += tick;
+		result.ticks.push_back( tick );
+	}
+}
+
+void Print( const char* name, const Result& result, size_t armed, size_t cancelled, bool last )
+{
+	vector<uint64_t> ticks( result.ticks );
+	sort( ticks.begin(), ticks.end() );
+	char line[ 512 ];
+	snprintf( line, sizeof( line ),
+		"\n    { \"structure\": \"%s\", \"arm_ns\": %.1f, \"cancel_ns\": %.1f, \"expire_ns\": %.1f, \"expired\": %llu, \"ticks\": %llu, \"tick_p50_ns\": %llu, \"tick_p99_ns\": %llu, \"tick_max_ns\": %llu }%s",
+		name, static_cast<double>( result.armNs ) / armed, static_cast<double>( result.cancelNs ) / cancelled,
+		result.expired > 0 ? static_cast<double>( result.expireNs ) / result.expired : 0.0,
+		static_cast<unsigned long long>( result.expired ), static_cast<unsigned long long>( ticks.size() ),
+		static_cast<unsigned long long>( Bench::Percentile( ticks, 50 ) ),
+		static_cast<unsigned long long>( Bench::Percentile( ticks, 99 ) ),
+		static_cast<unsigned long long>( ticks.empty() ? 0 : ticks.back() ), last ? "" : "," );
+	cout << line << flush;
+}
+
+}; //namespace
+
+int main( int argc, char* argv[] )
+{
+	Options options;
+	if ( !ParseOptions( argc, argv, options ) )
+	{
+		cerr << "usage: sip_timer_bench [--timers N] [--tick-ms N]" << endl;
+		return 1;
+	}
+
+	vector<uint64_t> deadlines = Deadlines( options.timers );
+	size_t cancelled = ( deadlines.size() + 1 ) / 2;
+
+	cout << "{\n  \"benchmark\": \"sip_timer_bench\",\n  \"schema\": 1,\n  \"timers\": " << options.timers
+		<< ",\n  \"tick_ms\": " << options.tickMs << ",\n  \"results\": [";
+
+	Result wheel, heap;
+	RunWheel( deadlines, options.tickMs, wheel );
+	Print( "timing_wheel", wheel, deadlines.size(), cancelled, false );
+	RunHeap( deadlines, options.tickMs, heap );
+	Print( "binary_heap", heap, deadlines.size(), cancelled, true );
+	cout << "\n  ]\n}\n";
+
+	return 0;
+}
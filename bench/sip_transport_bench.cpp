@@ -0,0 +1,314 @@
+//
+// sip_transport_bench: UDP transport backends on loopback
+//
+// Runs a server thread that parses every datagram and queues a reply, once per backend: the epoll reactor with
+// recvmmsg/sendmmsg, and io_uring when built with -DSIP_IO_URING=ON. The main thread plays the clients: it sends a
+// window of requests with one sendmmsg, collects the replies and sends the next window. Each backend reports the
+// round-trip message rate and, per message handled by the server, the system calls it made and the context switches
+// its thread took. Replies that didn't come back within 200ms count as lost.
+//
+// Both sides share one machine, so the rate is only comparable between backends on the same host.
+//
+#include <iostream>
+#include <cstdlib>
+#include <cstring>
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <sys/resource.h>
+#include <sys/time.h>
+#include <unistd.h>
+#include <boost/thread.hpp>
+#include "BenchCommon.hpp"
+#include "../transport/Reactor.hpp"
+#include "../transport/UdpTransport.hpp"
+#ifdef SIP_IO_URING
+#include "../transport/UringUdpTransport.hpp"
+#endif
+
+#include "../tests/sip_messages.h"
+
+using namespace Sip;
+using namespace std;
+
+namespace {
+
+const char REPLY[] = "SIP/2.0 200 OK\r\nVia: SIP/2.0/UDP 127.0.0.1:5060;branch=z9hG4bK776asdhds\r\n"
+	"From: <sip:alice@127.0.0.1>;tag=1928301774\r\nTo: <sip:bob@127.0.0.1>;tag=a6c85cf\r\n"
+	"Call-ID: a84b4c76e66710\r\nCSeq: 314159 INVITE\r\nContent-Length: 0\r\n\r\n";
+
+/**
+* \class Echo
+* \brief Queues the same reply to every message, through whichever transport it is given
+*/
+template <class Transport>
+class Echo : public SipMessageHandler
+{
+	public:
+		Echo() : transport( NULL ), m_reply( REPLY ) {}
+
+		void OnMessage( auto_ptr<SipMessage>& message, const sockaddr_storage& source, int socket )
+		{
+			transport->Queue( socket, m_reply, source );
+		}
+
+		Transport* transport;
+
+	private:
+		string m_reply;
+};
+
+/**
+* \class ServerResult
+* \brief What the server thread measured about itself
+*/
+struct ServerResult
+{
+	ServerResult() : port( 0 ), messages( 0 ), syscalls( 0 ), contextSwitches( 0 ) {}
+	unsigned short port;
+	uint64_t messages, syscalls, contextSwitches;
+	string error; ///< Set if the backend couldn't start
+};
+
+uint64_t ContextSwitches()
+{
+	rusage usage;
+	getrusage( RUSAGE_THREAD, &usage );
+	return usage.ru_nvcsw + usage.ru_nivcsw;
+}
+
+/**
+* \class EpollServer
+* \brief Runs UdpTransport on a Reactor until told to stop
+*/
+class EpollServer
+{
+	public:
+		EpollServer( unsigned int batchSize, boost::barrier& ready, volatile bool& stop, ServerResult& result )
+			: m_batchSize( batchSize ), m_ready( ready ), m_stop( stop ), m_result( result ) {}
+
+		void operator()()
+		{
+			Reactor reactor;
+			Echo<UdpTransport> handler;
+			UdpTransport transport( reactor, handler, m_batchSize );
+			handler.transport = &transport;
+			m_result.port = UdpTransport::LocalPort( transport.Listen( "127.0.0.1", 0 ) );
+
+			uint64_t switches = ContextSwitches(), waits = 0;
+			m_ready.wait();
+			while ( !m_stop )
+			{
+				reactor.RunOnce( 100 );
+				++waits;
+			}
+
+			const UdpTransport::Stats& stats = transport.GetStats();
+			m_result.messages = stats.datagrams;
+			m_result.syscalls = waits + stats.receiveCalls + stats.sendCalls;
+			m_result.contextSwitches = ContextSwitches() - switches;
+		}
+
+	private:
+		unsigned int m_batchSize;
+		boost::barrier& m_ready;
+		volatile bool& m_stop;
+		ServerResult& m_result;
+};
+
+#ifdef SIP_IO_URING
+/**
+* \class UringServer
+* \brief Runs UringUdpTransport until told to stop. The ring is created on this thread, which is its only submitter.
+*/
+class UringServer
+{
+	public:
+		UringServer( unsigned int buffers, boost::barrier& ready, volatile bool& stop, ServerResult& result )
+			: m_buffers( buffers ), m_ready( ready ), m_stop( stop ), m_result( result ) {}
+
+		void operator()()
+		{
+			Echo<UringUdpTransport> handler;
+			auto_ptr<UringUdpTransport> created;
+			try
+			{
+				created.reset( new UringUdpTransport( handler, m_buffers ) );
+				m_result.port = UdpTransport::LocalPort( created->Listen( "127.0.0.1", 0 ) );
+			}
+			catch ( TransportException& e )
+			{
+				m_result.error = e.what();
+				m_ready.wait();
+				return;
+			}
+			UringUdpTransport& transport = *created;
+			handler.transport = &transport;
+
+			uint64_t switches = ContextSwitches();
+			m_ready.wait();
+			while ( !m_stop )
+				transport.RunOnce( 100 );
+
+			UringUdpTransport::Stats stats = transport.GetStats();
+			m_result.messages = stats.datagrams;
+			m_result.syscalls = stats.enters;
+			m_result.contextSwitches = ContextSwitches() - switches;
+		}
+
+	private:
+		unsigned int m_buffers;
+		boost::barrier& m_ready;
+		volatile bool& m_stop;
+		ServerResult& m_result;
+};
+#endif //SIP_IO_URING
+
+struct Options
+{
+	Options() : durationMs( 1000 ), window( 64 ), batchSize( 32 ) {}
+	unsigned int durationMs, window, batchSize;
+};
+
+bool ParseOptions( int argc, char* argv[], Options& options )
+{
+	for ( int arg = 1; arg + 1 < argc; arg += 2 )
+	{
+		string name( argv[arg] );
+		if ( name == "--duration-ms" )
+			options.durationMs = atoi( argv[arg + 1] );
+		else if ( name == "--window" )
+			options.window = atoi( argv[arg + 1] );
+		else if ( name == "--batch" )
+			options.batchSize = atoi( argv[arg + 1] );
+		else
+			return false;
+	}
+	if ( argc % 2 == 0 || options.window == 0 || options.batchSize == 0 )
+		return false;
+	return true;
+}
+
+/**
+ *     Sends windows of requests to port until durationMs is up
+ * @return Replies received; lost is set to the requests that got none
+ */
+uint64_t Drive( unsigned short port, const Options& options, uint64_t& lost )
+{
+	int client = socket( AF_INET, SOCK_DGRAM, 0 );
+	timeval timeout = { 0, 200000 };
+	setsockopt( client, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof( timeout ) );
+	int bufferSize = 4 * 1024 * 1024;
+	setsockopt( client, SOL_SOCKET, SO_RCVBUF, &bufferSize, sizeof( bufferSize ) );
+
+	sockaddr_in server;
+	memset( &server, 0, sizeof( server ) );
+	server.sin_family = AF_INET;
+	server.sin_port = htons( port );
+	server.sin_addr.s_addr = htonl( INADDR_LOOPBACK );
+
+	string request( sip_messages[0] );
+	iovec requestVector = { const_cast<char*>( request.data() ), request.length() };
+	vector<mmsghdr> requests( options.window );
+	memset( &requests[0], 0, requests.size() * sizeof( mmsghdr ) );
+	for ( unsigned int i = 0; i < options.window; ++i )
+	{
+		requests[i].msg_hdr.msg_name = &server;
+		requests[i].msg_hdr.msg_namelen = sizeof( server );
+		requests[i].msg_hdr.msg_iov = &requestVector;
+		requests[i].msg_hdr.msg_iovlen = 1;
+	}
+
+	vector<char> replyBuffers( options.window * 2048 );
+	vector<iovec> replyVectors( options.window );
+	vector<mmsghdr> replies( options.window );
+	memset( &replies[0], 0, replies.size() * sizeof( mmsghdr ) );
+	for ( unsigned int i = 0; i < options.window; ++i )
+	{
+		replyVectors[i].iov_base = &replyBuffers[ i * 2048 ];
+		replyVectors[i].iov_len = 2048;
+		replies[i].msg_hdr.msg_iov = &replyVectors[i];
+		replies[i].msg_hdr.msg_iovlen = 1;
+	}
+
+	uint64_t received = 0, endNs = Bench::NowNs() + options.durationMs * 1000000ULL;
+	lost = 0;
+	while ( Bench::NowNs() < endNs )
+	{
+		unsigned int sent = 0;
+		while ( sent < options.window )
+		{
+			int result = sendmmsg( client, &requests[sent], options.window - sent, 0 );
+			if ( result <= 0 )
+				break;
+			sent += result;
+		}
+
+		unsigned int answered = 0;
+		while ( answered < sent )
+		{
+			int result = recvmmsg( client, &replies[0], sent - answered, MSG_WAITFORONE, NULL );
+			if ( result <= 0 )
+				break;
+			answered += result;
+		}
+		received += answered;
+		lost += sent - answered;
+	}
+	close( client );
+	return received;
+}
+
+template <class Server>
+void Measure( const char* backend, unsigned int argument, const Options& options, bool first )
+{
+	boost::barrier ready( 2 );
+	volatile bool stop = false;
+	ServerResult result;
+	Server server( argument, ready, stop, result );
+	boost::thread thread( boost::ref( server ) );
+	ready.wait();
+	if ( !result.error.empty() )
+	{
+		thread.join();
+		cerr << backend << " backend unavailable: " << result.error << endl;
+		return;
+	}
+
+	uint64_t lost;
+	uint64_t startNs = Bench::NowNs();
+	uint64_t replies = Drive( result.port, options, lost );
+	uint64_t elapsedNs = Bench::NowNs() - startNs;
+	stop = true;
+	thread.join();
+
+	double perMessage = result.messages > 0 ? 1.0 / result.messages : 0.0;
+	char line[ 384 ];
+	snprintf( line, sizeof( line ),
+		"%s\n    { \"backend\": \"%s\", \"replies\": %llu, \"lost\": %llu, \"messages_per_sec\": %.1f, \"server_syscalls_per_message\": %.3f, \"server_context_switches_per_message\": %.4f }",
+		first ? "" : ",", backend, static_cast<unsigned long long>( replies ), static_cast<unsigned long long>( lost ),
+		replies * 1e9 / elapsedNs, result.syscalls * perMessage, result.contextSwitches * perMessage );
+	cout << line << flush;
+}
+
+}; //namespace
+
+int main( int argc, char* argv[] )
+{
+	Options options;
+	if ( !ParseOptions( argc, argv, options ) )
+	{
+		cerr << "usage: sip_transport_bench [--duration-ms N] [--window N] [--batch N]" << endl;
+		return 1;
+	}
+
+	cout << "{\n  \"benchmark\": \"sip_transport_bench\",\n  \"schema\": 1,\n  \"duration_ms\": " << options.durationMs
+		<< ",\n  \"window\": " << options.window << ",\n  \"batch\": " << options.batchSize << ",\n  \"results\": [";
+
+	Measure<EpollServer>( "epoll_recvmmsg", options.batchSize, options, true );
+#ifdef SIP_IO_URING
+	Measure<UringServer>( "io_uring", options.window * 2, options, false );
+#endif
+	cout << "\n  ]\n}\n";
+
+	return 0;
+}
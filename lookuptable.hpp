@@ -13,10 +13,17 @@
 #define LOOKUPTABLE_HPP
 #include <map>
 #include <algorithm> //transform
-#include <string> //tolower
+#include <string>
 
 using namespace std;
 
+/**
+ *     Locale independent ASCII case conversion. SIP tokens are ASCII; unlike tolower/toupper these never consult the
+ *     process locale, so results don't change under setlocale() and there is no shared locale state between threads.
+ */
+inline char AsciiToLower( char c ) { return ( c >= 'A' && c <= 'Z' ) ? c + ( 'a' - 'A' ) : c; }
+inline char AsciiToUpper( char c ) { return ( c >= 'a' && c <= 'z' ) ? c - ( 'a' - 'A' ) : c; }
+
 
 /**
  * \class LookupTableException
@@ -87,7 +94,7 @@ template <class K, class V>
 		{
 			typename map<K, V>::const_iterator iter;
 			string lcase_key( key );
-			std::transform( lcase_key.begin(), lcase_key.end(), lcase_key.begin(), (int(*)(int)) tolower );
+			std::transform( lcase_key.begin(), lcase_key.end(), lcase_key.begin(), AsciiToLower );
 			iter = table.find ( lcase_key );
 			if ( iter == table.end() )
 				throw LookupTableException ( "Key not found." );
@@ -115,7 +122,7 @@ template <class K, class V>
 		{
 			typename map<K, string>::const_iterator iter;
 			string lcase_value( value );
-			std::transform( lcase_value.begin(), lcase_value.end(), lcase_value.begin(), (int(*)(int)) tolower );
+			std::transform( lcase_value.begin(), lcase_value.end(), lcase_value.begin(), AsciiToLower );
 
 			for ( iter = table.begin(); iter != table.end(); ++iter ) {
 				if ( ( *iter ).second == lcase_value )
@@ -0,0 +1,104 @@
+#include "AllocationCounter.hpp"
+#include <new>
+#include <cstdlib>
+
+namespace {
+
+//Keeps the returned memory aligned for any type
+const size_t HEADER_SIZE = 16;
+
+uint64_t g_allocations = 0, g_deallocations = 0, g_bytes = 0;
+int64_t g_liveBytes = 0;
+__thread uint64_t t_allocations = 0, t_deallocations = 0, t_bytes = 0;
+__thread int64_t t_liveBytes = 0;
+
+AllocationCounter::Counts Difference( AllocationCounter::Counts now, const AllocationCounter::Counts& start )
+{
+	now.allocations -= start.allocations;
+	now.deallocations -= start.deallocations;
+	now.bytes -= start.bytes;
+	now.liveBytes -= start.liveBytes;
+	return now;
+}
+
+void* CountedAllocate( size_t size ) throw()
+{
+	unsigned char* block = static_cast<unsigned char*>( malloc( size + HEADER_SIZE ) );
+	if ( block == NULL )
+		return NULL;
+
+	*reinterpret_cast<size_t*>( block ) = size;
+	__sync_fetch_and_add( &g_allocations, 1 );
+	__sync_fetch_and_add( &g_bytes, size );
+	__sync_fetch_and_add( &g_liveBytes, size );
+	++t_allocations;
+	t_bytes += size;
+	t_liveBytes += size;
+	return block + HEADER_SIZE;
+}
+
+void CountedFree( void* memory ) throw()
+{
+	if ( memory == NULL )
+		return;
+
+	unsigned char* block = static_cast<unsigned char*>( memory ) - HEADER_SIZE;
+	__sync_fetch_and_add( &g_deallocations, 1 );
+	__sync_fetch_and_sub( &g_liveBytes, *reinterpret_cast<size_t*>( block ) );
+	++t_deallocations;
+	t_liveBytes -= *reinterpret_cast<size_t*>( block );
+	free( block );
+}
+
+void* Allocate( size_t size ) throw( std::bad_alloc )
+{
+	void* memory = CountedAllocate( size );
+	if ( memory == NULL )
+		throw std::bad_alloc();
+	return memory;
+}
+
+}; //namespace
+
+AllocationCounter::Counts AllocationCounter::Now()
+{
+	Counts now;
+	now.allocations = __sync_fetch_and_add( &g_allocations, 0 );
+	now.deallocations = __sync_fetch_and_add( &g_deallocations, 0 );
+	now.bytes = __sync_fetch_and_add( &g_bytes, 0 );
+	now.liveBytes = __sync_fetch_and_add( &g_liveBytes, 0 );
+	return now;
+}
+
+AllocationCounter::Counts AllocationCounter::Since( const Counts& start )
+{
+	return Difference( Now(), start );
+}
+
+AllocationCounter::Counts AllocationCounter::ThisThread()
+{
+	Counts now;
+	now.allocations = t_allocations;
+	now.deallocations = t_deallocations;
+	now.bytes = t_bytes;
+	now.liveBytes = t_liveBytes;
+	return now;
+}
+
+AllocationCounter::Counts AllocationCounter::ThisThreadSince( const Counts& start )
+{
+	return Difference( ThisThread(), start );
+}
+
+//
+// Global operator replacements
+//
+
+void* operator new( size_t size ) throw( std::bad_alloc ) { return Allocate( size ); }
+void* operator new[]( size_t size ) throw( std::bad_alloc ) { return Allocate( size ); }
+void* operator new( size_t size, const std::nothrow_t& ) throw() { return CountedAllocate( size ); }
+void* operator new[]( size_t size, const std::nothrow_t& ) throw() { return CountedAllocate( size ); }
+void operator delete( void* memory ) throw() { CountedFree( memory ); }
+void operator delete[]( void* memory ) throw() { CountedFree( memory ); }
+void operator delete( void* memory, const std::nothrow_t& ) throw() { CountedFree( memory ); }
+void operator delete[]( void* memory, const std::nothrow_t& ) throw() { CountedFree( memory ); }
@@ -0,0 +1,47 @@
+#ifndef ALLOCATIONCOUNTER_HPP
+#define ALLOCATIONCOUNTER_HPP
+#include <stdint.h>
+
+/**
+* \class AllocationCounter
+* \brief Counts calls through the global operator new/delete.
+* \details Linking AllocationCounter.cpp into an executable replaces the global allocation operators with
+* 	counting versions. Each allocation carries a small header recording its size, so live bytes can be tracked
+* 	as well. Counters are updated atomically, but a snapshot is only meaningful for work done on one thread; the
+* 	ThisThread() counts leave out other threads, for work that has a helper thread running next to it.
+*/
+class AllocationCounter
+{
+	public:
+		struct Counts
+		{
+			Counts() : allocations( 0 ), deallocations( 0 ), bytes( 0 ), liveBytes( 0 ) {}
+
+			uint64_t allocations, deallocations, bytes;
+			int64_t liveBytes;
+		};
+
+		/**
+		 *     Current totals since program start
+		 */
+		static Counts Now();
+
+		/**
+		 *     Totals accumulated since an earlier snapshot
+		 * @param start The snapshot taken before the work being measured
+		 */
+		static Counts Since( const Counts& start );
+
+		/**
+		 *     Totals for the calling thread alone. Live bytes go down on the thread that frees, which need not be
+		 *     the one that allocated.
+		 */
+		static Counts ThisThread();
+
+		/**
+		 *     Totals accumulated on the calling thread since an earlier ThisThread() snapshot
+		 */
+		static Counts ThisThreadSince( const Counts& start );
+};
+
+#endif //ALLOCATIONCOUNTER_HPP
@@ -0,0 +1,348 @@
+#include "FakeRedis.hpp"
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <stdexcept>
+#include <poll.h>
+#include <unistd.h>
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <sys/socket.h>
+
+using namespace std;
+
+namespace {
+
+void Status( string& out, const char* status )
+{
+	out += status;
+	out += "\r\n";
+}
+
+void Integer( string& out, long long value )
+{
+	char line[ 32 ];
+	snprintf( line, sizeof( line ), ":%lld\r\n", value );
+	out += line;
+}
+
+void Bulk( string& out, const string& value )
+{
+	char header[ 32 ];
+	snprintf( header, sizeof( header ), "$%lu\r\n", static_cast<unsigned long>( value.length() ) );
+	out += header;
+	out += value;
+	out += "\r\n";
+}
+
+/**
+ *     Parses one command, an array of bulk strings, at position; false if in doesn't hold all of it yet
+ */
+bool ParseCommand( const string& in, size_t& position, vector<string>& command )
+{
+	size_t end = in.find( "\r\n", position );
+	if ( end == string::npos )
+		return false;
+	if ( in[position] != '*' )
+		throw runtime_error( "not RESP" );
+	long count = strtol( in.c_str() + position + 1, NULL, 10 );
+	size_t next = end + 2;
+	command.clear();
+	for ( long i = 0; i < count; ++i )
+	{
+		end = in.find( "\r\n", next );
+		if ( end == string::npos )
+			return false;
+		if ( in[next] != '$' )
+			throw runtime_error( "not RESP" );
+		size_t length = strtoul( in.c_str() + next + 1, NULL, 10 );
+		next = end + 2;
+		if ( next + length + 2 > in.length() )
+			return false;
+		command.push_back( in.substr( next, length ) );
+		next += length + 2;
+	}
+	position = next;
+	return true;
+}
+
+}; //namespace
+
+FakeRedis::FakeRedis( unsigned int delay )
+	: m_listener( socket( AF_INET, SOCK_STREAM, 0 ) ), m_port( 0 ), m_delay( delay ), m_disconnect( false ),
+	m_roundTrips( 0 ), m_commands( 0 )
+{
+	int on = 1;
+	setsockopt( m_listener, SOL_SOCKET, SO_REUSEADDR, &on, sizeof( on ) );
+	sockaddr_in address;
+	memset( &address, 0, sizeof( address ) );
+	address.sin_family = AF_INET;
+	address.sin_addr.s_addr = htonl( INADDR_LOOPBACK );
+	socklen_t length = sizeof( address );
+	if ( bind( m_listener, reinterpret_cast<sockaddr*>( &address ), sizeof( address ) ) != 0 ||
+		listen( m_listener, 64 ) != 0 ||
+		getsockname( m_listener, reinterpret_cast<sockaddr*>( &address ), &length ) != 0 ||
+		pipe( m_wake ) != 0 )
+		throw runtime_error( "FakeRedis could not listen" );
+	m_port = ntohs( address.sin_port );
+	m_thread = boost::thread( &FakeRedis::Run, this );
+}
+
+FakeRedis::~FakeRedis()
+{
+	close( m_wake[1] );
+	m_thread.join();
+	close( m_wake[0] );
+	close( m_listener );
+}
+
+unsigned short FakeRedis::Port() const
+{
+	return m_port;
+}
+
+uint64_t FakeRedis::RoundTrips() const
+{
+	boost::mutex::scoped_lock lock( m_mutex );
+	return m_roundTrips;
+}
+
+uint64_t FakeRedis::Commands() const
+{
+	boost::mutex::scoped_lock lock( m_mutex );
+	return m_commands;
+}
+
+bool FakeRedis::Get( const string& key, Hash& hash ) const
+{
+	boost::mutex::scoped_lock lock( m_mutex );
+	map<string, Hash>::const_iterator found = m_hashes.find( key );
+	if ( found == m_hashes.end() )
+		return false;
+	hash = found->second;
+	return true;
+}
+
+int FakeRedis::Ttl( const string& key ) const
+{
+	boost::mutex::scoped_lock lock( m_mutex );
+	if ( m_hashes.count( key ) == 0 )
+		return -2;
+	map<string, int>::const_iterator found = m_ttls.find( key );
+	return found == m_ttls.end() ? -1 : found->second;
+}
+
+void FakeRedis::Disconnect()
+{
+	{
+		boost::mutex::scoped_lock lock( m_mutex );
+		m_disconnect = true;
+	}
+	char wake = 0;
+	if ( write( m_wake[1], &wake, 1 ) != 1 )
+		return;
+	//Wait for the server thread to see it, so the caller knows the connections are gone
+	for ( ;; )
+	{
+		usleep( 1000 );
+		boost::mutex::scoped_lock lock( m_mutex );
+		if ( !m_disconnect )
+			return;
+	}
+}
+
+void FakeRedis::Run()
+{
+	map<int, Client> clients;
+	vector<pollfd> polled;
+	for ( ;; )
+	{
+		polled.clear();
+		pollfd wake = { m_wake[0], POLLIN, 0 }, listener = { m_listener, POLLIN, 0 };
+		polled.push_back( wake );
+		polled.push_back( listener );
+		for ( map<int, Client>::iterator client = clients.begin(); client != clients.end(); ++client )
+		{
+			pollfd readable = { client->first, POLLIN, 0 };
+			polled.push_back( readable );
+		}
+		if ( poll( &polled[0], polled.size(), -1 ) < 0 )
+			continue;
+
+		if ( polled[0].revents != 0 )
+		{
+			char wakeup;
+			if ( read( m_wake[0], &wakeup, 1 ) <= 0 )	//Closed: the destructor wants the thread done
+				break;
+			for ( map<int, Client>::iterator client = clients.begin(); client != clients.end(); ++client )
+				close( client->first );
+			clients.clear();
+			boost::mutex::scoped_lock lock( m_mutex );
+			m_disconnect = false;
+			continue;
+		}
+		if ( polled[1].revents & POLLIN )
+		{
+			int accepted = accept( m_listener, NULL, NULL );
+			if ( accepted >= 0 )
+				clients[accepted];
+		}
+		for ( size_t i = 2; i < polled.size(); ++i )
+		{
+			if ( polled[i].revents == 0 )
+				continue;
+			Client& client = clients[polled[i].fd];
+			char buffer[ 16384 ];
+			ssize_t received = recv( polled[i].fd, buffer, sizeof( buffer ), 0 );
+			string out;
+			unsigned int commands = 0;
+			bool open = received > 0;
+			if ( open )
+			{
+				client.in.append( buffer, received );
+				open = Serve( client, out, commands );
+			}
+			if ( commands > 0 )
+			{
+				//Counted before the answer goes, so a client that has its answer sees the count
+				{
+					boost::mutex::scoped_lock lock( m_mutex );
+					++m_roundTrips;
+					m_commands += commands;
+				}
+				if ( m_delay > 0 )
+					usleep( m_delay );
+				if ( send( polled[i].fd, out.data(), out.length(), MSG_NOSIGNAL ) != static_cast<ssize_t>( out.length() ) )
+					open = false;
+			}
+			if ( !open )
+			{
+				close( polled[i].fd );
+				clients.erase( polled[i].fd );
+			}
+		}
+	}
+	for ( map<int, Client>::iterator client = clients.begin(); client != clients.end(); ++client )
+		close( client->first );
+}
+
+bool FakeRedis::Serve( Client& client, string& out, unsigned int& commands )
+{
+	size_t position = 0;
+	vector<string> command;
+	try
+	{
+		while ( position < client.in.length() && ParseCommand( client.in, position, command ) )
+		{
+			++commands;
+			if ( command.empty() )
+				continue;
+			string name( command[0] );
+			for ( string::iterator c = name.begin(); c != name.end(); ++c )
+				*c = toupper( *c );
+			if ( name == "MULTI" )
+			{
+				client.multi = true;
+				client.queued = 0;
+				client.queuedReplies.clear();
+				Status( out, "+OK" );
+			}
+			else if ( name == "EXEC" && client.multi )
+			{
+				char header[ 16 ];
+				snprintf( header, sizeof( header ), "*%u\r\n", client.queued );
+				out += header;
+				out += client.queuedReplies;
+				client.multi = false;
+			}
+			else if ( name == "DISCARD" && client.multi )
+			{
+				client.multi = false;
+				Status( out, "+OK" );
+			}
+			else if ( client.multi )
+			{
+				Execute( command, client.queuedReplies );
+				++client.queued;
+				Status( out, "+QUEUED" );
+			}
+			else
+				Execute( command, out );
+		}
+	}
+	catch ( runtime_error& )
+	{
+		return false;
+	}
+	client.in.erase( 0, position );
+	return true;
+}
+
+void FakeRedis::Execute( const vector<string>& command, string& out )
+{
+	string name( command[0] );
+	for ( string::iterator c = name.begin(); c != name.end(); ++c )
+		*c = toupper( *c );
+	boost::mutex::scoped_lock lock( m_mutex );
+	if ( name == "PING" )
+		Status( out, "+PONG" );
+	else if ( name == "EXISTS" && command.size() == 2 )
+		Integer( out, m_hashes.count( command[1] ) );
+	else if ( name == "DEL" && command.size() >= 2 )
+	{
+		long long deleted = 0;
+		for ( size_t i = 1; i < command.size(); ++i )
+		{
+			deleted += m_hashes.erase( command[i] );
+			m_ttls.erase( command[i] );
+		}
+		Integer( out, deleted );
+	}
+	else if ( name == "HSET" && command.size() >= 4 && command.size() % 2 == 0 )
+	{
+		Hash& hash = m_hashes[command[1]];
+		long long added = 0;
+		for ( size_t i = 2; i < command.size(); i += 2 )
+		{
+			added += hash.count( command[i] ) == 0;
+			hash[command[i]] = command[i + 1];
+		}
+		Integer( out, added );
+	}
+	else if ( name == "HGET" && command.size() == 3 )
+	{
+		map<string, Hash>::const_iterator hash = m_hashes.find( command[1] );
+		Hash::const_iterator field;
+		if ( hash == m_hashes.end() || ( field = hash->second.find( command[2] ) ) == hash->second.end() )
+			out += "$-1\r\n";
+		else
+			Bulk( out, field->second );
+	}
+	else if ( name == "HGETALL" && command.size() == 2 )
+	{
+		map<string, Hash>::const_iterator found = m_hashes.find( command[1] );
+		const Hash hash = found == m_hashes.end() ? Hash() : found->second;
+		char header[ 16 ];
+		snprintf( header, sizeof( header ), "*%lu\r\n", static_cast<unsigned long>( hash.size() * 2 ) );
+		out += header;
+		for ( Hash::const_iterator field = hash.begin(); field != hash.end(); ++field )
+		{
+			Bulk( out, field->first );
+			Bulk( out, field->second );
+		}
+	}
+	else if ( name == "EXPIRE" && command.size() == 3 )
+	{
+		bool exists = m_hashes.count( command[1] ) > 0;
+		if ( exists )
+			m_ttls[command[1]] = atoi( command[2].c_str() );
+		Integer( out, exists );
+	}
+	else if ( name == "TTL" && command.size() == 2 )
+	{
+		map<string, int>::const_iterator ttl = m_ttls.find( command[1] );
+		Integer( out, m_hashes.count( command[1] ) == 0 ? -2 : ttl == m_ttls.end() ? -1 : ttl->second );
+	}
+	else
+		Status( out, ( "-ERR unknown command or wrong number of arguments for '" + command[0] + "'" ).c_str() );
+}
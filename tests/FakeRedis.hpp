@@ -0,0 +1,84 @@
+#ifndef FAKEREDIS_HPP
+#define FAKEREDIS_HPP
+#include <map>
+#include <string>
+#include <vector>
+#include <stdint.h>
+#include <boost/thread/mutex.hpp>
+#include <boost/thread/thread.hpp>
+
+/**
+* \class FakeRedis
+* \brief Just enough of a redis server, on a loopback port of its own, to test and time the registrar without one
+* \details Speaks RESP and keeps hashes in memory. Knows PING, EXISTS, DEL, HSET, HGET, HGETALL, EXPIRE and TTL
+* 	(which records the TTL but never expires anything), and MULTI/EXEC/DISCARD. Commands that arrive in one read
+* 	are answered in one write, after an optional delay standing in for the network, and counted as one round trip.
+*/
+class FakeRedis
+{
+	public:
+		typedef std::map<std::string, std::string> Hash;
+
+		/**
+		 * @param delay Microseconds to wait before answering each read, as a network round trip would
+		 */
+		explicit FakeRedis( unsigned int delay = 0 );
+		~FakeRedis();
+
+		unsigned short Port() const;
+
+		/**
+		 *     Reads that carried at least one command: round trips, from the server's side
+		 */
+		uint64_t RoundTrips() const;
+		uint64_t Commands() const;
+
+		/**
+		 *     A copy of the hash at key; false if there is none
+		 */
+		bool Get( const std::string& key, Hash& hash ) const;
+
+		/**
+		 *     The TTL last set on key, -1 if none and -2 if there is no key, as TTL answers
+		 */
+		int Ttl( const std::string& key ) const;
+
+		/**
+		 *     Closes every client connection, as a redis restart or an idle timeout would
+		 */
+		void Disconnect();
+
+	private:
+		FakeRedis( const FakeRedis& );
+		FakeRedis& operator=( const FakeRedis& );
+
+		struct Client
+		{
+			Client() : multi( false ), queued( 0 ) {}
+			std::string in;
+			bool multi;
+			std::string queuedReplies;
+			unsigned int queued;
+		};
+
+		void Run();
+		/**
+		 *     Answers every whole command in client.in; false if the client sent something that isn't RESP
+		 */
+		bool Serve( Client& client, std::string& out, unsigned int& commands );
+		void Execute( const std::vector<std::string>& command, std::string& out );
+
+		int m_listener, m_wake[2];
+		unsigned short m_port;
+		unsigned int m_delay;
+		bool m_disconnect;
+
+		mutable boost::mutex m_mutex;
+		std::map<std::string, Hash> m_hashes;
+		std::map<std::string, int> m_ttls;
+		uint64_t m_roundTrips, m_commands;
+
+		boost::thread m_thread;
+};
+
+#endif //FAKEREDIS_HPP
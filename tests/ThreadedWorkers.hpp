@@ -0,0 +1,47 @@
+#ifndef THREADEDWORKERS_HPP
+#define THREADEDWORKERS_HPP
+#include <vector>
+#include <boost/bind.hpp>
+#include <boost/thread.hpp>
+
+/**
+* \class ThreadedWorkers
+* \brief Runs a set of workers on threads of their own, released together, and totals the failures they count
+* \details Each Worker provides Prepare(), run on its thread before the start, and Run(), run once every worker
+* 	is prepared, which returns the number of failures it saw. Boost.Test assertions aren't thread safe, so
+* 	failures are only counted here and checked after join.
+*/
+template <class Worker>
+class ThreadedWorkers
+{
+	public:
+		/**
+		 *     Runs every worker to completion
+		 * @return The failures counted by all of them
+		 */
+		static int Run( std::vector<Worker>& workers )
+		{
+			boost::barrier start( workers.size() );
+			std::vector<int> failures( workers.size(), 0 );
+			boost::thread_group group;
+			for ( size_t i = 0; i < workers.size(); ++i )
+				group.create_thread( boost::bind( &ThreadedWorkers::Start, boost::ref( workers[i] ),
+					boost::ref( start ), boost::ref( failures[i] ) ) );
+			group.join_all();
+
+			int total = 0;
+			for ( size_t i = 0; i < failures.size(); ++i )
+				total += failures[i];
+			return total;
+		}
+
+	private:
+		static void Start( Worker& worker, boost::barrier& start, int& failures )
+		{
+			worker.Prepare();
+			start.wait();
+			failures = worker.Run();
+		}
+};
+
+#endif //THREADEDWORKERS_HPP
@@ -0,0 +1,101 @@
+#include <boost/test/unit_test.hpp>
+#include <sstream>
+#include <cstring>
+#include "AllocationCounter.hpp"
+#include "../SipUtility.hpp"
+#include "../SipRequest.hpp"
+#include "../SipResponse.hpp"
+#include "../Registrar.hpp"
+#include "../RedisPool.hpp"
+#include "FakeRedis.hpp"
+
+using namespace Sip;
+using namespace std;
+
+//The corpora are defined in the other suites' translation units
+extern const char* sip_messages[];
+extern const char* register_sip_messages[];
+
+//
+// Allocation budgets for the hot path, per message. Tighten these as the parser improves; a failure here means a
+// change made the hot path allocate more than it used to.
+//
+const uint64_t PARSE_ALLOCATION_BUDGET = 350;
+const uint64_t TOSTRING_ALLOCATION_BUDGET = 8;
+const uint64_t RESPONSE_ALLOCATION_BUDGET = 48;
+const uint64_t REGISTRAR_ALLOCATION_BUDGET = 64; //A full write to redis
+//Resident bytes kept by a parsed message, as a multiple of its size on the wire
+const int64_t RETAINED_BYTES_PER_RAW_BYTE = 16;
+
+namespace {
+
+void CheckBudget( const char* path, int i, const AllocationCounter::Counts& used, uint64_t budget )
+{
+	ostringstream mesg;
+	mesg << path << " @ " << i << ": " << used.allocations << " allocations, " << used.bytes << " bytes (budget " << budget << " allocations)";
+	BOOST_TEST_MESSAGE( mesg.str() );
+	BOOST_CHECK_MESSAGE( used.allocations <= budget, mesg.str() );
+}
+
+void CheckMessage( const char* raw, int i )
+{
+	auto_ptr<SipMessage> message;
+	AllocationCounter::Counts start = AllocationCounter::Now();
+	BOOST_REQUIRE_NO_THROW( Utility::ParseMessage( message, raw ) );
+	AllocationCounter::Counts parse = AllocationCounter::Since( start );
+	CheckBudget( "parse", i, parse, PARSE_ALLOCATION_BUDGET );
+
+	ostringstream mesg;
+	mesg << "retained @ " << i << ": " << parse.liveBytes << " bytes for a " << strlen( raw ) << " byte message";
+	BOOST_CHECK_MESSAGE( parse.liveBytes <= RETAINED_BYTES_PER_RAW_BYTE * static_cast<int64_t>( strlen( raw ) ), mesg.str() );
+
+	start = AllocationCounter::Now();
+	if ( message->Type == SipMessage::MT_REQUEST )
+		static_cast<SipRequest&>( *message ).ToString();
+	else
+		static_cast<SipResponse&>( *message ).ToString();
+	CheckBudget( "ToString", i, AllocationCounter::Since( start ), TOSTRING_ALLOCATION_BUDGET );
+
+	if ( message->Type == SipMessage::MT_REQUEST )
+	{
+		start = AllocationCounter::Now();
+		{
+			SipResponse response( 200, "OK", static_cast<SipRequest&>( *message ) );
+		}
+		CheckBudget( "SipResponse(status, reason, request)", i, AllocationCounter::Since( start ), RESPONSE_ALLOCATION_BUDGET );
+	}
+}
+
+}; //namespace
+
+BOOST_AUTO_TEST_CASE( allocation_budgets ) {
+	for ( int i = 0; sip_messages[i] != NULL; ++i )
+		CheckMessage( sip_messages[i], i );
+	for ( int i = 0; register_sip_messages[i] != NULL; ++i )
+		CheckMessage( register_sip_messages[i], i );
+}
+
+BOOST_AUTO_TEST_CASE( registrar_allocation_budget ) {
+	//A registrar that really writes: the fake server's thread allocates too, so only this thread's count
+	FakeRedis redis;
+	RedisPool pool( "127.0.0.1", redis.Port() );
+	Sip::Registrar registrar( pool );
+	registrar.SetCoalescing( false ); //Every call a full write, not a refresh of the warm-up's
+	for ( int i = 0; register_sip_messages[i] != NULL; ++i ) {
+		auto_ptr<SipMessage> message;
+		BOOST_REQUIRE_NO_THROW( Utility::ParseMessage( message, register_sip_messages[i] ) );
+		SipRequest& request = static_cast<SipRequest&>( *message );
+		if ( i == 0 ) //Connects this thread to redis, which isn't the hot path
+			auto_ptr<SipResponse> warmup( registrar.HandleRequest( request ) );
+
+		AllocationCounter::Counts start = AllocationCounter::ThisThread();
+		int code;
+		{
+			auto_ptr<SipResponse> response( registrar.HandleRequest( request ) );
+			code = response->StatusCode();
+		}
+		BOOST_CHECK_EQUAL( code, 200 );
+		CheckBudget( "Registrar::HandleRequest", i, AllocationCounter::ThisThreadSince( start ), REGISTRAR_ALLOCATION_BUDGET );
+	}
+	BOOST_CHECK( redis.Commands() > 0 );
+}
@@ -0,0 +1,71 @@
+#include <boost/test/unit_test.hpp>
+#include "../SipUtility.hpp"
+#include "../SipRequest.hpp"
+#include "../SipResponse.hpp"
+#include "ThreadedWorkers.hpp"
+
+using namespace Sip;
+using namespace std;
+
+extern const char* sip_messages[];
+
+namespace {
+
+string Render( const SipMessage& message )
+{
+	if ( message.Type == SipMessage::MT_REQUEST )
+		return static_cast<const SipRequest&>( message ).ToString();
+	return static_cast<const SipResponse&>( message ).ToString();
+}
+
+/**
+ * 	Parses every message repeatedly, counting results that differ from the single threaded rendering or throw
+ */
+class ConcurrentParser
+{
+	public:
+		explicit ConcurrentParser( const vector<string>& expected ) : m_expected( expected ) {}
+
+		void Prepare() {}
+
+		int Run()
+		{
+			int failures = 0;
+			for ( int pass = 0; pass < 20; ++pass )
+			{
+				for ( size_t i = 0; sip_messages[i] != NULL; ++i )
+				{
+					try
+					{
+						auto_ptr<SipMessage> message;
+						Utility::ParseMessage( message, sip_messages[i] );
+						if ( Render( *message ) != m_expected[i] )
+							++failures;
+					}
+					catch ( std::exception& e )
+					{
+						++failures;
+					}
+				}
+			}
+			return failures;
+		}
+
+	private:
+		const vector<string>& m_expected;
+};
+
+}; //namespace
+
+BOOST_AUTO_TEST_CASE( concurrent_parsing ) {
+	const unsigned int threads = 4;
+	vector<string> expected;
+	for ( int i = 0; sip_messages[i] != NULL; ++i ) {
+		auto_ptr<SipMessage> message;
+		BOOST_REQUIRE_NO_THROW( Utility::ParseMessage( message, sip_messages[i] ) );
+		expected.push_back( Render( *message ) );
+	}
+
+	vector<ConcurrentParser> parsers( threads, ConcurrentParser( expected ) );
+	BOOST_CHECK_EQUAL( ThreadedWorkers<ConcurrentParser>::Run( parsers ), 0 );
+}
@@ -0,0 +1,225 @@
+#include <boost/test/unit_test.hpp>
+#include <sstream>
+#include <string>
+#include "../Dialog.hpp"
+#include "ThreadedWorkers.hpp"
+
+using namespace Sip;
+using namespace std;
+
+namespace {
+
+/**
+ *     A request from Alice (tag a1) to Bob through two record-routing proxies; toTag empty for a dialog-creating one
+ */
+string Request( const string& method, int sequence, const string& callId, const string& toTag, const string& contact )
+{
+	ostringstream request;
+	request << method << " sip:bob@192.0.2.2 SIP/2.0\r\n"
+		"Via: SIP/2.0/UDP 192.0.2.1;branch=z9hG4bK" << method << sequence << "\r\n"
+		"Record-Route: <sip:p2.example.com;lr>\r\n"
+		"Record-Route: <sip:p1.example.com;lr>\r\n"
+		"From: \"Alice\" <sip:alice@example.com>;tag=a1\r\n"
+		"To: <sip:bob@example.com>" << ( toTag.empty() ? "" : ";tag=" + toTag ) << "\r\n"
+		"Call-ID: " << callId << "\r\n"
+		"CSeq: " << sequence << " " << method << "\r\n"
+		"Contact: " << contact << "\r\n"
+		"Max-Forwards: 70\r\n"
+		"Content-Length: 0\r\n\r\n";
+	return request.str();
+}
+
+/**
+ *     Bob's answer to a request above, with his tag and Contact
+ */
+string Response( int code, const string& reason, const string& method, int sequence, const string& callId,
+	const string& toTag )
+{
+	ostringstream response;
+	response << "SIP/2.0 " << code << " " << reason << "\r\n"
+		"Via: SIP/2.0/UDP 192.0.2.1;branch=z9hG4bK" << method << sequence << "\r\n"
+		"Record-Route: <sip:p2.example.com;lr>\r\n"
+		"Record-Route: <sip:p1.example.com;lr>\r\n"
+		"From: \"Alice\" <sip:alice@example.com>;tag=a1\r\n"
+		"To: <sip:bob@example.com>" << ( toTag.empty() ? "" : ";tag=" + toTag ) << "\r\n"
+		"Call-ID: " << callId << "\r\n"
+		"CSeq: " << sequence << " " << method << "\r\n"
+		"Contact: <sip:bob@192.0.2.2:5062>\r\n"
+		"Content-Length: 0\r\n\r\n";
+	return response.str();
+}
+
+/**
+ *     Creates, matches and removes dialogs of its own, all in one shared table
+ */
+class DialogWorker
+{
+	public:
+		DialogWorker( Dialogs& dialogs, int worker ) : m_dialogs( dialogs ), m_worker( worker ), m_failures( 0 ) {}
+
+		void Prepare()
+		{
+			for ( int i = 0; i < 500; ++i )
+			{
+				ostringstream callId;
+				callId << m_worker << "-" << i << "@192.0.2.1";
+				SipRequest invite( Request( "INVITE", 1, callId.str(), "", "<sip:alice@192.0.2.1>" ) );
+				SipResponse ok( Response( 200, "OK", "INVITE", 1, callId.str(), "b1" ) );
+				if ( !m_dialogs.Create( invite, ok, false ) )
+					++m_failures;
+				m_byes.push_back( SipRequest( Request( "BYE", 2, callId.str(), "b1", "<sip:alice@192.0.2.1>" ) ) );
+			}
+		}
+
+		int Run()
+		{
+			for ( int pass = 0; pass < 20; ++pass )
+				for ( vector<SipRequest>::iterator bye = m_byes.begin(); bye != m_byes.end(); ++bye )
+				{
+					Dialog dialog;
+					if ( m_dialogs.Receive( *bye, &dialog ) != Dialogs::MATCH_FOUND || dialog.remoteSequence != 2 )
+						++m_failures;
+				}
+			for ( vector<SipRequest>::iterator bye = m_byes.begin(); bye != m_byes.end(); ++bye )
+			{
+				DialogId id;
+				if ( !DialogId::ForRequest( *bye, id ) || !m_dialogs.Remove( id ) )
+					++m_failures;
+			}
+			return m_failures;
+		}
+
+	private:
+		Dialogs& m_dialogs;
+		int m_worker;
+		int m_failures;
+		vector<SipRequest> m_byes;
+};
+
+}; //namespace
+
+BOOST_AUTO_TEST_CASE( uas_dialog ) {
+	Dialogs dialogs( 4 );
+	SipRequest invite( Request( "INVITE", 10, "d1@192.0.2.1", "", "\"Alice\" <sip:alice@192.0.2.1>" ) );
+
+	//A 100 or a failure makes no dialog, nor does a request that can't create one
+	BOOST_CHECK( !dialogs.Create( invite, SipResponse( Response( 100, "Trying", "INVITE", 10, "d1@192.0.2.1", "" ) ), false ) );
+	BOOST_CHECK( !dialogs.Create( invite, SipResponse( Response( 486, "Busy Here", "INVITE", 10, "d1@192.0.2.1", "b1" ) ), false ) );
+	SipRequest options( Request( "OPTIONS", 1, "d1@192.0.2.1", "", "<sip:alice@192.0.2.1>" ) );
+	BOOST_CHECK( !dialogs.Create( options, SipResponse( Response( 200, "OK", "OPTIONS", 1, "d1@192.0.2.1", "b1" ) ), false ) );
+	BOOST_CHECK_EQUAL( dialogs.Size(), 0u );
+
+	//A 180 with our tag makes an early dialog; the 200 confirms it
+	BOOST_CHECK( dialogs.Create( invite, SipResponse( Response( 180, "Ringing", "INVITE", 10, "d1@192.0.2.1", "b1" ) ), false ) );
+	SipRequest bye( Request( "BYE", 11, "d1@192.0.2.1", "b1", "<sip:alice@192.0.2.1>" ) );
+	DialogId id;
+	BOOST_REQUIRE( DialogId::ForRequest( bye, id ) );
+	BOOST_CHECK_EQUAL( id.localTag, "b1" );
+	BOOST_CHECK_EQUAL( id.remoteTag, "a1" );
+	Dialog dialog;
+	BOOST_REQUIRE( dialogs.Find( id, dialog ) );
+	BOOST_CHECK_EQUAL( dialog.state, Dialog::STATE_EARLY );
+	BOOST_CHECK( dialogs.Create( invite, SipResponse( Response( 200, "OK", "INVITE", 10, "d1@192.0.2.1", "b1" ) ), false ) );
+	BOOST_REQUIRE( dialogs.Find( id, dialog ) );
+	BOOST_CHECK_EQUAL( dialog.state, Dialog::STATE_CONFIRMED );
+	BOOST_CHECK_EQUAL( dialogs.Size(), 1u );
+
+	//At the UAS, the route set is Record-Route in order, the target the caller's Contact, and our CSeq starts at 1
+	BOOST_CHECK_EQUAL( dialog.remoteTarget, "sip:alice@192.0.2.1" );
+	BOOST_REQUIRE_EQUAL( dialog.routeSet.size(), 2u );
+	BOOST_CHECK_EQUAL( dialog.routeSet[0], "<sip:p2.example.com;lr>" );
+	BOOST_CHECK_EQUAL( dialog.routeSet[1], "<sip:p1.example.com;lr>" );
+	BOOST_CHECK_EQUAL( dialog.remoteSequence, 10u );
+	uint32_t sequence;
+	BOOST_CHECK( dialogs.NextSequence( id, sequence ) );
+	BOOST_CHECK_EQUAL( sequence, 1u );
+
+	//A re-INVITE refreshes the target; a request with a lower CSeq is out of order; a wrong tag matches nothing
+	BOOST_CHECK_EQUAL( dialogs.Receive( SipRequest( Request( "INVITE", 11, "d1@192.0.2.1", "b1", "<sip:alice@198.51.100.1>" ) ), &dialog ),
+		Dialogs::MATCH_FOUND );
+	BOOST_CHECK_EQUAL( dialog.remoteTarget, "sip:alice@198.51.100.1" );
+	BOOST_CHECK_EQUAL( dialogs.Receive( SipRequest( Request( "INFO", 9, "d1@192.0.2.1", "b1", "<sip:x@203.0.113.1>" ) ) ),
+		Dialogs::MATCH_OUT_OF_ORDER );
+	BOOST_CHECK_EQUAL( dialogs.Receive( SipRequest( Request( "BYE", 12, "d1@192.0.2.1", "b2", "<sip:alice@192.0.2.1>" ) ) ),
+		Dialogs::MATCH_NONE );
+	BOOST_CHECK_EQUAL( dialogs.Receive( SipRequest( Request( "BYE", 12, "d1@192.0.2.1", "", "<sip:alice@192.0.2.1>" ) ) ),
+		Dialogs::MATCH_NONE );
+
+	//A BYE matches, with the target left alone, and the dialog is removed
+	BOOST_CHECK_EQUAL( dialogs.Receive( SipRequest( Request( "BYE", 12, "d1@192.0.2.1", "b1", "<sip:x@203.0.113.1>" ) ), &dialog ),
+		Dialogs::MATCH_FOUND );
+	BOOST_CHECK_EQUAL( dialog.remoteTarget, "sip:alice@198.51.100.1" );
+	BOOST_CHECK( dialogs.Remove( id ) );
+	BOOST_CHECK( !dialogs.Remove( id ) );
+	BOOST_CHECK( !dialogs.Find( id, dialog ) );
+	BOOST_CHECK( !dialogs.NextSequence( id, sequence ) );
+	BOOST_CHECK_EQUAL( dialogs.Size(), 0u );
+}
+
+BOOST_AUTO_TEST_CASE( uac_dialog ) {
+	Dialogs dialogs;
+	SipRequest invite( Request( "INVITE", 7, "d2@192.0.2.1", "", "<sip:alice@192.0.2.1>" ) );
+	BOOST_CHECK( dialogs.Create( invite, SipResponse( Response( 200, "OK", "INVITE", 7, "d2@192.0.2.1", "b9" ) ), true ) );
+
+	//At the UAC, our tag is the From tag, the route set is Record-Route reversed and the target the callee's Contact
+	DialogId id;
+	BOOST_REQUIRE( DialogId::ForResponse( SipResponse( Response( 200, "OK", "INVITE", 7, "d2@192.0.2.1", "b9" ) ), true, id ) );
+	BOOST_CHECK_EQUAL( id.localTag, "a1" );
+	BOOST_CHECK_EQUAL( id.remoteTag, "b9" );
+	Dialog dialog;
+	BOOST_REQUIRE( dialogs.Find( id, dialog ) );
+	BOOST_CHECK_EQUAL( dialog.remoteTarget, "sip:bob@192.0.2.2:5062" );
+	BOOST_REQUIRE_EQUAL( dialog.routeSet.size(), 2u );
+	BOOST_CHECK_EQUAL( dialog.routeSet[0], "<sip:p1.example.com;lr>" );
+	BOOST_CHECK_EQUAL( dialog.routeSet[1], "<sip:p2.example.com;lr>" );
+	BOOST_CHECK_EQUAL( dialog.remoteSequence, 0u );
+	uint32_t sequence;
+	BOOST_CHECK( dialogs.NextSequence( id, sequence ) );
+	BOOST_CHECK_EQUAL( sequence, 8u );
+
+	//The same Call-ID answered with another tag, as a forking proxy does, is another dialog
+	BOOST_CHECK( dialogs.Create( invite, SipResponse( Response( 200, "OK", "INVITE", 7, "d2@192.0.2.1", "c3" ) ), true ) );
+	BOOST_CHECK_EQUAL( dialogs.Size(), 2u );
+}
+
+BOOST_AUTO_TEST_CASE( prack_before_answer ) {
+	//The UAS: a PRACK in the early dialog moves the remote CSeq on, and the 2xx to the INVITE doesn't take it back
+	Dialogs dialogs;
+	SipRequest invite( Request( "INVITE", 20, "d3@192.0.2.1", "", "<sip:alice@192.0.2.1>" ) );
+	BOOST_CHECK( dialogs.Create( invite, SipResponse( Response( 183, "Session Progress", "INVITE", 20, "d3@192.0.2.1", "b1" ) ), false ) );
+	SipRequest prack( Request( "PRACK", 21, "d3@192.0.2.1", "b1", "<sip:alice@192.0.2.1>" ) );
+	BOOST_CHECK_EQUAL( dialogs.Receive( prack ), Dialogs::MATCH_FOUND );
+	BOOST_CHECK( dialogs.Create( invite, SipResponse( Response( 200, "OK", "INVITE", 20, "d3@192.0.2.1", "b1" ) ), false ) );
+	DialogId id;
+	BOOST_REQUIRE( DialogId::ForRequest( prack, id ) );
+	Dialog dialog;
+	BOOST_REQUIRE( dialogs.Find( id, dialog ) );
+	BOOST_CHECK_EQUAL( dialog.state, Dialog::STATE_CONFIRMED );
+	BOOST_CHECK_EQUAL( dialog.remoteSequence, 21u );
+	BOOST_CHECK_EQUAL( dialogs.Receive( SipRequest( Request( "INFO", 21, "d3@192.0.2.1", "b1", "<sip:x@203.0.113.1>" ) ) ),
+		Dialogs::MATCH_FOUND );
+	BOOST_CHECK_EQUAL( dialogs.Receive( SipRequest( Request( "INFO", 20, "d3@192.0.2.1", "b1", "<sip:x@203.0.113.1>" ) ) ),
+		Dialogs::MATCH_OUT_OF_ORDER );
+
+	//The UAC: the PRACK it sent took the next CSeq, so the request after the 2xx takes the one after that
+	SipRequest outgoing( Request( "INVITE", 30, "d4@192.0.2.1", "", "<sip:alice@192.0.2.1>" ) );
+	SipResponse progress( Response( 183, "Session Progress", "INVITE", 30, "d4@192.0.2.1", "b2" ) );
+	BOOST_CHECK( dialogs.Create( outgoing, progress, true ) );
+	BOOST_REQUIRE( DialogId::ForResponse( progress, true, id ) );
+	uint32_t sequence;
+	BOOST_CHECK( dialogs.NextSequence( id, sequence ) );
+	BOOST_CHECK_EQUAL( sequence, 31u );
+	BOOST_CHECK( dialogs.Create( outgoing, SipResponse( Response( 200, "OK", "INVITE", 30, "d4@192.0.2.1", "b2" ) ), true ) );
+	BOOST_CHECK( dialogs.NextSequence( id, sequence ) );
+	BOOST_CHECK_EQUAL( sequence, 32u );
+}
+
+BOOST_AUTO_TEST_CASE( concurrent_dialogs ) {
+	const int threads = 4;
+	Dialogs dialogs;
+	vector<DialogWorker> workers;
+	for ( int i = 0; i < threads; ++i )
+		workers.push_back( DialogWorker( dialogs, i ) );
+	BOOST_CHECK_EQUAL( ThreadedWorkers<DialogWorker>::Run( workers ), 0 );
+	BOOST_CHECK_EQUAL( dialogs.Size(), 0u );
+}
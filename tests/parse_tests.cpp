@@ -1,10 +1,16 @@
 #include <boost/test/unit_test.hpp>
+#include <boost/thread.hpp>
 #include <sstream>
 #include "../SipUtility.hpp"
 #include "../SipRequest.hpp"
 #include "../SipResponse.hpp"
+#include "../URI.hpp"
+#include "../Via.hpp"
+#include "../CSeq.hpp"
+#include "../ReceiveBuffer.hpp"
 //http://code.google.com/p/dtl-cpp/
 #include "dtl/dtl.hpp"
+#include "AllocationCounter.hpp"
 
 #include "sip_messages.h"
 using namespace Sip;
@@ -66,3 +72,184 @@ BOOST_AUTO_TEST_CASE( invites ) {
 		
 	}
 }
+
+BOOST_AUTO_TEST_CASE( max_forwards ) {
+	auto_ptr<Sip::SipMessage> this_message;
+	BOOST_REQUIRE_NO_THROW( Utility::ParseMessage( this_message, sip_messages[0] ) );
+	SipMessage& message = *this_message;
+
+	BOOST_CHECK( message.RawMessageCurrent() );
+	BOOST_CHECK_EQUAL( message.GetUInt( "max-forwards" ), 70u );
+	BOOST_CHECK( message.DecrementMaxForwards() );
+	BOOST_CHECK_EQUAL( message.GetUInt( "max-forwards" ), 69u );
+	BOOST_CHECK_EQUAL( message.GetHeaderValues( "max-forwards" )[0].Value(), "69" );
+
+	//Same width, so the raw bytes are patched and still usable as-is
+	BOOST_CHECK( message.RawMessageCurrent() );
+	BOOST_CHECK( message.GetOriginalRawMessage().find( "Max-Forwards: 69\r\n" ) != string::npos );
+
+	//Width changes, so only the parsed representation can be trusted
+	message.SetUInt( "max-forwards", 9 );
+	BOOST_CHECK( !message.RawMessageCurrent() );
+	BOOST_CHECK( static_cast<SipRequest&>( message ).ToString().find( "Max-Forwards: 9\r\n" ) != string::npos );
+
+	message.SetUInt( "max-forwards", 0 );
+	BOOST_CHECK_THROW( message.DecrementMaxForwards(), SipMessageException );
+}
+
+namespace {
+
+string RequestWith( const string& extraHeaders ) {
+	return "INVITE sip:bob@192.0.2.4 SIP/2.0\r\n"
+		"Via: SIP/2.0/UDP 192.0.2.1:5060;branch=z9hG4bK776asdhds\r\n"
+		"To: Bob <sip:bob@192.0.2.4>\r\n"
+		"From: Alice <sip:alice@192.0.2.1>;tag=1928301774\r\n"
+		"Call-ID: a84b4c76e66710@192.0.2.1\r\n"
+		"CSeq: 314159 INVITE\r\n"
+		+ extraHeaders +
+		"Content-Length: 0\r\n\r\n";
+}
+
+string Repeat( const string& unit, unsigned int count ) {
+	string repeated;
+	for ( unsigned int i = 0; i < count; ++i )
+		repeated += unit;
+	return repeated;
+}
+
+}; //namespace
+
+BOOST_AUTO_TEST_CASE( parse_limits ) {
+	auto_ptr<Sip::SipMessage> message;
+
+	BOOST_CHECK_NO_THROW( Utility::ParseMessage( message, RequestWith( Repeat( "X-A: b\r\n", SIP_MAX_HEADERS - 10 ) ) ) );
+	BOOST_CHECK_THROW( Utility::ParseMessage( message, RequestWith( Repeat( "X-A: b\r\n", SIP_MAX_HEADERS ) ) ), SipMessageException );
+
+	BOOST_CHECK_NO_THROW( Utility::ParseMessage( message, RequestWith( "Accept: a" + Repeat( ",a", SIP_MAX_HEADER_VALUES - 1 ) + "\r\n" ) ) );
+	BOOST_CHECK_THROW( Utility::ParseMessage( message, RequestWith( "Accept: a" + Repeat( ",a", SIP_MAX_HEADER_VALUES ) + "\r\n" ) ), SipMessageException );
+
+	BOOST_CHECK_NO_THROW( Utility::ParseMessage( message, RequestWith( "Contact: <sip:b@c>" + Repeat( ";p=1", SIP_MAX_PARAMETERS ) + "\r\n" ) ) );
+	BOOST_CHECK_THROW( Utility::ParseMessage( message, RequestWith( "Contact: <sip:b@c>" + Repeat( ";p=1", SIP_MAX_PARAMETERS + 1 ) + "\r\n" ) ), SipMessageException );
+	BOOST_CHECK_THROW( URI( "<sip:b@c" + Repeat( ";p", SIP_MAX_PARAMETERS + 1 ) + ">" ), URIException );
+
+	BOOST_CHECK_THROW( Utility::ParseMessage( message, RequestWith( "Subject: " + string( SIP_MAX_MESSAGE_SIZE, 'a' ) + "\r\n" ) ), SipMessageException );
+
+	//Responses carry the same limits, and must report them rather than escape the exception specification
+	BOOST_CHECK_THROW( Utility::ParseMessage( message, "SIP/2.0 200 OK\r\n" + Repeat( "X-A: b\r\n", SIP_MAX_HEADERS + 1 ) + "\r\n" ), SipMessageException );
+}
+
+BOOST_AUTO_TEST_CASE( hand_written_scanners ) {
+	map<string, string> tags;
+	BOOST_CHECK( Utility::FillTags( ";a=1;;=x;b;c=2=3;a=4", tags ) );
+	BOOST_CHECK_EQUAL( tags.size(), 3u );
+	BOOST_CHECK_EQUAL( tags["a"], "4" );
+	BOOST_CHECK_EQUAL( tags["b"], "" );
+	BOOST_CHECK_EQUAL( tags["c"], "2=3" );
+
+	string::size_type tagsEnd;
+	string value( "<sip:a@b;lr>;tag=1;x?h=v" );
+	BOOST_CHECK_EQUAL( Utility::FindTags( value, value.find( '>' ), tagsEnd ), value.find( ";tag" ) );
+	BOOST_CHECK_EQUAL( tagsEnd, value.find( '?' ) );
+	BOOST_CHECK_EQUAL( Utility::FindTags( "a;b;", 0, tagsEnd ), string::npos );
+	BOOST_CHECK_EQUAL( Utility::FindTags( "a;;b;c", 0, tagsEnd ), 2u );
+
+	BOOST_CHECK_EQUAL( Utility::Trim( " \t a b \r\n" ), "a b" );
+
+	SipHeaderValue contact( "\"A \\\"B\" <sip:a@b;lr>;expires=60" );
+	BOOST_CHECK_EQUAL( contact.Value(), "\"A \\\"B\" <sip:a@b;lr>" );
+	BOOST_CHECK_EQUAL( contact.GetTagValue( "expires" ), "60" );
+
+	URI uri( "\"Alice\" <sips:alice@192.0.2.1:5061;transport=tls?subject=x>" );
+	BOOST_CHECK_EQUAL( uri.DisplayName(), "Alice" );
+	BOOST_CHECK_EQUAL( uri.Protocol(), "sips" );
+	BOOST_CHECK_EQUAL( uri.User(), "alice" );
+	BOOST_CHECK_EQUAL( uri.Host(), "192.0.2.1" );
+	BOOST_CHECK_EQUAL( uri.Port(), 5061 );
+	BOOST_CHECK_THROW( URI( "<sip:a@b" ), URIException );
+	BOOST_CHECK_THROW( URI( "sip:a@b:x" ), URIException );
+
+	Via via( SipHeaderValue( "SIP/2.0/TCP host.example.com:5070;branch=z9hG4bK1" ) );
+	BOOST_CHECK_EQUAL( via.Host(), "host.example.com" );
+	BOOST_CHECK_EQUAL( via.Port(), 5070 );
+	BOOST_CHECK_THROW( Via( SipHeaderValue( "SIP/2.0/udp host" ) ), ViaException );
+	BOOST_CHECK_THROW( Via( SipHeaderValue( "SIP/2" ) ), ViaException );
+
+	BOOST_CHECK_EQUAL( CSeq( SipHeaderValue( "42 \t REGISTER" ) ).Sequence(), 42 );
+	BOOST_CHECK_THROW( CSeq( SipHeaderValue( "42" ) ), CSeqException );
+}
+
+BOOST_AUTO_TEST_CASE( receive_buffer_ownership ) {
+	ReceiveBufferPool pool( 1024 );
+	ReceiveBufferHandle buffer = pool.Acquire();
+	BOOST_REQUIRE_EQUAL( buffer->Bytes().length(), 1024u );
+
+	//The message takes the bytes the socket wrote, not a copy of them
+	string request( sip_messages[0] );
+	std::copy( request.begin(), request.end(), buffer->Bytes().begin() );
+	buffer->Bytes().resize( request.length() );
+	const char* bytes = buffer->Bytes().data();
+	auto_ptr<SipMessage> message;
+	Utility::ParseMessage( message, buffer );
+	BOOST_CHECK( buffer->Bytes().empty() );
+	BOOST_CHECK_EQUAL( message->GetOriginalRawMessage(), request );
+	BOOST_CHECK( message->GetOriginalRawMessage().data() == bytes );
+
+	//Only the message holds the slab now; destroying it returns the storage to the pool
+	buffer.reset();
+	message.reset();
+	buffer = pool.Acquire();
+	BOOST_CHECK( buffer->Bytes().data() == bytes );
+	BOOST_CHECK_EQUAL( pool.GetStats().acquired, 2u );
+	BOOST_CHECK_EQUAL( pool.GetStats().allocated, 1u );
+
+	//A failed parse leaves the bytes in the buffer
+	const string garbage( "SIP/2.0 abc\r\n\r\n" );
+	buffer->Bytes() = garbage;
+	buffer->Bytes().reserve( 1024 );
+	BOOST_CHECK_THROW( Utility::ParseMessage( message, buffer ), SipMessageException );
+	BOOST_CHECK_EQUAL( buffer->Bytes(), garbage );
+
+	//Slabs held past the pool are freed with their last handle
+	auto_ptr<ReceiveBufferPool> shortLived( new ReceiveBufferPool( 64 ) );
+	ReceiveBufferHandle survivor = shortLived->Acquire();
+	shortLived.reset();
+	survivor->Bytes().assign( "still here" );
+	BOOST_CHECK_EQUAL( survivor->Bytes(), "still here" );
+}
+
+namespace {
+
+void ReleaseAfter( ReceiveBufferHandle& buffer, boost::barrier& start )
+{
+	start.wait();
+	buffer.reset();
+}
+
+}; //namespace
+
+BOOST_AUTO_TEST_CASE( receive_buffer_concurrent_release ) {
+	//Slabs released on other threads while the pool goes away: every one is freed, and the pool's shared state with
+	//the last of them, so each round gives back everything it allocated
+	const int threads = 4;
+	for ( int round = 0; round < 200; ++round )
+	{
+		AllocationCounter::Counts before = AllocationCounter::Now();
+		{
+			auto_ptr<ReceiveBufferPool> pool( new ReceiveBufferPool( 64 ) );
+			ReceiveBufferHandle buffers[ threads ];
+			boost::barrier start( threads + 1 );
+			boost::thread_group releasing;
+			for ( int i = 0; i < threads; ++i )
+			{
+				buffers[i] = pool->Acquire();
+				releasing.create_thread( boost::bind( ReleaseAfter, boost::ref( buffers[i] ), boost::ref( start ) ) );
+			}
+			start.wait();
+			pool.reset();
+			releasing.join_all();
+		}
+		AllocationCounter::Counts used = AllocationCounter::Since( before );
+		BOOST_REQUIRE_EQUAL( used.allocations, used.deallocations );
+		BOOST_REQUIRE_EQUAL( used.liveBytes, 0 );
+	}
+}
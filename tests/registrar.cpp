@@ -1,12 +1,65 @@
 #include <boost/test/unit_test.hpp>
+#include <unistd.h>
 #include "../Registrar.hpp"
 #include "../SipUtility.hpp"
 #include "registrar_sip_messages.h"
+#include "FakeRedis.hpp"
+#include "ThreadedWorkers.hpp"
 
 using namespace Sip;
 
+namespace {
+
+/**
+ *     The test REGISTER, from endpoint instead of 3170
+ */
+string RegisterFrom( const string& endpoint )
+{
+	string message( register_sip_messages[0] );
+	for ( string::size_type at = message.find( "3170" ); at != string::npos; at = message.find( "3170", at + endpoint.length() ) )
+		message.replace( at, 4, endpoint );
+	return message;
+}
+
+/**
+ *     Registers endpoints of its own through a shared registrar
+ */
+class RegisterWorker
+{
+	public:
+		RegisterWorker( Registrar& registrar, int worker ) : m_registrar( registrar ), m_worker( worker ) {}
+
+		void Prepare()
+		{
+			for ( int i = 0; i < 20; ++i )
+			{
+				ostringstream endpoint;
+				endpoint << 1000 + m_worker * 100 + i;
+				m_requests.push_back( SipRequest( RegisterFrom( endpoint.str() ) ) );
+			}
+		}
+
+		int Run()
+		{
+			int failures = 0;
+			for ( vector<SipRequest>::iterator request = m_requests.begin(); request != m_requests.end(); ++request )
+				if ( auto_ptr<SipResponse>( m_registrar.HandleRequest( *request ) )->StatusCode() != 200 )
+					++failures;
+			return failures;
+		}
+
+	private:
+		Registrar& m_registrar;
+		int m_worker;
+		vector<SipRequest> m_requests;
+};
+
+}; //namespace
+
 BOOST_AUTO_TEST_CASE( registration ) {
-	Sip::Registrar registrar;
+	FakeRedis redis;
+	RedisPool pool( "127.0.0.1", redis.Port() );
+	Sip::Registrar registrar( pool );
 	int i = 0;
 	for ( const char* sip_message = register_sip_messages[i];
 			sip_message != NULL; sip_message = register_sip_messages[++i] ) {
@@ -18,7 +71,12 @@ BOOST_AUTO_TEST_CASE( registration ) {
 			SipRequest& request = static_cast<SipRequest&>( *this_message );
 			auto_ptr<SipResponse> response( registrar.HandleRequest( request ) );
 			BOOST_CHECK_EQUAL( response->StatusCode(), 200 );
-			//TODO: Check registratration in DB
+			const string endpoint( Sip::URI( request.GetHeaderValues( "to" )[0] ).User() );
+			FakeRedis::Hash registration;
+			BOOST_REQUIRE( redis.Get( "registrar:" + endpoint, registration ) );
+			BOOST_CHECK_EQUAL( registration["uri"], Sip::URI( request.GetHeaderValues( "contact" )[0] ).URIAsString() );
+			BOOST_CHECK_EQUAL( registration["expiration"], request.GetHeaderValues( "expires" )[0].Value() );
+			BOOST_CHECK_EQUAL( redis.Ttl( "registrar:" + endpoint ), atoi( registration["expiration"].c_str() ) );
 		}
 		else if ( this_message->Type == SipMessage::MT_RESPONSE ) {
 			BOOST_FAIL( "Test Message not a REGISTER Request!" );
@@ -33,3 +91,238 @@ BOOST_AUTO_TEST_CASE( registration ) {
 		
 	}
 }
+
+BOOST_AUTO_TEST_CASE( registrar_redis_down ) {
+	//Nothing listens on port 1: the first REGISTER tries and fails, the next is refused without trying until the backoff
+	//is over, and each failure doubles it
+	RedisPool pool( "127.0.0.1", 1 );
+	Registrar registrar( pool );
+	SipRequest request( register_sip_messages[0] );
+
+	auto_ptr<SipResponse> response( registrar.HandleRequest( request ) );
+	BOOST_CHECK_EQUAL( response->StatusCode(), 503 );
+	BOOST_REQUIRE( response->HasHeader( "retry-after" ) );
+	BOOST_CHECK_EQUAL( response->GetHeaderValues( "retry-after" )[0].Value(), "1" );
+	BOOST_CHECK_EQUAL( pool.GetStats().failures, 1u );
+
+	response = registrar.HandleRequest( request );
+	BOOST_CHECK_EQUAL( response->StatusCode(), 503 );
+	BOOST_CHECK_EQUAL( pool.GetStats().failures, 1u );
+	BOOST_CHECK_EQUAL( pool.GetStats().refused, 1u );
+
+	usleep( 150 * 1000 );
+	registrar.HandleRequest( request );
+	BOOST_CHECK_EQUAL( pool.GetStats().failures, 2u );
+	BOOST_CHECK_EQUAL( pool.GetStats().connects, 0u );
+
+	//A request too brief to register never needs a connection
+	SipRequest tooBrief( register_sip_messages[0] );
+	tooBrief.SetHeader( "expires", "60" );
+	response = registrar.HandleRequest( tooBrief );
+	BOOST_CHECK_EQUAL( response->StatusCode(), 423 );
+	BOOST_CHECK_EQUAL( pool.GetStats().refused, 1u );
+}
+
+BOOST_AUTO_TEST_CASE( registrar_round_trips ) {
+	FakeRedis redis;
+	RedisPool pool( "127.0.0.1", redis.Port() );
+	Registrar registrar( pool );
+	SipRequest request( register_sip_messages[0] );
+
+	//A registration is MULTI, HSET, EXPIRE, EXEC in one write; a de-registration is one DEL
+	BOOST_CHECK_EQUAL( registrar.HandleRequest( request )->StatusCode(), 200 );
+	BOOST_CHECK_EQUAL( redis.RoundTrips(), 1u );
+	BOOST_CHECK_EQUAL( redis.Commands(), 4u );
+	BOOST_CHECK_EQUAL( redis.Ttl( "registrar:3170" ), 3600 );
+
+	SipRequest refresh( register_sip_messages[0] );
+	refresh.SetHeader( "expires", "600" );
+	BOOST_CHECK_EQUAL( registrar.HandleRequest( refresh )->StatusCode(), 200 );
+	BOOST_CHECK_EQUAL( redis.RoundTrips(), 2u );
+	BOOST_CHECK_EQUAL( redis.Ttl( "registrar:3170" ), 600 );
+
+	SipRequest unregister( register_sip_messages[0] );
+	unregister.SetHeader( "expires", "0" );
+	BOOST_CHECK_EQUAL( registrar.HandleRequest( unregister )->StatusCode(), 200 );
+	BOOST_CHECK_EQUAL( redis.RoundTrips(), 3u );
+	BOOST_CHECK_EQUAL( redis.Commands(), 9u );
+	BOOST_CHECK_EQUAL( redis.Ttl( "registrar:3170" ), -2 );
+
+	//When redis closes the connection, that REGISTER is told to come back shortly, and the next one reconnects
+	redis.Disconnect();
+	auto_ptr<SipResponse> refused( registrar.HandleRequest( request ) );
+	BOOST_CHECK_EQUAL( refused->StatusCode(), 503 );
+	BOOST_REQUIRE( refused->HasHeader( "retry-after" ) );
+	BOOST_CHECK_EQUAL( refused->GetHeaderValues( "retry-after" )[0].Value(), "1" );
+	BOOST_CHECK_EQUAL( registrar.HandleRequest( request )->StatusCode(), 200 );
+	BOOST_CHECK_EQUAL( pool.GetStats().connects, 2u );
+	BOOST_CHECK_EQUAL( pool.GetStats().dropped, 1u );
+	BOOST_CHECK_EQUAL( redis.Ttl( "registrar:3170" ), 3600 );
+}
+
+BOOST_AUTO_TEST_CASE( redis_pipeline ) {
+	FakeRedis redis;
+	RedisConnection connection( "127.0.0.1", redis.Port() );
+
+	//Replies come back in order, one round trip for the lot, errors among them as replies
+	connection.Append( RedisCommand( "HSET" ) << "k" << "a" << "1" << "b" << "two words" );
+	connection.Append( RedisCommand( "HGET" ) << "k" << "b" );
+	connection.Append( RedisCommand( "HGET" ) << "k" << "c" );
+	connection.Append( RedisCommand( "EXPIRE" ) << "k" << int64_t( 30 ) );
+	connection.Append( RedisCommand( "NOSUCH" ) );
+	connection.Append( RedisCommand( "HGETALL" ) << "k" );
+	BOOST_CHECK_EQUAL( connection.Queued(), 6u );
+	vector<RedisReply> replies;
+	connection.Flush( replies );
+	BOOST_CHECK_EQUAL( connection.Queued(), 0u );
+	BOOST_CHECK_EQUAL( connection.RoundTrips(), 1u );
+	BOOST_CHECK_EQUAL( redis.RoundTrips(), 1u );
+	BOOST_REQUIRE_EQUAL( replies.size(), 6u );
+	BOOST_CHECK_EQUAL( replies[0].type, RedisReply::REPLY_INTEGER );
+	BOOST_CHECK_EQUAL( replies[0].integer, 2 );
+	BOOST_CHECK_EQUAL( replies[1].type, RedisReply::REPLY_BULK );
+	BOOST_CHECK_EQUAL( replies[1].text, "two words" );
+	BOOST_CHECK_EQUAL( replies[2].type, RedisReply::REPLY_NIL );
+	BOOST_CHECK_EQUAL( replies[3].integer, 1 );
+	BOOST_CHECK_EQUAL( replies[4].type, RedisReply::REPLY_ERROR );
+	BOOST_REQUIRE_EQUAL( replies[5].type, RedisReply::REPLY_ARRAY );
+	BOOST_REQUIRE_EQUAL( replies[5].elements.size(), 4u );
+	BOOST_CHECK_EQUAL( replies[5].elements[0].text, "a" );
+	BOOST_CHECK_EQUAL( replies[5].elements[3].text, "two words" );
+
+	//Nothing queued, nothing sent
+	connection.Flush( replies );
+	BOOST_CHECK( replies.empty() );
+	BOOST_CHECK_EQUAL( connection.RoundTrips(), 1u );
+
+	//A closed connection throws, and stays failed
+	BOOST_CHECK_EQUAL( connection.Run( RedisCommand( "PING" ) ).text, "PONG" );
+	redis.Disconnect();
+	BOOST_CHECK_THROW( connection.Run( RedisCommand( "PING" ) ), RedisConnectionException );
+	BOOST_CHECK_THROW( connection.Run( RedisCommand( "PING" ) ), RedisConnectionException );
+	BOOST_CHECK_THROW( RedisConnection( "127.0.0.1", 1 ), RedisConnectionException );
+}
+
+BOOST_AUTO_TEST_CASE( registrar_batching ) {
+	//Redis 2 ms away: one REGISTER at a time, 8 threads of 20 would take 320 ms. With as many threads as a batch
+	//holds and a window no thread takes that long to come back in, a batch only goes once every thread is in it
+	const int threads = 8;
+	FakeRedis redis( 2000 );
+	RedisPool pool( "127.0.0.1", redis.Port() );
+	Registrar registrar( pool );
+	registrar.SetBatching( 10000000, threads );
+	vector<RegisterWorker> workers;
+	for ( int i = 0; i < threads; ++i )
+		workers.push_back( RegisterWorker( registrar, i ) );
+	BOOST_CHECK_EQUAL( ThreadedWorkers<RegisterWorker>::Run( workers ), 0 );
+	for ( int i = 0; i < threads; ++i )
+		for ( int j = 0; j < 20; ++j ) {
+			ostringstream key;
+			key << "registrar:" << 1000 + i * 100 + j;
+			FakeRedis::Hash registration;
+			BOOST_REQUIRE( redis.Get( key.str(), registration ) );
+			BOOST_CHECK_EQUAL( registration["uri"], "<sip:" + key.str().substr( 10 ) + "@172.20.3.20:5060>" );
+			BOOST_CHECK_EQUAL( redis.Ttl( key.str() ), 3600 );
+		}
+	//Every REGISTER's commands went, in 20 full batches
+	BOOST_CHECK_EQUAL( redis.Commands(), threads * 20 * 4u );
+	BOOST_CHECK_EQUAL( redis.RoundTrips(), 20u );
+
+	//Alone, a REGISTER waits out the window and goes by itself
+	registrar.SetBatching( 1000, threads );
+	BOOST_CHECK_EQUAL( registrar.HandleRequest( SipRequest( RegisterFrom( "4000" ) ) )->StatusCode(), 200 );
+	BOOST_CHECK_EQUAL( redis.Ttl( "registrar:4000" ), 3600 );
+}
+
+BOOST_AUTO_TEST_CASE( registrar_batching_redis_down ) {
+	//Every REGISTER in a batch that can't be written is refused, with the pool's Retry-After
+	RedisPool pool( "127.0.0.1", 1 );
+	Registrar registrar( pool );
+	registrar.SetBatching( 1000, 8 );
+	auto_ptr<SipResponse> response( registrar.HandleRequest( SipRequest( register_sip_messages[0] ) ) );
+	BOOST_CHECK_EQUAL( response->StatusCode(), 503 );
+	BOOST_REQUIRE( response->HasHeader( "retry-after" ) );
+	BOOST_CHECK_EQUAL( response->GetHeaderValues( "retry-after" )[0].Value(), "1" );
+}
+
+BOOST_AUTO_TEST_CASE( registration_fingerprints ) {
+	RegistrationFingerprints fingerprints( 1024, 4 );
+	BOOST_CHECK_EQUAL( fingerprints.Slots(), 1024u );
+	uint64_t fingerprint = RegistrationFingerprints::Fingerprint( "<sip:3170@172.20.3.20:5060>", "e2d0@10.1.1.11", 3600 );
+	BOOST_CHECK_NE( fingerprint, RegistrationFingerprints::Fingerprint( "<sip:3170@172.20.3.21:5060>", "e2d0@10.1.1.11", 3600 ) );
+	BOOST_CHECK_NE( fingerprint, RegistrationFingerprints::Fingerprint( "<sip:3170@172.20.3.20:5060>", "e2d1@10.1.1.11", 3600 ) );
+	BOOST_CHECK_NE( fingerprint, RegistrationFingerprints::Fingerprint( "<sip:3170@172.20.3.20:5060>", "e2d0@10.1.1.11", 1800 ) );
+	BOOST_CHECK_NE( RegistrationFingerprints::Fingerprint( "a", "bc", 0 ), RegistrationFingerprints::Fingerprint( "ab", "c", 0 ) );
+
+	BOOST_CHECK( !fingerprints.Matches( "registrar:3170", fingerprint ) );
+	fingerprints.Remember( "registrar:3170", fingerprint );
+	BOOST_CHECK( fingerprints.Matches( "registrar:3170", fingerprint ) );
+	BOOST_CHECK( !fingerprints.Matches( "registrar:3170", fingerprint + 1 ) );
+	BOOST_CHECK( !fingerprints.Matches( "registrar:3171", fingerprint ) );
+	fingerprints.Forget( "registrar:3171" );
+	BOOST_CHECK( fingerprints.Matches( "registrar:3170", fingerprint ) );
+	fingerprints.Forget( "registrar:3170" );
+	BOOST_CHECK( !fingerprints.Matches( "registrar:3170", fingerprint ) );
+
+	//With one slot, each key pushes the last out
+	RegistrationFingerprints tiny( 1, 1 );
+	tiny.Remember( "registrar:3170", fingerprint );
+	tiny.Remember( "registrar:3171", fingerprint );
+	BOOST_CHECK( !tiny.Matches( "registrar:3170", fingerprint ) );
+	BOOST_CHECK( tiny.Matches( "registrar:3171", fingerprint ) );
+}
+
+BOOST_AUTO_TEST_CASE( registrar_coalescing ) {
+	FakeRedis redis;
+	RedisPool pool( "127.0.0.1", redis.Port() );
+	Registrar registrar( pool );
+	SipRequest request( register_sip_messages[0] );
+
+	//The first REGISTER is written in full; refreshes that change nothing only extend the TTL
+	BOOST_CHECK_EQUAL( registrar.HandleRequest( request )->StatusCode(), 200 );
+	BOOST_CHECK_EQUAL( redis.Commands(), 4u );
+	for ( int i = 0; i < 10; ++i )
+		BOOST_CHECK_EQUAL( registrar.HandleRequest( request )->StatusCode(), 200 );
+	BOOST_CHECK_EQUAL( redis.Commands(), 14u );
+	BOOST_CHECK_EQUAL( redis.RoundTrips(), 11u );
+	BOOST_CHECK_EQUAL( redis.Ttl( "registrar:3170" ), 3600 );
+
+	//A new Call-ID (the phone restarted), Contact or Expires is written in full
+	SipRequest restarted( register_sip_messages[0] );
+	restarted.SetHeader( "call-id", "f00d@172.20.3.20" );
+	BOOST_CHECK_EQUAL( registrar.HandleRequest( restarted )->StatusCode(), 200 );
+	BOOST_CHECK_EQUAL( redis.Commands(), 18u );
+	SipRequest moved( RegisterFrom( "3170" ) );
+	moved.SetHeader( "call-id", "f00d@172.20.3.20" );
+	moved.SetHeader( "contact", "<sip:3170@172.20.3.99:5060>" );
+	BOOST_CHECK_EQUAL( registrar.HandleRequest( moved )->StatusCode(), 200 );
+	BOOST_CHECK_EQUAL( redis.Commands(), 22u );
+	FakeRedis::Hash registration;
+	BOOST_REQUIRE( redis.Get( "registrar:3170", registration ) );
+	BOOST_CHECK_EQUAL( registration["uri"], "<sip:3170@172.20.3.99:5060>" );
+	moved.SetHeader( "expires", "1800" );
+	BOOST_CHECK_EQUAL( registrar.HandleRequest( moved )->StatusCode(), 200 );
+	BOOST_CHECK_EQUAL( redis.Commands(), 26u );
+	BOOST_CHECK_EQUAL( redis.Ttl( "registrar:3170" ), 1800 );
+
+	//A key redis lost is found out by the EXPIRE, and written again
+	RedisConnection connection( "127.0.0.1", redis.Port() );
+	connection.Run( RedisCommand( "DEL" ) << "registrar:3170" );
+	BOOST_CHECK_EQUAL( registrar.HandleRequest( moved )->StatusCode(), 200 );
+	BOOST_CHECK_EQUAL( redis.Commands(), 32u );
+	BOOST_REQUIRE( redis.Get( "registrar:3170", registration ) );
+	BOOST_CHECK_EQUAL( registration["expiration"], "1800" );
+
+	//A de-registration forgets the fingerprint, so registering again writes in full
+	SipRequest unregister( register_sip_messages[0] );
+	unregister.SetHeader( "expires", "0" );
+	BOOST_CHECK_EQUAL( registrar.HandleRequest( unregister )->StatusCode(), 200 );
+	BOOST_CHECK_EQUAL( registrar.HandleRequest( request )->StatusCode(), 200 );
+	BOOST_CHECK_EQUAL( redis.Commands(), 37u );
+	BOOST_CHECK_EQUAL( redis.Ttl( "registrar:3170" ), 3600 );
+
+	//Off, every refresh is written in full
+	registrar.SetCoalescing( false );
+	BOOST_CHECK_EQUAL( registrar.HandleRequest( request )->StatusCode(), 200 );
+	BOOST_CHECK_EQUAL( redis.Commands(), 41u );
+}
@@ -0,0 +1,666 @@
+#include <boost/test/unit_test.hpp>
+#include <cstdlib>
+#include <cstring>
+#include <map>
+#include <string>
+#include <vector>
+#include <arpa/inet.h>
+#include "../ClientTransaction.hpp"
+#include "../HandleSlab.hpp"
+#include "../RttTable.hpp"
+#include "../ServerTransaction.hpp"
+#include "../SipDefines.hpp"
+#include "../TimingWheel.hpp"
+#include "../transport/ServerTransactionFilter.hpp"
+
+using namespace Sip;
+using namespace std;
+
+namespace {
+
+const char INVITE[] =
+	"INVITE sip:2100@172.20.3.28;user=phone SIP/2.0\r\n"
+	"Via: SIP/2.0/UDP 172.20.3.46;branch=z9hG4bKce49e348C486E67\r\n"
+	"From: \"2278\" <sip:2278@172.20.3.28>;tag=F29AA123-A06C7B62\r\n"
+	"To: <sip:2100@172.20.3.28;user=phone>\r\n"
+	"CSeq: 1 INVITE\r\n"
+	"Call-ID: f3c99e26-20e78e85-6ecadb84@172.20.3.46\r\n"
+	"Route: <sip:172.20.3.28;lr>\r\n"
+	"Max-Forwards: 70\r\n"
+	"Content-Length: 0\r\n\r\n";
+
+const char OPTIONS[] =
+	"OPTIONS sip:172.20.3.28 SIP/2.0\r\n"
+	"Via: SIP/2.0/UDP 172.20.3.46;branch=z9hG4bK77aa01\r\n"
+	"From: <sip:2278@172.20.3.28>;tag=81ac\r\n"
+	"To: <sip:172.20.3.28>\r\n"
+	"CSeq: 7 OPTIONS\r\n"
+	"Call-ID: 0ab1c2@172.20.3.46\r\n"
+	"Max-Forwards: 70\r\n"
+	"Content-Length: 0\r\n\r\n";
+
+/**
+ *     A response to one of the requests above, with a To tag
+ */
+SipResponse Answer( const char* request, int code, const string& reason )
+{
+	SipRequest parsed( request );
+	SipResponse response( code, reason, parsed );
+	vector<SipHeaderValue>& to = response.ModifyHeader( "to" );
+	map<string, string> tags;
+	tags["tag"] = "98asjd8";
+	to[0] = SipHeaderValue( to[0].Value(), tags );
+	return SipResponse( response.ToString() );
+}
+
+class RecordingSender : public TransactionSender
+{
+	public:
+		RecordingSender() : fail( false ) {}
+
+		bool Send( const string& data, const sockaddr_storage& destination )
+		{
+			if ( fail )
+				return false;
+			sent.push_back( data );
+			return true;
+		}
+
+		vector<string> sent;
+		bool fail;
+};
+
+class RecordingUser : public ClientTransactionUser
+{
+	public:
+		RecordingUser() : timeouts( 0 ), transportErrors( 0 ) {}
+
+		void OnResponse( SlabHandle transaction, const SipResponse& response )
+		{
+			codes.push_back( response.StatusCode() );
+		}
+
+		void OnTimeout( SlabHandle transaction )
+		{
+			++timeouts;
+		}
+
+		void OnTransportError( SlabHandle transaction )
+		{
+			++transportErrors;
+		}
+
+		vector<int> codes;
+		int timeouts, transportErrors;
+};
+
+class CountingHandler : public SipMessageHandler
+{
+	public:
+		CountingHandler() : requests( 0 ), responses( 0 ) {}
+
+		void OnMessage( auto_ptr<SipMessage>& message, const sockaddr_storage& source, int socket )
+		{
+			++( message->Type == SipMessage::MT_REQUEST ? requests : responses );
+		}
+
+		int requests, responses;
+};
+
+/**
+ *     The ACK a UAC would send for a failure to INVITE above
+ */
+SipRequest Ack()
+{
+	string ack( INVITE );
+	ack.replace( 0, 6, "ACK" );
+	ack.replace( ack.find( "1 INVITE" ), 8, "1 ACK" );
+	return SipRequest( ack );
+}
+
+sockaddr_storage Nowhere()
+{
+	sockaddr_storage destination;
+	memset( &destination, 0, sizeof( destination ) );
+	destination.ss_family = AF_INET;
+	return destination;
+}
+
+sockaddr_storage Address( const char* ip, unsigned short port )
+{
+	sockaddr_storage address;
+	memset( &address, 0, sizeof( address ) );
+	if ( strchr( ip, ':' ) != NULL )
+	{
+		sockaddr_in6& ipv6 = reinterpret_cast<sockaddr_in6&>( address );
+		ipv6.sin6_family = AF_INET6;
+		ipv6.sin6_port = htons( port );
+		inet_pton( AF_INET6, ip, &ipv6.sin6_addr );
+	}
+	else
+	{
+		sockaddr_in& ipv4 = reinterpret_cast<sockaddr_in&>( address );
+		ipv4.sin_family = AF_INET;
+		ipv4.sin_port = htons( port );
+		inet_pton( AF_INET, ip, &ipv4.sin_addr );
+	}
+	return address;
+}
+
+}; //namespace
+
+BOOST_AUTO_TEST_CASE( handle_slab ) {
+	HandleSlab<string, 4> slab;
+	BOOST_CHECK( !SlabHandle().Valid() );
+	BOOST_CHECK( slab.Get( SlabHandle() ) == NULL );
+
+	vector<SlabHandle> handles;
+	for ( int i = 0; i < 6; ++i )
+	{
+		handles.push_back( slab.Acquire() );
+		*slab.Get( handles.back() ) = "occupant";
+	}
+	BOOST_CHECK_EQUAL( slab.Size(), 6u );
+	BOOST_CHECK_EQUAL( slab.Capacity(), 8u );
+	string* first = slab.Get( handles[0] );
+
+	//A released slot is reused first, under a new generation; the old handle stays stale
+	slab.Release( handles[2] );
+	BOOST_CHECK( slab.Get( handles[2] ) == NULL );
+	SlabHandle reused = slab.Acquire();
+	BOOST_CHECK_EQUAL( reused.index, handles[2].index );
+	BOOST_CHECK( reused != handles[2] );
+	BOOST_CHECK( slab.Get( handles[2] ) == NULL );
+	BOOST_CHECK_EQUAL( *slab.Get( reused ), "occupant" );
+
+	//Releasing twice is harmless, and growth never moves what is already there
+	slab.Release( handles[2] );
+	BOOST_CHECK_EQUAL( slab.Size(), 6u );
+	for ( int i = 0; i < 10; ++i )
+		slab.Acquire();
+	BOOST_CHECK( slab.Get( handles[0] ) == first );
+	BOOST_CHECK_EQUAL( slab.Size(), 16u );
+}
+
+BOOST_AUTO_TEST_CASE( timing_wheel ) {
+	//Deadlines from the same millisecond to past the top level, against a map of what should be armed
+	srand( 42 );
+	const uint64_t start = 123456789;
+	TimingWheel wheel( start );
+	map<uint32_t, uint64_t> armed; //By timer index
+	vector<SlabHandle> timers;
+	const uint64_t spans[] = { 1, 256, 65536, 1 << 24, 3600 * 1000, 1ULL << 33 };
+	for ( int i = 0; i < 20000; ++i )
+	{
+		uint64_t span = spans[ i % 6 ];
+		uint64_t deadline = start + ( static_cast<uint64_t>( rand() ) * rand() ) % span;
+		timers.push_back( wheel.Schedule( start, deadline, SlabHandle( i, 1 ), i % 3 ) );
+		armed[ timers.back().index ] = deadline;
+	}
+	for ( int i = 0; i < 20000; i += 7 )
+	{
+		BOOST_CHECK( wheel.Cancel( timers[i] ) );
+		BOOST_CHECK( !wheel.Cancel( timers[i] ) );
+		armed.erase( timers[i].index );
+	}
+	BOOST_CHECK_EQUAL( wheel.Size(), armed.size() );
+
+	//Every timer expires on the first Advance() at or after its deadline, and Next() is never late
+	uint64_t now = start - 1;
+	vector<TimingWheel::Expired> expired;
+	while ( wheel.Size() > 0 )
+	{
+		uint64_t next;
+		BOOST_REQUIRE( wheel.Next( next ) );
+		BOOST_REQUIRE( next >= now );
+		uint64_t step = now + 1 + ( static_cast<uint64_t>( rand() ) * rand() ) % ( 1ULL << ( rand() % 34 ) );
+		uint64_t earliest = armed.empty() ? step : ~0ULL;
+		for ( map<uint32_t, uint64_t>::iterator timer = armed.begin(); timer != armed.end(); ++timer )
+			earliest = std::min( earliest, timer->second );
+		BOOST_REQUIRE( next <= std::max( earliest, now + 1 ) );
+
+		expired.clear();
+		wheel.Advance( step, expired );
+		for ( vector<TimingWheel::Expired>::iterator due = expired.begin(); due != expired.end(); ++due )
+		{
+			BOOST_REQUIRE( armed.count( due->timer.index ) == 1 );
+			BOOST_CHECK_EQUAL( armed[ due->timer.index ], due->deadline );
+			BOOST_CHECK( due->deadline <= step && due->deadline > now );
+			BOOST_CHECK( due + 1 == expired.end() || due->deadline <= ( due + 1 )->deadline );
+			armed.erase( due->timer.index );
+		}
+		for ( map<uint32_t, uint64_t>::iterator timer = armed.begin(); timer != armed.end(); ++timer )
+			BOOST_REQUIRE( timer->second > step );
+		now = step;
+	}
+	BOOST_CHECK( armed.empty() );
+
+	//A deadline already past expires on the next Advance(); an idle wheel jumps to the caller's clock
+	wheel.Schedule( now, now - 10, SlabHandle(), 0 );
+	BOOST_CHECK_EQUAL( wheel.Advance( now, expired ), 1u );
+	wheel.Schedule( now + ( 1ULL << 40 ), now + ( 1ULL << 40 ) + 5, SlabHandle(), 0 );
+	uint64_t next;
+	BOOST_REQUIRE( wheel.Next( next ) );
+	BOOST_CHECK_EQUAL( next, now + ( 1ULL << 40 ) + 5 );
+
+	//An Advance() that stops just short of a turn leaves the wheel on it; a timer scheduled then mustn't hide the
+	//timers the turn brings down
+	for ( int stop = 0; stop < 2; ++stop )
+	{
+		TimingWheel turning( 0 );
+		turning.Schedule( 0, 300, SlabHandle( 1, 1 ), 0 );
+		if ( stop == 1 ) //Or stops after expiring a timer due just before the turn
+			turning.Schedule( 0, 255, SlabHandle( 2, 1 ), 0 );
+		expired.clear();
+		BOOST_CHECK_EQUAL( turning.Advance( 255, expired ), static_cast<size_t>( stop ) );
+		turning.Schedule( 255, 260, SlabHandle( 3, 1 ), 0 );
+		BOOST_REQUIRE( turning.Next( next ) );
+		BOOST_CHECK_EQUAL( next, 260u );
+		expired.clear();
+		BOOST_CHECK_EQUAL( turning.Advance( 400, expired ), 2u );
+		BOOST_REQUIRE_EQUAL( expired.size(), 2u );
+		BOOST_CHECK_EQUAL( expired[0].deadline, 260u );
+		BOOST_CHECK_EQUAL( expired[1].deadline, 300u );
+	}
+}
+
+BOOST_AUTO_TEST_CASE( rtt_table ) {
+	RttTable table( 64 );
+	sockaddr_storage phone = Address( "192.168.1.20", 5060 ), trunk = Address( "203.0.113.9", 5060 );
+	BOOST_CHECK( RttTable::IsPrivate( phone ) );
+	BOOST_CHECK( RttTable::IsPrivate( Address( "fd00::1", 5060 ) ) );
+	BOOST_CHECK( RttTable::IsPrivate( Address( "::ffff:10.1.2.3", 5060 ) ) );
+	BOOST_CHECK( !RttTable::IsPrivate( trunk ) );
+	BOOST_CHECK( !RttTable::IsPrivate( Address( "2001:db8::1", 5060 ) ) );
+
+	//Nothing known: the RFC 3261 default
+	double srtt, rttvar;
+	BOOST_CHECK( !table.Estimate( phone, srtt, rttvar ) );
+	BOOST_CHECK_EQUAL( table.T1For( phone ), static_cast<uint64_t>( SIP_T1 ) );
+
+	//RFC 6298: the first sample sets SRTT = R and RTTVAR = R/2, later ones move them by 1/8 and 1/4
+	table.Sample( trunk, 300 );
+	BOOST_REQUIRE( table.Estimate( trunk, srtt, rttvar ) );
+	BOOST_CHECK_EQUAL( srtt, 300 );
+	BOOST_CHECK_EQUAL( rttvar, 150 );
+	BOOST_CHECK_EQUAL( table.T1For( trunk ), 900u ); //300 + 4 * 150
+	table.Sample( trunk, 340 );
+	table.Estimate( trunk, srtt, rttvar );
+	BOOST_CHECK_EQUAL( srtt, 305 );
+	BOOST_CHECK_EQUAL( rttvar, 122.5 );
+	BOOST_CHECK_EQUAL( table.T1For( trunk ), 795u );
+
+	//A fast public destination still gets SIP_T1; a fast private one goes down to SIP_T1_PRIVATE
+	sockaddr_storage fastPublic = Address( "198.51.100.7", 5060 );
+	for ( int i = 0; i < 20; ++i )
+	{
+		table.Sample( phone, 4 );
+		table.Sample( fastPublic, 4 );
+	}
+	BOOST_CHECK_EQUAL( table.T1For( fastPublic ), static_cast<uint64_t>( SIP_T1 ) );
+	BOOST_CHECK_EQUAL( table.T1For( phone ), static_cast<uint64_t>( SIP_T1_PRIVATE ) );
+	BOOST_CHECK_EQUAL( table.T1For( Address( "192.168.1.20", 5062 ) ), static_cast<uint64_t>( SIP_T1 ) ); //Other port
+	table.SetBounds( 1, SIP_T1, SIP_T2 );
+	BOOST_CHECK( table.T1For( phone ) < 10u );
+
+	//Backoff doubles until the next sample, up to the maximum, and leaves unknown destinations alone
+	table.SetBounds( SIP_T1_PRIVATE, SIP_T1, SIP_T2 );
+	table.Backoff( phone );
+	BOOST_CHECK_EQUAL( table.T1For( phone ), static_cast<uint64_t>( SIP_T1_PRIVATE * 2 ) );
+	for ( int i = 0; i < 40; ++i )
+		table.Backoff( phone );
+	BOOST_CHECK_EQUAL( table.T1For( phone ), static_cast<uint64_t>( SIP_T2 ) );
+	table.Sample( phone, 4 );
+	BOOST_CHECK_EQUAL( table.T1For( phone ), static_cast<uint64_t>( SIP_T1_PRIVATE ) );
+	table.Backoff( Address( "10.9.9.9", 5060 ) );
+	BOOST_CHECK_EQUAL( table.T1For( Address( "10.9.9.9", 5060 ) ), static_cast<uint64_t>( SIP_T1 ) );
+
+	//Only IP destinations are kept
+	sockaddr_storage local;
+	memset( &local, 0, sizeof( local ) );
+	local.ss_family = AF_UNIX;
+	table.Sample( local, 4 );
+	BOOST_CHECK( !table.Estimate( local, srtt, rttvar ) );
+}
+
+BOOST_AUTO_TEST_CASE( invite_client_transaction ) {
+	RecordingSender sender;
+	RecordingUser user;
+	ClientTransactions transactions( sender, user );
+	SipRequest invite( INVITE );
+
+	SlabHandle call = transactions.Start( invite, Nowhere(), false, 0 );
+	BOOST_REQUIRE( call.Valid() );
+	BOOST_CHECK_EQUAL( transactions.GetState( call ), ClientTransactions::STATE_CALLING );
+	BOOST_REQUIRE_EQUAL( sender.sent.size(), 1u );
+	BOOST_CHECK_EQUAL( sender.sent[0], string( INVITE ) ); //Unmodified, so sent as parsed
+	BOOST_CHECK_THROW( transactions.Start( invite, Nowhere(), false, 0 ), TransactionException );
+
+	//Timer A: T1, then doubling
+	transactions.RunTimers( SIP_T1 - 1 );
+	BOOST_CHECK_EQUAL( sender.sent.size(), 1u );
+	transactions.RunTimers( SIP_T1 );
+	transactions.RunTimers( SIP_T1 * 3 );
+	BOOST_REQUIRE_EQUAL( sender.sent.size(), 3u );
+	BOOST_CHECK_EQUAL( sender.sent[2], sender.sent[0] );
+
+	//A provisional stops retransmission and Timer B
+	BOOST_CHECK( transactions.OnResponse( Answer( INVITE, 180, "Ringing" ), 2000 ) );
+	BOOST_CHECK_EQUAL( transactions.GetState( call ), ClientTransactions::STATE_PROCEEDING );
+	transactions.RunTimers( SIP_TB * 2 );
+	BOOST_CHECK_EQUAL( sender.sent.size(), 3u );
+	BOOST_CHECK_EQUAL( user.timeouts, 0 );
+
+	//A failure is ACKed, once per retransmission of it, and reaches the user once
+	uint64_t now = SIP_TB * 2;
+	BOOST_CHECK( transactions.OnResponse( Answer( INVITE, 486, "Busy Here" ), now ) );
+	BOOST_CHECK_EQUAL( transactions.GetState( call ), ClientTransactions::STATE_COMPLETED );
+	BOOST_REQUIRE_EQUAL( sender.sent.size(), 4u );
+	SipRequest ack( sender.sent[3] );
+	BOOST_CHECK_EQUAL( ack.RequestMethod(), SipRequest::REQUEST_METHOD_ACK );
+	BOOST_CHECK_EQUAL( ack.RequestURI().Host(), "172.20.3.28" );
+	BOOST_CHECK_EQUAL( ack.GetHeaderValues( "to" )[0].GetTagValue( "tag" ), "98asjd8" );
+	BOOST_CHECK_EQUAL( ack.GetHeaderValues( "cseq" )[0].Value(), "1 ACK" );
+	BOOST_CHECK_EQUAL( ack.GetHeaderValues( "via" )[0].ToString(), invite.GetHeaderValues( "via" )[0].ToString() );
+	BOOST_CHECK( ack.HasHeader( "route" ) );
+
+	BOOST_CHECK( transactions.OnResponse( Answer( INVITE, 486, "Busy Here" ), now + 100 ) );
+	BOOST_REQUIRE_EQUAL( sender.sent.size(), 5u );
+	BOOST_CHECK_EQUAL( sender.sent[4], sender.sent[3] );
+	BOOST_REQUIRE_EQUAL( user.codes.size(), 2u );
+	BOOST_CHECK_EQUAL( user.codes[1], 486 );
+	BOOST_CHECK_EQUAL( transactions.GetStats().absorbed, 1u );
+
+	//Timer D
+	transactions.RunTimers( now + SIP_TD - 1 );
+	BOOST_CHECK_EQUAL( transactions.Size(), 1u );
+	transactions.RunTimers( now + SIP_TD );
+	BOOST_CHECK_EQUAL( transactions.Size(), 0u );
+	BOOST_CHECK_EQUAL( transactions.GetState( call ), ClientTransactions::STATE_TERMINATED );
+	BOOST_CHECK( !transactions.OnResponse( Answer( INVITE, 486, "Busy Here" ), now + SIP_TD ) );
+	BOOST_CHECK_EQUAL( transactions.GetStats().unmatched, 1u );
+}
+
+BOOST_AUTO_TEST_CASE( invite_client_transaction_timeout ) {
+	RecordingSender sender;
+	RecordingUser user;
+	ClientTransactions transactions( sender, user );
+	transactions.Start( SipRequest( INVITE ), Nowhere(), false, 0 );
+
+	uint64_t when;
+	while ( transactions.NextTimer( when ) )
+		transactions.RunTimers( when );
+	//Sent at 0, T1, 3T1, 7T1, 15T1, 31T1 and 63T1; Timer B fires at 64T1
+	BOOST_CHECK_EQUAL( sender.sent.size(), 7u );
+	BOOST_CHECK_EQUAL( user.timeouts, 1 );
+	BOOST_CHECK_EQUAL( transactions.Size(), 0u );
+
+	//A 2xx ends the transaction at once: the ACK for it is the user's
+	SlabHandle call = transactions.Start( SipRequest( INVITE ), Nowhere(), false, 0 );
+	BOOST_CHECK( transactions.OnResponse( Answer( INVITE, 200, "OK" ), 10 ) );
+	BOOST_CHECK_EQUAL( transactions.GetState( call ), ClientTransactions::STATE_TERMINATED );
+	BOOST_CHECK_EQUAL( sender.sent.size(), 8u );
+	BOOST_CHECK_EQUAL( user.codes.back(), 200 );
+}
+
+BOOST_AUTO_TEST_CASE( non_invite_client_transaction ) {
+	RecordingSender sender;
+	RecordingUser user;
+	ClientTransactions transactions( sender, user );
+	SipRequest options( OPTIONS );
+	options.SetUInt( "max-forwards", 69 ); //Same width, so still sent as parsed
+	SlabHandle ping = transactions.Start( options, Nowhere(), false, 0 );
+	BOOST_CHECK_EQUAL( transactions.GetState( ping ), ClientTransactions::STATE_TRYING );
+
+	//Timer E: T1, 2T1, then capped at T2
+	uint64_t expected[] = { SIP_T1, SIP_T1 * 3, SIP_T1 * 7, SIP_T1 * 7 + SIP_T2 };
+	for ( size_t i = 0; i < 4; ++i )
+	{
+		uint64_t when;
+		BOOST_REQUIRE( transactions.NextTimer( when ) );
+		BOOST_CHECK( when <= expected[i] );
+		transactions.RunTimers( expected[i] - 1 );
+		BOOST_CHECK_EQUAL( sender.sent.size(), i + 1 );
+		transactions.RunTimers( expected[i] );
+	}
+	BOOST_CHECK_EQUAL( sender.sent.size(), 5u );
+	BOOST_CHECK( sender.sent[4].find( "Max-Forwards: 69" ) != string::npos );
+
+	BOOST_CHECK( transactions.OnResponse( Answer( OPTIONS, 200, "OK" ), 6000 ) );
+	BOOST_CHECK_EQUAL( transactions.GetState( ping ), ClientTransactions::STATE_COMPLETED );
+	BOOST_CHECK( transactions.OnResponse( Answer( OPTIONS, 200, "OK" ), 6100 ) );
+	BOOST_CHECK_EQUAL( user.codes.size(), 1u );
+	transactions.RunTimers( 6000 + SIP_TK );
+	BOOST_CHECK_EQUAL( transactions.Size(), 0u );
+	BOOST_CHECK_EQUAL( sender.sent.size(), 5u );
+
+	//Timer F
+	sender.sent.clear();
+	transactions.Start( options, Nowhere(), false, 0 );
+	transactions.RunTimers( SIP_TF - 1 );
+	BOOST_CHECK_EQUAL( user.timeouts, 0 );
+	transactions.RunTimers( SIP_TF );
+	BOOST_CHECK_EQUAL( user.timeouts, 1 );
+}
+
+BOOST_AUTO_TEST_CASE( reliable_client_transaction ) {
+	RecordingSender sender;
+	RecordingUser user;
+	ClientTransactions transactions( sender, user );
+
+	//No retransmission over a reliable transport, and no lingering once complete
+	transactions.Start( SipRequest( INVITE ), Nowhere(), true, 0 );
+	transactions.RunTimers( SIP_TB - 1 );
+	BOOST_CHECK_EQUAL( sender.sent.size(), 1u );
+	BOOST_CHECK( transactions.OnResponse( Answer( INVITE, 603, "Decline" ), SIP_TB - 1 ) );
+	BOOST_CHECK_EQUAL( sender.sent.size(), 2u );
+	transactions.RunTimers( SIP_TB - 1 );
+	BOOST_CHECK_EQUAL( transactions.Size(), 0u );
+
+	//A transport that refuses the request fails the transaction, at the start or on a retransmission
+	sender.fail = true;
+	BOOST_CHECK( !transactions.Start( SipRequest( OPTIONS ), Nowhere(), false, 0 ).Valid() );
+	sender.fail = false;
+	transactions.Start( SipRequest( OPTIONS ), Nowhere(), false, 0 );
+	sender.fail = true;
+	transactions.RunTimers( SIP_T1 );
+	BOOST_CHECK_EQUAL( user.transportErrors, 1 );
+	BOOST_CHECK_EQUAL( transactions.Size(), 0u );
+	BOOST_CHECK_EQUAL( transactions.GetStats().transportErrors, 2u );
+
+	SipRequest ack( INVITE );
+	ack.SetRequestMethod( SipRequest::REQUEST_METHOD_ACK );
+	ack.SetHeader( "cseq", "1 ACK" );
+	BOOST_CHECK_THROW( transactions.Start( ack, Nowhere(), false, 0 ), TransactionException );
+}
+
+BOOST_AUTO_TEST_CASE( adaptive_client_transaction ) {
+	RecordingSender sender;
+	RecordingUser user;
+	ClientTransactions transactions( sender, user );
+	sockaddr_storage phone = Address( "192.168.1.20", 5060 );
+
+	//A request answered before any retransmission is an RTT sample; a LAN phone's brings Timer E down to the floor
+	uint64_t now = 0;
+	for ( int i = 0; i < 10; ++i, now += SIP_TK + 3 )
+	{
+		transactions.Start( SipRequest( OPTIONS ), phone, false, now );
+		BOOST_CHECK( transactions.OnResponse( Answer( OPTIONS, 200, "OK" ), now + 3 ) );
+		transactions.RunTimers( now + SIP_TK + 3 ); //Timer K
+	}
+	BOOST_CHECK_EQUAL( transactions.GetRttTable().T1For( phone ), static_cast<uint64_t>( SIP_T1_PRIVATE ) );
+	sender.sent.clear();
+	SlabHandle ping = transactions.Start( SipRequest( OPTIONS ), phone, false, now );
+	transactions.RunTimers( now + SIP_T1_PRIVATE - 1 );
+	BOOST_CHECK_EQUAL( sender.sent.size(), 1u );
+	transactions.RunTimers( now + SIP_T1_PRIVATE );
+	BOOST_CHECK_EQUAL( sender.sent.size(), 2u );
+
+	//The answer to a retransmitted request is no sample, but backs the destination off for the next request
+	double srtt, rttvar;
+	transactions.GetRttTable().Estimate( phone, srtt, rttvar );
+	BOOST_CHECK( transactions.OnResponse( Answer( OPTIONS, 200, "OK" ), now + SIP_T1_PRIVATE + 1 ) );
+	double afterSrtt, afterRttvar;
+	transactions.GetRttTable().Estimate( phone, afterSrtt, afterRttvar );
+	BOOST_CHECK_EQUAL( srtt, afterSrtt );
+	BOOST_CHECK_EQUAL( transactions.GetRttTable().T1For( phone ), static_cast<uint64_t>( SIP_T1_PRIVATE * 2 ) );
+	BOOST_CHECK_EQUAL( transactions.GetState( ping ), ClientTransactions::STATE_COMPLETED );
+
+	//Timer F doesn't shrink with T1
+	transactions.RunTimers( now + SIP_TK * 2 );
+	now += SIP_TK * 2;
+	transactions.Start( SipRequest( OPTIONS ), phone, false, now );
+	transactions.RunTimers( now + SIP_TF - 1 );
+	BOOST_CHECK_EQUAL( user.timeouts, 0 );
+	transactions.RunTimers( now + SIP_TF );
+	BOOST_CHECK_EQUAL( user.timeouts, 1 );
+}
+
+BOOST_AUTO_TEST_CASE( non_invite_server_transaction ) {
+	RecordingSender sender;
+	ServerTransactions transactions( sender );
+	SipRequest options( OPTIONS );
+
+	//Retransmissions before the UAS answers are dropped, and after it the answer is re-sent as serialized
+	BOOST_CHECK( !transactions.Receive( options, Nowhere(), false, 0 ) );
+	BOOST_CHECK_EQUAL( transactions.GetState( options ), ServerTransactions::STATE_TRYING );
+	BOOST_CHECK( transactions.Receive( options, Nowhere(), false, SIP_T1 ) );
+	BOOST_CHECK( sender.sent.empty() );
+	BOOST_CHECK( transactions.Respond( options, SipResponse( 200, "OK", options ), Nowhere(), SIP_T1 ) );
+	BOOST_CHECK_EQUAL( transactions.GetState( options ), ServerTransactions::STATE_COMPLETED );
+	BOOST_CHECK( transactions.Receive( options, Nowhere(), false, SIP_T1 * 3 ) );
+	BOOST_REQUIRE_EQUAL( sender.sent.size(), 2u );
+	BOOST_CHECK_EQUAL( sender.sent[1], sender.sent[0] );
+	BOOST_CHECK_EQUAL( transactions.GetStats().absorbed, 2u );
+
+	//A different branch from the same phone is a new request
+	SipRequest other( OPTIONS );
+	other.SetHeader( "via", "SIP/2.0/UDP 172.20.3.46;branch=z9hG4bK77aa02" );
+	BOOST_CHECK( !transactions.Receive( other, Nowhere(), false, SIP_T1 * 3 ) );
+
+	//Timer J; and the request the UAS never answered is forgotten too
+	transactions.RunTimers( SIP_T1 + SIP_TJ );
+	BOOST_CHECK_EQUAL( transactions.GetState( options ), ServerTransactions::STATE_TERMINATED );
+	BOOST_CHECK( !transactions.Receive( options, Nowhere(), false, SIP_T1 + SIP_TJ ) );
+	transactions.RunTimers( SIP_T1 * 3 + SIP_TH );
+	BOOST_CHECK_EQUAL( transactions.GetStats().abandoned, 1u );
+
+	//Over a reliable transport the final response isn't kept
+	transactions.RunTimers( SIP_T1 * 2 + SIP_TJ * 2 );
+	BOOST_CHECK_EQUAL( transactions.Size(), 0u );
+	BOOST_CHECK( !transactions.Receive( options, Nowhere(), true, 0 ) );
+	transactions.Respond( options, SipResponse( 200, "OK", options ), Nowhere(), 0 );
+	transactions.RunTimers( 0 );
+	BOOST_CHECK_EQUAL( transactions.Size(), 0u );
+}
+
+BOOST_AUTO_TEST_CASE( invite_server_transaction ) {
+	RecordingSender sender;
+	ServerTransactions transactions( sender );
+	SipRequest invite( INVITE );
+
+	BOOST_CHECK( !transactions.Receive( invite, Nowhere(), false, 0 ) );
+	BOOST_CHECK_EQUAL( transactions.GetState( invite ), ServerTransactions::STATE_PROCEEDING );
+	transactions.Respond( invite, SipResponse( 100, "Trying", invite ), Nowhere(), 0 );
+	BOOST_CHECK( transactions.Receive( invite, Nowhere(), false, SIP_T1 ) );
+	BOOST_REQUIRE_EQUAL( sender.sent.size(), 2u );
+	BOOST_CHECK_EQUAL( SipResponse( sender.sent[1] ).StatusCode(), 100 );
+
+	//A failure is retransmitted on Timer G until the ACK, which goes no further
+	transactions.Respond( invite, Answer( INVITE, 486, "Busy Here" ), Nowhere(), 1000 );
+	BOOST_CHECK_EQUAL( transactions.GetState( invite ), ServerTransactions::STATE_COMPLETED );
+	transactions.RunTimers( 1000 + SIP_T1 );
+	transactions.RunTimers( 1000 + SIP_T1 * 3 );
+	BOOST_REQUIRE_EQUAL( sender.sent.size(), 5u );
+	BOOST_CHECK_EQUAL( sender.sent[4], sender.sent[2] );
+	BOOST_CHECK( transactions.Receive( Ack(), Nowhere(), false, 3000 ) );
+	BOOST_CHECK_EQUAL( transactions.GetState( invite ), ServerTransactions::STATE_CONFIRMED );
+	BOOST_CHECK( transactions.Receive( invite, Nowhere(), false, 3000 ) );
+	BOOST_CHECK( transactions.Receive( Ack(), Nowhere(), false, 3000 ) );
+	transactions.RunTimers( 3000 + SIP_TI - 1 );
+	BOOST_CHECK_EQUAL( sender.sent.size(), 5u );
+	transactions.RunTimers( 3000 + SIP_TI );
+	BOOST_CHECK_EQUAL( transactions.Size(), 0u );
+	BOOST_CHECK_EQUAL( transactions.GetStats().acks, 2u );
+
+	//A failure never ACKed gives up on Timer H
+	uint64_t now = 10000;
+	transactions.Receive( invite, Nowhere(), false, now );
+	transactions.Respond( invite, Answer( INVITE, 486, "Busy Here" ), Nowhere(), now );
+	transactions.RunTimers( now + SIP_TH );
+	BOOST_CHECK_EQUAL( transactions.GetStats().timeouts, 1u );
+	BOOST_CHECK_EQUAL( transactions.Size(), 0u );
+
+	//A 2xx is re-sent for retransmitted INVITEs until Timer L; its ACK is the UAS's
+	now += SIP_TH;
+	sender.sent.clear();
+	transactions.Receive( invite, Nowhere(), false, now );
+	transactions.Respond( invite, Answer( INVITE, 200, "OK" ), Nowhere(), now );
+	BOOST_CHECK_EQUAL( transactions.GetState( invite ), ServerTransactions::STATE_ACCEPTED );
+	BOOST_CHECK( transactions.Receive( invite, Nowhere(), false, now + 1 ) );
+	BOOST_CHECK_EQUAL( sender.sent.size(), 2u );
+	BOOST_CHECK( !transactions.Receive( Ack(), Nowhere(), false, now + 1 ) );
+	transactions.RunTimers( now + SIP_TL );
+	BOOST_CHECK_EQUAL( transactions.Size(), 0u );
+
+	//A call ringing for longer than 64*T1 is still there to answer; one that rings on past Timer C is given up on
+	now += SIP_TL;
+	transactions.Receive( invite, Nowhere(), false, now );
+	transactions.Respond( invite, Answer( INVITE, 180, "Ringing" ), Nowhere(), now );
+	transactions.RunTimers( now + SIP_TH * 2 );
+	BOOST_CHECK_EQUAL( transactions.GetState( invite ), ServerTransactions::STATE_PROCEEDING );
+	transactions.Respond( invite, Answer( INVITE, 200, "OK" ), Nowhere(), now + SIP_TH * 2 );
+	BOOST_CHECK_EQUAL( transactions.GetState( invite ), ServerTransactions::STATE_ACCEPTED );
+	transactions.RunTimers( now + SIP_TH * 2 + SIP_TL );
+	BOOST_CHECK_EQUAL( transactions.Size(), 0u );
+	now += SIP_TH * 2 + SIP_TL;
+	transactions.Receive( invite, Nowhere(), false, now );
+	transactions.Respond( invite, Answer( INVITE, 180, "Ringing" ), Nowhere(), now );
+	transactions.RunTimers( now + SIP_TC - 1 );
+	BOOST_CHECK_EQUAL( transactions.Size(), 1u );
+	transactions.RunTimers( now + SIP_TC );
+	BOOST_CHECK_EQUAL( transactions.Size(), 0u );
+	BOOST_CHECK_EQUAL( transactions.GetStats().abandoned, 1u );
+
+	//A UAS slow to say anything: the retransmitted INVITE gets a 100 Trying, and so does the next, from the same bytes
+	now += SIP_TC;
+	sender.sent.clear();
+	BOOST_CHECK( !transactions.Receive( invite, Nowhere(), false, now ) );
+	BOOST_CHECK( sender.sent.empty() );
+	BOOST_CHECK( transactions.Receive( invite, Nowhere(), false, now + SIP_T1 ) );
+	BOOST_REQUIRE_EQUAL( sender.sent.size(), 1u );
+	SipResponse trying( sender.sent[0] );
+	BOOST_CHECK_EQUAL( trying.StatusCode(), 100 );
+	BOOST_CHECK( transactions.Receive( invite, Nowhere(), false, now + SIP_T1 * 3 ) );
+	BOOST_REQUIRE_EQUAL( sender.sent.size(), 2u );
+	BOOST_CHECK_EQUAL( sender.sent[1], sender.sent[0] );
+	BOOST_CHECK_EQUAL( transactions.GetStats().trying, 1u );
+	transactions.Respond( invite, Answer( INVITE, 200, "OK" ), Nowhere(), now + SIP_T1 * 4 );
+	BOOST_CHECK( transactions.Receive( invite, Nowhere(), false, now + SIP_T1 * 5 ) );
+	BOOST_REQUIRE_EQUAL( sender.sent.size(), 4u );
+	BOOST_CHECK_EQUAL( SipResponse( sender.sent[3] ).StatusCode(), 200 );
+}
+
+BOOST_AUTO_TEST_CASE( server_transaction_filter ) {
+	Reactor reactor;
+	RecordingSender sender;
+	CountingHandler uas;
+	ServerTransactionFilter filter( reactor, sender, uas );
+	sockaddr_storage phone = Nowhere();
+
+	for ( int i = 0; i < 3; ++i )
+	{
+		auto_ptr<SipMessage> request( new SipRequest( OPTIONS ) );
+		filter.OnMessage( request, phone, -1 );
+		if ( i == 0 )
+			BOOST_CHECK( filter.Respond( static_cast<SipRequest&>( *request ), SipResponse( 200, "OK", SipRequest( OPTIONS ) ), phone ) );
+	}
+	auto_ptr<SipMessage> response( new SipResponse( Answer( INVITE, 180, "Ringing" ) ) );
+	filter.OnMessage( response, phone, -1 );
+
+	BOOST_CHECK_EQUAL( uas.requests, 1 );
+	BOOST_CHECK_EQUAL( uas.responses, 1 );
+	BOOST_CHECK_EQUAL( sender.sent.size(), 3u );
+	BOOST_CHECK_EQUAL( filter.GetStats().absorbed, 2u );
+	BOOST_CHECK_EQUAL( filter.Size(), 1u );
+}
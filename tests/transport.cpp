@@ -0,0 +1,1037 @@
+#include <boost/test/unit_test.hpp>
+#include <boost/thread.hpp>
+#include <cstring>
+#include <sstream>
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <unistd.h>
+#include "../transport/Reactor.hpp"
+#include "../transport/UdpTransport.hpp"
+#include "../transport/UdpWorkers.hpp"
+#include "../transport/IngressWorkers.hpp"
+#include "../transport/SpscRing.hpp"
+#include "../transport/TcpTransport.hpp"
+#include "../SipUtility.hpp"
+#include "../SipRequest.hpp"
+
+using namespace Sip;
+using namespace std;
+
+extern const char* sip_messages[];
+
+namespace {
+
+class CountingHandler : public SipMessageHandler
+{
+	public:
+		CountingHandler() : messages( 0 ), parseErrors( 0 ) {}
+
+		void OnMessage( auto_ptr<SipMessage>& message, const sockaddr_storage& source, int socket )
+		{
+			++messages;
+			lastSource = source;
+		}
+
+		void OnParseError( const SipMessageException& error, const sockaddr_storage& source, int socket )
+		{
+			++parseErrors;
+		}
+
+		int messages, parseErrors;
+		sockaddr_storage lastSource;
+};
+
+/**
+* \class EchoHandler
+* \brief Queues a reply to every message so replies leave in the same batch as the requests arrived
+*/
+class EchoHandler : public CountingHandler
+{
+	public:
+		EchoHandler( UdpTransport*& transport ) : m_transport( transport ) {}
+
+		void OnMessage( auto_ptr<SipMessage>& message, const sockaddr_storage& source, int socket )
+		{
+			CountingHandler::OnMessage( message, source, socket );
+			m_transport->Queue( socket, "pong", source );
+		}
+
+	private:
+		UdpTransport*& m_transport;
+};
+
+sockaddr_in Loopback( unsigned short port )
+{
+	sockaddr_in address;
+	memset( &address, 0, sizeof( address ) );
+	address.sin_family = AF_INET;
+	address.sin_port = htons( port );
+	address.sin_addr.s_addr = htonl( INADDR_LOOPBACK );
+	return address;
+}
+
+}; //namespace
+
+BOOST_AUTO_TEST_CASE( udp_transport_loopback ) {
+	Reactor reactor;
+	CountingHandler handler;
+	UdpTransport transport( reactor, handler );
+
+	//Nothing to read is not an error
+	BOOST_CHECK_EQUAL( reactor.RunOnce( 0 ), 0u );
+
+	int first = transport.Listen( "127.0.0.1", 0 ), second = transport.Listen( "127.0.0.1", 0 );
+	BOOST_REQUIRE( UdpTransport::LocalPort( first ) != 0 );
+	BOOST_REQUIRE_EQUAL( transport.Sockets().size(), 2u );
+
+	int client = socket( AF_INET, SOCK_DGRAM, 0 );
+	BOOST_REQUIRE( client != -1 );
+	sockaddr_in firstAddress = Loopback( UdpTransport::LocalPort( first ) );
+	sockaddr_in secondAddress = Loopback( UdpTransport::LocalPort( second ) );
+
+	//Several datagrams per socket must all come out of a single edge-triggered wakeup
+	const int perSocket = 5;
+	for ( int i = 0; i < perSocket; ++i )
+	{
+		sendto( client, sip_messages[0], strlen( sip_messages[0] ), 0, reinterpret_cast<sockaddr*>( &firstAddress ), sizeof( firstAddress ) );
+		sendto( client, sip_messages[1], strlen( sip_messages[1] ), 0, reinterpret_cast<sockaddr*>( &secondAddress ), sizeof( secondAddress ) );
+	}
+	const char garbage[] = "not a sip message";
+	sendto( client, garbage, sizeof( garbage ), 0, reinterpret_cast<sockaddr*>( &firstAddress ), sizeof( firstAddress ) );
+
+	for ( int wakeups = 0; wakeups < 10 && handler.messages + handler.parseErrors < 2 * perSocket + 1; ++wakeups )
+		reactor.RunOnce( 1000 );
+
+	BOOST_CHECK_EQUAL( handler.messages, 2 * perSocket );
+	BOOST_CHECK_EQUAL( handler.parseErrors, 1 );
+	BOOST_CHECK_EQUAL( transport.GetStats().datagrams, 2u * perSocket + 1 );
+	BOOST_CHECK( transport.GetStats().wakeups <= 4u );
+	BOOST_CHECK_EQUAL( handler.lastSource.ss_family, AF_INET );
+
+	//Replies go out through the listening socket, so the peer sees the port it sent to
+	BOOST_CHECK( transport.Send( first, "pong", handler.lastSource ) );
+	char reply[ 16 ];
+	sockaddr_in from;
+	socklen_t fromLength = sizeof( from );
+	ssize_t received = recvfrom( client, reply, sizeof( reply ), 0, reinterpret_cast<sockaddr*>( &from ), &fromLength );
+	BOOST_CHECK_EQUAL( received, 4 );
+	BOOST_CHECK_EQUAL( ntohs( from.sin_port ), UdpTransport::LocalPort( first ) );
+	close( client );
+
+	BOOST_CHECK_THROW( transport.Listen( "not an address", 0 ), TransportException );
+}
+
+BOOST_AUTO_TEST_CASE( udp_transport_batching ) {
+	Reactor reactor;
+	UdpTransport* transport = NULL;
+	EchoHandler handler( transport );
+	const unsigned int batch = 4;
+	UdpTransport batched( reactor, handler, batch );
+	transport = &batched;
+	BOOST_CHECK_EQUAL( batched.BatchSize(), batch );
+
+	int server = batched.Listen( "127.0.0.1", 0 );
+	sockaddr_in serverAddress = Loopback( UdpTransport::LocalPort( server ) );
+	int client = socket( AF_INET, SOCK_DGRAM, 0 );
+	BOOST_REQUIRE( client != -1 );
+
+	//More than two batches' worth, so the drain loop has to go round and end on a short batch
+	const int datagrams = 10;
+	for ( int i = 0; i < datagrams; ++i )
+		sendto( client, sip_messages[0], strlen( sip_messages[0] ), 0, reinterpret_cast<sockaddr*>( &serverAddress ), sizeof( serverAddress ) );
+
+	for ( int wakeups = 0; wakeups < 10 && handler.messages < datagrams; ++wakeups )
+		reactor.RunOnce( 1000 );
+	BOOST_REQUIRE_EQUAL( handler.messages, datagrams );
+
+	//Every datagram is accounted for in the histogram, and no call read more than a batch
+	const UdpTransport::Stats& stats = batched.GetStats();
+	BOOST_REQUIRE_EQUAL( stats.receiveBatches.size(), batch + 1 );
+	uint64_t histogrammed = 0, calls = 0;
+	for ( size_t n = 0; n < stats.receiveBatches.size(); ++n )
+	{
+		histogrammed += n * stats.receiveBatches[n];
+		calls += stats.receiveBatches[n];
+	}
+	BOOST_CHECK_EQUAL( histogrammed, static_cast<uint64_t>( datagrams ) );
+	BOOST_CHECK( stats.receiveBatches[batch] >= 2u );
+	BOOST_CHECK( calls <= stats.receiveCalls );
+
+	//Replies queued while handling went out once dispatch finished, a batch per sendmmsg
+	BOOST_CHECK_EQUAL( stats.sent, static_cast<uint64_t>( datagrams ) );
+	BOOST_CHECK_EQUAL( stats.sendErrors, 0u );
+	BOOST_CHECK( stats.sendCalls < static_cast<uint64_t>( datagrams ) );
+	histogrammed = 0;
+	for ( size_t n = 0; n < stats.sendBatches.size(); ++n )
+		histogrammed += n * stats.sendBatches[n];
+	BOOST_CHECK_EQUAL( histogrammed, static_cast<uint64_t>( datagrams ) );
+
+	char reply[ 16 ];
+	int replies = 0;
+	while ( recv( client, reply, sizeof( reply ), MSG_DONTWAIT ) == 4 )
+		++replies;
+	BOOST_CHECK_EQUAL( replies, datagrams );
+	close( client );
+
+	//Nothing queued means nothing sent
+	batched.Flush();
+	BOOST_CHECK_EQUAL( batched.GetStats().sent, static_cast<uint64_t>( datagrams ) );
+}
+
+BOOST_AUTO_TEST_CASE( udp_transport_send_socket ) {
+	Reactor reactor;
+	CountingHandler handler;
+	UdpTransport transport( reactor, handler );
+
+	sockaddr_storage destination;
+	transport.Resolve( URI( "sip:alice@127.0.0.1" ), destination );
+	BOOST_CHECK_EQUAL( destination.ss_family, AF_INET );
+	BOOST_CHECK_EQUAL( ntohs( reinterpret_cast<sockaddr_in&>( destination ).sin_port ), DEFAULT_UDP_LISTENPORT );
+	BOOST_CHECK_THROW( transport.Resolve( URI( "sips:alice@127.0.0.1" ), destination ), TransportException );
+
+	//No socket for the family means nothing to send through
+	BOOST_CHECK_EQUAL( transport.SocketFor( destination ), -1 );
+	BOOST_CHECK( !transport.Send( "ping", destination ) );
+
+	int wildcard = transport.Listen( "0.0.0.0", 0 ), loopback = transport.Listen( "127.0.0.1", 0 );
+
+	//The socket on the destination's subnet wins over the wildcard; anything else takes the wildcard
+	BOOST_CHECK_EQUAL( transport.SocketFor( destination ), loopback );
+	sockaddr_storage elsewhere;
+	transport.Resolve( "192.0.2.1", 5060, elsewhere );
+	BOOST_CHECK_EQUAL( transport.SocketFor( elsewhere ), wildcard );
+
+	int client = socket( AF_INET, SOCK_DGRAM, 0 );
+	BOOST_REQUIRE( client != -1 );
+	sockaddr_in clientAddress = Loopback( 0 );
+	BOOST_REQUIRE( bind( client, reinterpret_cast<sockaddr*>( &clientAddress ), sizeof( clientAddress ) ) == 0 );
+	transport.Resolve( "127.0.0.1", UdpTransport::LocalPort( client ), destination );
+
+	//Both the immediate and the queued path leave from the listening port
+	BOOST_CHECK( transport.Send( "ping", destination ) );
+	BOOST_CHECK( transport.Queue( "pong", destination ) );
+	transport.Flush();
+	for ( int i = 0; i < 2; ++i )
+	{
+		char reply[ 16 ];
+		sockaddr_in from;
+		socklen_t fromLength = sizeof( from );
+		BOOST_CHECK_EQUAL( recvfrom( client, reply, sizeof( reply ), 0, reinterpret_cast<sockaddr*>( &from ), &fromLength ), 4 );
+		BOOST_CHECK_EQUAL( ntohs( from.sin_port ), UdpTransport::LocalPort( loopback ) );
+	}
+	close( client );
+}
+
+BOOST_AUTO_TEST_CASE( udp_transport_oversize ) {
+	Reactor reactor;
+	CountingHandler handler;
+	UdpTransport transport( reactor, handler, 4 );
+	int server = transport.Listen( "127.0.0.1", 0 );
+	sockaddr_in serverAddress = Loopback( UdpTransport::LocalPort( server ) );
+	int client = socket( AF_INET, SOCK_DGRAM, 0 );
+	BOOST_REQUIRE( client != -1 );
+
+	//One message fits a slab; the other runs past it into the overflow area and must still arrive whole
+	string small( sip_messages[0] ), large( small );
+	large.insert( large.find( "\r\n" ) + 2, "Subject: " + string( SIP_RECEIVE_SLAB_SIZE, 'a' ) + "\r\n" );
+	sendto( client, small.data(), small.length(), 0, reinterpret_cast<sockaddr*>( &serverAddress ), sizeof( serverAddress ) );
+	sendto( client, large.data(), large.length(), 0, reinterpret_cast<sockaddr*>( &serverAddress ), sizeof( serverAddress ) );
+	sendto( client, small.data(), small.length(), 0, reinterpret_cast<sockaddr*>( &serverAddress ), sizeof( serverAddress ) );
+
+	for ( int wakeups = 0; wakeups < 10 && handler.messages + handler.parseErrors < 3; ++wakeups )
+		reactor.RunOnce( 1000 );
+	close( client );
+
+	BOOST_CHECK_EQUAL( handler.messages, 3 );
+	BOOST_CHECK_EQUAL( handler.parseErrors, 0 );
+	BOOST_CHECK_EQUAL( transport.GetStats().oversize, 1u );
+	BOOST_CHECK_EQUAL( transport.GetStats().truncated, 0u );
+	BOOST_CHECK_EQUAL( transport.GetStats().bytes, 2 * small.length() + large.length() );
+
+	//Handled messages gave their slabs back, so the pool stops growing once every batch entry has one
+	BOOST_CHECK( transport.Pool().GetStats().allocated <= transport.BatchSize() + 2u );
+}
+
+namespace {
+
+/**
+* \class CountingFactory
+* \brief Gives every worker a CountingHandler and keeps track of them
+*/
+class CountingFactory : public SipMessageHandlerFactory
+{
+	public:
+		SipMessageHandler* Create( unsigned int worker, UdpTransport& transport )
+		{
+			handlers.push_back( new CountingHandler() );
+			return handlers.back();
+		}
+
+		vector<CountingHandler*> handlers; //Owned by the workers
+};
+
+}; //namespace
+
+BOOST_AUTO_TEST_CASE( udp_workers_steering ) {
+	CountingFactory factory;
+	UdpWorkers workers( factory, 2 );
+	BOOST_REQUIRE_EQUAL( workers.Workers(), 2u );
+	BOOST_REQUIRE_EQUAL( factory.handlers.size(), 2u );
+
+	unsigned short port = workers.Listen( "127.0.0.1", 0, true );
+	BOOST_REQUIRE( port != 0 );
+	BOOST_CHECK_EQUAL( UdpTransport::LocalPort( workers.Transport( 1 ).Sockets()[0] ), port );
+	workers.Start();
+
+	//Two sources that hash to different workers; every datagram from one must land on the same worker
+	sockaddr_in sources[] = { Loopback( 0 ), Loopback( 0 ) };
+	sources[1].sin_addr.s_addr = htonl( INADDR_LOOPBACK + 1 );
+	unsigned int expected[ 2 ];
+	sockaddr_in server = Loopback( port );
+	const int perSource = 10;
+	for ( int i = 0; i < 2; ++i )
+	{
+		expected[i] = UdpWorkers::WorkerFor( reinterpret_cast<sockaddr_storage&>( sources[i] ), 2 );
+		int client = socket( AF_INET, SOCK_DGRAM, 0 );
+		BOOST_REQUIRE( bind( client, reinterpret_cast<sockaddr*>( &sources[i] ), sizeof( sources[i] ) ) == 0 );
+		for ( int j = 0; j < perSource; ++j )
+			sendto( client, sip_messages[0], strlen( sip_messages[0] ), 0, reinterpret_cast<sockaddr*>( &server ), sizeof( server ) );
+		close( client );
+	}
+	BOOST_REQUIRE( expected[0] != expected[1] );
+
+	boost::this_thread::sleep( boost::posix_time::milliseconds( 300 ) );
+	workers.Stop();
+	BOOST_CHECK_EQUAL( factory.handlers[ expected[0] ]->messages, perSource );
+	BOOST_CHECK_EQUAL( factory.handlers[ expected[1] ]->messages, perSource );
+	BOOST_CHECK_EQUAL( workers.Transport( 0 ).GetStats().datagrams + workers.Transport( 1 ).GetStats().datagrams, 2u * perSource );
+}
+
+BOOST_AUTO_TEST_CASE( reactor_stop ) {
+	//Stop() from another thread wakes a Run() that would otherwise wait forever
+	Reactor reactor;
+	boost::thread running( boost::bind( &Reactor::Run, &reactor, -1 ) );
+	boost::this_thread::sleep( boost::posix_time::milliseconds( 50 ) );
+	reactor.Stop();
+	BOOST_CHECK( running.timed_join( boost::posix_time::seconds( 5 ) ) );
+
+	//A Stop() before Run() still stops it, and the wakeup it left behind doesn't stop the next one
+	reactor.Stop();
+	reactor.Run( -1 );
+	BOOST_CHECK_EQUAL( reactor.RunOnce( 0 ), 0u );
+}
+
+namespace {
+
+/**
+* \class RingProducer
+* \brief Pushes 0 to count - 1 in batches, waiting whenever the ring is full
+*/
+struct RingProducer
+{
+	RingProducer( SpscRing<unsigned int>& ring, unsigned int count ) : m_ring( ring ), m_count( count ) {}
+
+	void operator()()
+	{
+		unsigned int batch[ 16 ], next = 0;
+		while ( next < m_count )
+		{
+			unsigned int size = 0;
+			while ( size < 16 && next + size < m_count )
+			{
+				batch[size] = next + size;
+				++size;
+			}
+			next += m_ring.Push( batch, size );
+		}
+	}
+
+	SpscRing<unsigned int>& m_ring;
+	unsigned int m_count;
+};
+
+/**
+* \class SharedCounter
+* \brief Counts messages from any number of threads
+*/
+class SharedCounter : public SipMessageHandler
+{
+	public:
+		SharedCounter() : messages( 0 ) {}
+
+		void OnMessage( auto_ptr<SipMessage>& message, const sockaddr_storage& source, int socket )
+		{
+			__atomic_add_fetch( &messages, 1, __ATOMIC_SEQ_CST );
+		}
+
+		int Messages() const { return __atomic_load_n( &messages, __ATOMIC_SEQ_CST ); }
+
+		int messages;
+};
+
+auto_ptr<SipMessage> RequestFor( const string& callId )
+{
+	string request( sip_messages[0] );
+	string::size_type begin = request.find( "Call-ID: " ) + 9;
+	request.replace( begin, request.find( "\r\n", begin ) - begin, callId );
+	auto_ptr<SipMessage> message;
+	Utility::ParseMessage( message, request );
+	return message;
+}
+
+bool WaitFor( const SharedCounter& counter, int messages )
+{
+	for ( int waits = 0; waits < 500 && counter.Messages() < messages; ++waits )
+		boost::this_thread::sleep( boost::posix_time::milliseconds( 10 ) );
+	return counter.Messages() == messages;
+}
+
+}; //namespace
+
+BOOST_AUTO_TEST_CASE( spsc_ring ) {
+	SpscRing<unsigned int> ring( 5 );
+	BOOST_REQUIRE_EQUAL( ring.Capacity(), 8u );
+
+	//A batch bigger than the room left goes in partly; the rest is rejected
+	unsigned int items[ 10 ] = { 0, 1, 2, 3, 4, 5, 6, 7, 8, 9 };
+	BOOST_CHECK_EQUAL( ring.Push( items, 10 ), 8u );
+	BOOST_CHECK( !ring.Push( 8 ) );
+	BOOST_CHECK_EQUAL( ring.Depth(), 8u );
+	BOOST_CHECK( ring.Congested() );
+
+	unsigned int popped[ 10 ];
+	BOOST_REQUIRE_EQUAL( ring.Pop( popped, 3 ), 3u );
+	BOOST_CHECK_EQUAL( popped[0], 0u );
+	BOOST_CHECK_EQUAL( popped[2], 2u );
+	BOOST_CHECK( !ring.Congested() );
+
+	//Around the end of the array and back
+	BOOST_CHECK_EQUAL( ring.Push( items + 8, 2 ), 2u );
+	BOOST_REQUIRE_EQUAL( ring.Pop( popped, 10 ), 7u );
+	for ( unsigned int i = 0; i < 7; ++i )
+		BOOST_CHECK_EQUAL( popped[i], i + 3 );
+	BOOST_CHECK_EQUAL( ring.Pop( popped, 10 ), 0u );
+
+	SpscRingStats stats = ring.GetStats();
+	BOOST_CHECK_EQUAL( stats.pushed, 10u );
+	BOOST_CHECK_EQUAL( stats.rejected, 3u );
+	BOOST_CHECK_EQUAL( stats.popped, 10u );
+	BOOST_CHECK_EQUAL( stats.maxDepth, 8u );
+
+	//Across threads, everything arrives once and in order
+	SpscRing<unsigned int> shared( 64 );
+	const unsigned int count = 200000;
+	RingProducer producer( shared, count );
+	boost::thread thread( boost::ref( producer ) );
+	unsigned int expected = 0;
+	bool ordered = true;
+	while ( expected < count )
+	{
+		unsigned int got = shared.Pop( popped, 10 );
+		for ( unsigned int i = 0; i < got; ++i )
+			ordered = ordered && popped[i] == expected++;
+	}
+	thread.join();
+	BOOST_CHECK( ordered );
+	BOOST_CHECK_EQUAL( shared.GetStats().popped, count );
+}
+
+BOOST_AUTO_TEST_CASE( ingress_workers ) {
+	SharedCounter handler, overflow;
+	{
+		//Not started, so the ring fills and the rest spills to the overflow handler
+		IngressWorkers ingress( handler, 2, 4, &overflow );
+		for ( int i = 0; i < 10; ++i )
+		{
+			auto_ptr<SipMessage> message = RequestFor( "same-call" );
+			ingress.OnMessage( message, sockaddr_storage(), -1 );
+		}
+		ingress.OnBatchComplete();
+
+		unsigned int worker = IngressWorkers::WorkerFor( "same-call", 2 );
+		BOOST_CHECK_EQUAL( overflow.Messages(), 6 );
+		BOOST_CHECK_EQUAL( ingress.Depth( worker ), 4u );
+		BOOST_CHECK_EQUAL( ingress.Depth( 1 - worker ), 0u );
+		BOOST_CHECK( ingress.Congested( worker ) );
+		BOOST_CHECK_EQUAL( ingress.GetStats( worker ).rejected, 6u );
+
+		ingress.Start();
+		BOOST_CHECK( WaitFor( handler, 4 ) );
+		ingress.Stop();
+		BOOST_CHECK_EQUAL( ingress.Depth( worker ), 0u );
+		BOOST_CHECK_EQUAL( ingress.GetStats( worker ).popped, 4u );
+	}
+
+	//Running, across many calls and batches
+	IngressWorkers ingress( handler, 2 );
+	ingress.Start();
+	const int messages = 1000;
+	for ( int i = 0; i < messages; ++i )
+	{
+		std::ostringstream callId;
+		callId << "call-" << i;
+		auto_ptr<SipMessage> message = RequestFor( callId.str() );
+		ingress.OnMessage( message, sockaddr_storage(), -1 );
+		if ( i % 32 == 31 )
+			ingress.OnBatchComplete();
+	}
+	ingress.OnBatchComplete();
+	BOOST_CHECK( WaitFor( handler, 4 + messages ) );
+	ingress.Stop();
+	BOOST_CHECK( ingress.GetStats( 0 ).pushed > 0 && ingress.GetStats( 1 ).pushed > 0 );
+	BOOST_CHECK_EQUAL( ingress.GetStats( 0 ).pushed + ingress.GetStats( 1 ).pushed, static_cast<uint64_t>( messages ) );
+	BOOST_CHECK_EQUAL( ingress.GetStats( 0 ).rejected + ingress.GetStats( 1 ).rejected, 0u );
+}
+
+namespace {
+
+const char TCP_REPLY[] = "SIP/2.0 200 OK\r\nContent-Length: 0\r\n\r\n";
+
+/**
+* \class TcpEchoHandler
+* \brief Replies to every message over the connection it came in on
+*/
+class TcpEchoHandler : public CountingHandler
+{
+	public:
+		TcpEchoHandler() : transport( NULL ), lastSocket( -1 ) {}
+
+		void OnMessage( auto_ptr<SipMessage>& message, const sockaddr_storage& source, int socket )
+		{
+			CountingHandler::OnMessage( message, source, socket );
+			lastSocket = socket;
+			if ( message->Type == SipMessage::MT_REQUEST )
+				transport->Send( socket, TCP_REPLY );
+		}
+
+		TcpTransport* transport;
+		int lastSocket;
+};
+
+string WithVia( const string& via )
+{
+	string request( sip_messages[0] );
+	string::size_type begin = request.find( "Via: " ) + 5;
+	return request.replace( begin, request.find( "\r\n", begin ) - begin, via );
+}
+
+/**
+ *     Runs the reactor until handler has seen messages, or a second has passed
+ */
+void RunUntil( Reactor& reactor, const CountingHandler& handler, int messages )
+{
+	for ( int wakeups = 0; wakeups < 20 && handler.messages + handler.parseErrors < messages; ++wakeups )
+		reactor.RunOnce( 50 );
+}
+
+}; //namespace
+
+BOOST_AUTO_TEST_CASE( tcp_transport_framing ) {
+	Reactor reactor;
+	TcpEchoHandler handler;
+	TcpTransport transport( reactor, handler );
+	handler.transport = &transport;
+	sockaddr_in server = Loopback( UdpSockets::LocalPort( transport.Listen( "127.0.0.1", 0 ) ) );
+
+	int client = socket( AF_INET, SOCK_STREAM, 0 );
+	BOOST_REQUIRE( connect( client, reinterpret_cast<sockaddr*>( &server ), sizeof( server ) ) == 0 );
+	timeval timeout = { 1, 0 };
+	setsockopt( client, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof( timeout ) );
+
+	//Two messages pipelined in one segment, a ping, and a third split mid-header
+	string request( WithVia( "SIP/2.0/TCP 127.0.0.1:5070;branch=z9hG4bK1;alias" ) );
+	string burst = request + request + "\r\n\r\n" + request.substr( 0, 40 );
+	BOOST_REQUIRE_EQUAL( write( client, burst.data(), burst.length() ), static_cast<ssize_t>( burst.length() ) );
+	RunUntil( reactor, handler, 2 );
+	BOOST_CHECK_EQUAL( handler.messages, 2 );
+	BOOST_REQUIRE_EQUAL( write( client, request.data() + 40, request.length() - 40 ), static_cast<ssize_t>( request.length() - 40 ) );
+	RunUntil( reactor, handler, 3 );
+	BOOST_CHECK_EQUAL( handler.messages, 3 );
+	BOOST_CHECK_EQUAL( transport.GetStats().parseErrors, 0u );
+
+	//Replies and the pong come back on the same connection, the first burst's in one write. The pong is queued while
+	//framing, so it goes ahead of the replies the handler queues afterwards.
+	string expected = string( "\r\n" ) + TCP_REPLY + TCP_REPLY + TCP_REPLY, replies;
+	char buffer[ 512 ];
+	while ( replies.length() < expected.length() )
+	{
+		ssize_t received = read( client, buffer, sizeof( buffer ) );
+		if ( received <= 0 )
+			break;
+		replies.append( buffer, received );
+	}
+	BOOST_CHECK_EQUAL( replies, expected );
+	BOOST_CHECK_EQUAL( transport.GetStats().writes, 2u );
+
+	//The connection is known by its address and by the Via alias, and sends to either reuse it
+	BOOST_CHECK_EQUAL( transport.Connections(), 1u );
+	BOOST_CHECK_EQUAL( transport.ConnectionFor( handler.lastSource ), handler.lastSocket );
+	BOOST_CHECK_EQUAL( transport.ConnectionFor( "127.0.0.1:5070" ), handler.lastSocket );
+	BOOST_CHECK( transport.Send( TCP_REPLY, "127.0.0.1:5070" ) );
+	BOOST_CHECK( transport.Send( TCP_REPLY, handler.lastSource ) );
+	transport.Flush();
+	BOOST_CHECK_EQUAL( transport.GetStats().reused, 2u );
+	BOOST_CHECK_EQUAL( transport.GetStats().connected, 0u );
+
+	//A message without Content-Length can't be framed on a stream, so the connection goes
+	string unframed( request );
+	unframed.erase( unframed.find( "Content-Length" ), unframed.find( "\r\n", unframed.find( "Content-Length" ) ) + 2 - unframed.find( "Content-Length" ) );
+	write( client, unframed.data(), unframed.length() );
+	for ( int wakeups = 0; wakeups < 20 && transport.Connections() > 0; ++wakeups )
+		reactor.RunOnce( 50 );
+	BOOST_CHECK_EQUAL( transport.Connections(), 0u );
+	BOOST_CHECK_EQUAL( transport.GetStats().framingErrors, 1u );
+	BOOST_CHECK_EQUAL( transport.ConnectionFor( "127.0.0.1:5070" ), -1 );
+	close( client );
+}
+
+BOOST_AUTO_TEST_CASE( tcp_transport_connect ) {
+	Reactor reactor;
+	TcpEchoHandler serverHandler, clientHandler;
+	TcpTransport server( reactor, serverHandler ), client( reactor, clientHandler );
+	serverHandler.transport = &server;
+	clientHandler.transport = &client;
+	sockaddr_in serverAddress = Loopback( UdpSockets::LocalPort( server.Listen( "127.0.0.1", 0 ) ) );
+	sockaddr_storage destination;
+	memset( &destination, 0, sizeof( destination ) );
+	memcpy( &destination, &serverAddress, sizeof( serverAddress ) );
+
+	//Requests sent before the connect completes wait for it, and later ones reuse the connection
+	string request( WithVia( "SIP/2.0/TCP 127.0.0.1:5070;branch=z9hG4bK2" ) );
+	BOOST_CHECK( client.Send( request, destination ) );
+	BOOST_CHECK( client.Send( request, destination ) );
+	RunUntil( reactor, serverHandler, 2 );
+	BOOST_CHECK( client.Send( request, destination ) );
+	RunUntil( reactor, serverHandler, 3 );
+	RunUntil( reactor, clientHandler, 3 );
+
+	BOOST_CHECK_EQUAL( serverHandler.messages, 3 );
+	BOOST_CHECK_EQUAL( clientHandler.messages, 3 );
+	BOOST_CHECK_EQUAL( client.GetStats().connected, 1u );
+	BOOST_CHECK_EQUAL( client.GetStats().reused, 2u );
+	BOOST_CHECK_EQUAL( server.GetStats().accepted, 1u );
+	BOOST_CHECK_EQUAL( client.ConnectionFor( destination ), clientHandler.lastSocket );
+
+	//A refused connect is closed without taking anything down with it
+	sockaddr_in nobody = Loopback( 1 );
+	memcpy( &destination, &nobody, sizeof( nobody ) );
+	client.Send( request, destination );
+	for ( int wakeups = 0; wakeups < 20 && client.Connections() > 1; ++wakeups )
+		reactor.RunOnce( 50 );
+	BOOST_CHECK_EQUAL( client.Connections(), 1u );
+}
+
+#include "../transport/WebSocket.hpp"
+
+namespace {
+
+const char WS_UPGRADE[] = "GET /sip HTTP/1.1\r\nHost: example.com\r\nUpgrade: websocket\r\nConnection: Upgrade\r\n"
+	"Sec-WebSocket-Key: dGhlIHNhbXBsZSBub25jZQ==\r\nSec-WebSocket-Version: 13\r\nSec-WebSocket-Protocol: sip\r\n\r\n";
+
+/**
+ *     A frame as a browser sends it: masked, with a fixed key
+ */
+string Masked( unsigned int opcode, const string& payload, bool final = true )
+{
+	static const unsigned char key[4] = { 0x37, 0xFA, 0x21, 0x3D };
+	string frame( WebSocket::Header( opcode, payload.length() ) );
+	frame[0] = static_cast<char>( ( final ? 0x80 : 0 ) | opcode );
+	frame[1] = static_cast<char>( frame[1] | 0x80 );
+	frame.append( reinterpret_cast<const char*>( key ), 4 );
+	string masked( payload );
+	for ( size_t i = 0; i < masked.length(); ++i )
+		masked[i] ^= key[i & 3];
+	return frame + masked;
+}
+
+/**
+ *     A plain TCP connection to a local port
+ */
+int ConnectTo( unsigned short port )
+{
+	sockaddr_in address = Loopback( port );
+	int sock = socket( AF_INET, SOCK_STREAM, 0 );
+	connect( sock, reinterpret_cast<sockaddr*>( &address ), sizeof( address ) );
+	return sock;
+}
+
+/**
+ *     Runs the reactor a little, then takes whatever has arrived on socket
+ */
+string Drain( Reactor& reactor, int socket )
+{
+	string received;
+	char buffer[4096];
+	for ( int wakeups = 0; wakeups < 10; ++wakeups )
+	{
+		reactor.RunOnce( 20 );
+		ssize_t length;
+		while ( ( length = recv( socket, buffer, sizeof( buffer ), MSG_DONTWAIT ) ) > 0 )
+			received.append( buffer, length );
+		if ( !received.empty() )
+			break;
+	}
+	return received;
+}
+
+}; //namespace
+
+BOOST_AUTO_TEST_CASE( websocket_framing ) {
+	//RFC 6455 1.3
+	BOOST_CHECK_EQUAL( WebSocket::AcceptKey( "dGhlIHNhbXBsZSBub25jZQ==" ), "s3pPLMBiTxaQ9kYGzzhZRbK+xOo=" );
+
+	WebSocket::Frame frame;
+	BOOST_CHECK_EQUAL( WebSocket::ParseHeader( WebSocket::Header( WebSocket::OP_TEXT, 125 ).data(), 2, frame ), 2u );
+	BOOST_CHECK_EQUAL( frame.length, 125u );
+	BOOST_CHECK( frame.final && !frame.masked );
+	string header( WebSocket::Header( WebSocket::OP_BINARY, 70000 ) );
+	BOOST_CHECK_EQUAL( WebSocket::ParseHeader( header.data(), 9, frame ), 0u );
+	BOOST_CHECK_EQUAL( WebSocket::ParseHeader( header.data(), header.length(), frame ), 10u );
+	BOOST_CHECK_EQUAL( frame.length, 70000u );
+	BOOST_CHECK_EQUAL( frame.opcode, static_cast<unsigned int>( WebSocket::OP_BINARY ) );
+	string masked( Masked( WebSocket::OP_TEXT, string( 300, 'x' ) ) );
+	BOOST_CHECK_EQUAL( WebSocket::ParseHeader( masked.data(), masked.length(), frame ), 8u );
+	BOOST_CHECK( frame.masked );
+	BOOST_CHECK_EQUAL( frame.length, 300u );
+
+	//The vector kernel agrees with byte-at-a-time XOR at every length and alignment
+	const unsigned char key[4] = { 0xA1, 0x02, 0x7F, 0xC4 };
+	for ( size_t start = 0; start < 4; ++start )
+		for ( size_t length = 0; length < 200; ++length )
+		{
+			string data( start + length, '\0' ), expected;
+			for ( size_t i = 0; i < data.length(); ++i )
+				data[i] = static_cast<char>( i * 7 + length );
+			expected = data;
+			for ( size_t i = 0; i < length; ++i )
+				expected[start + i] ^= key[i & 3];
+			WebSocket::Unmask( &data[start], length, key );
+			BOOST_CHECK( data == expected );
+		}
+}
+
+BOOST_AUTO_TEST_CASE( websocket_transport ) {
+	Reactor reactor;
+	TcpEchoHandler handler;
+	TcpTransport server( reactor, handler );
+	handler.transport = &server;
+	unsigned short port = UdpSockets::LocalPort( server.Listen( "127.0.0.1", 0, TcpTransport::FRAMING_WEBSOCKET ) );
+
+	int browser = ConnectTo( port );
+	BOOST_CHECK( write( browser, WS_UPGRADE, strlen( WS_UPGRADE ) ) > 0 );
+	string response( Drain( reactor, browser ) );
+	BOOST_CHECK_EQUAL( response.compare( 0, 12, "HTTP/1.1 101" ), 0 );
+	BOOST_CHECK( response.find( "Sec-WebSocket-Accept: s3pPLMBiTxaQ9kYGzzhZRbK+xOo=\r\n" ) != string::npos );
+	BOOST_CHECK( response.find( "Sec-WebSocket-Protocol: sip\r\n" ) != string::npos );
+	BOOST_CHECK_EQUAL( server.GetStats().upgrades, 1u );
+
+	//A whole message, a ping, and a message in two fragments, in one write
+	string request( WithVia( "SIP/2.0/WS df7jal23ls0d.invalid;branch=z9hG4bK4" ) );
+	string frames( Masked( WebSocket::OP_TEXT, request ) + Masked( WebSocket::OP_PING, "hi" ) +
+		Masked( WebSocket::OP_TEXT, request.substr( 0, 100 ), false ) + Masked( WebSocket::OP_CONTINUATION, request.substr( 100 ) ) );
+	BOOST_CHECK( write( browser, frames.data(), frames.length() ) > 0 );
+	RunUntil( reactor, handler, 2 );
+	BOOST_CHECK_EQUAL( handler.messages, 2 );
+	BOOST_CHECK_EQUAL( handler.parseErrors, 0 );
+
+	//The pong is queued while framing, ahead of the replies; each reply is one unmasked text frame
+	string replies( Drain( reactor, browser ) );
+	string expected( WebSocket::Header( WebSocket::OP_PONG, 2 ) + "hi" );
+	for ( int i = 0; i < 2; ++i )
+		expected += WebSocket::Header( WebSocket::OP_TEXT, strlen( TCP_REPLY ) ) + TCP_REPLY;
+	BOOST_CHECK( replies == expected );
+
+	//An unmasked frame from a client breaks the protocol and loses the connection
+	string unmasked( WebSocket::Header( WebSocket::OP_TEXT, request.length() ) + request );
+	BOOST_CHECK( write( browser, unmasked.data(), unmasked.length() ) > 0 );
+	for ( int wakeups = 0; wakeups < 20 && server.Connections() > 0; ++wakeups )
+		reactor.RunOnce( 50 );
+	BOOST_CHECK_EQUAL( server.Connections(), 0u );
+	BOOST_CHECK_EQUAL( server.GetStats().framingErrors, 1u );
+	close( browser );
+
+	//An upgrade that doesn't ask for the sip subprotocol is refused
+	browser = ConnectTo( port );
+	string withoutSip( WS_UPGRADE );
+	withoutSip.erase( withoutSip.find( "Sec-WebSocket-Protocol" ), strlen( "Sec-WebSocket-Protocol: sip\r\n" ) );
+	BOOST_CHECK( write( browser, withoutSip.data(), withoutSip.length() ) > 0 );
+	BOOST_CHECK_EQUAL( Drain( reactor, browser ).compare( 0, 12, "HTTP/1.1 400" ), 0 );
+	BOOST_CHECK_EQUAL( server.GetStats().upgrades, 1u );
+	close( browser );
+}
+
+BOOST_AUTO_TEST_CASE( tcp_pings_over_limit ) {
+	Reactor reactor;
+	TcpEchoHandler handler;
+	TcpTransport transport( reactor, handler, 3 );
+	handler.transport = &transport;
+	int client = ConnectTo( UdpSockets::LocalPort( transport.Listen( "127.0.0.1", 0 ) ) );
+
+	//Only one pong fits; the rest are dropped rather than closing the connection while it is being framed
+	string pings( "\r\n\r\n\r\n\r\n\r\n\r\n" );
+	BOOST_REQUIRE_EQUAL( write( client, pings.data(), pings.length() ), static_cast<ssize_t>( pings.length() ) );
+	BOOST_CHECK_EQUAL( Drain( reactor, client ), "\r\n" );
+	BOOST_CHECK_EQUAL( transport.Connections(), 1u );
+	BOOST_CHECK_EQUAL( transport.GetStats().sendErrors, 0u );
+	close( client );
+}
+
+BOOST_AUTO_TEST_CASE( websocket_pings_over_limit ) {
+	Reactor reactor;
+	TcpEchoHandler handler;
+	TcpTransport server( reactor, handler, 300 );
+	handler.transport = &server;
+	unsigned short port = UdpSockets::LocalPort( server.Listen( "127.0.0.1", 0, TcpTransport::FRAMING_WEBSOCKET ) );
+
+	//The upgrade and more pongs than fit, all answered while one read is framed: the pongs that don't fit are
+	//dropped, and the connection isn't closed from under the framing
+	int browser = ConnectTo( port );
+	string flood( WS_UPGRADE );
+	for ( int i = 0; i < 5; ++i )
+		flood += Masked( WebSocket::OP_PING, string( 100, 'p' ) );
+	BOOST_CHECK( write( browser, flood.data(), flood.length() ) > 0 );
+	string response( Drain( reactor, browser ) );
+	BOOST_CHECK_EQUAL( response.compare( 0, 12, "HTTP/1.1 101" ), 0 );
+	string pong( WebSocket::Header( WebSocket::OP_PONG, 100 ) + string( 100, 'p' ) );
+	string::size_type pongs = response.find( "\r\n\r\n" ) + 4;
+	BOOST_CHECK( pongs + pong.length() <= response.length() );
+	BOOST_CHECK( response.length() <= 300 );
+	BOOST_CHECK_EQUAL( response.compare( pongs, pong.length(), pong ), 0 );
+	BOOST_CHECK_EQUAL( server.Connections(), 1u );
+	BOOST_CHECK_EQUAL( server.GetStats().sendErrors, 0u );
+
+	//A close whose echo doesn't fit still closes
+	string closes;
+	for ( int i = 0; i < 3; ++i )
+		closes += Masked( WebSocket::OP_PING, string( 100, 'p' ) );
+	closes += Masked( WebSocket::OP_CLOSE, string( "\x03\xe8", 2 ) );
+	BOOST_CHECK( write( browser, closes.data(), closes.length() ) > 0 );
+	for ( int wakeups = 0; wakeups < 20 && server.Connections() > 0; ++wakeups )
+		reactor.RunOnce( 50 );
+	BOOST_CHECK_EQUAL( server.Connections(), 0u );
+	close( browser );
+}
+
+#ifdef SIP_TLS
+#include <cstdio>
+#include <stdlib.h>
+#include <openssl/ec.h>
+#include <openssl/pem.h>
+#include <openssl/x509.h>
+#include "../transport/TlsTransport.hpp"
+
+namespace {
+
+/**
+* \class SelfSigned
+* \brief A throwaway P-256 key and self-signed certificate for localhost, in temporary PEM files
+*/
+struct SelfSigned
+{
+	SelfSigned()
+	{
+		EVP_PKEY* key = NULL;
+		EVP_PKEY_CTX* generator = EVP_PKEY_CTX_new_id( EVP_PKEY_EC, NULL );
+		EVP_PKEY_keygen_init( generator );
+		EVP_PKEY_CTX_set_ec_paramgen_curve_nid( generator, NID_X9_62_prime256v1 );
+		EVP_PKEY_keygen( generator, &key );
+		EVP_PKEY_CTX_free( generator );
+
+		X509* certificate = X509_new();
+		X509_set_version( certificate, 2 );
+		ASN1_INTEGER_set( X509_get_serialNumber( certificate ), 1 );
+		X509_gmtime_adj( X509_getm_notBefore( certificate ), 0 );
+		X509_gmtime_adj( X509_getm_notAfter( certificate ), 3600 );
+		X509_set_pubkey( certificate, key );
+		X509_NAME* name = X509_get_subject_name( certificate );
+		X509_NAME_add_entry_by_txt( name, "CN", MBSTRING_ASC, reinterpret_cast<const unsigned char*>( "localhost" ), -1, -1, 0 );
+		X509_set_issuer_name( certificate, name );
+		X509_sign( certificate, key, EVP_sha256() );
+
+		FILE* file = Create( certificateFile );
+		PEM_write_X509( file, certificate );
+		fclose( file );
+		file = Create( keyFile );
+		PEM_write_PrivateKey( file, key, NULL, NULL, 0, NULL, NULL );
+		fclose( file );
+		X509_free( certificate );
+		EVP_PKEY_free( key );
+	}
+
+	~SelfSigned()
+	{
+		unlink( certificateFile.c_str() );
+		unlink( keyFile.c_str() );
+	}
+
+	static FILE* Create( string& path )
+	{
+		char name[] = "/tmp/sip_tls_XXXXXX";
+		int fd = mkstemp( name );
+		path = name;
+		return fdopen( fd, "w" );
+	}
+
+	string certificateFile, keyFile;
+};
+
+}; //namespace
+
+BOOST_AUTO_TEST_CASE( tls_transport_resumption ) {
+	SelfSigned credentials;
+	Reactor reactor;
+	TcpEchoHandler serverHandler, clientHandler;
+	TlsTransport server( reactor, serverHandler, credentials.certificateFile, credentials.keyFile ),
+		client( reactor, clientHandler, credentials.certificateFile, credentials.keyFile );
+	serverHandler.transport = &server;
+	clientHandler.transport = &client;
+	sockaddr_in serverAddress = Loopback( UdpSockets::LocalPort( server.Listen( "127.0.0.1", 0 ) ) );
+	sockaddr_storage destination;
+	memset( &destination, 0, sizeof( destination ) );
+	memcpy( &destination, &serverAddress, sizeof( serverAddress ) );
+
+	//Sends queue behind the handshake, which the pool does while the reactor carries on
+	string request( WithVia( "SIP/2.0/TLS 127.0.0.1:5071;branch=z9hG4bK3" ) );
+	BOOST_CHECK( client.Send( request, destination ) );
+	BOOST_CHECK( client.Send( request, destination ) );
+	BOOST_CHECK_EQUAL( client.HandshakesPending(), 1u );
+	RunUntil( reactor, serverHandler, 2 );
+	RunUntil( reactor, clientHandler, 2 );
+	BOOST_CHECK_EQUAL( serverHandler.messages, 2 );
+	BOOST_CHECK_EQUAL( clientHandler.messages, 2 );
+	BOOST_CHECK_EQUAL( client.GetHandshakeStats().completed, 1u );
+	BOOST_CHECK_EQUAL( client.GetHandshakeStats().resumed, 0u );
+	BOOST_CHECK_EQUAL( server.GetHandshakeStats().completed, 1u );
+
+	//A reconnect, as after a NAT timeout, resumes the session instead of paying for a full handshake
+	client.Close( client.ConnectionFor( destination ) );
+	BOOST_CHECK( client.Send( request, destination ) );
+	RunUntil( reactor, serverHandler, 3 );
+	RunUntil( reactor, clientHandler, 3 );
+	BOOST_CHECK_EQUAL( serverHandler.messages, 3 );
+	BOOST_CHECK_EQUAL( clientHandler.messages, 3 );
+	BOOST_CHECK_EQUAL( client.GetHandshakeStats().completed, 2u );
+	BOOST_CHECK_EQUAL( client.GetHandshakeStats().resumed, 1u );
+	BOOST_CHECK_EQUAL( server.GetHandshakeStats().resumed, 1u );
+	BOOST_CHECK( server.GetHandshakeStats().microseconds > 0 );
+
+	//Plain text where a handshake should be fails it without disturbing anything else
+	int plain = ConnectTo( ntohs( serverAddress.sin_port ) );
+	BOOST_CHECK( write( plain, request.data(), request.length() ) > 0 );
+	for ( int wakeups = 0; wakeups < 20 && server.GetHandshakeStats().failed == 0; ++wakeups )
+		reactor.RunOnce( 50 );
+	BOOST_CHECK_EQUAL( server.GetHandshakeStats().failed, 1u );
+	BOOST_CHECK_EQUAL( serverHandler.parseErrors, 0 );
+	close( plain );
+}
+
+BOOST_AUTO_TEST_CASE( tls_transport_handshake_budget ) {
+	SelfSigned credentials;
+	Reactor reactor;
+	TcpEchoHandler handler;
+	//One handshake at a time, and 200ms for it
+	TlsTransport server( reactor, handler, credentials.certificateFile, credentials.keyFile, 1, 1, 200 );
+	unsigned short port = UdpSockets::LocalPort( server.Listen( "127.0.0.1", 0 ) );
+
+	//A peer that never speaks holds the only slot, so the next is turned away; then the first times out
+	int silent = ConnectTo( port );
+	for ( int wakeups = 0; wakeups < 20 && server.HandshakesPending() == 0; ++wakeups )
+		reactor.RunOnce( 50 );
+	int turnedAway = ConnectTo( port );
+	for ( int wakeups = 0; wakeups < 20 && server.GetHandshakeStats().rejected == 0; ++wakeups )
+		reactor.RunOnce( 50 );
+	BOOST_CHECK_EQUAL( server.GetHandshakeStats().rejected, 1u );
+	for ( int wakeups = 0; wakeups < 20 && server.GetHandshakeStats().failed == 0; ++wakeups )
+		reactor.RunOnce( 50 );
+	BOOST_CHECK_EQUAL( server.GetHandshakeStats().failed, 1u );
+	BOOST_CHECK_EQUAL( server.HandshakesPending(), 0u );
+	BOOST_CHECK_EQUAL( server.Connections(), 0u );
+	close( silent );
+	close( turnedAway );
+}
+
+#endif //SIP_TLS
+
+#ifdef SIP_IO_URING
+#include "../transport/UringUdpTransport.hpp"
+
+namespace {
+
+/**
+* \class UringEchoHandler
+* \brief Queues a reply to every message on the io_uring transport
+*/
+class UringEchoHandler : public CountingHandler
+{
+	public:
+		UringEchoHandler() : transport( NULL ) {}
+
+		void OnMessage( auto_ptr<SipMessage>& message, const sockaddr_storage& source, int socket )
+		{
+			CountingHandler::OnMessage( message, source, socket );
+			transport->Queue( socket, "pong", source );
+		}
+
+		UringUdpTransport* transport;
+};
+
+}; //namespace
+
+BOOST_AUTO_TEST_CASE( uring_udp_transport_loopback ) {
+	UringEchoHandler handler;
+	//Fewer buffers than datagrams, so the multishot receive runs dry and has to be posted again
+	UringUdpTransport transport( handler, 4 );
+	handler.transport = &transport;
+
+	BOOST_CHECK_EQUAL( transport.RunOnce( 0 ), 0u );
+
+	int server = transport.Listen( "127.0.0.1", 0 );
+	sockaddr_in serverAddress = Loopback( UdpTransport::LocalPort( server ) );
+	int client = socket( AF_INET, SOCK_DGRAM, 0 );
+	BOOST_REQUIRE( client != -1 );
+
+	const int datagrams = 10;
+	for ( int i = 0; i < datagrams; ++i )
+		sendto( client, sip_messages[0], strlen( sip_messages[0] ), 0, reinterpret_cast<sockaddr*>( &serverAddress ), sizeof( serverAddress ) );
+	const char garbage[] = "not a sip message";
+	sendto( client, garbage, sizeof( garbage ), 0, reinterpret_cast<sockaddr*>( &serverAddress ), sizeof( serverAddress ) );
+
+	//Datagrams the kernel had no buffer for wait in the socket until the receive is posted again
+	for ( int wakeups = 0; wakeups < 20 && handler.messages + handler.parseErrors < datagrams + 1; ++wakeups )
+		transport.RunOnce( 1000 );
+	BOOST_CHECK_EQUAL( handler.messages, datagrams );
+	BOOST_CHECK_EQUAL( handler.parseErrors, 1 );
+
+	transport.Flush();
+	for ( int wakeups = 0; wakeups < 10 && transport.GetStats().sent < static_cast<uint64_t>( datagrams ); ++wakeups )
+		transport.RunOnce( 100 );
+
+	UringUdpTransport::Stats stats = transport.GetStats();
+	BOOST_CHECK_EQUAL( stats.datagrams, static_cast<uint64_t>( datagrams + 1 ) );
+	BOOST_CHECK_EQUAL( stats.sent, static_cast<uint64_t>( datagrams ) );
+	BOOST_CHECK_EQUAL( stats.sendErrors, 0u );
+	BOOST_CHECK( stats.rearms >= 1u );
+	BOOST_CHECK( stats.enters < static_cast<uint64_t>( 2 * datagrams ) );
+
+	//Replies leave from the listening port
+	char reply[ 16 ];
+	sockaddr_in from;
+	socklen_t fromLength = sizeof( from );
+	int replies = 0;
+	while ( recvfrom( client, reply, sizeof( reply ), MSG_DONTWAIT, reinterpret_cast<sockaddr*>( &from ), &fromLength ) == 4 )
+	{
+		BOOST_CHECK_EQUAL( ntohs( from.sin_port ), UdpTransport::LocalPort( server ) );
+		++replies;
+	}
+	BOOST_CHECK_EQUAL( replies, datagrams );
+	close( client );
+
+	BOOST_CHECK_THROW( transport.Listen( "not an address", 0 ), TransportException );
+
+	//Stop() from another thread wakes a Run() that would otherwise wait forever
+	boost::thread running( boost::bind( &UringUdpTransport::Run, &transport, -1 ) );
+	boost::this_thread::sleep( boost::posix_time::milliseconds( 50 ) );
+	transport.Stop();
+	BOOST_CHECK( running.timed_join( boost::posix_time::seconds( 5 ) ) );
+}
+#endif //SIP_IO_URING
@@ -0,0 +1,231 @@
+#include "IngressWorkers.hpp"
+#include <cstring>
+#include <errno.h>
+#include <poll.h>
+#include <unistd.h>
+#include <sys/eventfd.h>
+#include <boost/thread.hpp>
+
+namespace Sip {
+
+namespace {
+
+const unsigned int POP_BATCH = 32;
+const size_t PUSH_BATCH = 64; //Pushed early if a receive batch brings this many for one worker
+const string NO_CALL_ID;
+
+}; //namespace
+
+/**
+* \class IngressWorkers::Worker
+* \brief One ring and the thread draining it. The thread sleeps on an eventfd only when the ring is empty, and the
+*        producer writes to it only when the thread said it was going to sleep.
+*/
+struct IngressWorkers::Worker
+{
+	Worker( SipMessageHandler& downstream, unsigned int depth ) throw( TransportException )
+		: handler( downstream ), ring( depth ), sleeping( false ), stopping( false ), thread( NULL )
+	{
+		wakeup = eventfd( 0, EFD_NONBLOCK | EFD_CLOEXEC );
+		if ( wakeup == -1 )
+			throw TransportException( string( "Could not create eventfd: " ) + strerror( errno ) );
+		pending.reserve( PUSH_BATCH );
+	}
+
+	~Worker()
+	{
+		Ingress left[ POP_BATCH ];
+		unsigned int count;
+		while ( ( count = ring.Pop( left, POP_BATCH ) ) > 0 )
+			for ( unsigned int i = 0; i < count; ++i )
+				delete left[i].message;
+		for ( vector<Ingress>::iterator ingress = pending.begin(); ingress != pending.end(); ++ingress )
+			delete ingress->message;
+		close( wakeup );
+	}
+
+	void Signal()
+	{
+		uint64_t one = 1;
+		ssize_t written = write( wakeup, &one, sizeof( one ) );
+		(void)written; //A full counter already means "wake up"
+	}
+
+	/**
+	 *     Producer: wakes the thread if it is asleep or about to be
+	 */
+	void Wake()
+	{
+		__atomic_thread_fence( __ATOMIC_SEQ_CST ); //Order the ring's tail store before reading sleeping
+		if ( __atomic_exchange_n( &sleeping, false, __ATOMIC_SEQ_CST ) )
+			Signal();
+	}
+
+	void operator()()
+	{
+		Ingress batch[ POP_BATCH ];
+		for ( ;; )
+		{
+			unsigned int count = ring.Pop( batch, POP_BATCH );
+			for ( unsigned int i = 0; i < count; ++i )
+			{
+				auto_ptr<SipMessage> message( batch[i].message );
+				handler.OnMessage( message, batch[i].source, batch[i].socket );
+			}
+			if ( count > 0 )
+				continue;
+			if ( __atomic_load_n( &stopping, __ATOMIC_SEQ_CST ) )
+				break;
+
+			//Say we are going to sleep, then look once more, so a push in between is never missed
+			__atomic_store_n( &sleeping, true, __ATOMIC_SEQ_CST );
+			__atomic_thread_fence( __ATOMIC_SEQ_CST );
+			if ( ring.Depth() == 0 && !__atomic_load_n( &stopping, __ATOMIC_SEQ_CST ) )
+			{
+				pollfd wait = { wakeup, POLLIN, 0 };
+				poll( &wait, 1, 100 );
+			}
+			__atomic_store_n( &sleeping, false, __ATOMIC_SEQ_CST );
+			uint64_t signals;
+			ssize_t drained = read( wakeup, &signals, sizeof( signals ) );
+			(void)drained;
+		}
+	}
+
+	SipMessageHandler& handler;
+	SpscRing<Ingress> ring;
+	vector<Ingress> pending; //Receive thread only: this batch's messages, not yet pushed
+	int wakeup;
+	bool sleeping, stopping;
+	boost::thread* thread;
+};
+
+IngressWorkers::IngressWorkers( SipMessageHandler& handler, unsigned int workers, unsigned int depth, SipMessageHandler* overflow ) throw( TransportException )
+	: m_handler( handler ), m_overflow( overflow ), m_running( false )
+{
+	if ( workers == 0 )
+		workers = boost::thread::hardware_concurrency() > 0 ? boost::thread::hardware_concurrency() : 1;
+	try
+	{
+		for ( unsigned int i = 0; i < workers; ++i )
+			m_workers.push_back( new Worker( handler, depth ) );
+	}
+	catch ( TransportException& e )
+	{
+		for ( vector<Worker*>::iterator worker = m_workers.begin(); worker != m_workers.end(); ++worker )
+			delete *worker;
+		throw;
+	}
+}
+
+IngressWorkers::~IngressWorkers()
+{
+	Stop();
+	for ( vector<Worker*>::iterator worker = m_workers.begin(); worker != m_workers.end(); ++worker )
+		delete *worker;
+}
+
+void IngressWorkers::Start()
+{
+	if ( m_running )
+		return;
+	for ( vector<Worker*>::iterator worker = m_workers.begin(); worker != m_workers.end(); ++worker )
+	{
+		( *worker )->stopping = false;
+		( *worker )->thread = new boost::thread( boost::ref( **worker ) );
+	}
+	m_running = true;
+}
+
+void IngressWorkers::Stop()
+{
+	if ( !m_running )
+		return;
+	for ( vector<Worker*>::iterator worker = m_workers.begin(); worker != m_workers.end(); ++worker )
+	{
+		__atomic_store_n( &( *worker )->stopping, true, __ATOMIC_SEQ_CST );
+		( *worker )->Signal();
+	}
+	for ( vector<Worker*>::iterator worker = m_workers.begin(); worker != m_workers.end(); ++worker )
+	{
+		( *worker )->thread->join();
+		delete ( *worker )->thread;
+		( *worker )->thread = NULL;
+	}
+	m_running = false;
+}
+
+unsigned int IngressWorkers::Workers() const throw()
+{
+	return m_workers.size();
+}
+
+unsigned int IngressWorkers::Depth( unsigned int worker ) const throw()
+{
+	return m_workers[worker]->ring.Depth();
+}
+
+bool IngressWorkers::Congested( unsigned int worker ) const throw()
+{
+	return m_workers[worker]->ring.Congested();
+}
+
+SpscRingStats IngressWorkers::GetStats( unsigned int worker ) const throw()
+{
+	return m_workers[worker]->ring.GetStats();
+}
+
+unsigned int IngressWorkers::WorkerFor( const string& callId, unsigned int workers ) throw()
+{
+	//FNV-1a
+	uint32_t hash = 2166136261u;
+	for ( string::const_iterator c = callId.begin(); c != callId.end(); ++c )
+	{
+		hash ^= static_cast<unsigned char>( *c );
+		hash *= 16777619u;
+	}
+	return workers == 0 ? 0 : hash % workers;
+}
+
+void IngressWorkers::OnMessage( auto_ptr<SipMessage>& message, const sockaddr_storage& source, int socket )
+{
+	const string& callId = message->HasHeader( "call-id" ) ? message->GetHeaderValues( "call-id" )[0].Value() : NO_CALL_ID;
+	unsigned int worker = WorkerFor( callId, m_workers.size() );
+
+	m_workers[worker]->pending.push_back( Ingress() );
+	Ingress& ingress = m_workers[worker]->pending.back();
+	ingress.message = message.release();
+	ingress.source = source;
+	ingress.socket = socket;
+
+	if ( m_workers[worker]->pending.size() >= PUSH_BATCH )
+		OnBatchComplete();
+}
+
+void IngressWorkers::OnParseError( const SipMessageException& error, const sockaddr_storage& source, int socket )
+{
+	m_handler.OnParseError( error, source, socket );
+}
+
+void IngressWorkers::OnBatchComplete()
+{
+	for ( vector<Worker*>::iterator each = m_workers.begin(); each != m_workers.end(); ++each )
+	{
+		Worker& worker = **each;
+		if ( worker.pending.empty() )
+			continue;
+
+		unsigned int pushed = worker.ring.Push( &worker.pending[0], worker.pending.size() );
+		if ( pushed > 0 )
+			worker.Wake();
+		for ( size_t i = pushed; i < worker.pending.size(); ++i )
+		{
+			auto_ptr<SipMessage> message( worker.pending[i].message );
+			if ( m_overflow != NULL )
+				m_overflow->OnMessage( message, worker.pending[i].source, worker.pending[i].socket );
+		}
+		worker.pending.clear();
+	}
+}
+
+}; //namespace Sip
@@ -0,0 +1,99 @@
+#ifndef INGRESSWORKERS_HPP
+#define INGRESSWORKERS_HPP
+#include <vector>
+#include "SpscRing.hpp"
+#include "UdpTransport.hpp"
+
+namespace Sip {
+
+/**
+* \class IngressWorkers
+* \brief Hands messages from one receive thread to N handler threads, so a handler that blocks (on redis, say)
+*        doesn't stall receiving
+*
+* Give it to a transport as that transport's handler. Each message goes on the SpscRing of the worker its Call-ID
+* hashes to, so a dialog's requests and responses are handled in order by one thread. Messages are collected per
+* ring while the transport works through a receive batch and pushed with one Push() per ring at the end of it;
+* a worker that went to sleep on an empty ring is woken once per batch, not per message.
+*
+* A full ring is the backpressure signal: the message goes to the overflow handler on the receive thread (to answer
+* 503 statelessly, say), or is dropped if there is none. Congested() reports a ring past its high-water mark.
+*
+* The downstream handler is called from every worker thread at once and must be thread safe. Replies from it must go
+* through UdpTransport::Send(), which is; Queue() is not.
+*/
+class IngressWorkers : public SipMessageHandler
+{
+	public:
+		/**
+		 * @param handler Handles every message, on the worker threads
+		 * @param workers How many; 0 means one per CPU
+		 * @param depth Each ring's capacity; rounded up to a power of two
+		 * @param overflow Gets messages that found their ring full, on the receive thread; NULL drops them
+		 * @throw TransportException if a worker's wakeup descriptor can't be created
+		 */
+		IngressWorkers( SipMessageHandler& handler, unsigned int workers = 0, unsigned int depth = 1024, SipMessageHandler* overflow = NULL ) throw( TransportException );
+
+		/**
+		 *     Stops the workers and deletes any messages still queued
+		 */
+		~IngressWorkers();
+
+		/**
+		 *     Starts a thread per worker
+		 */
+		void Start();
+
+		/**
+		 *     Stops every worker once it has handled what is already in its ring, and waits for its thread
+		 */
+		void Stop();
+
+		unsigned int Workers() const throw();
+
+		/**
+		 *     Messages waiting in a worker's ring
+		 */
+		unsigned int Depth( unsigned int worker ) const throw();
+
+		/**
+		 *     Whether a worker's ring is past its high-water mark
+		 */
+		bool Congested( unsigned int worker ) const throw();
+
+		SpscRingStats GetStats( unsigned int worker ) const throw();
+
+		/**
+		 *     The worker a Call-ID is handled by
+		 */
+		static unsigned int WorkerFor( const string& callId, unsigned int workers ) throw();
+
+		//Receive thread
+		void OnMessage( auto_ptr<SipMessage>& message, const sockaddr_storage& source, int socket );
+		void OnParseError( const SipMessageException& error, const sockaddr_storage& source, int socket );
+		void OnBatchComplete();
+
+	private:
+		IngressWorkers( const IngressWorkers& );
+		IngressWorkers& operator=( const IngressWorkers& );
+
+		/**
+		* \class Ingress
+		* \brief One message on its way to a worker, which takes ownership of it
+		*/
+		struct Ingress
+		{
+			SipMessage* message;
+			sockaddr_storage source;
+			int socket;
+		};
+
+		struct Worker;
+		SipMessageHandler& m_handler;
+		SipMessageHandler* m_overflow;
+		vector<Worker*> m_workers;
+		bool m_running;
+};
+
+}; //namespace Sip
+#endif //INGRESSWORKERS_HPP
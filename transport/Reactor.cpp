@@ -0,0 +1,114 @@
+#include "Reactor.hpp"
+#include <algorithm>
+#include <cstring>
+#include <errno.h>
+#include <stdint.h>
+#include <unistd.h>
+#include <sys/eventfd.h>
+
+namespace Sip {
+
+Reactor::Reactor( unsigned int maxEvents ) throw( TransportException )
+	: m_events( maxEvents == 0 ? 1 : maxEvents ), m_wakeup( -1 ), m_stopped( false )
+{
+	m_epoll = epoll_create1( EPOLL_CLOEXEC );
+	if ( m_epoll == -1 )
+		throw TransportException( string( "Could not create epoll instance: " ) + strerror( errno ) );
+
+	epoll_event event;
+	memset( &event, 0, sizeof( event ) );
+	event.events = EPOLLIN | EPOLLET;
+	m_wakeup = event.data.fd = eventfd( 0, EFD_NONBLOCK | EFD_CLOEXEC );
+	if ( m_wakeup == -1 || epoll_ctl( m_epoll, EPOLL_CTL_ADD, m_wakeup, &event ) == -1 )
+	{
+		string error( strerror( errno ) );
+		if ( m_wakeup != -1 )
+			close( m_wakeup );
+		close( m_epoll );
+		throw TransportException( "Could not create the reactor's eventfd: " + error );
+	}
+}
+
+Reactor::~Reactor()
+{
+	close( m_wakeup );
+	close( m_epoll );
+}
+
+void Reactor::Add( int fd, ReactorHandler& handler, bool writable ) throw( TransportException )
+{
+	epoll_event event;
+	memset( &event, 0, sizeof( event ) );
+	event.events = EPOLLIN | EPOLLET | ( writable ? EPOLLOUT : 0 );
+	event.data.fd = fd;
+
+	if ( epoll_ctl( m_epoll, EPOLL_CTL_ADD, fd, &event ) == -1 )
+		throw TransportException( string( "Could not watch socket: " ) + strerror( errno ) );
+
+	if ( static_cast<size_t>( fd ) >= m_handlers.size() )
+		m_handlers.resize( fd + 1, NULL );
+	m_handlers[fd] = &handler;
+}
+
+void Reactor::Remove( int fd ) throw()
+{
+	epoll_ctl( m_epoll, EPOLL_CTL_DEL, fd, NULL );
+	if ( static_cast<size_t>( fd ) < m_handlers.size() )
+		m_handlers[fd] = NULL;
+}
+
+unsigned int Reactor::RunOnce( int timeoutMs )
+{
+	int ready = epoll_wait( m_epoll, &m_events[0], m_events.size(), timeoutMs );
+	if ( ready <= 0 ) //Timeout, or EINTR; either way there is nothing to do
+		return 0;
+
+	m_dispatched.clear();
+	unsigned int events = ready;
+	for ( int i = 0; i < ready; ++i )
+	{
+		int fd = m_events[i].data.fd;
+		if ( fd == m_wakeup )
+		{
+			uint64_t signals;
+			ssize_t drained = read( m_wakeup, &signals, sizeof( signals ) );
+			(void)drained;
+			--events; //Stop()'s, not a handler's
+			continue;
+		}
+		//A handler earlier in this batch may have removed fd
+		ReactorHandler* handler = static_cast<size_t>( fd ) < m_handlers.size() ? m_handlers[fd] : NULL;
+		if ( handler == NULL )
+			continue;
+
+		if ( m_events[i].events & ( EPOLLIN | EPOLLERR | EPOLLHUP ) )
+			handler->OnReadable( fd );
+		if ( ( m_events[i].events & EPOLLOUT ) && m_handlers[fd] == handler )
+			handler->OnWritable( fd );
+
+		if ( std::find( m_dispatched.begin(), m_dispatched.end(), handler ) == m_dispatched.end() )
+			m_dispatched.push_back( handler );
+	}
+
+	for ( vector<ReactorHandler*>::iterator handler = m_dispatched.begin(); handler != m_dispatched.end(); ++handler )
+		( *handler )->OnDispatchComplete();
+
+	return events;
+}
+
+void Reactor::Run( int timeoutMs )
+{
+	while ( !__atomic_load_n( &m_stopped, __ATOMIC_SEQ_CST ) )
+		RunOnce( timeoutMs );
+	__atomic_store_n( &m_stopped, false, __ATOMIC_SEQ_CST );
+}
+
+void Reactor::Stop() throw()
+{
+	__atomic_store_n( &m_stopped, true, __ATOMIC_SEQ_CST );
+	uint64_t one = 1;
+	ssize_t written = write( m_wakeup, &one, sizeof( one ) );
+	(void)written; //A full counter already means "wake up"
+}
+
+}; //namespace Sip
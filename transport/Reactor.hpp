@@ -0,0 +1,104 @@
+#ifndef REACTOR_HPP
+#define REACTOR_HPP
+#include <stdexcept>
+#include <string>
+#include <vector>
+#include <sys/epoll.h>
+
+namespace Sip {
+
+using std::runtime_error;
+using std::string;
+using std::vector;
+
+/**
+* \class TransportException
+* \brief standard exception class for the transport layer. Only thrown while setting up sockets and the reactor;
+*        idle periods, timeouts and per-datagram errors are never reported with exceptions.
+*/
+class TransportException : public runtime_error
+{
+	public:
+		TransportException( string what ) : runtime_error( what ) { }
+};
+
+/**
+* \class ReactorHandler
+* \brief Receives readiness notifications for the file descriptors it registered with a Reactor
+*/
+class ReactorHandler
+{
+	public:
+		virtual ~ReactorHandler() {}
+
+		/**
+		 *     fd became readable. Registrations are edge triggered: read until EAGAIN or there won't be another call.
+		 */
+		virtual void OnReadable( int fd ) = 0;
+
+		/**
+		 *     fd became writable; only delivered for descriptors registered with writable = true
+		 */
+		virtual void OnWritable( int fd ) {}
+
+		/**
+		 *     Called once after every batch of events a RunOnce() dispatched, so handlers can flush work they queued
+		 */
+		virtual void OnDispatchComplete() {}
+};
+
+/**
+* \class Reactor
+* \brief Edge-triggered epoll event loop over any number of sockets
+*/
+class Reactor
+{
+	public:
+		/**
+		 * @param maxEvents Most events handled per wakeup
+		 */
+		Reactor( unsigned int maxEvents = 64 ) throw( TransportException );
+		~Reactor();
+
+		/**
+		 *     Starts watching fd. fd should be non-blocking.
+		 * @throw TransportException if epoll refuses the descriptor
+		 */
+		void Add( int fd, ReactorHandler& handler, bool writable = false ) throw( TransportException );
+
+		/**
+		 *     Stops watching fd. Call before closing it.
+		 */
+		void Remove( int fd ) throw();
+
+		/**
+		 *     Waits up to timeoutMs (-1 forever, 0 poll) and dispatches whatever is ready.
+		 * @return Events dispatched; 0 means the timeout expired or a signal interrupted the wait
+		 */
+		unsigned int RunOnce( int timeoutMs );
+
+		/**
+		 *     Dispatches events until Stop(), waiting up to timeoutMs at a time
+		 */
+		void Run( int timeoutMs = 1000 );
+
+		/**
+		 *     Makes Run() return after the current wakeup, waking it if it is waiting. Safe to call from handlers and
+		 *     other threads.
+		 */
+		void Stop() throw();
+
+	private:
+		Reactor( const Reactor& );
+		Reactor& operator=( const Reactor& );
+
+		int m_epoll;
+		vector<epoll_event> m_events;
+		vector<ReactorHandler*> m_handlers; //Indexed by fd
+		vector<ReactorHandler*> m_dispatched; //Handlers that saw events in the current RunOnce()
+		int m_wakeup; //An eventfd in the epoll set, written by Stop()
+		bool m_stopped; //Only touched atomically
+};
+
+}; //namespace Sip
+#endif //REACTOR_HPP
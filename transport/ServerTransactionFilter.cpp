@@ -0,0 +1,114 @@
+#include "ServerTransactionFilter.hpp"
+#include <cerrno>
+#include <cstring>
+#include <time.h>
+#include <unistd.h>
+#include <sys/timerfd.h>
+#include "../SipRequest.hpp"
+
+namespace Sip {
+
+ServerTransactionFilter::ServerTransactionFilter( Reactor& reactor, TransactionSender& transport, SipMessageHandler& downstream,
+	bool reliable ) throw( TransportException )
+	: m_reactor( reactor ), m_downstream( downstream ), m_reliable( reliable ), m_timer( -1 ), m_transactions( transport ),
+	m_armed( 0 )
+{
+	m_timer = timerfd_create( CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC );
+	if ( m_timer == -1 )
+		throw TransportException( string( "Could not create timerfd: " ) + strerror( errno ) );
+	try
+	{
+		m_reactor.Add( m_timer, *this );
+	}
+	catch ( TransportException& e )
+	{
+		close( m_timer );
+		throw;
+	}
+}
+
+ServerTransactionFilter::~ServerTransactionFilter()
+{
+	m_reactor.Remove( m_timer );
+	close( m_timer );
+}
+
+bool ServerTransactionFilter::Respond( const SipRequest& request, const SipResponse& response, const sockaddr_storage& destination ) throw()
+{
+	boost::mutex::scoped_lock lock( m_lock );
+	bool sent = m_transactions.Respond( request, response, destination, Now() );
+	Arm();
+	return sent;
+}
+
+ServerTransactions::Stats ServerTransactionFilter::GetStats() throw()
+{
+	boost::mutex::scoped_lock lock( m_lock );
+	return m_transactions.GetStats();
+}
+
+size_t ServerTransactionFilter::Size() throw()
+{
+	boost::mutex::scoped_lock lock( m_lock );
+	return m_transactions.Size();
+}
+
+uint64_t ServerTransactionFilter::Now() throw()
+{
+	timespec now;
+	clock_gettime( CLOCK_MONOTONIC, &now );
+	return static_cast<uint64_t>( now.tv_sec ) * 1000 + now.tv_nsec / 1000000;
+}
+
+void ServerTransactionFilter::OnMessage( auto_ptr<SipMessage>& message, const sockaddr_storage& source, int socket )
+{
+	if ( message->Type == SipMessage::MT_REQUEST )
+	{
+		boost::mutex::scoped_lock lock( m_lock );
+		bool absorbed = m_transactions.Receive( static_cast<const SipRequest&>( *message ), source, m_reliable, Now() );
+		Arm();
+		if ( absorbed )
+			return;
+	}
+	m_downstream.OnMessage( message, source, socket );
+}
+
+void ServerTransactionFilter::OnParseError( const SipMessageException& error, const sockaddr_storage& source, int socket )
+{
+	m_downstream.OnParseError( error, source, socket );
+}
+
+void ServerTransactionFilter::OnBatchComplete()
+{
+	m_downstream.OnBatchComplete();
+}
+
+void ServerTransactionFilter::OnReadable( int fd )
+{
+	uint64_t expirations;
+	ssize_t drained = read( m_timer, &expirations, sizeof( expirations ) );
+	(void)drained;
+
+	boost::mutex::scoped_lock lock( m_lock );
+	m_armed = 0;
+	m_transactions.RunTimers( Now() );
+	Arm();
+}
+
+void ServerTransactionFilter::Arm() throw()
+{
+	uint64_t when;
+	if ( !m_transactions.NextTimer( when ) || ( m_armed != 0 && m_armed <= when ) )
+		return;
+	//An absolute time of zero would disarm the timer instead
+	if ( when == 0 )
+		when = 1;
+	itimerspec setting;
+	memset( &setting, 0, sizeof( setting ) );
+	setting.it_value.tv_sec = when / 1000;
+	setting.it_value.tv_nsec = ( when % 1000 ) * 1000000;
+	if ( timerfd_settime( m_timer, TFD_TIMER_ABSTIME, &setting, NULL ) == 0 )
+		m_armed = when;
+}
+
+}; //namespace Sip
@@ -0,0 +1,81 @@
+#ifndef SERVERTRANSACTIONFILTER_HPP
+#define SERVERTRANSACTIONFILTER_HPP
+#include <stdint.h>
+#include <boost/thread/mutex.hpp>
+#include "Reactor.hpp"
+#include "UdpTransport.hpp"
+#include "../ServerTransaction.hpp"
+
+namespace Sip {
+
+/**
+* \class ServerTransactionFilter
+* \brief Keeps retransmitted requests away from the UAS: a SipMessageHandler that runs each request through a
+*        ServerTransactions table and passes on only the new ones
+*
+* Give it to a transport as that transport's handler, with the handler it replaces as downstream; put it in front of
+* IngressWorkers, so retransmissions are answered on the receive thread and never queue behind a slow UAS. The UAS
+* must answer through Respond(), which sends through the transport and keeps the response for the retransmissions.
+* A retransmitted request is answered with that response, or ignored if the UAS hasn't answered yet; an ACK for a
+* failure is absorbed. Responses pass straight through.
+*
+* Transaction timers run off a timerfd on the reactor. The table is locked, but Respond() sends on the calling thread,
+* so it may only be called off the reactor thread if the transport's sends may be: UdpTransport's may, from any thread;
+* the stream transports' may only be made on their reactor's thread, and so must Respond() in front of them.
+*/
+class ServerTransactionFilter : public SipMessageHandler, public ReactorHandler
+{
+	public:
+		/**
+		 * @param transport Sends responses; the transport this is the handler of
+		 * @param downstream Gets the requests that start transactions, and everything else
+		 * @param reliable Whether the transport is reliable, which turns off retransmission of INVITE failures
+		 * @throw TransportException if the timerfd can't be created
+		 */
+		ServerTransactionFilter( Reactor& reactor, TransactionSender& transport, SipMessageHandler& downstream, bool reliable = false )
+			throw( TransportException );
+		~ServerTransactionFilter();
+
+		/**
+		 *     Sends the UAS's response to request, keeping it for retransmissions of the request
+		 * @return False if it couldn't be serialized or sent
+		 */
+		bool Respond( const SipRequest& request, const SipResponse& response, const sockaddr_storage& destination ) throw();
+
+		ServerTransactions::Stats GetStats() throw();
+
+		/**
+		 *     Transactions not yet terminated
+		 */
+		size_t Size() throw();
+
+		/**
+		 *     Milliseconds on the clock transaction timers use
+		 */
+		static uint64_t Now() throw();
+
+		void OnMessage( auto_ptr<SipMessage>& message, const sockaddr_storage& source, int socket );
+		void OnParseError( const SipMessageException& error, const sockaddr_storage& source, int socket );
+		void OnBatchComplete();
+		void OnReadable( int fd );
+
+	private:
+		ServerTransactionFilter( const ServerTransactionFilter& );
+		ServerTransactionFilter& operator=( const ServerTransactionFilter& );
+
+		/**
+		 *     Sets the timerfd for the table's next timer, if that is sooner than it is set for. Called with the lock held.
+		 */
+		void Arm() throw();
+
+		Reactor& m_reactor;
+		SipMessageHandler& m_downstream;
+		bool m_reliable;
+		int m_timer;
+		boost::mutex m_lock;
+		ServerTransactions m_transactions;
+		uint64_t m_armed; //When the timerfd fires, 0 if it isn't set
+};
+
+}; //namespace Sip
+#endif //SERVERTRANSACTIONFILTER_HPP
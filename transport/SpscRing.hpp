@@ -0,0 +1,163 @@
+#ifndef SPSCRING_HPP
+#define SPSCRING_HPP
+#include <vector>
+#include <stdint.h>
+
+namespace Sip {
+
+using std::vector;
+
+/**
+* \class SpscRingStats
+* \brief Running totals for one SpscRing. Each side writes only its own counters.
+*/
+struct SpscRingStats
+{
+	SpscRingStats() : pushed( 0 ), rejected( 0 ), popped( 0 ), maxDepth( 0 ) {}
+	/// Items the producer pushed, and items it couldn't because the ring was full
+	uint64_t pushed, rejected;
+	/// Items the consumer popped
+	uint64_t popped;
+	/// Deepest the ring has been, as seen by the producer after a push
+	uint64_t maxDepth;
+};
+
+/**
+* \class SpscRing
+* \brief A bounded lock-free queue between exactly one producer thread and one consumer thread
+*
+* The capacity is rounded up to a power of two. Each side owns one index and keeps a cached copy of the other's,
+* reloading it only when the cached value says the ring is full (or empty), so in steady state a push or pop of a
+* whole batch touches the other side's cache line once at most. The two sides' fields are padded onto separate
+* cache lines.
+*
+* Push() fails rather than blocks when the ring is full, and Congested() reports a depth at or above the high-water
+* mark; both are the producer's backpressure signal. T must be cheap to copy: items are copied in and out.
+*/
+template <class T>
+class SpscRing
+{
+	public:
+		/**
+		 * @param capacity Most items held; rounded up to a power of two
+		 * @param highWater Depth at which Congested() turns true; 0 means three quarters of the capacity
+		 */
+		SpscRing( unsigned int capacity, unsigned int highWater = 0 ) throw()
+			: m_tail( 0 ), m_cachedHead( 0 ), m_head( 0 ), m_cachedTail( 0 ), m_consumerPopped( 0 )
+		{
+			m_capacity = 1;
+			while ( m_capacity < capacity )
+				m_capacity <<= 1;
+			m_mask = m_capacity - 1;
+			m_highWater = highWater == 0 || highWater > m_capacity ? m_capacity - m_capacity / 4 : highWater;
+			m_items.resize( m_capacity );
+		}
+
+		/**
+		 *     Producer: adds one item.
+		 * @return False, leaving the ring unchanged, if it is full
+		 */
+		bool Push( const T& item ) throw()
+		{
+			return Push( &item, 1 ) == 1;
+		}
+
+		/**
+		 *     Producer: adds as many of count items, in order, as there is room for.
+		 * @return How many were added; the rest count as rejected
+		 */
+		unsigned int Push( const T* items, unsigned int count ) throw()
+		{
+			unsigned int tail = m_tail;
+			if ( m_capacity - ( tail - m_cachedHead ) < count )
+				m_cachedHead = __atomic_load_n( &m_head, __ATOMIC_ACQUIRE );
+			unsigned int room = m_capacity - ( tail - m_cachedHead );
+			unsigned int pushed = count < room ? count : room;
+
+			for ( unsigned int i = 0; i < pushed; ++i )
+				m_items[ ( tail + i ) & m_mask ] = items[i];
+			__atomic_store_n( &m_tail, tail + pushed, __ATOMIC_RELEASE );
+
+			m_producerStats.pushed += pushed;
+			m_producerStats.rejected += count - pushed;
+			uint64_t depth = tail + pushed - m_cachedHead;
+			if ( depth > m_producerStats.maxDepth )
+				m_producerStats.maxDepth = depth;
+			return pushed;
+		}
+
+		/**
+		 *     Consumer: removes up to max items, oldest first.
+		 * @return How many were removed; 0 if the ring is empty
+		 */
+		unsigned int Pop( T* items, unsigned int max ) throw()
+		{
+			unsigned int head = m_head;
+			if ( m_cachedTail - head < max )
+				m_cachedTail = __atomic_load_n( &m_tail, __ATOMIC_ACQUIRE );
+			unsigned int available = m_cachedTail - head;
+			unsigned int popped = max < available ? max : available;
+
+			for ( unsigned int i = 0; i < popped; ++i )
+				items[i] = m_items[ ( head + i ) & m_mask ];
+			__atomic_store_n( &m_head, head + popped, __ATOMIC_RELEASE );
+
+			__atomic_store_n( &m_consumerPopped, m_consumerPopped + popped, __ATOMIC_RELAXED );
+			return popped;
+		}
+
+		/**
+		 *     Items in the ring. Exact from either side's own thread at that moment; a snapshot from anywhere else.
+		 */
+		unsigned int Depth() const throw()
+		{
+			return __atomic_load_n( &m_tail, __ATOMIC_ACQUIRE ) - __atomic_load_n( &m_head, __ATOMIC_ACQUIRE );
+		}
+
+		/**
+		 *     Whether the depth is at or above the high-water mark
+		 */
+		bool Congested() const throw()
+		{
+			return Depth() >= m_highWater;
+		}
+
+		unsigned int Capacity() const throw()
+		{
+			return m_capacity;
+		}
+
+		/**
+		 *     A snapshot of the counters. Only consistent with each other while both sides are idle.
+		 */
+		SpscRingStats GetStats() const throw()
+		{
+			SpscRingStats stats = m_producerStats;
+			stats.popped = __atomic_load_n( &m_consumerPopped, __ATOMIC_RELAXED );
+			return stats;
+		}
+
+	private:
+		SpscRing( const SpscRing& );
+		SpscRing& operator=( const SpscRing& );
+
+		enum { CACHE_LINE = 64 };
+
+		//Read-only after construction
+		unsigned int m_capacity, m_mask, m_highWater;
+		vector<T> m_items;
+		char m_padShared[ CACHE_LINE ];
+
+		//Producer's line
+		unsigned int m_tail, m_cachedHead;
+		SpscRingStats m_producerStats;
+		char m_padProducer[ CACHE_LINE ];
+
+		//Consumer's line
+		unsigned int m_head, m_cachedTail;
+		uint64_t m_consumerPopped;
+		char m_padConsumer[ CACHE_LINE ];
+};
+
+}; //namespace Sip
+#endif //SPSCRING_HPP
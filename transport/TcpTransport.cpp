@@ -0,0 +1,776 @@
+#include "TcpTransport.hpp"
+#include <algorithm>
+#include <cstring>
+#include <sstream>
+#include <errno.h>
+#include <netdb.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <strings.h>
+#include <sys/uio.h>
+#include <unistd.h>
+#include "UdpSockets.hpp"
+#include "WebSocket.hpp"
+#include "../SipRequest.hpp"
+#include "../SipUtility.hpp"
+#include "../Via.hpp"
+
+namespace Sip {
+
+namespace {
+
+const size_t READ_CHUNK = 65536;
+const unsigned int MAX_WRITE_VECTORS = 64;
+const size_t MAX_UPGRADE_SIZE = 8192; //Longest WebSocket opening handshake accepted
+
+void NoDelay( int socket )
+{
+	int on = 1;
+	setsockopt( socket, IPPROTO_TCP, TCP_NODELAY, &on, sizeof( on ) );
+}
+
+/**
+ *     Finds the Content-Length of the message whose headers run from begin to headersEnd (the blank line).
+ * @return False if there is no Content-Length, or it isn't a number
+ */
+bool ContentLength( const string& stream, string::size_type begin, string::size_type headersEnd, size_t& length )
+{
+	string::size_type line = stream.find( "\r\n", begin ); //Skip the start line
+	while ( line != string::npos && line < headersEnd )
+	{
+		line += 2;
+		string::size_type colon = stream.find( ':', line ), lineEnd = stream.find( "\r\n", line );
+		if ( colon == string::npos || colon > lineEnd )
+		{
+			line = lineEnd;
+			continue;
+		}
+		string::size_type nameEnd = colon;
+		while ( nameEnd > line && Utility::IsSpace( stream[nameEnd - 1] ) )
+			--nameEnd;
+		if ( ( nameEnd - line == 14 && strncasecmp( &stream[line], "content-length", 14 ) == 0 ) ||
+			( nameEnd - line == 1 && ( stream[line] == 'l' || stream[line] == 'L' ) ) )
+		{
+			string::size_type digit = colon + 1;
+			while ( digit < lineEnd && Utility::IsSpace( stream[digit] ) )
+				++digit;
+			if ( digit == lineEnd || !Utility::IsDigit( stream[digit] ) )
+				return false;
+			length = 0;
+			for ( ; digit < lineEnd && Utility::IsDigit( stream[digit] ); ++digit )
+			{
+				length = length * 10 + ( stream[digit] - '0' );
+				if ( length > SIP_MAX_MESSAGE_SIZE )
+					return true; //The caller rejects it as too long
+			}
+			return true;
+		}
+		line = lineEnd;
+	}
+	return false;
+}
+
+}; //namespace
+
+TcpTransport::TcpTransport( Reactor& reactor, SipMessageHandler& handler, size_t maxQueued ) throw()
+	: m_reactor( reactor ), m_handler( handler ), m_maxQueued( maxQueued ), m_readBuffer( READ_CHUNK ), m_open( 0 ), m_generation( 0 )
+{ }
+
+TcpTransport::~TcpTransport()
+{
+	CloseAll();
+	for ( vector<int>::iterator listener = m_listeners.begin(); listener != m_listeners.end(); ++listener )
+	{
+		m_reactor.Remove( *listener );
+		close( *listener );
+	}
+}
+
+int TcpTransport::Listen( const string& address, unsigned short port, Framing framing ) throw( TransportException )
+{
+	std::ostringstream portAsString;
+	portAsString << port;
+
+	addrinfo hints, *result;
+	memset( &hints, 0, sizeof( hints ) );
+	hints.ai_family = AF_UNSPEC;
+	hints.ai_socktype = SOCK_STREAM;
+	hints.ai_flags = AI_PASSIVE | AI_NUMERICHOST | AI_NUMERICSERV;
+
+	int error = getaddrinfo( address.c_str(), portAsString.str().c_str(), &hints, &result );
+	if ( error != 0 )
+		throw TransportException( string( "Invalid listen address " ) + address + ": " + gai_strerror( error ) );
+
+	int sock = socket( result->ai_family, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0 );
+	if ( sock == -1 )
+	{
+		freeaddrinfo( result );
+		throw TransportException( string( "Could not create socket: " ) + strerror( errno ) );
+	}
+
+	int on = 1;
+	setsockopt( sock, SOL_SOCKET, SO_REUSEADDR, &on, sizeof( on ) );
+	if ( result->ai_family == AF_INET6 )
+		setsockopt( sock, IPPROTO_IPV6, IPV6_V6ONLY, &on, sizeof( on ) );
+
+	if ( bind( sock, result->ai_addr, result->ai_addrlen ) == -1 || listen( sock, SOMAXCONN ) == -1 )
+	{
+		std::ostringstream errorBuilder;
+		errorBuilder << "Could not listen on TCP " << address << " port " << port << ", error: " << strerror( errno );
+		freeaddrinfo( result );
+		close( sock );
+		throw TransportException( errorBuilder.str() );
+	}
+	freeaddrinfo( result );
+
+	try
+	{
+		m_reactor.Add( sock, *this );
+	}
+	catch ( TransportException& e )
+	{
+		close( sock );
+		throw;
+	}
+	m_listeners.push_back( sock );
+	if ( framing == FRAMING_WEBSOCKET )
+		m_webSocketListeners.push_back( sock );
+	return sock;
+}
+
+int TcpTransport::Connect( const sockaddr_storage& destination ) throw()
+{
+	bool inProgress;
+	int sock = Open( destination, inProgress );
+	if ( sock == -1 )
+		return -1;
+	return Add( sock, destination, inProgress );
+}
+
+int TcpTransport::ConnectionFor( const sockaddr_storage& destination ) const throw()
+{
+	map<string, int>::const_iterator found = m_byAddress.find( AddressKey( destination ) );
+	return found == m_byAddress.end() ? -1 : found->second;
+}
+
+int TcpTransport::ConnectionFor( const string& alias ) const throw()
+{
+	map<string, int>::const_iterator found = m_byAlias.find( alias );
+	return found == m_byAlias.end() ? -1 : found->second;
+}
+
+void TcpTransport::SetAlias( int connection, const string& alias ) throw()
+{
+	if ( connection < 0 || static_cast<size_t>( connection ) >= m_connections.size() || m_connections[connection] == NULL )
+		return;
+
+	map<string, int>::iterator found = m_byAlias.find( alias );
+	if ( found != m_byAlias.end() )
+	{
+		if ( found->second == connection )
+			return;
+		vector<string>& previous = m_connections[found->second]->aliases;
+		previous.erase( std::find( previous.begin(), previous.end(), alias ) );
+	}
+	m_byAlias[alias] = connection;
+	m_connections[connection]->aliases.push_back( alias );
+}
+
+bool TcpTransport::Send( int connection, const string& data ) throw()
+{
+	if ( connection < 0 || static_cast<size_t>( connection ) >= m_connections.size() || m_connections[connection] == NULL )
+		return false;
+	return Queue( *m_connections[connection], data );
+}
+
+bool TcpTransport::Send( const string& data, const sockaddr_storage& destination ) throw()
+{
+	int connection = ConnectionFor( destination );
+	if ( connection != -1 )
+		++m_stats.reused;
+	else if ( ( connection = Connect( destination ) ) == -1 )
+		return false;
+	return Queue( *m_connections[connection], data );
+}
+
+bool TcpTransport::Send( const string& data, const string& alias ) throw()
+{
+	int connection = ConnectionFor( alias );
+	if ( connection == -1 )
+		return false;
+	++m_stats.reused;
+	return Queue( *m_connections[connection], data );
+}
+
+void TcpTransport::Flush() throw()
+{
+	vector<int> dirty;
+	dirty.swap( m_dirty );
+	for ( vector<int>::iterator socket = dirty.begin(); socket != dirty.end(); ++socket )
+	{
+		Connection* connection = m_connections[*socket];
+		if ( connection == NULL || !connection->dirty )
+			continue;
+		connection->dirty = false;
+		Write( *connection );
+	}
+}
+
+void TcpTransport::Close( int connection ) throw()
+{
+	if ( connection < 0 || static_cast<size_t>( connection ) >= m_connections.size() || m_connections[connection] == NULL )
+		return;
+	Connection* closing = m_connections[connection];
+
+	map<string, int>::iterator byAddress = m_byAddress.find( AddressKey( closing->remote ) );
+	if ( byAddress != m_byAddress.end() && byAddress->second == connection )
+		m_byAddress.erase( byAddress );
+	for ( vector<string>::iterator alias = closing->aliases.begin(); alias != closing->aliases.end(); ++alias )
+		m_byAlias.erase( *alias );
+
+	OnClosing( connection, closing->held );
+	if ( !closing->held )
+	{
+		m_reactor.Remove( connection );
+		close( connection );
+	}
+	m_connections[connection] = NULL;
+	delete closing;
+	--m_open;
+	++m_stats.closed;
+}
+
+size_t TcpTransport::Connections() const throw()
+{
+	return m_open;
+}
+
+const TcpTransport::Stats& TcpTransport::GetStats() const throw()
+{
+	return m_stats;
+}
+
+void TcpTransport::OnReadable( int fd )
+{
+	if ( std::find( m_listeners.begin(), m_listeners.end(), fd ) != m_listeners.end() )
+		Accept( fd );
+	else if ( static_cast<size_t>( fd ) < m_connections.size() && m_connections[fd] != NULL )
+		Read( *m_connections[fd] );
+}
+
+void TcpTransport::OnWritable( int fd )
+{
+	if ( static_cast<size_t>( fd ) >= m_connections.size() || m_connections[fd] == NULL )
+		return;
+	Connection& connection = *m_connections[fd];
+	if ( connection.connecting )
+	{
+		int error = 0;
+		socklen_t length = sizeof( error );
+		if ( getsockopt( fd, SOL_SOCKET, SO_ERROR, &error, &length ) == -1 || error != 0 )
+		{
+			if ( connection.queued > 0 )
+				++m_stats.sendErrors;
+			Close( fd );
+			return;
+		}
+		connection.connecting = false;
+	}
+	Write( connection );
+}
+
+void TcpTransport::OnDispatchComplete()
+{
+	if ( !m_dirty.empty() )
+		Flush();
+}
+
+int TcpTransport::Add( int socket, const sockaddr_storage& remote, bool connecting, bool held, Framing framing ) throw()
+{
+	if ( !held )
+	{
+		try
+		{
+			m_reactor.Add( socket, *this, true );
+		}
+		catch ( TransportException& e )
+		{
+			close( socket );
+			return -1;
+		}
+	}
+
+	Connection* connection = new Connection();
+	connection->socket = socket;
+	connection->generation = ++m_generation;
+	connection->remote = remote;
+	connection->connecting = connecting;
+	connection->dirty = false;
+	connection->held = held;
+	connection->framing = framing;
+	connection->upgraded = false;
+	connection->fragmented = false;
+	connection->outputOffset = 0;
+	connection->queued = 0;
+
+	if ( static_cast<size_t>( socket ) >= m_connections.size() )
+		m_connections.resize( socket + 1, NULL );
+	m_connections[socket] = connection;
+	m_byAddress[ AddressKey( remote ) ] = socket;
+	++m_open;
+	return socket;
+}
+
+bool TcpTransport::Release( int connection ) throw()
+{
+	if ( Generation( connection ) == 0 || !m_connections[connection]->held )
+		return false;
+	Connection& released = *m_connections[connection];
+	released.held = false;
+	released.connecting = false;
+	try
+	{
+		m_reactor.Add( connection, *this, true );
+	}
+	catch ( TransportException& e )
+	{
+		Close( connection );
+		return false;
+	}
+	Write( released );
+	return Generation( connection ) != 0;
+}
+
+int TcpTransport::Open( const sockaddr_storage& destination, bool& inProgress ) throw()
+{
+	int sock = socket( destination.ss_family, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0 );
+	if ( sock == -1 )
+		return -1;
+	NoDelay( sock );
+
+	int result = connect( sock, reinterpret_cast<const sockaddr*>( &destination ), UdpSockets::AddressLength( destination ) );
+	if ( result == -1 && errno != EINPROGRESS )
+	{
+		close( sock );
+		return -1;
+	}
+	inProgress = result == -1;
+	++m_stats.connected;
+	return sock;
+}
+
+uint64_t TcpTransport::Generation( int connection ) const throw()
+{
+	if ( connection < 0 || static_cast<size_t>( connection ) >= m_connections.size() || m_connections[connection] == NULL )
+		return 0;
+	return m_connections[connection]->generation;
+}
+
+void TcpTransport::CloseAll() throw()
+{
+	for ( size_t socket = 0; socket < m_connections.size(); ++socket )
+		if ( m_connections[socket] != NULL )
+			Close( socket );
+}
+
+void TcpTransport::OnAccepted( int socket, const sockaddr_storage& remote, Framing framing ) throw()
+{
+	Add( socket, remote, false, false, framing );
+}
+
+void TcpTransport::OnClosing( int connection, bool held ) throw()
+{ }
+
+ssize_t TcpTransport::Receive( int connection, char* buffer, size_t length ) throw()
+{
+	return read( connection, buffer, length );
+}
+
+ssize_t TcpTransport::Transmit( int connection, const iovec* vectors, unsigned int count ) throw()
+{
+	//sendmsg is writev with MSG_NOSIGNAL, so a peer that went away is an error here rather than a SIGPIPE
+	msghdr header;
+	memset( &header, 0, sizeof( header ) );
+	header.msg_iov = const_cast<iovec*>( vectors );
+	header.msg_iovlen = count;
+	return sendmsg( connection, &header, MSG_NOSIGNAL );
+}
+
+unsigned short TcpTransport::DefaultPort() const throw()
+{
+	return DEFAULT_UDP_LISTENPORT;
+}
+
+string TcpTransport::AddressKey( const sockaddr_storage& address )
+{
+	if ( address.ss_family == AF_INET6 )
+	{
+		const sockaddr_in6& in6 = reinterpret_cast<const sockaddr_in6&>( address );
+		return string( 1, 6 ) + string( reinterpret_cast<const char*>( &in6.sin6_addr ), sizeof( in6.sin6_addr ) ) +
+			string( reinterpret_cast<const char*>( &in6.sin6_port ), sizeof( in6.sin6_port ) );
+	}
+	const sockaddr_in& in = reinterpret_cast<const sockaddr_in&>( address );
+	return string( 1, 4 ) + string( reinterpret_cast<const char*>( &in.sin_addr ), sizeof( in.sin_addr ) ) +
+		string( reinterpret_cast<const char*>( &in.sin_port ), sizeof( in.sin_port ) );
+}
+
+bool TcpTransport::Queue( Connection& connection, const string& data ) throw()
+{
+	if ( connection.framing == FRAMING_SIP )
+		return Append( connection, string(), data );
+	if ( !connection.upgraded )
+		return false;
+	return Append( connection, WebSocket::Header( WebSocket::OP_TEXT, data.length() ), data );
+}
+
+bool TcpTransport::Fits( const Connection& connection, size_t length ) const throw()
+{
+	return connection.queued + length <= m_maxQueued;
+}
+
+bool TcpTransport::Append( Connection& connection, const string& header, const string& data ) throw()
+{
+	if ( !Fits( connection, header.length() + data.length() ) )
+	{
+		++m_stats.sendErrors;
+		Close( connection.socket );
+		return false;
+	}
+	if ( !header.empty() )
+		connection.output.push_back( header );
+	connection.output.push_back( data );
+	connection.queued += header.length() + data.length();
+	if ( !connection.dirty )
+	{
+		connection.dirty = true;
+		m_dirty.push_back( connection.socket );
+	}
+	return true;
+}
+
+void TcpTransport::Write( Connection& connection ) throw()
+{
+	if ( connection.connecting || connection.held )
+		return;
+
+	iovec vectors[ MAX_WRITE_VECTORS ];
+	while ( connection.queued > 0 )
+	{
+		unsigned int count = 0;
+		for ( deque<string>::iterator pending = connection.output.begin(); pending != connection.output.end() && count < MAX_WRITE_VECTORS; ++pending, ++count )
+		{
+			size_t skip = count == 0 ? connection.outputOffset : 0;
+			vectors[count].iov_base = const_cast<char*>( pending->data() ) + skip;
+			vectors[count].iov_len = pending->length() - skip;
+		}
+
+		ssize_t written = Transmit( connection.socket, vectors, count );
+		if ( written < 0 )
+		{
+			if ( errno == EINTR )
+				continue;
+			if ( errno == EAGAIN || errno == EWOULDBLOCK )
+				return; //OnWritable() picks up from here
+			++m_stats.sendErrors;
+			Close( connection.socket );
+			return;
+		}
+		++m_stats.writes;
+		m_stats.sent += written;
+		connection.queued -= written;
+
+		size_t consumed = written;
+		while ( consumed > 0 )
+		{
+			size_t remaining = connection.output.front().length() - connection.outputOffset;
+			if ( consumed < remaining )
+			{
+				connection.outputOffset += consumed;
+				break;
+			}
+			consumed -= remaining;
+			connection.output.pop_front();
+			connection.outputOffset = 0;
+		}
+	}
+}
+
+void TcpTransport::Accept( int listener ) throw()
+{
+	for ( ;; )
+	{
+		sockaddr_storage remote;
+		socklen_t length = sizeof( remote );
+		int sock = accept4( listener, reinterpret_cast<sockaddr*>( &remote ), &length, SOCK_NONBLOCK | SOCK_CLOEXEC );
+		if ( sock == -1 )
+		{
+			if ( errno == EINTR || errno == ECONNABORTED )
+				continue;
+			return; //EAGAIN, or out of descriptors; either way wait for the next edge
+		}
+		NoDelay( sock );
+		++m_stats.accepted;
+		bool webSocket = std::find( m_webSocketListeners.begin(), m_webSocketListeners.end(), listener ) != m_webSocketListeners.end();
+		OnAccepted( sock, remote, webSocket ? FRAMING_WEBSOCKET : FRAMING_SIP );
+	}
+}
+
+void TcpTransport::Read( Connection& connection ) throw()
+{
+	int socket = connection.socket;
+	bool open = true;
+	//Frame after every read, so a peer sending faster than we handle can't grow the input without bound
+	while ( open )
+	{
+		ssize_t received = Receive( socket, &m_readBuffer[0], m_readBuffer.size() );
+		if ( received < 0 && errno == EINTR )
+			continue;
+		if ( received < 0 && ( errno == EAGAIN || errno == EWOULDBLOCK ) )
+			break;
+		if ( received <= 0 ) //Closed by the peer, or reset
+		{
+			Close( socket );
+			open = false;
+			break;
+		}
+		m_stats.bytes += received;
+		connection.input.append( &m_readBuffer[0], received );
+		open = connection.framing == FRAMING_WEBSOCKET ? FrameWebSocket( connection ) : Frame( connection );
+	}
+	m_handler.OnBatchComplete();
+}
+
+bool TcpTransport::Frame( Connection& connection ) throw()
+{
+	//Messages are parsed first and handed over after, since a handler may close this very connection
+	int socket = connection.socket;
+	uint64_t generation = connection.generation;
+	sockaddr_storage remote = connection.remote;
+	const string& input = connection.input;
+	vector<SipMessage*> messages;
+	vector<string> errors;
+	string::size_type offset = 0;
+	bool framed = true;
+
+	for ( ;; )
+	{
+		//CRLF keep-alives between messages; a double CRLF is a ping and wants a single CRLF back
+		while ( offset + 1 < input.length() && input[offset] == '\r' && input[offset + 1] == '\n' )
+		{
+			if ( input.compare( offset, 4, "\r\n\r\n" ) == 0 )
+			{
+				if ( Fits( connection, 2 ) ) //Never close the connection from in here
+					Queue( connection, "\r\n" );
+				offset += 4;
+			}
+			else
+				offset += 2;
+		}
+		if ( offset >= input.length() )
+			break;
+
+		string::size_type headersEnd = input.find( "\r\n\r\n", offset );
+		if ( headersEnd == string::npos )
+		{
+			framed = input.length() - offset <= SIP_MAX_MESSAGE_SIZE;
+			break;
+		}
+		size_t bodyLength;
+		if ( !ContentLength( input, offset, headersEnd, bodyLength ) || headersEnd + 4 - offset + bodyLength > SIP_MAX_MESSAGE_SIZE )
+		{
+			framed = false;
+			break;
+		}
+		size_t length = headersEnd + 4 - offset + bodyLength;
+		if ( input.length() - offset < length )
+			break;
+
+		Parse( connection, input, offset, length, messages, errors );
+		offset += length;
+	}
+	connection.input.erase( 0, offset );
+
+	if ( !framed )
+	{
+		++m_stats.framingErrors;
+		Close( socket );
+	}
+	return Deliver( socket, generation, remote, messages, errors ) && framed;
+}
+
+bool TcpTransport::FrameWebSocket( Connection& connection ) throw()
+{
+	int socket = connection.socket;
+	uint64_t generation = connection.generation;
+	sockaddr_storage remote = connection.remote;
+	string& input = connection.input;
+
+	if ( !connection.upgraded )
+	{
+		string::size_type headersEnd = input.find( "\r\n\r\n" );
+		if ( headersEnd == string::npos )
+		{
+			if ( input.length() <= MAX_UPGRADE_SIZE )
+				return true;
+			++m_stats.framingErrors;
+			Close( socket );
+			return false;
+		}
+		string response;
+		bool upgraded = WebSocket::Upgrade( input.substr( 0, headersEnd + 4 ), response );
+		if ( !Append( connection, string(), response ) )
+			return false; //Closed for being over the limit
+		if ( !upgraded )
+		{
+			++m_stats.framingErrors;
+			Write( connection );
+			Close( socket );
+			return false;
+		}
+		++m_stats.upgrades;
+		connection.upgraded = true;
+		input.erase( 0, headersEnd + 4 );
+	}
+
+	vector<SipMessage*> messages;
+	vector<string> errors;
+	string::size_type offset = 0;
+	bool framed = true, closing = false;
+	while ( framed && !closing )
+	{
+		WebSocket::Frame frame;
+		size_t headerLength = WebSocket::ParseHeader( input.data() + offset, input.length() - offset, frame );
+		if ( headerLength == 0 )
+			break;
+		bool control = frame.opcode >= WebSocket::OP_CLOSE;
+		//Clients must mask (RFC 6455 5.1), control frames are short and whole, and no message may be over the limit
+		if ( !frame.masked || frame.length > SIP_MAX_MESSAGE_SIZE || ( control && ( !frame.final || frame.length > 125 ) ) )
+		{
+			framed = false;
+			break;
+		}
+		size_t length = frame.length;
+		if ( input.length() - offset - headerLength < length )
+			break;
+
+		string::size_type payload = offset + headerLength;
+		WebSocket::Unmask( &input[payload], length, frame.mask );
+		offset = payload + length;
+
+		switch ( frame.opcode )
+		{
+			case WebSocket::OP_PING:
+			{
+				//Never close the connection from in here: input is still being framed
+				string header( WebSocket::Header( WebSocket::OP_PONG, length ) );
+				if ( Fits( connection, header.length() + length ) )
+					Append( connection, header, input.substr( payload, length ) );
+				break;
+			}
+			case WebSocket::OP_PONG:
+				break;
+			case WebSocket::OP_CLOSE:
+			{
+				//Echo the status code, if there is one and there's room for it, and close
+				size_t echoed = length < 2 ? 0 : 2;
+				string header( WebSocket::Header( WebSocket::OP_CLOSE, echoed ) );
+				if ( Fits( connection, header.length() + echoed ) )
+					Append( connection, header, input.substr( payload, echoed ) );
+				closing = true;
+				break;
+			}
+			case WebSocket::OP_TEXT:
+			case WebSocket::OP_BINARY:
+			case WebSocket::OP_CONTINUATION:
+			{
+				bool continuation = frame.opcode == WebSocket::OP_CONTINUATION;
+				if ( continuation != connection.fragmented || connection.fragments.length() + length > SIP_MAX_MESSAGE_SIZE )
+				{
+					framed = false; //A continuation of nothing, a new message inside a fragmented one, or too much
+					break;
+				}
+				if ( frame.final && !continuation )
+				{
+					Parse( connection, input, payload, length, messages, errors );
+					break;
+				}
+				connection.fragments.append( input, payload, length );
+				connection.fragmented = !frame.final;
+				if ( frame.final )
+				{
+					Parse( connection, connection.fragments, 0, connection.fragments.length(), messages, errors );
+					connection.fragments.clear();
+				}
+				break;
+			}
+			default:
+				framed = false;
+				break;
+		}
+	}
+	input.erase( 0, offset );
+
+	if ( closing )
+		Write( connection );
+	if ( !framed )
+		++m_stats.framingErrors;
+	if ( closing || !framed )
+		Close( socket );
+	return Deliver( socket, generation, remote, messages, errors ) && framed && !closing;
+}
+
+void TcpTransport::Parse( Connection& connection, const string& source, string::size_type offset, size_t length, vector<SipMessage*>& messages, vector<string>& errors ) throw()
+{
+	++m_stats.messages;
+	auto_ptr<SipMessage> message;
+	try
+	{
+		if ( length <= m_pool.SlabSize() )
+		{
+			ReceiveBufferHandle slab = m_pool.Acquire();
+			slab->Bytes().assign( source, offset, length );
+			Utility::ParseMessage( message, slab );
+		}
+		else
+			Utility::ParseMessage( message, source.substr( offset, length ) );
+		Alias( connection, *message );
+		messages.push_back( message.release() );
+	}
+	catch ( SipMessageException& e )
+	{
+		++m_stats.parseErrors;
+		errors.push_back( e.what() );
+	}
+}
+
+bool TcpTransport::Deliver( int socket, uint64_t generation, const sockaddr_storage& remote, vector<SipMessage*>& messages, const vector<string>& errors ) throw()
+{
+	for ( vector<string>::const_iterator error = errors.begin(); error != errors.end(); ++error )
+		m_handler.OnParseError( SipMessageException( *error ), remote, socket );
+	for ( size_t i = 0; i < messages.size(); ++i )
+	{
+		auto_ptr<SipMessage> message( messages[i] );
+		m_handler.OnMessage( message, remote, socket );
+	}
+	return Generation( socket ) == generation;
+}
+
+void TcpTransport::Alias( Connection& connection, const SipMessage& message ) throw()
+{
+	if ( message.Type != SipMessage::MT_REQUEST || !message.HasHeader( "via" ) )
+		return;
+	try
+	{
+		const SipHeaderValue& top = message.GetHeaderValues( "via" )[0];
+		if ( !top.HasTag( "alias" ) )
+			return;
+		Via via( top );
+		std::ostringstream alias;
+		alias << via.Host() << ':' << ( via.HasPort() ? via.Port() : DefaultPort() );
+		SetAlias( connection.socket, alias.str() );
+	}
+	catch ( SipHeaderValueException& e )
+	{ } //A Via we can't read just doesn't alias the connection
+}
+
+}; //namespace Sip
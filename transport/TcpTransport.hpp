@@ -0,0 +1,314 @@
+#ifndef TCPTRANSPORT_HPP
+#define TCPTRANSPORT_HPP
+#include <deque>
+#include <map>
+#include <string>
+#include <vector>
+#include <stdint.h>
+#include <sys/socket.h>
+#include <sys/uio.h>
+#include "Reactor.hpp"
+#include "UdpTransport.hpp"
+#include "../ReceiveBuffer.hpp"
+
+namespace Sip {
+
+using std::deque;
+using std::map;
+
+/**
+* \class TcpTransport
+* \brief Accepts and opens SIP over TCP connections through a Reactor, frames the streams into messages and keeps
+*        the connections for reuse
+*
+* Every connection is in a table keyed by its remote address, and may also be known by aliases: the sent-by of a
+* request whose top Via carries ;alias (RFC 5923) is added automatically, and SetAlias() adds others. Send() to an
+* address reuses the connection to it, and only connects if there is none, so a trunk pays for one connection, not
+* one per message. Replies should go back over the connection the request came in on (RFC 3261 18.2.2): use the
+* socket OnMessage() was given.
+*
+* Incoming streams are framed by Content-Length, which RFC 3261 18.3 requires on streams; a message without one, or
+* longer than SIP_MAX_MESSAGE_SIZE, closes the connection. CRLF keep-alives (RFC 5626) are skipped, and a double
+* CRLF ping gets its CRLF pong.
+*
+* A listener may instead speak SIP over WebSocket (RFC 7118), for browser clients. Its connections start with the
+* HTTP upgrade to the "sip" subprotocol; after that each text or binary frame carries one message, unmasked in place
+* in the input before it is parsed. Sends to such a connection are framed, the frame header and the message going
+* out as separate iovecs of the same writev. Over a TlsTransport this is WSS.
+*
+* Outbound messages are queued per connection and written with one writev per connection once the reactor has
+* dispatched the current wakeup (or by Flush()), so the replies to a burst of pipelined requests leave together.
+* Whatever the socket won't take waits for it to become writable.
+*
+* Subclasses layer a security protocol over the stream (see TlsTransport) by overriding Receive() and Transmit(),
+* and may hold a connection aside while they set it up: a held connection is in the table and queues sends, but the
+* reactor doesn't watch it and this class doesn't touch its socket until Release().
+*/
+class TcpTransport : public ReactorHandler, public TransactionSender
+{
+	public:
+		/**
+		 *     What a listener's connections carry
+		 */
+		enum Framing
+		{
+			FRAMING_SIP, //SIP messages straight on the stream (RFC 3261 18.3)
+			FRAMING_WEBSOCKET //An HTTP upgrade, then one SIP message per WebSocket frame (RFC 7118)
+		};
+
+		/**
+		* \class Stats
+		* \brief Running totals since the transport was created
+		*/
+		struct Stats
+		{
+			Stats() : accepted( 0 ), connected( 0 ), closed( 0 ), reused( 0 ), messages( 0 ), bytes( 0 ),
+				parseErrors( 0 ), framingErrors( 0 ), upgrades( 0 ), writes( 0 ), sent( 0 ), sendErrors( 0 ) {}
+			/// Connections accepted, opened by Send() or Connect(), and closed for any reason
+			uint64_t accepted, connected, closed;
+			/// Sends to an address or alias that found a connection already open
+			uint64_t reused;
+			/// Messages framed, bytes read, and messages that framed but didn't parse
+			uint64_t messages, bytes, parseErrors;
+			/// Connections closed because their stream couldn't be framed, or their WebSocket upgrade was refused
+			uint64_t framingErrors;
+			/// WebSocket upgrades accepted
+			uint64_t upgrades;
+			/// writev calls, bytes they wrote, and connections that failed with output pending
+			uint64_t writes, sent, sendErrors;
+		};
+
+		/**
+		 * @param maxQueued Most bytes queued on one connection; a peer that stops reading past this is disconnected
+		 */
+		TcpTransport( Reactor& reactor, SipMessageHandler& handler, size_t maxQueued = 4 * 1024 * 1024 ) throw();
+
+		/**
+		 *     Closes every connection and listening socket
+		 */
+		virtual ~TcpTransport();
+
+		/**
+		 *     Binds a non-blocking listening socket and starts accepting on it.
+		 * @param address A numeric IPv4 or IPv6 address; "0.0.0.0" or "::" for all interfaces
+		 * @param port The port, or 0 for any free one (see UdpSockets::LocalPort(), which works on any socket)
+		 * @param framing What the connections it accepts carry
+		 * @return The listening socket
+		 * @throw TransportException if the socket can't be created, bound or listened on
+		 */
+		int Listen( const string& address, unsigned short port = DEFAULT_UDP_LISTENPORT, Framing framing = FRAMING_SIP ) throw( TransportException );
+
+		/**
+		 *     Opens a connection to destination. The connect completes in the background; sends queue until it does.
+		 * @return The connection, or -1 if it couldn't even be started
+		 */
+		virtual int Connect( const sockaddr_storage& destination ) throw();
+
+		/**
+		 *     The open connection to destination, if there is one
+		 * @return The connection, or -1
+		 */
+		int ConnectionFor( const sockaddr_storage& destination ) const throw();
+
+		/**
+		 *     The connection known by alias, if there is one
+		 * @param alias "host:port"
+		 * @return The connection, or -1
+		 */
+		int ConnectionFor( const string& alias ) const throw();
+
+		/**
+		 *     Makes alias refer to a connection, so sends to it reuse the connection. An alias follows one
+		 *     connection at a time; setting it again moves it.
+		 * @param alias "host:port", as the peer would appear in a URI or Via sent-by
+		 */
+		void SetAlias( int connection, const string& alias ) throw();
+
+		/**
+		 *     Queues data on a connection.
+		 * @return False if connection isn't open, or the peer has stopped reading (it is then closed)
+		 */
+		bool Send( int connection, const string& data ) throw();
+
+		/**
+		 *     Queues data on the connection to destination, connecting first if there is none.
+		 * @return False if there is no connection and one couldn't be started
+		 */
+		bool Send( const string& data, const sockaddr_storage& destination ) throw();
+
+		/**
+		 *     Queues data on the connection known by alias.
+		 * @return False if no connection has the alias
+		 */
+		bool Send( const string& data, const string& alias ) throw();
+
+		/**
+		 *     Writes what is queued, one writev per connection
+		 */
+		void Flush() throw();
+
+		/**
+		 *     Closes a connection, dropping anything queued on it
+		 */
+		void Close( int connection ) throw();
+
+		/**
+		 *     Open connections, including ones still connecting
+		 */
+		size_t Connections() const throw();
+
+		const Stats& GetStats() const throw();
+
+		void OnReadable( int fd );
+		void OnWritable( int fd );
+		void OnDispatchComplete();
+
+	protected:
+		/**
+		 *     Puts a connection in the table.
+		 * @param connecting Whether its connect is still in progress
+		 * @param held Whether the caller keeps the socket for now; see Release()
+		 * @return The connection, or -1 (the socket is then closed)
+		 */
+		int Add( int socket, const sockaddr_storage& remote, bool connecting, bool held = false, Framing framing = FRAMING_SIP ) throw();
+
+		/**
+		 *     Hands a held connection's socket over: the reactor starts watching it and anything queued is written.
+		 * @return False if the connection has gone, or couldn't be watched (it is then closed)
+		 */
+		bool Release( int connection ) throw();
+
+		/**
+		 *     Starts a non-blocking connect to destination.
+		 * @param inProgress Set if the connect hasn't completed yet
+		 * @return The socket, or -1
+		 */
+		int Open( const sockaddr_storage& destination, bool& inProgress ) throw();
+
+		/**
+		 *     Identifies the connection now on a socket, so a later one reusing the number isn't mistaken for it
+		 * @return 0 if there is no connection on the socket
+		 */
+		uint64_t Generation( int connection ) const throw();
+
+		/**
+		 *     Closes every connection; a subclass's destructor calls this while its overrides still apply
+		 */
+		void CloseAll() throw();
+
+		/**
+		 *     A connection was accepted on one of the listening sockets. Adds it.
+		 */
+		virtual void OnAccepted( int socket, const sockaddr_storage& remote, Framing framing ) throw();
+
+		/**
+		 *     A connection is being closed; called before its socket is. A held socket is left open for its holder.
+		 */
+		virtual void OnClosing( int connection, bool held ) throw();
+
+		/**
+		 *     Reads from a connection, with read()'s results: -1 with errno EAGAIN when there is nothing more for now
+		 */
+		virtual ssize_t Receive( int connection, char* buffer, size_t length ) throw();
+
+		/**
+		 *     Writes the start of count vectors to a connection, with writev()'s results
+		 */
+		virtual ssize_t Transmit( int connection, const iovec* vectors, unsigned int count ) throw();
+
+		/**
+		 *     The port a Via sent-by without one means
+		 */
+		virtual unsigned short DefaultPort() const throw();
+
+		/**
+		 *     A map key for an address of either family: family, address bytes and port
+		 */
+		static string AddressKey( const sockaddr_storage& address );
+
+	private:
+		TcpTransport( const TcpTransport& );
+		TcpTransport& operator=( const TcpTransport& );
+
+		/**
+		* \class Connection
+		* \brief One stream: what has arrived but isn't a whole message yet, and what is waiting to be written
+		*/
+		struct Connection
+		{
+			int socket;
+			uint64_t generation; //Tells this connection from a later one on the same socket number
+			sockaddr_storage remote;
+			bool connecting, dirty;
+			bool held; //Someone else has the socket until Release()
+			Framing framing;
+			bool upgraded; //A WebSocket connection past its HTTP upgrade
+			bool fragmented; //Within a fragmented WebSocket message
+			string fragments; //Its fragments so far
+			string input;
+			deque<string> output;
+			size_t outputOffset; //Bytes of output.front() already written
+			size_t queued; //Bytes in output not yet written
+			vector<string> aliases;
+		};
+
+		/**
+		 *     Queues a message, in a frame if the connection is a WebSocket
+		 */
+		bool Queue( Connection& connection, const string& data ) throw();
+
+		/**
+		 *     Queues bytes as they are; a non-empty header goes first, in its own iovec
+		 */
+		bool Append( Connection& connection, const string& header, const string& data ) throw();
+
+		/**
+		 *     Whether length more bytes can be queued without going over the limit, and so without Append() closing
+		 *     the connection; checked by anything queueing while the connection's input is still being framed
+		 */
+		bool Fits( const Connection& connection, size_t length ) const throw();
+		void Write( Connection& connection ) throw();
+		void Accept( int listener ) throw();
+		void Read( Connection& connection ) throw();
+
+		/**
+		 *     Hands every whole message in connection's input to the handler.
+		 * @return False if the connection is gone: closed because the stream couldn't be framed, or by the handler
+		 */
+		bool Frame( Connection& connection ) throw();
+
+		/**
+		 *     Frame() for a WebSocket connection: answers the upgrade, then hands over the message in every whole
+		 *     data frame and answers pings and closes.
+		 */
+		bool FrameWebSocket( Connection& connection ) throw();
+
+		/**
+		 *     Parses length bytes of source into messages, or its error into errors
+		 */
+		void Parse( Connection& connection, const string& source, string::size_type offset, size_t length, vector<SipMessage*>& messages, vector<string>& errors ) throw();
+
+		/**
+		 *     Hands what Parse() collected to the handler.
+		 * @return False if the connection is gone
+		 */
+		bool Deliver( int socket, uint64_t generation, const sockaddr_storage& remote, vector<SipMessage*>& messages, const vector<string>& errors ) throw();
+
+		void Alias( Connection& connection, const SipMessage& message ) throw();
+
+		Reactor& m_reactor;
+		SipMessageHandler& m_handler;
+		size_t m_maxQueued;
+		vector<int> m_listeners, m_webSocketListeners;
+		vector<Connection*> m_connections; //Indexed by socket
+		map<string, int> m_byAddress, m_byAlias;
+		vector<int> m_dirty; //Connections with output queued since the last Flush()
+		vector<char> m_readBuffer;
+		ReceiveBufferPool m_pool;
+		size_t m_open;
+		uint64_t m_generation;
+		Stats m_stats;
+};
+
+}; //namespace Sip
+#endif //TCPTRANSPORT_HPP
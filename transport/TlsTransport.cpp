@@ -0,0 +1,550 @@
+#include "TlsTransport.hpp"
+#include <cstring>
+#include <errno.h>
+#include <poll.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/eventfd.h>
+#include <boost/bind.hpp>
+#include <openssl/err.h>
+
+namespace Sip {
+
+namespace {
+
+const size_t RECORD_SIZE = 16384; //Largest TLS record payload
+const unsigned int POLL_SLICE = 100; //Milliseconds a handshake thread waits before checking whether to stop
+const size_t MAX_RESUMABLE = 4096; //Destinations whose last session is kept
+
+uint64_t Microseconds()
+{
+	timespec now;
+	clock_gettime( CLOCK_MONOTONIC, &now );
+	return static_cast<uint64_t>( now.tv_sec ) * 1000000 + now.tv_nsec / 1000;
+}
+
+/**
+ *     The oldest error on this thread's OpenSSL error queue, which is then cleared
+ */
+string OpenSslError()
+{
+	char text[256];
+	unsigned long error = ERR_get_error();
+	ERR_clear_error();
+	if ( error == 0 )
+		return "unknown error";
+	ERR_error_string_n( error, text, sizeof( text ) );
+	return text;
+}
+
+//A socket BIO that sends with MSG_NOSIGNAL. OpenSSL's own uses write(), which raises SIGPIPE on a reset connection.
+int SocketWrite( BIO* bio, const char* data, int length )
+{
+	int socket = static_cast<int>( reinterpret_cast<intptr_t>( BIO_get_data( bio ) ) );
+	BIO_clear_retry_flags( bio );
+	ssize_t written = send( socket, data, length, MSG_NOSIGNAL );
+	if ( written < 0 && ( errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR ) )
+		BIO_set_retry_write( bio );
+	return written;
+}
+
+int SocketRead( BIO* bio, char* data, int length )
+{
+	int socket = static_cast<int>( reinterpret_cast<intptr_t>( BIO_get_data( bio ) ) );
+	BIO_clear_retry_flags( bio );
+	ssize_t received = recv( socket, data, length, 0 );
+	if ( received < 0 && ( errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR ) )
+		BIO_set_retry_read( bio );
+	return received;
+}
+
+long SocketControl( BIO* bio, int command, long, void* argument )
+{
+	int socket = static_cast<int>( reinterpret_cast<intptr_t>( BIO_get_data( bio ) ) );
+	switch ( command )
+	{
+		case BIO_CTRL_FLUSH:
+			return 1;
+		case BIO_C_GET_FD:
+			if ( argument != NULL )
+				*static_cast<int*>( argument ) = socket;
+			return socket;
+		default:
+			return 0;
+	}
+}
+
+}; //namespace
+
+TlsTransport::TlsTransport( Reactor& reactor, SipMessageHandler& handler, const string& certificateChain, const string& privateKey,
+	unsigned int threads, unsigned int maxHandshakes, unsigned int handshakeTimeout ) throw( TransportException )
+	: TcpTransport( reactor, handler ), m_reactor( reactor ), m_server( NULL ), m_client( NULL ), m_socketMethod( NULL ),
+	m_maxHandshakes( maxHandshakes ), m_timeout( handshakeTimeout ), m_wakeup( -1 ), m_pending( 0 ), m_record( RECORD_SIZE ),
+	m_stopping( false )
+{
+	try
+	{
+		m_server = SSL_CTX_new( TLS_server_method() );
+		m_client = SSL_CTX_new( TLS_client_method() );
+		m_socketMethod = BIO_meth_new( BIO_get_new_index() | BIO_TYPE_SOURCE_SINK | BIO_TYPE_DESCRIPTOR, "sip socket" );
+		if ( m_server == NULL || m_client == NULL || m_socketMethod == NULL )
+			throw TransportException( "Could not create TLS contexts: " + OpenSslError() );
+		BIO_meth_set_write( m_socketMethod, SocketWrite );
+		BIO_meth_set_read( m_socketMethod, SocketRead );
+		BIO_meth_set_ctrl( m_socketMethod, SocketControl );
+
+		SSL_CTX* contexts[] = { m_server, m_client };
+		for ( int i = 0; i < 2; ++i )
+		{
+			SSL_CTX_set_min_proto_version( contexts[i], TLS1_2_VERSION );
+			//Transmit() may offer a repeated write from a different buffer, and idle connections give their buffers back
+			SSL_CTX_set_mode( contexts[i], SSL_MODE_ENABLE_PARTIAL_WRITE | SSL_MODE_ACCEPT_MOVING_WRITE_BUFFER | SSL_MODE_RELEASE_BUFFERS );
+			if ( SSL_CTX_use_certificate_chain_file( contexts[i], certificateChain.c_str() ) != 1 )
+				throw TransportException( "Could not load TLS certificate " + certificateChain + ": " + OpenSslError() );
+			if ( SSL_CTX_use_PrivateKey_file( contexts[i], privateKey.c_str(), SSL_FILETYPE_PEM ) != 1 || SSL_CTX_check_private_key( contexts[i] ) != 1 )
+				throw TransportException( "Could not load TLS private key " + privateKey + ": " + OpenSslError() );
+		}
+
+		//Tickets are sealed with a key the context makes once, so they stay good for the life of the transport
+		static const unsigned char context[] = "sip";
+		SSL_CTX_set_session_id_context( m_server, context, sizeof( context ) - 1 );
+		SSL_CTX_set_num_tickets( m_server, 1 );
+		SSL_CTX_set_session_cache_mode( m_client, SSL_SESS_CACHE_CLIENT | SSL_SESS_CACHE_NO_INTERNAL_STORE );
+		SSL_CTX_sess_set_new_cb( m_client, OnNewSession );
+		SSL_CTX_set_app_data( m_client, this );
+
+		m_wakeup = eventfd( 0, EFD_NONBLOCK | EFD_CLOEXEC );
+		if ( m_wakeup == -1 )
+			throw TransportException( string( "Could not create eventfd: " ) + strerror( errno ) );
+		m_reactor.Add( m_wakeup, *this );
+
+		if ( threads == 0 )
+			threads = 1;
+		try
+		{
+			for ( unsigned int i = 0; i < threads; ++i )
+				m_threads.push_back( new boost::thread( boost::bind( &TlsTransport::Run, this ) ) );
+		}
+		catch ( boost::thread_resource_error& e )
+		{
+			throw TransportException( string( "Could not start handshake threads: " ) + e.what() );
+		}
+	}
+	catch ( TransportException& e )
+	{
+		Shutdown();
+		throw;
+	}
+}
+
+TlsTransport::~TlsTransport()
+{
+	Shutdown();
+}
+
+void TlsTransport::Verify( const string& trustedCertificates ) throw( TransportException )
+{
+	if ( SSL_CTX_load_verify_locations( m_client, trustedCertificates.c_str(), NULL ) != 1 )
+		throw TransportException( "Could not load trusted certificates " + trustedCertificates + ": " + OpenSslError() );
+	SSL_CTX_set_verify( m_client, SSL_VERIFY_PEER, NULL );
+}
+
+int TlsTransport::Connect( const sockaddr_storage& destination ) throw()
+{
+	bool inProgress;
+	int sock = Open( destination, inProgress );
+	if ( sock == -1 || Add( sock, destination, true, true ) == -1 )
+		return -1;
+
+	Handshake handshake;
+	handshake.socket = sock;
+	handshake.generation = Generation( sock );
+	handshake.remote = destination;
+	handshake.framing = FRAMING_SIP;
+	handshake.client = true;
+	Submit( handshake );
+	return sock;
+}
+
+unsigned int TlsTransport::HandshakesPending() const throw()
+{
+	return m_pending;
+}
+
+const TlsTransport::HandshakeStats& TlsTransport::GetHandshakeStats() const throw()
+{
+	return m_stats;
+}
+
+void TlsTransport::OnReadable( int fd )
+{
+	if ( fd == m_wakeup )
+		Complete();
+	else
+		TcpTransport::OnReadable( fd );
+}
+
+void TlsTransport::OnAccepted( int socket, const sockaddr_storage& remote, Framing framing ) throw()
+{
+	if ( m_pending >= m_maxHandshakes )
+	{
+		++m_stats.rejected;
+		close( socket );
+		return;
+	}
+	Handshake handshake;
+	handshake.socket = socket;
+	handshake.generation = 0;
+	handshake.remote = remote;
+	handshake.framing = framing;
+	handshake.client = false;
+	Submit( handshake );
+}
+
+void TlsTransport::OnClosing( int connection, bool held ) throw()
+{
+	if ( held || static_cast<size_t>( connection ) >= m_sessions.size() || m_sessions[connection].ssl == NULL )
+		return;
+	Session& session = m_sessions[connection];
+	SSL_shutdown( session.ssl ); //Sends close_notify if the socket will take it; the peer's isn't waited for
+	ERR_clear_error();
+	SSL_free( session.ssl );
+	session.ssl = NULL;
+	session.retry = 0;
+}
+
+ssize_t TlsTransport::Receive( int connection, char* buffer, size_t length ) throw()
+{
+	if ( static_cast<size_t>( connection ) >= m_sessions.size() || m_sessions[connection].ssl == NULL )
+	{
+		errno = ENOTCONN;
+		return -1;
+	}
+	SSL* ssl = m_sessions[connection].ssl;
+	ERR_clear_error();
+	int result = SSL_read( ssl, buffer, length );
+	if ( result > 0 )
+		return result;
+	switch ( SSL_get_error( ssl, result ) )
+	{
+		case SSL_ERROR_WANT_READ:
+		case SSL_ERROR_WANT_WRITE:
+			errno = EAGAIN;
+			return -1;
+		case SSL_ERROR_ZERO_RETURN:
+			return 0;
+		default:
+			ERR_clear_error();
+			errno = ECONNRESET;
+			return -1;
+	}
+}
+
+ssize_t TlsTransport::Transmit( int connection, const iovec* vectors, unsigned int count ) throw()
+{
+	if ( static_cast<size_t>( connection ) >= m_sessions.size() || m_sessions[connection].ssl == NULL )
+	{
+		errno = EPIPE;
+		return -1;
+	}
+	Session& session = m_sessions[connection];
+
+	//A write OpenSSL couldn't finish must be repeated with the same bytes; the queue only grows at the back, so the
+	//same length from its front is the same bytes
+	size_t length = session.retry;
+	if ( length == 0 )
+		for ( unsigned int i = 0; i < count && length < RECORD_SIZE; ++i )
+			length += vectors[i].iov_len;
+	if ( length > RECORD_SIZE )
+		length = RECORD_SIZE;
+
+	const char* data = static_cast<const char*>( vectors[0].iov_base );
+	if ( vectors[0].iov_len < length )
+	{
+		size_t gathered = 0;
+		for ( unsigned int i = 0; i < count && gathered < length; ++i )
+		{
+			size_t take = std::min( vectors[i].iov_len, length - gathered );
+			memcpy( &m_record[gathered], vectors[i].iov_base, take );
+			gathered += take;
+		}
+		data = &m_record[0];
+	}
+
+	ERR_clear_error();
+	int result = SSL_write( session.ssl, data, length );
+	if ( result > 0 )
+	{
+		session.retry = 0;
+		return result;
+	}
+	switch ( SSL_get_error( session.ssl, result ) )
+	{
+		case SSL_ERROR_WANT_READ:
+		case SSL_ERROR_WANT_WRITE:
+			session.retry = length;
+			errno = EAGAIN;
+			return -1;
+		default:
+			ERR_clear_error();
+			errno = EPIPE;
+			return -1;
+	}
+}
+
+unsigned short TlsTransport::DefaultPort() const throw()
+{
+	return DEFAULT_TLS_LISTENPORT;
+}
+
+void TlsTransport::Submit( const Handshake& handshake ) throw()
+{
+	++m_pending;
+	{
+		boost::mutex::scoped_lock lock( m_lock );
+		m_waiting.push_back( handshake );
+	}
+	m_queued.notify_one();
+}
+
+void TlsTransport::Run() throw()
+{
+	for ( ;; )
+	{
+		Handshake handshake;
+		{
+			boost::mutex::scoped_lock lock( m_lock );
+			while ( !m_stopping && m_waiting.empty() )
+				m_queued.wait( lock );
+			if ( m_stopping )
+				return;
+			handshake = m_waiting.front();
+			m_waiting.pop_front();
+		}
+
+		Perform( handshake );
+
+		{
+			boost::mutex::scoped_lock lock( m_lock );
+			m_done.push_back( handshake );
+		}
+		uint64_t one = 1;
+		ssize_t written = write( m_wakeup, &one, sizeof( one ) );
+		(void)written; //A full counter already means "wake up"
+	}
+}
+
+void TlsTransport::Perform( Handshake& handshake ) throw()
+{
+	uint64_t started = Microseconds(), deadline = started + static_cast<uint64_t>( m_timeout ) * 1000;
+	handshake.ssl = NULL;
+	handshake.succeeded = handshake.resumed = false;
+	handshake.microseconds = 0;
+
+	if ( handshake.client )
+	{
+		int error = 0;
+		socklen_t length = sizeof( error );
+		if ( !Await( handshake.socket, POLLOUT, deadline ) ||
+			getsockopt( handshake.socket, SOL_SOCKET, SO_ERROR, &error, &length ) == -1 || error != 0 )
+			return;
+	}
+
+	BIO* bio = BIO_new( m_socketMethod );
+	SSL* ssl = SSL_new( handshake.client ? m_client : m_server );
+	if ( bio == NULL || ssl == NULL )
+	{
+		BIO_free( bio );
+		SSL_free( ssl );
+		ERR_clear_error();
+		return;
+	}
+	BIO_set_data( bio, reinterpret_cast<void*>( static_cast<intptr_t>( handshake.socket ) ) );
+	BIO_set_init( bio, 1 );
+	SSL_set_bio( ssl, bio, bio );
+	handshake.ssl = ssl;
+
+	if ( handshake.client )
+	{
+		boost::mutex::scoped_lock lock( m_lock );
+		map<string, SSL_SESSION*>::iterator resumable = m_resumable.find( AddressKey( handshake.remote ) );
+		if ( resumable != m_resumable.end() )
+			SSL_set_session( ssl, resumable->second );
+		SSL_set_connect_state( ssl );
+	}
+	else
+		SSL_set_accept_state( ssl );
+
+	for ( ;; )
+	{
+		ERR_clear_error();
+		int result = SSL_do_handshake( ssl );
+		if ( result == 1 )
+			break;
+		int error = SSL_get_error( ssl, result );
+		if ( error == SSL_ERROR_WANT_READ ? !Await( handshake.socket, POLLIN, deadline ) :
+			error == SSL_ERROR_WANT_WRITE ? !Await( handshake.socket, POLLOUT, deadline ) : true )
+		{
+			ERR_clear_error();
+			return;
+		}
+	}
+	handshake.succeeded = true;
+	handshake.resumed = SSL_session_reused( ssl ) == 1;
+	handshake.microseconds = Microseconds() - started;
+}
+
+bool TlsTransport::Await( int socket, short events, uint64_t deadline ) throw()
+{
+	for ( ;; )
+	{
+		if ( __atomic_load_n( &m_stopping, __ATOMIC_SEQ_CST ) )
+			return false;
+		uint64_t now = Microseconds();
+		if ( now >= deadline )
+			return false;
+		uint64_t wait = std::min<uint64_t>( ( deadline - now + 999 ) / 1000, POLL_SLICE );
+		pollfd ready = { socket, events, 0 };
+		int result = poll( &ready, 1, wait );
+		if ( result > 0 )
+			return true; //Errors and hangups too: the handshake then fails on them
+		if ( result < 0 && errno != EINTR )
+			return false;
+	}
+}
+
+void TlsTransport::Complete() throw()
+{
+	uint64_t signals;
+	ssize_t drained = read( m_wakeup, &signals, sizeof( signals ) );
+	(void)drained;
+
+	deque<Handshake> done;
+	{
+		boost::mutex::scoped_lock lock( m_lock );
+		done.swap( m_done );
+	}
+
+	for ( deque<Handshake>::iterator handshake = done.begin(); handshake != done.end(); ++handshake )
+	{
+		--m_pending;
+		if ( handshake->succeeded )
+		{
+			++m_stats.completed;
+			if ( handshake->resumed )
+				++m_stats.resumed;
+			m_stats.microseconds += handshake->microseconds;
+		}
+		else
+			++m_stats.failed;
+
+		int socket = handshake->socket;
+		if ( handshake->client && Generation( socket ) != handshake->generation )
+		{
+			Discard( *handshake ); //Closed while the pool had it
+			continue;
+		}
+		if ( !handshake->succeeded )
+		{
+			if ( handshake->client )
+			{
+				//Anything queued on it fails with it
+				Release( socket );
+				Close( socket );
+				handshake->socket = -1; //Close() has closed it, and the number may already be someone else's
+			}
+			Discard( *handshake );
+			continue;
+		}
+
+		if ( static_cast<size_t>( socket ) >= m_sessions.size() )
+			m_sessions.resize( socket + 1 );
+		m_sessions[socket].ssl = handshake->ssl;
+		m_sessions[socket].retry = 0;
+		if ( handshake->client )
+			Release( socket );
+		else if ( Add( socket, handshake->remote, false, false, handshake->framing ) == -1 )
+		{
+			SSL_free( m_sessions[socket].ssl );
+			m_sessions[socket].ssl = NULL;
+		}
+	}
+}
+
+void TlsTransport::Discard( Handshake& handshake ) throw()
+{
+	if ( handshake.ssl != NULL )
+		SSL_free( handshake.ssl );
+	handshake.ssl = NULL;
+	if ( handshake.socket != -1 )
+		close( handshake.socket );
+	handshake.socket = -1;
+}
+
+void TlsTransport::Shutdown() throw()
+{
+	{
+		boost::mutex::scoped_lock lock( m_lock );
+		__atomic_store_n( &m_stopping, true, __ATOMIC_SEQ_CST );
+	}
+	m_queued.notify_all();
+	for ( vector<boost::thread*>::iterator thread = m_threads.begin(); thread != m_threads.end(); ++thread )
+	{
+		( *thread )->join();
+		delete *thread;
+	}
+	m_threads.clear();
+
+	//Whatever the pool still had is closed along with the connections
+	m_done.insert( m_done.end(), m_waiting.begin(), m_waiting.end() );
+	m_waiting.clear();
+	for ( deque<Handshake>::iterator handshake = m_done.begin(); handshake != m_done.end(); ++handshake )
+	{
+		if ( handshake->client && Generation( handshake->socket ) == handshake->generation )
+			Close( handshake->socket );
+		Discard( *handshake );
+	}
+	m_done.clear();
+	m_pending = 0;
+	CloseAll();
+
+	for ( map<string, SSL_SESSION*>::iterator resumable = m_resumable.begin(); resumable != m_resumable.end(); ++resumable )
+		SSL_SESSION_free( resumable->second );
+	m_resumable.clear();
+	if ( m_wakeup != -1 )
+	{
+		m_reactor.Remove( m_wakeup );
+		close( m_wakeup );
+		m_wakeup = -1;
+	}
+	SSL_CTX_free( m_server );
+	SSL_CTX_free( m_client );
+	BIO_meth_free( m_socketMethod );
+	m_server = m_client = NULL;
+	m_socketMethod = NULL;
+}
+
+int TlsTransport::OnNewSession( SSL* ssl, SSL_SESSION* session )
+{
+	TlsTransport* transport = static_cast<TlsTransport*>( SSL_CTX_get_app_data( SSL_get_SSL_CTX( ssl ) ) );
+	sockaddr_storage peer;
+	socklen_t length = sizeof( peer );
+	if ( getpeername( SSL_get_fd( ssl ), reinterpret_cast<sockaddr*>( &peer ), &length ) == -1 )
+		return 0;
+
+	string key( AddressKey( peer ) );
+	boost::mutex::scoped_lock lock( transport->m_lock );
+	map<string, SSL_SESSION*>::iterator previous = transport->m_resumable.find( key );
+	if ( previous != transport->m_resumable.end() )
+	{
+		SSL_SESSION_free( previous->second );
+		previous->second = session;
+	}
+	else if ( transport->m_resumable.size() < MAX_RESUMABLE )
+		transport->m_resumable[key] = session;
+	else
+		return 0;
+	return 1; //We keep the reference
+}
+
+}; //namespace Sip
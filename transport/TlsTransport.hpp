@@ -0,0 +1,161 @@
+#ifndef TLSTRANSPORT_HPP
+#define TLSTRANSPORT_HPP
+#include <deque>
+#include <map>
+#include <string>
+#include <vector>
+#include <stdint.h>
+#include <boost/thread.hpp>
+#include <openssl/ssl.h>
+#include "TcpTransport.hpp"
+
+namespace Sip {
+
+/**
+* \class TlsTransport
+* \brief SIP over TLS: a TcpTransport whose streams are encrypted with OpenSSL, with handshakes done on a thread pool
+*        and sessions resumed where the peer allows it
+*
+* Handshakes never run on the reactor thread. An accepted socket goes to the pool straight away and joins the
+* connection table only once its handshake has finished; an outbound connection is in the table (and queues sends)
+* from Connect() on, but is held by the pool until its handshake is done. A handshake that takes longer than
+* handshakeTimeout fails and its connection is closed. At most maxHandshakes may be waiting or in progress at once;
+* connections accepted past that are closed at once and counted as rejected, so a reconnect storm costs a bounded
+* amount of CPU and never holds up established connections.
+*
+* Resumption spares a phone reconnecting after a NAT timeout the full handshake. As a server, every connection
+* issues a session ticket encrypted with a key kept for the life of the transport, and a client presenting one
+* resumes. As a client, the last session from each destination is kept and offered on the next connect to it.
+*
+* Once established, reads and writes are OpenSSL's on the reactor thread. Queued output is written as records of up
+* to 16KB, so the replies to a burst of pipelined requests share records the way they share a writev on TCP.
+*/
+class TlsTransport : public TcpTransport
+{
+	public:
+		/**
+		* \class HandshakeStats
+		* \brief Running totals of handshakes; sample them twice to get rates
+		*/
+		struct HandshakeStats
+		{
+			HandshakeStats() : completed( 0 ), resumed( 0 ), failed( 0 ), rejected( 0 ), microseconds( 0 ) {}
+			/// Handshakes that completed, and how many of those resumed a session
+			uint64_t completed, resumed;
+			/// Handshakes that failed or timed out, and accepted connections turned away because the pool was full
+			uint64_t failed, rejected;
+			/// Time spent in completed handshakes, from a pool thread taking them up to their end
+			uint64_t microseconds;
+		};
+
+		/**
+		 * @param certificateChain PEM file with this side's certificate first, then any intermediates
+		 * @param privateKey PEM file with the certificate's private key
+		 * @param threads Handshake threads
+		 * @param maxHandshakes Most handshakes waiting or in progress; further accepted connections are closed
+		 * @param handshakeTimeout Milliseconds a handshake may take
+		 * @throw TransportException if the certificate or key can't be loaded, or the pool can't be started
+		 */
+		TlsTransport( Reactor& reactor, SipMessageHandler& handler, const string& certificateChain, const string& privateKey,
+			unsigned int threads = 2, unsigned int maxHandshakes = 256, unsigned int handshakeTimeout = 5000 ) throw( TransportException );
+
+		/**
+		 *     Stops the handshake threads and closes every connection
+		 */
+		~TlsTransport();
+
+		/**
+		 *     Makes outbound connections verify the server's certificate against trusted CAs. Without it any
+		 *     certificate is accepted, which suits phones and loopback tests but not trunks.
+		 * @param trustedCertificates PEM file of CA certificates
+		 * @throw TransportException if the file can't be loaded
+		 */
+		void Verify( const string& trustedCertificates ) throw( TransportException );
+
+		/**
+		 *     Opens a connection to destination and hands it to the pool for its handshake; sends queue until it is done.
+		 * @return The connection, or -1 if it couldn't even be started
+		 */
+		int Connect( const sockaddr_storage& destination ) throw();
+
+		/**
+		 *     Handshakes waiting for or on a pool thread
+		 */
+		unsigned int HandshakesPending() const throw();
+
+		const HandshakeStats& GetHandshakeStats() const throw();
+
+		void OnReadable( int fd );
+
+	protected:
+		void OnAccepted( int socket, const sockaddr_storage& remote, Framing framing ) throw();
+		void OnClosing( int connection, bool held ) throw();
+		ssize_t Receive( int connection, char* buffer, size_t length ) throw();
+		ssize_t Transmit( int connection, const iovec* vectors, unsigned int count ) throw();
+		unsigned short DefaultPort() const throw();
+
+	private:
+		TlsTransport( const TlsTransport& );
+		TlsTransport& operator=( const TlsTransport& );
+
+		/**
+		* \class Handshake
+		* \brief One handshake on its way through the pool and back. The pool owns the socket while it has this.
+		*/
+		struct Handshake
+		{
+			int socket;
+			uint64_t generation; //Of the held connection, for an outbound handshake
+			sockaddr_storage remote;
+			Framing framing; //Of the listener an inbound connection came from
+			bool client, succeeded, resumed;
+			SSL* ssl;
+			uint64_t microseconds;
+		};
+
+		/**
+		* \class Session
+		* \brief A connection's TLS state, on the reactor thread once its handshake is done
+		*/
+		struct Session
+		{
+			Session() : ssl( NULL ), retry( 0 ) {}
+			SSL* ssl;
+			size_t retry; //Length of an SSL_write that wants repeating, which must be repeated the same
+		};
+
+		void Submit( const Handshake& handshake ) throw();
+		void Run() throw();
+		void Perform( Handshake& handshake ) throw();
+		bool Await( int socket, short events, uint64_t deadline ) throw();
+		void Complete() throw();
+		void Discard( Handshake& handshake ) throw();
+
+		/**
+		 *     Stops the pool, closes what it had and every connection, and frees the contexts
+		 */
+		void Shutdown() throw();
+
+		static int OnNewSession( SSL* ssl, SSL_SESSION* session );
+
+		Reactor& m_reactor;
+		SSL_CTX *m_server, *m_client;
+		BIO_METHOD* m_socketMethod;
+		unsigned int m_maxHandshakes, m_timeout;
+		int m_wakeup;
+		unsigned int m_pending; //Reactor thread: handshakes submitted and not yet completed
+		vector<Session> m_sessions; //Indexed by socket
+		vector<char> m_record;
+		HandshakeStats m_stats;
+
+		//Shared with the pool
+		boost::mutex m_lock;
+		boost::condition_variable m_queued;
+		deque<Handshake> m_waiting, m_done;
+		map<string, SSL_SESSION*> m_resumable; //Last session per destination, by TcpTransport::AddressKey()
+		bool m_stopping;
+		vector<boost::thread*> m_threads;
+};
+
+}; //namespace Sip
+#endif //TLSTRANSPORT_HPP
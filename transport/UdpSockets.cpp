@@ -0,0 +1,243 @@
+#include "UdpSockets.hpp"
+#include <cstring>
+#include <sstream>
+#include <errno.h>
+#include <ifaddrs.h>
+#include <netdb.h>
+#include <netinet/in.h>
+#include <unistd.h>
+
+namespace Sip {
+
+namespace {
+
+/**
+ *     The raw address inside a sockaddr, for comparing addresses of either family byte by byte
+ */
+const unsigned char* AddressBytes( const sockaddr_storage& address, size_t& length )
+{
+	if ( address.ss_family == AF_INET6 )
+	{
+		length = sizeof( in6_addr );
+		return reinterpret_cast<const unsigned char*>( &reinterpret_cast<const sockaddr_in6&>( address ).sin6_addr );
+	}
+	length = sizeof( in_addr );
+	return reinterpret_cast<const unsigned char*>( &reinterpret_cast<const sockaddr_in&>( address ).sin_addr );
+}
+
+bool SameSubnet( const sockaddr_storage& local, const sockaddr_storage& netmask, const sockaddr_storage& remote )
+{
+	size_t length;
+	const unsigned char* localBytes = AddressBytes( local, length );
+	const unsigned char* maskBytes = AddressBytes( netmask, length );
+	const unsigned char* remoteBytes = AddressBytes( remote, length );
+	for ( size_t i = 0; i < length; ++i )
+		if ( ( localBytes[i] & maskBytes[i] ) != ( remoteBytes[i] & maskBytes[i] ) )
+			return false;
+	return true;
+}
+
+bool IsWildcard( const sockaddr_storage& address )
+{
+	size_t length;
+	const unsigned char* bytes = AddressBytes( address, length );
+	for ( size_t i = 0; i < length; ++i )
+		if ( bytes[i] != 0 )
+			return false;
+	return true;
+}
+
+}; //namespace
+
+UdpSockets::~UdpSockets()
+{
+	for ( vector<int>::iterator sock = m_sockets.begin(); sock != m_sockets.end(); ++sock )
+		close( *sock );
+}
+
+int UdpSockets::Bind( const string& address, unsigned short port, bool sharePort ) throw( TransportException )
+{
+	std::ostringstream portAsString;
+	portAsString << port;
+
+	addrinfo hints, *result;
+	memset( &hints, 0, sizeof( hints ) );
+	hints.ai_family = AF_UNSPEC;
+	hints.ai_socktype = SOCK_DGRAM;
+	hints.ai_flags = AI_PASSIVE | AI_NUMERICHOST | AI_NUMERICSERV;
+
+	int error = getaddrinfo( address.c_str(), portAsString.str().c_str(), &hints, &result );
+	if ( error != 0 )
+		throw TransportException( string( "Invalid listen address " ) + address + ": " + gai_strerror( error ) );
+
+	int sock = socket( result->ai_family, SOCK_DGRAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0 );
+	if ( sock == -1 )
+	{
+		freeaddrinfo( result );
+		throw TransportException( string( "Could not create socket: " ) + strerror( errno ) );
+	}
+
+	int on = 1;
+	setsockopt( sock, SOL_SOCKET, SO_REUSEADDR, &on, sizeof( on ) );
+	if ( sharePort && setsockopt( sock, SOL_SOCKET, SO_REUSEPORT, &on, sizeof( on ) ) == -1 )
+	{
+		freeaddrinfo( result );
+		close( sock );
+		throw TransportException( string( "Could not share port: " ) + strerror( errno ) );
+	}
+	if ( result->ai_family == AF_INET6 ) //"::" should mean IPv6 only; listen on "0.0.0.0" as well for IPv4
+		setsockopt( sock, IPPROTO_IPV6, IPV6_V6ONLY, &on, sizeof( on ) );
+
+	if ( bind( sock, result->ai_addr, result->ai_addrlen ) == -1 )
+	{
+		std::ostringstream errorBuilder;
+		errorBuilder << "Could not bind to UDP " << address << " port " << port << ", error: " << strerror( errno );
+		freeaddrinfo( result );
+		close( sock );
+		throw TransportException( errorBuilder.str() );
+	}
+	freeaddrinfo( result );
+
+	//Work out which destinations this socket suits now, so SocketFor() needs no system calls
+	Listener listener;
+	memset( &listener, 0, sizeof( listener ) );
+	listener.socket = sock;
+	socklen_t localLength = sizeof( listener.local );
+	getsockname( sock, reinterpret_cast<sockaddr*>( &listener.local ), &localLength );
+	listener.wildcard = IsWildcard( listener.local );
+	listener.netmask.ss_family = listener.local.ss_family;
+	size_t length;
+	unsigned char* mask = const_cast<unsigned char*>( AddressBytes( listener.netmask, length ) );
+	memset( mask, 0xff, length ); //Unless an interface says otherwise, only the bound address itself is local
+
+	ifaddrs* interfaces;
+	if ( !listener.wildcard && getifaddrs( &interfaces ) == 0 )
+	{
+		for ( ifaddrs* interface = interfaces; interface != NULL; interface = interface->ifa_next )
+		{
+			if ( interface->ifa_addr == NULL || interface->ifa_netmask == NULL || interface->ifa_addr->sa_family != listener.local.ss_family )
+				continue;
+			sockaddr_storage interfaceAddress, interfaceMask;
+			memcpy( &interfaceAddress, interface->ifa_addr, AddressLength( listener.local ) );
+			memcpy( &interfaceMask, interface->ifa_netmask, AddressLength( listener.local ) );
+			size_t ignored;
+			if ( memcmp( AddressBytes( interfaceAddress, ignored ), AddressBytes( listener.local, ignored ), length ) == 0 )
+			{
+				memcpy( mask, AddressBytes( interfaceMask, ignored ), length );
+				break;
+			}
+		}
+		freeifaddrs( interfaces );
+	}
+
+	m_sockets.push_back( sock );
+	m_listeners.push_back( listener );
+	return sock;
+}
+
+void UdpSockets::Close( int socket ) throw()
+{
+	for ( size_t i = 0; i < m_sockets.size(); ++i )
+	{
+		if ( m_sockets[i] != socket )
+			continue;
+		m_sockets.erase( m_sockets.begin() + i );
+		m_listeners.erase( m_listeners.begin() + i );
+		close( socket );
+		return;
+	}
+}
+
+int UdpSockets::SocketFor( const sockaddr_storage& destination ) const throw()
+{
+	int wildcard = -1, sameFamily = -1;
+	for ( vector<Listener>::const_iterator listener = m_listeners.begin(); listener != m_listeners.end(); ++listener )
+	{
+		if ( listener->local.ss_family != destination.ss_family )
+			continue;
+		if ( listener->wildcard )
+		{
+			if ( wildcard == -1 )
+				wildcard = listener->socket;
+		}
+		else if ( SameSubnet( listener->local, listener->netmask, destination ) )
+			return listener->socket;
+		if ( sameFamily == -1 )
+			sameFamily = listener->socket;
+	}
+	return wildcard != -1 ? wildcard : sameFamily;
+}
+
+void UdpSockets::Resolve( const string& host, unsigned short port, sockaddr_storage& destination ) const throw( TransportException )
+{
+	std::ostringstream portAsString;
+	portAsString << port;
+
+	addrinfo hints, *result;
+	memset( &hints, 0, sizeof( hints ) );
+	hints.ai_family = AF_UNSPEC;
+	hints.ai_socktype = SOCK_DGRAM;
+	hints.ai_flags = AI_NUMERICSERV;
+
+	int error = getaddrinfo( host.c_str(), portAsString.str().c_str(), &hints, &result );
+	if ( error != 0 )
+		throw TransportException( string( "Could not resolve host " ) + host + ": " + gai_strerror( error ) );
+
+	//An address we have no socket for can't be sent to, so take one we can if there is one
+	addrinfo* chosen = result;
+	for ( addrinfo* candidate = result; candidate != NULL; candidate = candidate->ai_next )
+	{
+		bool listening = false;
+		for ( vector<Listener>::const_iterator listener = m_listeners.begin(); listener != m_listeners.end() && !listening; ++listener )
+			listening = listener->local.ss_family == candidate->ai_family;
+		if ( listening )
+		{
+			chosen = candidate;
+			break;
+		}
+	}
+
+	memset( &destination, 0, sizeof( destination ) );
+	memcpy( &destination, chosen->ai_addr, chosen->ai_addrlen );
+	freeaddrinfo( result );
+}
+
+void UdpSockets::Resolve( const URI& recipient, sockaddr_storage& destination ) const throw( TransportException )
+{
+	try
+	{
+		if ( !recipient.HasHost() )
+			throw TransportException( "No host to send message to" );
+		if ( recipient.HasProtocol() && recipient.Protocol() != "sip" )
+			throw TransportException( string( "Unsupported protocol: " ) + recipient.Protocol() );
+
+		Resolve( recipient.Host(), recipient.HasPort() ? recipient.Port() : DEFAULT_UDP_LISTENPORT, destination );
+	}
+	catch ( URIException& e )
+	{
+		throw TransportException( e.what() );
+	}
+}
+
+unsigned short UdpSockets::LocalPort( int socket ) throw()
+{
+	sockaddr_storage local;
+	socklen_t length = sizeof( local );
+	if ( getsockname( socket, reinterpret_cast<sockaddr*>( &local ), &length ) == -1 )
+		return 0;
+	if ( local.ss_family == AF_INET6 )
+		return ntohs( reinterpret_cast<sockaddr_in6&>( local ).sin6_port );
+	return ntohs( reinterpret_cast<sockaddr_in&>( local ).sin_port );
+}
+
+socklen_t UdpSockets::AddressLength( const sockaddr_storage& address ) throw()
+{
+	return address.ss_family == AF_INET6 ? sizeof( sockaddr_in6 ) : sizeof( sockaddr_in );
+}
+
+const vector<int>& UdpSockets::Sockets() const throw()
+{
+	return m_sockets;
+}
+
+}; //namespace Sip
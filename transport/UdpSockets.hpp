@@ -0,0 +1,101 @@
+#ifndef UDPSOCKETS_HPP
+#define UDPSOCKETS_HPP
+#include <string>
+#include <vector>
+#include <sys/socket.h>
+#include "Reactor.hpp"
+#include "../SipDefines.hpp"
+#include "../URI.hpp"
+
+namespace Sip {
+
+/**
+* \class UdpSockets
+* \brief The bound UDP sockets a transport listens and sends on, whatever loop drives them
+*
+* Outbound datagrams always leave through one of these, so peers behind NAT see the port they registered against.
+* Resolve() does the name lookup once, outside the send path; SocketFor() picks a socket from what Bind() worked out,
+* without system calls.
+*/
+class UdpSockets
+{
+	public:
+		/**
+		 *     Closes every socket
+		 */
+		virtual ~UdpSockets();
+
+		/**
+		 *     Picks the socket to send to destination from: one bound to an address on the destination's
+		 *     subnet, else a wildcard socket of the same family, else any socket of the same family.
+		 * @return The socket, or -1 if none is bound on the destination's address family
+		 */
+		int SocketFor( const sockaddr_storage& destination ) const throw();
+
+		/**
+		 *     Looks up host once so later sends can reuse the address. Prefers addresses of a family a socket is
+		 *     bound on.
+		 * @param host A host name or numeric address
+		 * @param port The port
+		 * @param destination Filled with the address
+		 * @throw TransportException if host doesn't resolve
+		 */
+		void Resolve( const string& host, unsigned short port, sockaddr_storage& destination ) const throw( TransportException );
+
+		/**
+		 *     Resolves a sip: URI, defaulting to DEFAULT_UDP_LISTENPORT when it has no port.
+		 * @throw TransportException if the URI has no host, isn't sip: or doesn't resolve
+		 */
+		void Resolve( const URI& recipient, sockaddr_storage& destination ) const throw( TransportException );
+
+		/**
+		 *     The port a socket is bound to
+		 */
+		static unsigned short LocalPort( int socket ) throw();
+
+		/**
+		 *     The length to pass with a sockaddr_storage holding an IPv4 or IPv6 address
+		 */
+		static socklen_t AddressLength( const sockaddr_storage& address ) throw();
+
+		const vector<int>& Sockets() const throw();
+
+	protected:
+		UdpSockets() throw() {}
+
+		/**
+		 *     Creates and binds a non-blocking UDP socket.
+		 * @param address A numeric IPv4 or IPv6 address; "0.0.0.0" or "::" for all interfaces
+		 * @param port The port, or 0 for any free one
+		 * @param sharePort Set SO_REUSEPORT, so other sockets with it set can bind the same address and port and
+		 *        the kernel spreads datagrams across them
+		 * @throw TransportException if the socket can't be created or bound
+		 */
+		int Bind( const string& address, unsigned short port, bool sharePort = false ) throw( TransportException );
+
+		/**
+		 *     Closes a socket from Bind() and forgets it
+		 */
+		void Close( int socket ) throw();
+
+	private:
+		UdpSockets( const UdpSockets& );
+		UdpSockets& operator=( const UdpSockets& );
+
+		/**
+		* \class Listener
+		* \brief What SocketFor() needs to know about a socket, worked out once in Bind()
+		*/
+		struct Listener
+		{
+			int socket;
+			sockaddr_storage local, netmask;
+			bool wildcard;
+		};
+
+		vector<int> m_sockets;
+		vector<Listener> m_listeners;
+};
+
+}; //namespace Sip
+#endif //UDPSOCKETS_HPP
@@ -0,0 +1,230 @@
+#include "UdpTransport.hpp"
+#include <cstring>
+#include <errno.h>
+#include "../SipUtility.hpp"
+
+namespace Sip {
+
+UdpTransport::UdpTransport( Reactor& reactor, SipMessageHandler& handler, unsigned int batchSize ) throw()
+	: m_reactor( reactor ), m_handler( handler ), m_batchSize( batchSize == 0 ? 1 : batchSize ),
+	m_slabs( m_batchSize ), m_overflow( m_batchSize * ( SIP_MAX_MESSAGE_SIZE - m_pool.SlabSize() ) ),
+	m_receiveVectors( m_batchSize * 2 ), m_sources( m_batchSize ),
+	m_receiveHeaders( m_batchSize ), m_sendVectors( m_batchSize ), m_sendHeaders( m_batchSize )
+{
+	m_stats.receiveBatches.resize( m_batchSize + 1, 0 );
+	m_stats.sendBatches.resize( m_batchSize + 1, 0 );
+
+	memset( &m_receiveHeaders[0], 0, m_batchSize * sizeof( mmsghdr ) );
+	size_t overflow = SIP_MAX_MESSAGE_SIZE - m_pool.SlabSize();
+	for ( unsigned int i = 0; i < m_batchSize; ++i )
+	{
+		Refill( i );
+		m_receiveVectors[ i * 2 + 1 ].iov_base = &m_overflow[ i * overflow ];
+		m_receiveVectors[ i * 2 + 1 ].iov_len = overflow;
+		m_receiveHeaders[i].msg_hdr.msg_iov = &m_receiveVectors[ i * 2 ];
+		m_receiveHeaders[i].msg_hdr.msg_iovlen = 2;
+		m_receiveHeaders[i].msg_hdr.msg_name = &m_sources[i];
+	}
+}
+
+void UdpTransport::Refill( unsigned int entry ) throw()
+{
+	m_slabs[entry] = m_pool.Acquire();
+	m_receiveVectors[ entry * 2 ].iov_base = &m_slabs[entry]->Bytes()[0];
+	m_receiveVectors[ entry * 2 ].iov_len = m_slabs[entry]->Bytes().length();
+}
+
+UdpTransport::~UdpTransport()
+{
+	for ( vector<int>::const_iterator sock = Sockets().begin(); sock != Sockets().end(); ++sock )
+		m_reactor.Remove( *sock );
+}
+
+int UdpTransport::Listen( const string& address, unsigned short port, bool sharePort ) throw( TransportException )
+{
+	int sock = Bind( address, port, sharePort );
+	try
+	{
+		m_reactor.Add( sock, *this );
+	}
+	catch ( TransportException& e )
+	{
+		Close( sock );
+		throw;
+	}
+	return sock;
+}
+
+void UdpTransport::OnReadable( int fd )
+{
+	++m_stats.wakeups;
+	//Edge triggered: keep reading until the kernel says there is nothing left
+	for ( ;; )
+	{
+		for ( unsigned int i = 0; i < m_batchSize; ++i )
+			m_receiveHeaders[i].msg_hdr.msg_namelen = sizeof( sockaddr_storage );
+
+		int received = recvmmsg( fd, &m_receiveHeaders[0], m_batchSize, 0, NULL );
+		++m_stats.receiveCalls;
+		if ( received < 0 )
+		{
+			if ( errno == EINTR )
+				continue;
+			if ( errno == EAGAIN || errno == EWOULDBLOCK )
+				break;
+			++m_stats.receiveErrors;
+			//ICMP errors from earlier sends surface here; they don't stop the socket
+			if ( errno == ECONNREFUSED || errno == EHOSTUNREACH || errno == ENETUNREACH )
+				continue;
+			break;
+		}
+		++m_stats.receiveBatches[received];
+
+		for ( int i = 0; i < received; ++i )
+		{
+			++m_stats.datagrams;
+			m_stats.bytes += m_receiveHeaders[i].msg_len;
+
+			//The overflow area makes a datagram up to SIP_MAX_MESSAGE_SIZE fit without peeking at its length first
+			unsigned int length = m_receiveHeaders[i].msg_len;
+			if ( m_receiveHeaders[i].msg_hdr.msg_flags & MSG_TRUNC )
+			{
+				++m_stats.truncated;
+				m_handler.OnParseError( SipMessageException( "Datagram exceeds SIP_MAX_MESSAGE_SIZE" ), m_sources[i], fd );
+				continue;
+			}
+
+			auto_ptr<SipMessage> message;
+			try
+			{
+				if ( length <= m_pool.SlabSize() )
+				{
+					//The message takes the slab over; the entry gets another for the next batch
+					m_slabs[i]->Bytes().resize( length );
+					ReceiveBufferHandle slab( m_slabs[i] );
+					Refill( i );
+					Utility::ParseMessage( message, slab );
+				}
+				else
+				{
+					++m_stats.oversize;
+					string data( m_slabs[i]->Bytes() );
+					data.append( static_cast<char*>( m_receiveVectors[ i * 2 + 1 ].iov_base ), length - data.length() );
+					Utility::ParseMessage( message, data );
+				}
+			}
+			catch ( SipMessageException& e )
+			{
+				++m_stats.parseErrors;
+				m_handler.OnParseError( e, m_sources[i], fd );
+				continue;
+			}
+			m_handler.OnMessage( message, m_sources[i], fd );
+		}
+		if ( received > 0 )
+			m_handler.OnBatchComplete();
+
+		//A short batch means the queue was empty; anything arriving later raises a fresh edge
+		if ( static_cast<unsigned int>( received ) < m_batchSize )
+			break;
+	}
+}
+
+bool UdpTransport::Send( int socket, const string& data, const sockaddr_storage& destination ) throw()
+{
+	ssize_t sent;
+	do
+		sent = sendto( socket, data.data(), data.length(), 0, reinterpret_cast<const sockaddr*>( &destination ), AddressLength( destination ) );
+	while ( sent < 0 && errno == EINTR );
+	return sent == static_cast<ssize_t>( data.length() );
+}
+
+bool UdpTransport::Send( const string& data, const sockaddr_storage& destination ) throw()
+{
+	int socket = SocketFor( destination );
+	return socket != -1 && Send( socket, data, destination );
+}
+
+void UdpTransport::Queue( int socket, const string& data, const sockaddr_storage& destination ) throw()
+{
+	m_outbound.push_back( Outbound() );
+	m_outbound.back().socket = socket;
+	m_outbound.back().data = data;
+	m_outbound.back().destination = destination;
+}
+
+bool UdpTransport::Queue( const string& data, const sockaddr_storage& destination ) throw()
+{
+	int socket = SocketFor( destination );
+	if ( socket == -1 )
+		return false;
+	Queue( socket, data, destination );
+	return true;
+}
+
+void UdpTransport::Flush() throw()
+{
+	memset( &m_sendHeaders[0], 0, m_batchSize * sizeof( mmsghdr ) );
+
+	//Runs of datagrams for the same socket go out together, up to a batch at a time
+	size_t first = 0;
+	while ( first < m_outbound.size() )
+	{
+		unsigned int count = 0;
+		int socket = m_outbound[first].socket;
+		while ( count < m_batchSize && first + count < m_outbound.size() && m_outbound[first + count].socket == socket )
+		{
+			Outbound& datagram = m_outbound[first + count];
+			m_sendVectors[count].iov_base = const_cast<char*>( datagram.data.data() );
+			m_sendVectors[count].iov_len = datagram.data.length();
+			m_sendHeaders[count].msg_hdr.msg_iov = &m_sendVectors[count];
+			m_sendHeaders[count].msg_hdr.msg_iovlen = 1;
+			m_sendHeaders[count].msg_hdr.msg_name = &datagram.destination;
+			m_sendHeaders[count].msg_hdr.msg_namelen = AddressLength( datagram.destination );
+			++count;
+		}
+
+		unsigned int done = 0;
+		while ( done < count )
+		{
+			int sent = sendmmsg( socket, &m_sendHeaders[done], count - done, 0 );
+			++m_stats.sendCalls;
+			if ( sent < 0 && errno == EINTR )
+				continue;
+			if ( sent <= 0 ) //Socket buffer full or a bad destination; drop this datagram and carry on with the rest
+			{
+				++m_stats.sendErrors;
+				++done;
+				continue;
+			}
+			++m_stats.sendBatches[sent];
+			m_stats.sent += sent;
+			done += sent;
+		}
+		first += count;
+	}
+	m_outbound.clear();
+}
+
+void UdpTransport::OnDispatchComplete()
+{
+	if ( !m_outbound.empty() )
+		Flush();
+}
+
+unsigned int UdpTransport::BatchSize() const throw()
+{
+	return m_batchSize;
+}
+
+const UdpTransport::Stats& UdpTransport::GetStats() const throw()
+{
+	return m_stats;
+}
+
+const ReceiveBufferPool& UdpTransport::Pool() const throw()
+{
+	return m_pool;
+}
+
+}; //namespace Sip
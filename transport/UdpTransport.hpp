@@ -0,0 +1,181 @@
+#ifndef UDPTRANSPORT_HPP
+#define UDPTRANSPORT_HPP
+#include <memory>
+#include <string>
+#include <vector>
+#include <stdint.h>
+#include <sys/socket.h>
+#include <sys/uio.h>
+#include "Reactor.hpp"
+#include "UdpSockets.hpp"
+#include "../SipDefines.hpp"
+#include "../SipMessage.hpp"
+#include "../ReceiveBuffer.hpp"
+#include "../Transaction.hpp"
+
+namespace Sip {
+
+using std::auto_ptr;
+
+/**
+* \class SipMessageHandler
+* \brief Receives the messages a transport read and parsed
+*/
+class SipMessageHandler
+{
+	public:
+		virtual ~SipMessageHandler() {}
+
+		/**
+		 *     A message arrived and parsed.
+		 * @param message The message; take ownership by releasing it
+		 * @param source Who sent it
+		 * @param socket The socket it arrived on; reply through it to keep the source port symmetric
+		 */
+		virtual void OnMessage( auto_ptr<SipMessage>& message, const sockaddr_storage& source, int socket ) = 0;
+
+		/**
+		 *     A datagram arrived but didn't parse. Default is to drop it.
+		 */
+		virtual void OnParseError( const SipMessageException& error, const sockaddr_storage& source, int socket ) {}
+
+		/**
+		 *     Every message from one receive batch has been handed over. Default does nothing.
+		 */
+		virtual void OnBatchComplete() {}
+};
+
+/**
+* \class UdpTransport
+* \brief Listens on any number of UDP sockets through a Reactor, reads until each is drained and hands parsed
+*        messages to a SipMessageHandler
+*
+* Datagrams are read up to BatchSize() at a time with recvmmsg, straight into slabs from a ReceiveBufferPool; each
+* parsed message takes its slab over, so the bytes the kernel wrote are never copied. A datagram longer than a slab
+* spills into an overflow area behind it and is copied out whole. Datagrams queued with Queue() are sent with one
+* sendmmsg per socket once the reactor has dispatched the current wakeup, so responses produced while handling a
+* batch leave in a batch.
+*
+* Send() and Queue() never create sockets; given only a destination they go through the listening socket
+* SocketFor() picks.
+*/
+class UdpTransport : public ReactorHandler, public UdpSockets, public TransactionSender
+{
+	public:
+		/**
+		* \class Stats
+		* \brief Running totals since the transport was created
+		*/
+		struct Stats
+		{
+			Stats() : datagrams( 0 ), bytes( 0 ), parseErrors( 0 ), receiveErrors( 0 ), wakeups( 0 ),
+				receiveCalls( 0 ), sent( 0 ), sendCalls( 0 ), sendErrors( 0 ), oversize( 0 ), truncated( 0 ) {}
+			uint64_t datagrams, bytes, parseErrors, receiveErrors, wakeups;
+			uint64_t receiveCalls, sent, sendCalls, sendErrors;
+			/// Datagrams too long for a slab, which were copied; and too long for SIP_MAX_MESSAGE_SIZE, which were dropped
+			uint64_t oversize, truncated;
+
+			/// receiveBatches[n] counts recvmmsg calls that returned n datagrams; sendBatches the same for sendmmsg
+			vector<uint64_t> receiveBatches, sendBatches;
+		};
+
+		/**
+		 * @param batchSize Most datagrams read by one recvmmsg or sent by one sendmmsg
+		 */
+		UdpTransport( Reactor& reactor, SipMessageHandler& handler, unsigned int batchSize = 32 ) throw();
+
+		/**
+		 *     Stops watching every socket this transport opened
+		 */
+		~UdpTransport();
+
+		/**
+		 *     Binds a non-blocking UDP socket and starts receiving on it.
+		 * @param address A numeric IPv4 or IPv6 address; "0.0.0.0" or "::" for all interfaces
+		 * @param port The port, or 0 for any free one (see LocalPort())
+		 * @param sharePort Let other sockets bind the same address and port with SO_REUSEPORT (see UdpWorkers)
+		 * @return The socket
+		 * @throw TransportException if the socket can't be created or bound
+		 */
+		int Listen( const string& address, unsigned short port = DEFAULT_UDP_LISTENPORT, bool sharePort = false ) throw( TransportException );
+
+		/**
+		 *     Sends one datagram.
+		 * @return False if the kernel didn't take it; UDP gives no other guarantee anyway
+		 */
+		bool Send( int socket, const string& data, const sockaddr_storage& destination ) throw();
+
+		/**
+		 *     Sends one datagram through the listening socket SocketFor() picks.
+		 * @return False if there is no socket for the destination's family or the kernel didn't take it
+		 */
+		bool Send( const string& data, const sockaddr_storage& destination ) throw();
+
+		/**
+		 *     Queues a datagram to go out with the rest of the current batch. Sent when the reactor finishes the
+		 *     current wakeup, or by Flush().
+		 */
+		void Queue( int socket, const string& data, const sockaddr_storage& destination ) throw();
+
+		/**
+		 *     Queues a datagram through the listening socket SocketFor() picks.
+		 * @return False if there is no socket for the destination's family
+		 */
+		bool Queue( const string& data, const sockaddr_storage& destination ) throw();
+
+		/**
+		 *     Sends everything queued, one sendmmsg per socket and batch
+		 */
+		void Flush() throw();
+
+		unsigned int BatchSize() const throw();
+
+		const Stats& GetStats() const throw();
+
+		/**
+		 *     The pool datagrams are received into
+		 */
+		const ReceiveBufferPool& Pool() const throw();
+
+		void OnReadable( int fd );
+		void OnDispatchComplete();
+
+	private:
+		UdpTransport( const UdpTransport& );
+		UdpTransport& operator=( const UdpTransport& );
+
+		/**
+		 *     Gives a batch entry a fresh slab to receive into
+		 */
+		void Refill( unsigned int entry ) throw();
+
+		Reactor& m_reactor;
+		SipMessageHandler& m_handler;
+		/**
+		* \class Outbound
+		* \brief A datagram waiting for Flush()
+		*/
+		struct Outbound
+		{
+			int socket;
+			string data;
+			sockaddr_storage destination;
+		};
+
+		unsigned int m_batchSize;
+		//Receive ring: per batch entry a pooled slab, then an overflow area making up SIP_MAX_MESSAGE_SIZE
+		ReceiveBufferPool m_pool;
+		vector<ReceiveBufferHandle> m_slabs;
+		vector<char> m_overflow;
+		vector<iovec> m_receiveVectors; //Two per entry: slab, overflow
+		vector<sockaddr_storage> m_sources;
+		vector<mmsghdr> m_receiveHeaders;
+
+		vector<Outbound> m_outbound;
+		vector<iovec> m_sendVectors;
+		vector<mmsghdr> m_sendHeaders;
+		Stats m_stats;
+};
+
+}; //namespace Sip
+#endif //UDPTRANSPORT_HPP
@@ -0,0 +1,208 @@
+#include "UdpWorkers.hpp"
+#include <cstring>
+#include <errno.h>
+#include <pthread.h>
+#include <sched.h>
+#include <unistd.h>
+#include <linux/filter.h>
+#include <netinet/in.h>
+#include <boost/thread.hpp>
+
+namespace Sip {
+
+namespace {
+
+/**
+ *     Attaches a program to a SO_REUSEPORT group that returns, as the index of the socket to deliver to,
+ *     a hash of the source address modulo workers. Same hash as UdpWorkers::WorkerFor().
+ */
+bool SteerBySource( int socket, int family, unsigned int workers )
+{
+	//Packet loads relative to the network header; cBPF loads come out in host byte order
+	const uint32_t NET = SKF_NET_OFF;
+	sock_filter ipv4[] = {
+		BPF_STMT( BPF_LD | BPF_W | BPF_ABS, NET + 12 ), //Source address
+		BPF_STMT( BPF_MISC | BPF_TAX, 0 ),
+		BPF_STMT( BPF_ALU | BPF_RSH | BPF_K, 16 ),
+		BPF_STMT( BPF_ALU | BPF_XOR | BPF_X, 0 ),
+		BPF_STMT( BPF_ALU | BPF_MOD | BPF_K, workers ),
+		BPF_STMT( BPF_RET | BPF_A, 0 )
+	};
+	sock_filter ipv6[] = {
+		BPF_STMT( BPF_LD | BPF_W | BPF_ABS, NET + 8 ), //Source address, folded a word at a time
+		BPF_STMT( BPF_MISC | BPF_TAX, 0 ),
+		BPF_STMT( BPF_LD | BPF_W | BPF_ABS, NET + 12 ),
+		BPF_STMT( BPF_ALU | BPF_XOR | BPF_X, 0 ),
+		BPF_STMT( BPF_MISC | BPF_TAX, 0 ),
+		BPF_STMT( BPF_LD | BPF_W | BPF_ABS, NET + 16 ),
+		BPF_STMT( BPF_ALU | BPF_XOR | BPF_X, 0 ),
+		BPF_STMT( BPF_MISC | BPF_TAX, 0 ),
+		BPF_STMT( BPF_LD | BPF_W | BPF_ABS, NET + 20 ),
+		BPF_STMT( BPF_ALU | BPF_XOR | BPF_X, 0 ),
+		BPF_STMT( BPF_MISC | BPF_TAX, 0 ),
+		BPF_STMT( BPF_ALU | BPF_RSH | BPF_K, 16 ),
+		BPF_STMT( BPF_ALU | BPF_XOR | BPF_X, 0 ),
+		BPF_STMT( BPF_ALU | BPF_MOD | BPF_K, workers ),
+		BPF_STMT( BPF_RET | BPF_A, 0 )
+	};
+
+	sock_fprog program;
+	if ( family == AF_INET6 )
+	{
+		program.len = sizeof( ipv6 ) / sizeof( ipv6[0] );
+		program.filter = ipv6;
+	}
+	else
+	{
+		program.len = sizeof( ipv4 ) / sizeof( ipv4[0] );
+		program.filter = ipv4;
+	}
+	return setsockopt( socket, SOL_SOCKET, SO_ATTACH_REUSEPORT_CBPF, &program, sizeof( program ) ) == 0;
+}
+
+}; //namespace
+
+/**
+* \class UdpWorkers::Worker
+* \brief One worker's loop, transport and handler; it forwards its transport's messages to the handler
+*/
+struct UdpWorkers::Worker : public SipMessageHandler
+{
+	Worker( unsigned int batchSize ) : transport( reactor, *this, batchSize ), cpu( -1 ), thread( NULL ) {}
+
+	void OnMessage( auto_ptr<SipMessage>& message, const sockaddr_storage& source, int socket )
+	{
+		handler->OnMessage( message, source, socket );
+	}
+
+	void OnParseError( const SipMessageException& error, const sockaddr_storage& source, int socket )
+	{
+		handler->OnParseError( error, source, socket );
+	}
+
+	void OnBatchComplete()
+	{
+		handler->OnBatchComplete();
+	}
+
+	void operator()()
+	{
+		if ( cpu != -1 )
+		{
+			cpu_set_t cpus;
+			CPU_ZERO( &cpus );
+			CPU_SET( cpu, &cpus );
+			pthread_setaffinity_np( pthread_self(), sizeof( cpus ), &cpus );
+		}
+		reactor.Run( 100 );
+	}
+
+	Reactor reactor;
+	UdpTransport transport;
+	auto_ptr<SipMessageHandler> handler;
+	int cpu;
+	boost::thread* thread;
+};
+
+UdpWorkers::UdpWorkers( SipMessageHandlerFactory& factory, unsigned int workers, unsigned int batchSize ) throw( TransportException )
+	: m_running( false )
+{
+	if ( workers == 0 )
+		workers = boost::thread::hardware_concurrency() > 0 ? boost::thread::hardware_concurrency() : 1;
+	try
+	{
+		for ( unsigned int i = 0; i < workers; ++i )
+		{
+			m_workers.push_back( new Worker( batchSize ) );
+			m_workers.back()->handler.reset( factory.Create( i, m_workers.back()->transport ) );
+		}
+	}
+	catch ( TransportException& e )
+	{
+		for ( vector<Worker*>::iterator worker = m_workers.begin(); worker != m_workers.end(); ++worker )
+			delete *worker;
+		throw;
+	}
+}
+
+UdpWorkers::~UdpWorkers()
+{
+	Stop();
+	for ( vector<Worker*>::iterator worker = m_workers.begin(); worker != m_workers.end(); ++worker )
+		delete *worker;
+}
+
+unsigned short UdpWorkers::Listen( const string& address, unsigned short port, bool steerBySource ) throw( TransportException )
+{
+	//The first socket settles the port when asked for any; the rest join its group in worker order, which is the
+	//order the steering program's return value indexes
+	int first = m_workers[0]->transport.Listen( address, port, true );
+	port = UdpSockets::LocalPort( first );
+	for ( size_t i = 1; i < m_workers.size(); ++i )
+		m_workers[i]->transport.Listen( address, port, true );
+
+	if ( steerBySource )
+	{
+		sockaddr_storage local;
+		socklen_t length = sizeof( local );
+		getsockname( first, reinterpret_cast<sockaddr*>( &local ), &length );
+		if ( !SteerBySource( first, local.ss_family, m_workers.size() ) )
+			throw TransportException( string( "Could not attach source steering program: " ) + strerror( errno ) );
+	}
+	return port;
+}
+
+void UdpWorkers::Start( bool pin )
+{
+	if ( m_running )
+		return;
+	unsigned int cpus = boost::thread::hardware_concurrency();
+	for ( size_t i = 0; i < m_workers.size(); ++i )
+	{
+		m_workers[i]->cpu = pin && cpus > 0 ? i % cpus : -1;
+		m_workers[i]->thread = new boost::thread( boost::ref( *m_workers[i] ) );
+	}
+	m_running = true;
+}
+
+void UdpWorkers::Stop()
+{
+	if ( !m_running )
+		return;
+	for ( vector<Worker*>::iterator worker = m_workers.begin(); worker != m_workers.end(); ++worker )
+		( *worker )->reactor.Stop();
+	for ( vector<Worker*>::iterator worker = m_workers.begin(); worker != m_workers.end(); ++worker )
+	{
+		( *worker )->thread->join();
+		delete ( *worker )->thread;
+		( *worker )->thread = NULL;
+	}
+	m_running = false;
+}
+
+unsigned int UdpWorkers::Workers() const throw()
+{
+	return m_workers.size();
+}
+
+const UdpTransport& UdpWorkers::Transport( unsigned int worker ) const throw()
+{
+	return m_workers[worker]->transport;
+}
+
+unsigned int UdpWorkers::WorkerFor( const sockaddr_storage& source, unsigned int workers ) throw()
+{
+	uint32_t hash = 0;
+	if ( source.ss_family == AF_INET6 )
+	{
+		const uint32_t* words = reinterpret_cast<const uint32_t*>( &reinterpret_cast<const sockaddr_in6&>( source ).sin6_addr );
+		for ( int i = 0; i < 4; ++i )
+			hash ^= ntohl( words[i] );
+	}
+	else
+		hash = ntohl( reinterpret_cast<const sockaddr_in&>( source ).sin_addr.s_addr );
+	hash ^= hash >> 16;
+	return workers == 0 ? 0 : hash % workers;
+}
+
+}; //namespace Sip
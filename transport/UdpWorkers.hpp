@@ -0,0 +1,95 @@
+#ifndef UDPWORKERS_HPP
+#define UDPWORKERS_HPP
+#include <string>
+#include <vector>
+#include "UdpTransport.hpp"
+
+namespace Sip {
+
+/**
+* \class SipMessageHandlerFactory
+* \brief Makes one SipMessageHandler per UdpWorkers worker, so workers share nothing
+*/
+class SipMessageHandlerFactory
+{
+	public:
+		virtual ~SipMessageHandlerFactory() {}
+
+		/**
+		 *     Makes the handler for one worker. Called from the UdpWorkers constructor.
+		 * @param worker Which worker, 0 to Workers() - 1
+		 * @param transport The worker's transport; reply through it from the handler
+		 * @return A new handler, owned by the worker from then on
+		 */
+		virtual SipMessageHandler* Create( unsigned int worker, UdpTransport& transport ) = 0;
+};
+
+/**
+* \class UdpWorkers
+* \brief N threads, each with its own SO_REUSEPORT socket on the same port, its own Reactor, UdpTransport and handler
+*
+* The kernel spreads datagrams across the sockets, and each worker reads, parses and handles its own, so nothing on
+* the receive path is shared or locked. By default the kernel picks a socket by a hash it keeps to itself and that
+* changes whenever a socket joins or leaves the group; Listen() can instead attach a classic BPF program that picks
+* the worker from the source address, so a phone's retransmissions always reach the worker holding its state.
+*/
+class UdpWorkers
+{
+	public:
+		/**
+		 * @param factory Makes each worker's handler
+		 * @param workers How many; 0 means one per CPU
+		 * @param batchSize Passed to each worker's UdpTransport
+		 * @throw TransportException if a worker's reactor can't be created
+		 */
+		UdpWorkers( SipMessageHandlerFactory& factory, unsigned int workers = 0, unsigned int batchSize = 32 ) throw( TransportException );
+
+		/**
+		 *     Stops the workers and closes their sockets
+		 */
+		~UdpWorkers();
+
+		/**
+		 *     Binds one socket per worker on address and port. Call before Start().
+		 * @param address A numeric IPv4 or IPv6 address
+		 * @param port The port, or 0 for any free one
+		 * @param steerBySource Pick the worker from the source address instead of the kernel's hash
+		 * @return The port bound
+		 * @throw TransportException if a socket can't be bound, or steering was asked for and the kernel refused it
+		 */
+		unsigned short Listen( const string& address, unsigned short port = DEFAULT_UDP_LISTENPORT, bool steerBySource = false ) throw( TransportException );
+
+		/**
+		 *     Starts a thread per worker.
+		 * @param pin Pin worker n to CPU n (modulo the CPU count)
+		 */
+		void Start( bool pin = true );
+
+		/**
+		 *     Stops every worker and waits for its thread. The sockets stay bound; Start() again to resume.
+		 */
+		void Stop();
+
+		unsigned int Workers() const throw();
+
+		/**
+		 *     A worker's transport, for its stats. Only read them while the workers are stopped.
+		 */
+		const UdpTransport& Transport( unsigned int worker ) const throw();
+
+		/**
+		 *     The worker that source steering sends a source address to
+		 */
+		static unsigned int WorkerFor( const sockaddr_storage& source, unsigned int workers ) throw();
+
+	private:
+		UdpWorkers( const UdpWorkers& );
+		UdpWorkers& operator=( const UdpWorkers& );
+
+		struct Worker;
+		vector<Worker*> m_workers;
+		bool m_running;
+};
+
+}; //namespace Sip
+#endif //UDPWORKERS_HPP
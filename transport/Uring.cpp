@@ -0,0 +1,285 @@
+#include "Uring.hpp"
+#include <algorithm>
+#include <cstring>
+#include <errno.h>
+#include <signal.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+namespace Sip {
+
+namespace {
+
+int Setup( unsigned int entries, io_uring_params& params )
+{
+	return syscall( __NR_io_uring_setup, entries, &params );
+}
+
+int Register( int ring, unsigned int opcode, void* arg, unsigned int count )
+{
+	return syscall( __NR_io_uring_register, ring, opcode, arg, count );
+}
+
+//The kernel writes the completion tail and reads the submission tail concurrently with us
+unsigned int LoadAcquire( unsigned int* p ) { return __atomic_load_n( p, __ATOMIC_ACQUIRE ); }
+void StoreRelease( unsigned int* p, unsigned int value ) { __atomic_store_n( p, value, __ATOMIC_RELEASE ); }
+
+}; //namespace
+
+Uring::Uring( unsigned int entries, unsigned int files ) throw( TransportException )
+	: m_sqMap( MAP_FAILED ), m_cqMap( MAP_FAILED ), m_sqPending( 0 ), m_files( files == 0 ? 1 : files, -1 ), m_enters( 0 )
+{
+	io_uring_params params;
+	memset( &params, 0, sizeof( params ) );
+	params.flags = IORING_SETUP_CQSIZE | IORING_SETUP_SINGLE_ISSUER | IORING_SETUP_DEFER_TASKRUN;
+	params.cq_entries = entries * 4;
+	m_ring = Setup( entries, params );
+	if ( m_ring == -1 && errno == EINVAL ) //Kernels before 6.1 don't know the single issuer flags; they only save work
+	{
+		memset( &params, 0, sizeof( params ) );
+		params.flags = IORING_SETUP_CQSIZE;
+		params.cq_entries = entries * 4;
+		m_ring = Setup( entries, params );
+	}
+	if ( m_ring == -1 )
+		throw TransportException( string( "Could not create io_uring: " ) + strerror( errno ) );
+	if ( !( params.features & IORING_FEAT_EXT_ARG ) )
+	{
+		close( m_ring );
+		throw TransportException( "io_uring is too old: no timeouts on io_uring_enter" );
+	}
+
+	m_sqMapSize = params.sq_off.array + params.sq_entries * sizeof( unsigned int );
+	m_cqMapSize = params.cq_off.cqes + params.cq_entries * sizeof( io_uring_cqe );
+	if ( params.features & IORING_FEAT_SINGLE_MMAP )
+		m_sqMapSize = m_cqMapSize = std::max( m_sqMapSize, m_cqMapSize );
+
+	m_sqMap = mmap( NULL, m_sqMapSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, m_ring, IORING_OFF_SQ_RING );
+	m_cqMap = params.features & IORING_FEAT_SINGLE_MMAP ? m_sqMap :
+		mmap( NULL, m_cqMapSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, m_ring, IORING_OFF_CQ_RING );
+	void* sqes = mmap( NULL, params.sq_entries * sizeof( io_uring_sqe ), PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, m_ring, IORING_OFF_SQES );
+	if ( m_sqMap == MAP_FAILED || m_cqMap == MAP_FAILED || sqes == MAP_FAILED )
+	{
+		string error = strerror( errno );
+		if ( sqes != MAP_FAILED )
+			munmap( sqes, params.sq_entries * sizeof( io_uring_sqe ) );
+		if ( m_cqMap != MAP_FAILED && m_cqMap != m_sqMap )
+			munmap( m_cqMap, m_cqMapSize );
+		if ( m_sqMap != MAP_FAILED )
+			munmap( m_sqMap, m_sqMapSize );
+		close( m_ring );
+		throw TransportException( "Could not map io_uring: " + error );
+	}
+
+	char* sq = static_cast<char*>( m_sqMap );
+	char* cq = static_cast<char*>( m_cqMap );
+	m_sqes = static_cast<io_uring_sqe*>( sqes );
+	m_sqEntries = params.sq_entries;
+	m_sqHead = reinterpret_cast<unsigned int*>( sq + params.sq_off.head );
+	m_sqTail = reinterpret_cast<unsigned int*>( sq + params.sq_off.tail );
+	m_sqMask = reinterpret_cast<unsigned int*>( sq + params.sq_off.ring_mask );
+	m_cqHead = reinterpret_cast<unsigned int*>( cq + params.cq_off.head );
+	m_cqTail = reinterpret_cast<unsigned int*>( cq + params.cq_off.tail );
+	m_cqMask = reinterpret_cast<unsigned int*>( cq + params.cq_off.ring_mask );
+	m_cqes = reinterpret_cast<io_uring_cqe*>( cq + params.cq_off.cqes );
+	m_sqPending = *m_sqTail;
+
+	//Entries are always used in ring order, so the indirection array never changes
+	unsigned int* array = reinterpret_cast<unsigned int*>( sq + params.sq_off.array );
+	for ( unsigned int i = 0; i < m_sqEntries; ++i )
+		array[i] = i;
+
+	io_uring_rsrc_register table;
+	memset( &table, 0, sizeof( table ) );
+	table.nr = m_files.size();
+	table.flags = IORING_RSRC_REGISTER_SPARSE;
+	if ( Register( m_ring, IORING_REGISTER_FILES2, &table, sizeof( table ) ) == -1 )
+	{
+		string error = strerror( errno );
+		Unmap();
+		throw TransportException( "Could not register io_uring file table: " + error );
+	}
+}
+
+Uring::~Uring()
+{
+	Unmap();
+}
+
+void Uring::Unmap() throw()
+{
+	munmap( m_sqes, m_sqEntries * sizeof( io_uring_sqe ) );
+	if ( m_cqMap != m_sqMap )
+		munmap( m_cqMap, m_cqMapSize );
+	munmap( m_sqMap, m_sqMapSize );
+	close( m_ring );
+}
+
+io_uring_sqe* Uring::GetSqe() throw()
+{
+	if ( m_sqPending - LoadAcquire( m_sqHead ) >= m_sqEntries )
+	{
+		Enter( 0, 0 );
+		if ( m_sqPending - LoadAcquire( m_sqHead ) >= m_sqEntries )
+			return NULL;
+	}
+	io_uring_sqe* sqe = &m_sqes[ m_sqPending & *m_sqMask ];
+	memset( sqe, 0, sizeof( *sqe ) );
+	++m_sqPending;
+	return sqe;
+}
+
+int Uring::Enter( unsigned int waitFor, int timeoutMs ) throw()
+{
+	unsigned int submit = m_sqPending - *m_sqTail;
+	StoreRelease( m_sqTail, m_sqPending );
+
+	__kernel_timespec timeout;
+	io_uring_getevents_arg arg;
+	memset( &arg, 0, sizeof( arg ) );
+	arg.sigmask_sz = _NSIG / 8;
+	if ( timeoutMs >= 0 )
+	{
+		timeout.tv_sec = timeoutMs / 1000;
+		timeout.tv_nsec = ( timeoutMs % 1000 ) * 1000000L;
+		arg.ts = reinterpret_cast<uint64_t>( &timeout );
+	}
+
+	//GETEVENTS even when not waiting: with deferred task running that is when completions get posted
+	int result;
+	do
+	{
+		++m_enters;
+		result = syscall( __NR_io_uring_enter, m_ring, submit, waitFor, IORING_ENTER_GETEVENTS | IORING_ENTER_EXT_ARG, &arg, sizeof( arg ) );
+	}
+	while ( result == -1 && errno == EINTR && timeoutMs < 0 );
+	return result == -1 ? -errno : result;
+}
+
+io_uring_cqe* Uring::PeekCqe() throw()
+{
+	unsigned int head = *m_cqHead;
+	if ( head == LoadAcquire( m_cqTail ) )
+		return NULL;
+	return &m_cqes[ head & *m_cqMask ];
+}
+
+void Uring::Seen() throw()
+{
+	StoreRelease( m_cqHead, *m_cqHead + 1 );
+}
+
+int Uring::RegisterFile( int fd ) throw( TransportException )
+{
+	int slot = FileSlot( -1 );
+	if ( slot == -1 )
+		throw TransportException( "io_uring file table is full" );
+
+	io_uring_files_update update;
+	memset( &update, 0, sizeof( update ) );
+	update.offset = slot;
+	update.fds = reinterpret_cast<uint64_t>( &fd );
+	if ( Register( m_ring, IORING_REGISTER_FILES_UPDATE, &update, 1 ) != 1 )
+		throw TransportException( string( "Could not register socket with io_uring: " ) + strerror( errno ) );
+	m_files[slot] = fd;
+	return slot;
+}
+
+void Uring::UnregisterFile( int slot ) throw()
+{
+	if ( slot < 0 || static_cast<size_t>( slot ) >= m_files.size() )
+		return;
+	int none = -1;
+	io_uring_files_update update;
+	memset( &update, 0, sizeof( update ) );
+	update.offset = slot;
+	update.fds = reinterpret_cast<uint64_t>( &none );
+	Register( m_ring, IORING_REGISTER_FILES_UPDATE, &update, 1 );
+	m_files[slot] = -1;
+}
+
+int Uring::FileSlot( int fd ) const throw()
+{
+	for ( size_t slot = 0; slot < m_files.size(); ++slot )
+		if ( m_files[slot] == fd )
+			return slot;
+	return -1;
+}
+
+int Uring::Fd() const throw()
+{
+	return m_ring;
+}
+
+uint64_t Uring::Enters() const throw()
+{
+	return m_enters;
+}
+
+UringBufferRing::UringBufferRing( Uring& ring, uint16_t group, unsigned int count, unsigned int size ) throw( TransportException )
+	: m_ring( ring ), m_group( group ), m_count( 1 ), m_size( size ), m_tail( 0 )
+{
+	while ( m_count < count && m_count < 32768 )
+		m_count <<= 1;
+	m_buffers.resize( static_cast<size_t>( m_count ) * m_size );
+
+	//The ring itself has to be page aligned, so it gets a mapping of its own
+	m_bufferRingSize = m_count * sizeof( io_uring_buf );
+	void* memory = mmap( NULL, m_bufferRingSize, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0 );
+	if ( memory == MAP_FAILED )
+		throw TransportException( string( "Could not allocate io_uring buffer ring: " ) + strerror( errno ) );
+	m_bufferRing = static_cast<io_uring_buf_ring*>( memory );
+
+	io_uring_buf_reg registration;
+	memset( &registration, 0, sizeof( registration ) );
+	registration.ring_addr = reinterpret_cast<uint64_t>( m_bufferRing );
+	registration.ring_entries = m_count;
+	registration.bgid = m_group;
+	if ( Register( m_ring.Fd(), IORING_REGISTER_PBUF_RING, &registration, 1 ) == -1 )
+	{
+		string error = strerror( errno );
+		munmap( m_bufferRing, m_bufferRingSize );
+		throw TransportException( "Could not register io_uring buffer ring: " + error );
+	}
+
+	for ( unsigned int id = 0; id < m_count; ++id )
+		Recycle( id );
+}
+
+UringBufferRing::~UringBufferRing()
+{
+	io_uring_buf_reg registration;
+	memset( &registration, 0, sizeof( registration ) );
+	registration.bgid = m_group;
+	Register( m_ring.Fd(), IORING_UNREGISTER_PBUF_RING, &registration, 1 );
+	munmap( m_bufferRing, m_bufferRingSize );
+}
+
+char* UringBufferRing::Buffer( uint16_t id ) throw()
+{
+	return &m_buffers[ static_cast<size_t>( id ) * m_size ];
+}
+
+unsigned int UringBufferRing::Size() const throw()
+{
+	return m_size;
+}
+
+uint16_t UringBufferRing::Group() const throw()
+{
+	return m_group;
+}
+
+void UringBufferRing::Recycle( uint16_t id ) throw()
+{
+	//Not m_bufferRing->bufs: in C++ the kernel header's flex array macro puts it 8 bytes in, and the ring starts at 0
+	io_uring_buf& entry = reinterpret_cast<io_uring_buf*>( m_bufferRing )[ m_tail & ( m_count - 1 ) ];
+	entry.addr = reinterpret_cast<uint64_t>( Buffer( id ) );
+	entry.len = m_size;
+	entry.bid = id;
+	++m_tail;
+	__atomic_store_n( &m_bufferRing->tail, m_tail, __ATOMIC_RELEASE );
+}
+
+}; //namespace Sip
@@ -0,0 +1,129 @@
+#ifndef URING_HPP
+#define URING_HPP
+#include <vector>
+#include <stdint.h>
+#include <linux/io_uring.h>
+#include "Reactor.hpp"
+
+namespace Sip {
+
+/**
+* \class Uring
+* \brief A bare io_uring instance driven through the raw system calls, so the backend needs nothing beyond kernel
+*        headers. Use it only from the thread that created it; the kernel is told there is a single submitter.
+*
+* Submissions accumulate in the submission queue until Enter(), which hands them all to the kernel and waits for
+* completions in the same system call.
+*/
+class Uring
+{
+	public:
+		/**
+		 * @param entries Submission queue size; the completion queue is four times larger, since multishot
+		 *        receives post many completions per submission
+		 * @param files Slots in the registered file table
+		 * @throw TransportException if the kernel has no io_uring or refuses the setup
+		 */
+		Uring( unsigned int entries, unsigned int files ) throw( TransportException );
+		~Uring();
+
+		/**
+		 *     A cleared submission queue entry to fill in, submitted by the next Enter(). If the queue is full
+		 *     what is there is submitted first.
+		 * @return NULL only if the kernel won't take any more submissions
+		 */
+		io_uring_sqe* GetSqe() throw();
+
+		/**
+		 *     Submits everything queued and waits for completions.
+		 * @param waitFor Completions to wait for; 0 just submits and collects whatever is ready
+		 * @param timeoutMs Most time to wait, -1 forever
+		 * @return Submissions the kernel took, or -errno; -ETIME means the timeout expired
+		 */
+		int Enter( unsigned int waitFor, int timeoutMs ) throw();
+
+		/**
+		 *     The oldest unseen completion, or NULL if there is none. Call Seen() when done with it.
+		 */
+		io_uring_cqe* PeekCqe() throw();
+		void Seen() throw();
+
+		/**
+		 *     Puts fd in the registered file table, so submissions can name it by slot and skip the per-call
+		 *     file lookup.
+		 * @return The slot, for sqe->fd with IOSQE_FIXED_FILE
+		 * @throw TransportException if the table is full or the kernel refuses
+		 */
+		int RegisterFile( int fd ) throw( TransportException );
+		void UnregisterFile( int slot ) throw();
+
+		/**
+		 *     The slot fd was registered in, or -1
+		 */
+		int FileSlot( int fd ) const throw();
+
+		int Fd() const throw();
+
+		/// io_uring_enter calls so far
+		uint64_t Enters() const throw();
+
+	private:
+		Uring( const Uring& );
+		Uring& operator=( const Uring& );
+		void Unmap() throw();
+
+		int m_ring;
+		void *m_sqMap, *m_cqMap;
+		size_t m_sqMapSize, m_cqMapSize;
+		io_uring_sqe* m_sqes;
+		unsigned int m_sqEntries;
+		unsigned int *m_sqHead, *m_sqTail, *m_sqMask;
+		unsigned int m_sqPending; //Local tail; published in Enter()
+		unsigned int *m_cqHead, *m_cqTail, *m_cqMask;
+		io_uring_cqe* m_cqes;
+		vector<int> m_files; //Slot -> fd, -1 if free
+		uint64_t m_enters;
+};
+
+/**
+* \class UringBufferRing
+* \brief Receive buffers the kernel picks from as data arrives (a provided buffer ring), so a multishot receive
+*        needs no buffer of its own and nothing is reserved for idle sockets
+*/
+class UringBufferRing
+{
+	public:
+		/**
+		 * @param ring The ring to register with
+		 * @param group The buffer group id submissions select with sqe->buf_group
+		 * @param count How many buffers; rounded up to a power of two
+		 * @param size Bytes per buffer
+		 * @throw TransportException if the kernel refuses the registration
+		 */
+		UringBufferRing( Uring& ring, uint16_t group, unsigned int count, unsigned int size ) throw( TransportException );
+		~UringBufferRing();
+
+		char* Buffer( uint16_t id ) throw();
+		unsigned int Size() const throw();
+		uint16_t Group() const throw();
+
+		/**
+		 *     Gives a buffer back to the kernel once its contents have been used
+		 */
+		void Recycle( uint16_t id ) throw();
+
+	private:
+		UringBufferRing( const UringBufferRing& );
+		UringBufferRing& operator=( const UringBufferRing& );
+
+		Uring& m_ring;
+		uint16_t m_group;
+		unsigned int m_count, m_size;
+		io_uring_buf_ring* m_bufferRing;
+		size_t m_bufferRingSize;
+		vector<char> m_buffers;
+		uint16_t m_tail;
+};
+
+}; //namespace Sip
+#endif //URING_HPP
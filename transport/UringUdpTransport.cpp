@@ -0,0 +1,298 @@
+#include "UringUdpTransport.hpp"
+#include <algorithm>
+#include <cstring>
+#include <errno.h>
+#include <unistd.h>
+#include <sys/eventfd.h>
+#include "../SipUtility.hpp"
+
+namespace Sip {
+
+namespace {
+
+//user_data: receives carry the socket, sends this flag and their Outbound id, and the read of the wakeup eventfd
+//the other flag
+const uint64_t SEND = static_cast<uint64_t>( 1 ) << 32;
+const uint64_t WAKEUP = SEND << 1;
+const uint16_t BUFFER_GROUP = 0;
+
+}; //namespace
+
+UringUdpTransport::UringUdpTransport( SipMessageHandler& handler, unsigned int buffers, unsigned int entries ) throw( TransportException )
+	: m_handler( handler ), m_ring( entries, 64 ),
+	m_buffers( m_ring, BUFFER_GROUP, buffers, sizeof( io_uring_recvmsg_out ) + sizeof( sockaddr_storage ) + SIP_MAX_MESSAGE_SIZE ),
+	m_inFlight( 0 ), m_wakeup( -1 ), m_signals( 0 ), m_stopped( false )
+{
+	memset( &m_receiveHeader, 0, sizeof( m_receiveHeader ) );
+	m_receiveHeader.msg_namelen = sizeof( sockaddr_storage );
+	//Blocking, so the ring waits on the read rather than completing it at once with EAGAIN
+	m_wakeup = eventfd( 0, EFD_CLOEXEC );
+	if ( m_wakeup == -1 )
+		throw TransportException( string( "Could not create eventfd: " ) + strerror( errno ) );
+	if ( !ArmWakeup() )
+	{
+		close( m_wakeup );
+		throw TransportException( "io_uring submission queue is full" );
+	}
+}
+
+UringUdpTransport::~UringUdpTransport()
+{
+	//The kernel still reads queued datagrams; give them a moment rather than free them under it
+	Flush();
+	for ( int attempts = 0; m_inFlight > 0 && attempts < 10; ++attempts )
+		RunOnce( 10 );
+	for ( vector<Outbound*>::iterator outbound = m_outbound.begin(); outbound != m_outbound.end(); ++outbound )
+		delete *outbound;
+	//Its read is cancelled with the ring
+	close( m_wakeup );
+}
+
+int UringUdpTransport::Listen( const string& address, unsigned short port ) throw( TransportException )
+{
+	int sock = Bind( address, port );
+	try
+	{
+		int slot = m_ring.RegisterFile( sock );
+		if ( static_cast<size_t>( sock ) >= m_slots.size() )
+			m_slots.resize( sock + 1, -1 );
+		m_slots[sock] = slot;
+	}
+	catch ( TransportException& e )
+	{
+		Close( sock );
+		throw;
+	}
+
+	if ( !Arm( sock ) )
+	{
+		m_ring.UnregisterFile( m_slots[sock] );
+		m_slots[sock] = -1;
+		Close( sock );
+		throw TransportException( "io_uring submission queue is full" );
+	}
+	return sock;
+}
+
+bool UringUdpTransport::Arm( int socket ) throw()
+{
+	io_uring_sqe* sqe = m_ring.GetSqe();
+	if ( sqe == NULL )
+		return false;
+	sqe->opcode = IORING_OP_RECVMSG;
+	sqe->fd = m_slots[socket];
+	sqe->flags = IOSQE_FIXED_FILE | IOSQE_BUFFER_SELECT;
+	sqe->addr = reinterpret_cast<uint64_t>( &m_receiveHeader );
+	sqe->len = 1;
+	sqe->ioprio = IORING_RECV_MULTISHOT;
+	sqe->buf_group = m_buffers.Group();
+	sqe->user_data = socket;
+	return true;
+}
+
+bool UringUdpTransport::ArmWakeup() throw()
+{
+	io_uring_sqe* sqe = m_ring.GetSqe();
+	if ( sqe == NULL )
+		return false;
+	sqe->opcode = IORING_OP_READ;
+	sqe->fd = m_wakeup;
+	sqe->addr = reinterpret_cast<uint64_t>( &m_signals );
+	sqe->len = sizeof( m_signals );
+	sqe->user_data = WAKEUP;
+	return true;
+}
+
+bool UringUdpTransport::Queue( int socket, const string& data, const sockaddr_storage& destination ) throw()
+{
+	if ( socket < 0 || static_cast<size_t>( socket ) >= m_slots.size() || m_slots[socket] == -1 )
+		return false;
+	io_uring_sqe* sqe = m_ring.GetSqe();
+	if ( sqe == NULL )
+	{
+		++m_stats.sendErrors;
+		return false;
+	}
+
+	if ( m_freeOutbound.empty() )
+	{
+		m_outbound.push_back( new Outbound() );
+		m_freeOutbound.push_back( m_outbound.size() - 1 );
+	}
+	unsigned int id = m_freeOutbound.back();
+	m_freeOutbound.pop_back();
+
+	Outbound& outbound = *m_outbound[id];
+	outbound.data = data;
+	outbound.destination = destination;
+	outbound.vector.iov_base = const_cast<char*>( outbound.data.data() );
+	outbound.vector.iov_len = outbound.data.length();
+	memset( &outbound.header, 0, sizeof( outbound.header ) );
+	outbound.header.msg_name = &outbound.destination;
+	outbound.header.msg_namelen = AddressLength( outbound.destination );
+	outbound.header.msg_iov = &outbound.vector;
+	outbound.header.msg_iovlen = 1;
+
+	sqe->opcode = IORING_OP_SENDMSG;
+	sqe->fd = m_slots[socket];
+	sqe->flags = IOSQE_FIXED_FILE;
+	sqe->addr = reinterpret_cast<uint64_t>( &outbound.header );
+	sqe->len = 1;
+	sqe->user_data = SEND | id;
+	++m_inFlight;
+	return true;
+}
+
+bool UringUdpTransport::Queue( const string& data, const sockaddr_storage& destination ) throw()
+{
+	int socket = SocketFor( destination );
+	return socket != -1 && Queue( socket, data, destination );
+}
+
+void UringUdpTransport::Flush() throw()
+{
+	m_ring.Enter( 0, 0 );
+}
+
+unsigned int UringUdpTransport::RunOnce( int timeoutMs )
+{
+	//One system call submits the replies queued last time and waits for the next input
+	int result = m_ring.Enter( 1, timeoutMs );
+	if ( result < 0 && result != -ETIME && result != -EINTR && result != -EBUSY )
+		++m_stats.receiveErrors;
+
+	unsigned int handled = 0;
+	io_uring_cqe* completion;
+	while ( ( completion = m_ring.PeekCqe() ) != NULL )
+	{
+		io_uring_cqe copy = *completion;
+		m_ring.Seen();
+		if ( copy.user_data == WAKEUP )
+		{
+			ArmWakeup(); //Failing that, a later Stop() waits out the timeout instead
+			continue;
+		}
+		Complete( copy );
+		++handled;
+	}
+	if ( handled > 0 )
+	{
+		++m_stats.wakeups;
+		m_handler.OnBatchComplete();
+	}
+
+	//Posted again only now, after every buffer from this batch went back to the ring
+	for ( vector<int>::iterator socket = m_rearm.begin(); socket != m_rearm.end(); ++socket )
+	{
+		if ( static_cast<size_t>( *socket ) < m_slots.size() && m_slots[*socket] != -1 && Arm( *socket ) )
+			++m_stats.rearms;
+	}
+	m_rearm.clear();
+	return handled;
+}
+
+void UringUdpTransport::Complete( const io_uring_cqe& completion ) throw()
+{
+	if ( completion.user_data & SEND )
+	{
+		unsigned int id = completion.user_data & ( SEND - 1 );
+		if ( completion.res < 0 )
+			++m_stats.sendErrors;
+		else
+			++m_stats.sent;
+		m_outbound[id]->data.clear();
+		m_freeOutbound.push_back( id );
+		--m_inFlight;
+		return;
+	}
+
+	int socket = completion.user_data;
+	if ( !( completion.flags & IORING_CQE_F_MORE ) )
+		m_rearm.push_back( socket );
+	if ( completion.res < 0 )
+	{
+		//ENOBUFS just means every buffer was in use; the receive is posted again once they come back
+		if ( completion.res != -ENOBUFS )
+			++m_stats.receiveErrors;
+		return;
+	}
+	Received( socket, completion );
+}
+
+void UringUdpTransport::Received( int socket, const io_uring_cqe& completion ) throw()
+{
+	if ( !( completion.flags & IORING_CQE_F_BUFFER ) )
+		return;
+	uint16_t id = completion.flags >> IORING_CQE_BUFFER_SHIFT;
+	char* buffer = m_buffers.Buffer( id );
+
+	//The kernel lays out a header, the source address (always msg_namelen bytes) and the payload
+	const io_uring_recvmsg_out* out = reinterpret_cast<const io_uring_recvmsg_out*>( buffer );
+	sockaddr_storage source;
+	memset( &source, 0, sizeof( source ) );
+	memcpy( &source, buffer + sizeof( *out ), std::min<size_t>( out->namelen, sizeof( source ) ) );
+	const char* payload = buffer + sizeof( *out ) + m_receiveHeader.msg_namelen + m_receiveHeader.msg_controllen;
+	size_t length = out->payloadlen;
+	bool truncated = out->flags & MSG_TRUNC;
+
+	//The ring's buffers go straight back to the kernel, so the payload is copied once: into a pooled slab the
+	//message takes over when it fits, else into a string
+	ReceiveBufferHandle slab;
+	string data;
+	if ( !truncated && length <= m_pool.SlabSize() )
+	{
+		slab = m_pool.Acquire();
+		slab->Bytes().assign( payload, length );
+	}
+	else if ( !truncated )
+		data.assign( payload, length );
+	m_buffers.Recycle( id );
+
+	++m_stats.datagrams;
+	m_stats.bytes += length;
+	if ( truncated )
+	{
+		++m_stats.receiveErrors;
+		return;
+	}
+
+	auto_ptr<SipMessage> message;
+	try
+	{
+		if ( slab )
+			Utility::ParseMessage( message, slab );
+		else
+			Utility::ParseMessage( message, data );
+	}
+	catch ( SipMessageException& e )
+	{
+		++m_stats.parseErrors;
+		m_handler.OnParseError( e, source, socket );
+		return;
+	}
+	m_handler.OnMessage( message, source, socket );
+}
+
+void UringUdpTransport::Run( int timeoutMs )
+{
+	while ( !__atomic_load_n( &m_stopped, __ATOMIC_SEQ_CST ) )
+		RunOnce( timeoutMs );
+	__atomic_store_n( &m_stopped, false, __ATOMIC_SEQ_CST );
+}
+
+void UringUdpTransport::Stop() throw()
+{
+	__atomic_store_n( &m_stopped, true, __ATOMIC_SEQ_CST );
+	uint64_t one = 1;
+	ssize_t written = write( m_wakeup, &one, sizeof( one ) );
+	(void)written; //A full counter already means "wake up"
+}
+
+UringUdpTransport::Stats UringUdpTransport::GetStats() const throw()
+{
+	Stats stats = m_stats;
+	stats.enters = m_ring.Enters();
+	return stats;
+}
+
+}; //namespace Sip
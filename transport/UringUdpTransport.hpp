@@ -0,0 +1,144 @@
+#ifndef URINGUDPTRANSPORT_HPP
+#define URINGUDPTRANSPORT_HPP
+#include <memory>
+#include <string>
+#include <vector>
+#include <stdint.h>
+#include <sys/socket.h>
+#include <sys/uio.h>
+#include "Uring.hpp"
+#include "UdpSockets.hpp"
+#include "UdpTransport.hpp"
+
+namespace Sip {
+
+/**
+* \class UringUdpTransport
+* \brief The io_uring counterpart of UdpTransport: same sockets, same SipMessageHandler, its own loop instead of
+*        a Reactor. Only built with -DSIP_IO_URING=ON (Linux 6.0 or later).
+*
+* Every socket has one multishot recvmsg posted for as long as it is open; the kernel picks a buffer from a
+* provided buffer ring for each datagram and posts a completion, so receiving costs no system call of its own.
+* Sends are queued as submissions and go to the kernel with the next RunOnce(), in the same io_uring_enter that
+* waits for more input. Sockets are registered files, which saves the per-operation file lookup.
+*/
+class UringUdpTransport : public UdpSockets
+{
+	public:
+		/**
+		* \class Stats
+		* \brief Running totals since the transport was created
+		*/
+		struct Stats
+		{
+			Stats() : datagrams( 0 ), bytes( 0 ), parseErrors( 0 ), receiveErrors( 0 ), wakeups( 0 ),
+				rearms( 0 ), sent( 0 ), sendErrors( 0 ), enters( 0 ) {}
+			uint64_t datagrams, bytes, parseErrors, receiveErrors, wakeups;
+			/// Multishot receives that ended (usually because every buffer was in use) and had to be posted again
+			uint64_t rearms;
+			uint64_t sent, sendErrors;
+			/// io_uring_enter calls; with datagrams, the system calls per message
+			uint64_t enters;
+		};
+
+		/**
+		 * @param buffers Receive buffers shared by every socket; each holds a SIP_MAX_MESSAGE_SIZE datagram
+		 * @param entries Submission queue size
+		 * @throw TransportException if io_uring is missing or too old
+		 */
+		UringUdpTransport( SipMessageHandler& handler, unsigned int buffers = 64, unsigned int entries = 256 ) throw( TransportException );
+
+		/**
+		 *     Waits briefly for sends still in flight
+		 */
+		~UringUdpTransport();
+
+		/**
+		 *     Binds a non-blocking UDP socket and starts receiving on it.
+		 * @param address A numeric IPv4 or IPv6 address; "0.0.0.0" or "::" for all interfaces
+		 * @param port The port, or 0 for any free one (see LocalPort())
+		 * @return The socket
+		 * @throw TransportException if the socket can't be created, bound or registered
+		 */
+		int Listen( const string& address, unsigned short port = DEFAULT_UDP_LISTENPORT ) throw( TransportException );
+
+		/**
+		 *     Queues a datagram. It goes to the kernel with the next RunOnce() or Flush().
+		 * @return False if socket isn't one of ours or the submission queue is full
+		 */
+		bool Queue( int socket, const string& data, const sockaddr_storage& destination ) throw();
+
+		/**
+		 *     Queues a datagram through the socket SocketFor() picks.
+		 * @return False if there is no socket for the destination's family or the submission queue is full
+		 */
+		bool Queue( const string& data, const sockaddr_storage& destination ) throw();
+
+		/**
+		 *     Submits everything queued without waiting
+		 */
+		void Flush() throw();
+
+		/**
+		 *     Submits what is queued, waits up to timeoutMs (-1 forever, 0 poll) for completions and handles them.
+		 * @return Completions handled; 0 means the timeout expired or a signal interrupted the wait
+		 */
+		unsigned int RunOnce( int timeoutMs );
+
+		/**
+		 *     Handles completions until Stop(), waiting up to timeoutMs at a time
+		 */
+		void Run( int timeoutMs = 1000 );
+
+		/**
+		 *     Makes Run() return after the current wakeup, waking it if it is waiting. Safe to call from handlers and
+		 *     other threads.
+		 */
+		void Stop() throw();
+
+		Stats GetStats() const throw();
+
+	private:
+		UringUdpTransport( const UringUdpTransport& );
+		UringUdpTransport& operator=( const UringUdpTransport& );
+
+		/**
+		* \class Outbound
+		* \brief A datagram between Queue() and its completion; the kernel reads the header, vector and data
+		*        until then
+		*/
+		struct Outbound
+		{
+			msghdr header;
+			iovec vector;
+			sockaddr_storage destination;
+			string data;
+		};
+
+		bool Arm( int socket ) throw();
+
+		/**
+		 *     Posts a read of m_wakeup, whose completion wakes RunOnce() when Stop() writes to it
+		 */
+		bool ArmWakeup() throw();
+		void Complete( const io_uring_cqe& completion ) throw();
+		void Received( int socket, const io_uring_cqe& completion ) throw();
+
+		SipMessageHandler& m_handler;
+		Uring m_ring;
+		UringBufferRing m_buffers;
+		ReceiveBufferPool m_pool; //What parsed messages hold on to, since ring buffers can't be lent out
+		msghdr m_receiveHeader; //What multishot recvmsg lays out in each buffer: source address, then payload
+		vector<int> m_slots; //Registered file slot by fd, -1 if not ours
+		vector<int> m_rearm; //Sockets whose multishot receive ended while handling completions
+		vector<Outbound*> m_outbound; //Owned; indexed by the id in a send's user_data
+		vector<unsigned int> m_freeOutbound;
+		unsigned int m_inFlight;
+		int m_wakeup; //An eventfd Stop() writes to; Stop() can't submit to the ring from another thread
+		uint64_t m_signals; //Where the kernel reads m_wakeup's counter into
+		bool m_stopped; //Only touched atomically
+		Stats m_stats;
+};
+
+}; //namespace Sip
+#endif //URINGUDPTRANSPORT_HPP
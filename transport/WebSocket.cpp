@@ -0,0 +1,215 @@
+#include "WebSocket.hpp"
+#include <cstring>
+#include <map>
+#include <boost/uuid/detail/sha1.hpp>
+#include "../SipUtility.hpp"
+#if defined( __SSE2__ )
+#include <emmintrin.h>
+#elif defined( __ARM_NEON )
+#include <arm_neon.h>
+#endif
+
+namespace Sip {
+
+namespace {
+
+const char GUID[] = "258EAFA5-E914-47DA-95CA-C5AB0DC85B11";
+const char BASE64[] = "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
+const char BAD_REQUEST[] = "HTTP/1.1 400 Bad Request\r\nConnection: close\r\nContent-Length: 0\r\n\r\n";
+
+string Base64( const unsigned char* data, size_t length )
+{
+	string encoded;
+	encoded.reserve( ( length + 2 ) / 3 * 4 );
+	for ( size_t i = 0; i < length; i += 3 )
+	{
+		unsigned int group = data[i] << 16;
+		if ( i + 1 < length )
+			group |= data[i + 1] << 8;
+		if ( i + 2 < length )
+			group |= data[i + 2];
+		encoded += BASE64[ ( group >> 18 ) & 0x3F ];
+		encoded += BASE64[ ( group >> 12 ) & 0x3F ];
+		encoded += i + 1 < length ? BASE64[ ( group >> 6 ) & 0x3F ] : '=';
+		encoded += i + 2 < length ? BASE64[ group & 0x3F ] : '=';
+	}
+	return encoded;
+}
+
+string Lower( string value )
+{
+	for ( string::iterator c = value.begin(); c != value.end(); ++c )
+		if ( *c >= 'A' && *c <= 'Z' )
+			*c += 'a' - 'A';
+	return value;
+}
+
+/**
+ *     Whether a comma separated header value lists token, ignoring case
+ */
+bool Lists( const string& value, const string& token )
+{
+	string::size_type begin = 0;
+	while ( begin <= value.length() )
+	{
+		string::size_type end = value.find( ',', begin );
+		if ( end == string::npos )
+			end = value.length();
+		if ( Lower( Utility::Trim( value.substr( begin, end - begin ) ) ) == token )
+			return true;
+		begin = end + 1;
+	}
+	return false;
+}
+
+}; //namespace
+
+size_t WebSocket::ParseHeader( const char* data, size_t available, Frame& frame ) throw()
+{
+	if ( available < 2 )
+		return 0;
+	const unsigned char* bytes = reinterpret_cast<const unsigned char*>( data );
+	frame.final = ( bytes[0] & 0x80 ) != 0;
+	frame.opcode = bytes[0] & 0x0F;
+	frame.masked = ( bytes[1] & 0x80 ) != 0;
+
+	size_t length = 2;
+	frame.length = bytes[1] & 0x7F;
+	if ( frame.length == 126 )
+		length += 2;
+	else if ( frame.length == 127 )
+		length += 8;
+	if ( frame.masked )
+		length += 4;
+	if ( available < length )
+		return 0;
+
+	size_t next = 2;
+	if ( frame.length >= 126 )
+	{
+		size_t extended = frame.length == 126 ? 2 : 8;
+		frame.length = 0;
+		for ( size_t i = 0; i < extended; ++i )
+			frame.length = frame.length << 8 | bytes[next++];
+	}
+	if ( frame.masked )
+		memcpy( frame.mask, bytes + next, 4 );
+	return length;
+}
+
+string WebSocket::Header( unsigned int opcode, size_t length )
+{
+	string header( 1, static_cast<char>( 0x80 | opcode ) );
+	if ( length < 126 )
+		header += static_cast<char>( length );
+	else if ( length <= 0xFFFF )
+	{
+		header += static_cast<char>( 126 );
+		header += static_cast<char>( length >> 8 );
+		header += static_cast<char>( length );
+	}
+	else
+	{
+		header += static_cast<char>( 127 );
+		for ( int shift = 56; shift >= 0; shift -= 8 )
+			header += static_cast<char>( static_cast<uint64_t>( length ) >> shift );
+	}
+	return header;
+}
+
+void WebSocket::Unmask( char* data, size_t length, const unsigned char mask[4] ) throw()
+{
+	//Every block below is a multiple of 4 bytes long, so each starts at key byte 0 and the key can be repeated across it
+	uint32_t key;
+	memcpy( &key, mask, sizeof( key ) );
+	size_t i = 0;
+#if defined( __SSE2__ )
+	__m128i keys = _mm_set1_epi32( key );
+	for ( ; i + 64 <= length; i += 64 )
+	{
+		__m128i* block = reinterpret_cast<__m128i*>( data + i );
+		__m128i a = _mm_loadu_si128( block ), b = _mm_loadu_si128( block + 1 ),
+			c = _mm_loadu_si128( block + 2 ), d = _mm_loadu_si128( block + 3 );
+		_mm_storeu_si128( block, _mm_xor_si128( a, keys ) );
+		_mm_storeu_si128( block + 1, _mm_xor_si128( b, keys ) );
+		_mm_storeu_si128( block + 2, _mm_xor_si128( c, keys ) );
+		_mm_storeu_si128( block + 3, _mm_xor_si128( d, keys ) );
+	}
+	for ( ; i + 16 <= length; i += 16 )
+	{
+		__m128i* block = reinterpret_cast<__m128i*>( data + i );
+		_mm_storeu_si128( block, _mm_xor_si128( _mm_loadu_si128( block ), keys ) );
+	}
+#elif defined( __ARM_NEON )
+	uint8x16_t keys = vreinterpretq_u8_u32( vdupq_n_u32( key ) );
+	for ( ; i + 16 <= length; i += 16 )
+	{
+		uint8_t* block = reinterpret_cast<uint8_t*>( data + i );
+		vst1q_u8( block, veorq_u8( vld1q_u8( block ), keys ) );
+	}
+#endif
+	uint64_t wide = static_cast<uint64_t>( key ) << 32 | key;
+	for ( ; i + 8 <= length; i += 8 )
+	{
+		uint64_t word;
+		memcpy( &word, data + i, sizeof( word ) );
+		word ^= wide;
+		memcpy( data + i, &word, sizeof( word ) );
+	}
+	for ( ; i < length; ++i )
+		data[i] ^= mask[i & 3];
+}
+
+string WebSocket::AcceptKey( const string& key )
+{
+	string keyed( key + GUID );
+	boost::uuids::detail::sha1 sha1;
+	sha1.process_bytes( keyed.data(), keyed.length() );
+	unsigned int words[5];
+	sha1.get_digest( words );
+
+	unsigned char digest[20];
+	for ( int i = 0; i < 5; ++i )
+	{
+		digest[i * 4] = words[i] >> 24;
+		digest[i * 4 + 1] = words[i] >> 16;
+		digest[i * 4 + 2] = words[i] >> 8;
+		digest[i * 4 + 3] = words[i];
+	}
+	return Base64( digest, sizeof( digest ) );
+}
+
+bool WebSocket::Upgrade( const string& request, string& response )
+{
+	response = BAD_REQUEST;
+	if ( request.compare( 0, 4, "GET " ) != 0 )
+		return false;
+
+	//Repeated headers are joined with commas, as HTTP allows
+	std::map<string, string> headers;
+	string::size_type line = request.find( "\r\n" );
+	while ( line != string::npos && line + 2 < request.length() )
+	{
+		line += 2;
+		string::size_type lineEnd = request.find( "\r\n", line ), colon = request.find( ':', line );
+		if ( lineEnd == string::npos )
+			break;
+		if ( colon != string::npos && colon < lineEnd )
+		{
+			string& value = headers[ Lower( Utility::Trim( request.substr( line, colon - line ) ) ) ];
+			value += ( value.empty() ? "" : "," ) + Utility::Trim( request.substr( colon + 1, lineEnd - colon - 1 ) );
+		}
+		line = lineEnd;
+	}
+
+	const string& key = headers["sec-websocket-key"];
+	if ( !Lists( headers["upgrade"], "websocket" ) || !Lists( headers["connection"], "upgrade" ) ||
+		headers["sec-websocket-version"] != "13" || key.empty() || !Lists( headers["sec-websocket-protocol"], "sip" ) )
+		return false;
+
+	response = "HTTP/1.1 101 Switching Protocols\r\nUpgrade: websocket\r\nConnection: Upgrade\r\nSec-WebSocket-Accept: " +
+		AcceptKey( key ) + "\r\nSec-WebSocket-Protocol: sip\r\n\r\n";
+	return true;
+}
+
+}; //namespace Sip
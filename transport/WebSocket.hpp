@@ -0,0 +1,77 @@
+#ifndef WEBSOCKET_HPP
+#define WEBSOCKET_HPP
+#include <string>
+#include <stddef.h>
+#include <stdint.h>
+
+namespace Sip {
+
+using std::string;
+
+/**
+* \class WebSocket
+* \brief The parts of RFC 6455 a SIP over WebSocket server (RFC 7118) needs: the opening handshake, frame headers,
+*        and unmasking
+*
+* TcpTransport uses these for connections accepted on a listener in FRAMING_WEBSOCKET mode; nothing here touches a
+* socket.
+*/
+class WebSocket
+{
+	public:
+		enum Opcode
+		{
+			OP_CONTINUATION = 0x0,
+			OP_TEXT = 0x1,
+			OP_BINARY = 0x2,
+			OP_CLOSE = 0x8,
+			OP_PING = 0x9,
+			OP_PONG = 0xA
+		};
+
+		/**
+		* \class Frame
+		* \brief A decoded frame header
+		*/
+		struct Frame
+		{
+			bool final, masked;
+			unsigned int opcode;
+			uint64_t length; //Of the payload
+			unsigned char mask[4];
+		};
+
+		/**
+		 *     Decodes the frame header at the start of data.
+		 * @param available Bytes at data
+		 * @return The header's length, or 0 if available doesn't hold all of it yet
+		 */
+		static size_t ParseHeader( const char* data, size_t available, Frame& frame ) throw();
+
+		/**
+		 *     The header of an unmasked, final frame, as a server sends them
+		 */
+		static string Header( unsigned int opcode, size_t length );
+
+		/**
+		 *     XORs length bytes in place with the masking key, 16 bytes at a time where the CPU has vectors
+		 */
+		static void Unmask( char* data, size_t length, const unsigned char mask[4] ) throw();
+
+		/**
+		 *     The Sec-WebSocket-Accept answering a Sec-WebSocket-Key
+		 */
+		static string AcceptKey( const string& key );
+
+		/**
+		 *     Answers an opening handshake. It must be a GET asking to upgrade to WebSocket version 13 with the "sip"
+		 *     subprotocol.
+		 * @param request The request, through the blank line ending its headers
+		 * @param response Set to the 101 switching protocols, or to the error to send before closing
+		 * @return Whether the connection is now a WebSocket
+		 */
+		static bool Upgrade( const string& request, string& response );
+};
+
+}; //namespace Sip
+#endif //WEBSOCKET_HPP